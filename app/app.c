@@ -47,6 +47,7 @@
 #include "gegl/gimp-gegl.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 #include "core/gimp-user-install.h"
 
 #include "file/file-open.h"
@@ -267,6 +268,8 @@ app_run (const gchar         *full_prog_name,
 
   g_main_loop_unref (loop);
 
+  gimp_parallel_exit (gimp);
+
   g_object_unref (gimp);
 
   gimp_debug_instances ();
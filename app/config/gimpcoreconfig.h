@@ -87,6 +87,8 @@ struct _GimpCoreConfig
   GimpColorConfig        *color_management;
   GimpColorProfilePolicy  color_profile_policy;
   gboolean                save_document_history;
+  gboolean                xcf_lazy_load;
+  gboolean                xcf_compression;
   GimpRGB                 quick_mask_color;
 };
 
@@ -467,6 +467,16 @@ N_("When enabled, uses OpenCL for some operations.")
 "The location of the online user manual. This is used if " \
 "'user-manual-online' is enabled."
 
+#define XCF_COMPRESSION_BLURB \
+N_("When enabled, the pixels of layers and channels are compressed with " \
+   "zlib when saving XCF files.  This makes them a lot smaller, but older " \
+   "versions of GIMP can't open them.")
+
+#define XCF_LAZY_LOAD_BLURB \
+N_("When enabled, the pixels of layers and channels in XCF files are only " \
+   "read from the file when they are first needed. The file is kept open " \
+   "as long as the image uses it.")
+
 #define ZOOM_QUALITY_BLURB \
 "There's a tradeoff between speed and quality of the zoomed-out display."
 
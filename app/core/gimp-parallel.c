@@ -0,0 +1,373 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-parallel.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <gegl.h>
+
+#include "core-types.h"
+
+#include "config/gimpgeglconfig.h"
+
+#include "gimp.h"
+#include "gimp-parallel.h"
+
+
+#define GIMP_PARALLEL_MAX_THREADS 64
+
+
+typedef struct
+{
+  GimpParallelDistributeFunc  func;
+  gpointer                    user_data;
+  gint                        n;
+
+  gint                        remaining;
+  GMutex                      mutex;
+  GCond                       cond;
+} GimpParallelDistribute;
+
+typedef struct
+{
+  GimpParallelDistribute *distribute;
+  gint                    i;
+} GimpParallelTask;
+
+typedef struct
+{
+  gsize                            size;
+  GimpParallelDistributeRangeFunc  func;
+  gpointer                         user_data;
+} GimpParallelDistributeRange;
+
+typedef struct
+{
+  const GeglRectangle             *area;
+  gboolean                         split_rows;
+  GimpParallelDistributeAreaFunc   func;
+  gpointer                         user_data;
+} GimpParallelDistributeArea;
+
+
+/*  local function prototypes  */
+
+static void   gimp_parallel_notify_num_processors (GimpGeglConfig         *config);
+static void   gimp_parallel_set_n_threads         (gint                    n_threads);
+
+static void   gimp_parallel_worker                (GimpParallelTask       *task,
+                                                   gpointer                data);
+static void   gimp_parallel_run                   (GimpParallelDistribute *distribute,
+                                                   gint                    i);
+
+static void   gimp_parallel_distribute_range_func (gint                    i,
+                                                   gint                    n,
+                                                   GimpParallelDistributeRange *range);
+static void   gimp_parallel_distribute_area_func  (gint                    i,
+                                                   gint                    n,
+                                                   GimpParallelDistributeArea  *area);
+
+
+/*  local variables  */
+
+static GThreadPool *gimp_parallel_pool      = NULL;
+static gint         gimp_parallel_n_threads = 1;
+static GPrivate     gimp_parallel_busy      = G_PRIVATE_INIT (NULL);
+
+
+/*  public functions  */
+
+void
+gimp_parallel_init (Gimp *gimp)
+{
+  GimpGeglConfig *config;
+
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  config = GIMP_GEGL_CONFIG (gimp->config);
+
+  g_signal_connect (config, "notify::num-processors",
+                    G_CALLBACK (gimp_parallel_notify_num_processors),
+                    NULL);
+
+  gimp_parallel_notify_num_processors (config);
+}
+
+void
+gimp_parallel_exit (Gimp *gimp)
+{
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  g_signal_handlers_disconnect_by_func (gimp->config,
+                                        gimp_parallel_notify_num_processors,
+                                        NULL);
+
+  gimp_parallel_set_n_threads (1);
+}
+
+gint
+gimp_parallel_get_n_threads (void)
+{
+  return gimp_parallel_n_threads;
+}
+
+/*  calls @func for i = 0 .. n - 1, where n is at most @max_n (or the
+ *  number of threads if @max_n is negative), concurrently, and returns
+ *  once all of the calls have finished.  nested calls, made from inside
+ *  @func, run serially in the calling thread.
+ */
+void
+gimp_parallel_distribute (gint                       max_n,
+                          GimpParallelDistributeFunc func,
+                          gpointer                   user_data)
+{
+  GimpParallelDistribute distribute;
+  GimpParallelTask       tasks[GIMP_PARALLEL_MAX_THREADS];
+  gint                   i;
+
+  g_return_if_fail (func != NULL);
+
+  if (max_n == 0)
+    return;
+
+  if (max_n < 0)
+    max_n = gimp_parallel_n_threads;
+  else
+    max_n = MIN (max_n, gimp_parallel_n_threads);
+
+  if (max_n == 1 || ! gimp_parallel_pool ||
+      g_private_get (&gimp_parallel_busy))
+    {
+      func (0, 1, user_data);
+
+      return;
+    }
+
+  distribute.func      = func;
+  distribute.user_data = user_data;
+  distribute.n         = max_n;
+  distribute.remaining = max_n - 1;
+
+  g_mutex_init (&distribute.mutex);
+  g_cond_init (&distribute.cond);
+
+  for (i = 1; i < max_n; i++)
+    {
+      tasks[i].distribute = &distribute;
+      tasks[i].i          = i;
+
+      g_thread_pool_push (gimp_parallel_pool, &tasks[i], NULL);
+    }
+
+  gimp_parallel_run (&distribute, 0);
+
+  g_mutex_lock (&distribute.mutex);
+
+  while (distribute.remaining > 0)
+    g_cond_wait (&distribute.cond, &distribute.mutex);
+
+  g_mutex_unlock (&distribute.mutex);
+
+  g_cond_clear (&distribute.cond);
+  g_mutex_clear (&distribute.mutex);
+}
+
+void
+gimp_parallel_distribute_range (gsize                           size,
+                                gsize                           min_sub_size,
+                                GimpParallelDistributeRangeFunc func,
+                                gpointer                        user_data)
+{
+  GimpParallelDistributeRange range;
+  gint                        n;
+
+  g_return_if_fail (func != NULL);
+
+  if (size == 0)
+    return;
+
+  n = gimp_parallel_n_threads;
+
+  if (min_sub_size > 1)
+    n = MIN (n, size / min_sub_size);
+
+  n = CLAMP (n, 1, size);
+
+  if (n == 1)
+    {
+      func (0, size, user_data);
+
+      return;
+    }
+
+  range.size      = size;
+  range.func      = func;
+  range.user_data = user_data;
+
+  gimp_parallel_distribute (n,
+                            (GimpParallelDistributeFunc)
+                            gimp_parallel_distribute_range_func,
+                            &range);
+}
+
+void
+gimp_parallel_distribute_area (const GeglRectangle            *area,
+                               gsize                           min_sub_area,
+                               GimpParallelDistributeAreaFunc  func,
+                               gpointer                        user_data)
+{
+  GimpParallelDistributeArea distribute_area;
+  gsize                      area_size;
+  gint                       n;
+
+  g_return_if_fail (area != NULL);
+  g_return_if_fail (func != NULL);
+
+  if (area->width <= 0 || area->height <= 0)
+    return;
+
+  area_size = (gsize) area->width * (gsize) area->height;
+
+  n = gimp_parallel_n_threads;
+
+  if (min_sub_area > 1)
+    n = MIN (n, area_size / min_sub_area);
+
+  n = CLAMP (n, 1, MAX (area->width, area->height));
+
+  if (n == 1)
+    {
+      func (area, user_data);
+
+      return;
+    }
+
+  distribute_area.area       = area;
+  distribute_area.split_rows = area->height >= n;
+  distribute_area.func       = func;
+  distribute_area.user_data  = user_data;
+
+  gimp_parallel_distribute (n,
+                            (GimpParallelDistributeFunc)
+                            gimp_parallel_distribute_area_func,
+                            &distribute_area);
+}
+
+
+/*  private functions  */
+
+static void
+gimp_parallel_notify_num_processors (GimpGeglConfig *config)
+{
+  gimp_parallel_set_n_threads (config->num_processors);
+}
+
+static void
+gimp_parallel_set_n_threads (gint n_threads)
+{
+  n_threads = CLAMP (n_threads, 1, GIMP_PARALLEL_MAX_THREADS);
+
+  if (n_threads > 1)
+    {
+      if (! gimp_parallel_pool)
+        {
+          gimp_parallel_pool = g_thread_pool_new ((GFunc) gimp_parallel_worker,
+                                                  NULL,
+                                                  n_threads - 1, FALSE,
+                                                  NULL);
+        }
+      else
+        {
+          g_thread_pool_set_max_threads (gimp_parallel_pool,
+                                         n_threads - 1, NULL);
+        }
+    }
+  else if (gimp_parallel_pool)
+    {
+      g_thread_pool_free (gimp_parallel_pool, FALSE, TRUE);
+
+      gimp_parallel_pool = NULL;
+    }
+
+  gimp_parallel_n_threads = n_threads;
+}
+
+static void
+gimp_parallel_worker (GimpParallelTask *task,
+                      gpointer          data)
+{
+  GimpParallelDistribute *distribute = task->distribute;
+
+  gimp_parallel_run (distribute, task->i);
+
+  g_mutex_lock (&distribute->mutex);
+
+  if (--distribute->remaining == 0)
+    g_cond_signal (&distribute->cond);
+
+  g_mutex_unlock (&distribute->mutex);
+}
+
+static void
+gimp_parallel_run (GimpParallelDistribute *distribute,
+                   gint                    i)
+{
+  g_private_set (&gimp_parallel_busy, GINT_TO_POINTER (TRUE));
+
+  distribute->func (i, distribute->n, distribute->user_data);
+
+  g_private_set (&gimp_parallel_busy, NULL);
+}
+
+static void
+gimp_parallel_distribute_range_func (gint                         i,
+                                     gint                         n,
+                                     GimpParallelDistributeRange *range)
+{
+  gsize offset;
+  gsize end;
+
+  offset = range->size * i       / n;
+  end    = range->size * (i + 1) / n;
+
+  range->func (offset, end - offset, range->user_data);
+}
+
+static void
+gimp_parallel_distribute_area_func (gint                        i,
+                                    gint                        n,
+                                    GimpParallelDistributeArea *area)
+{
+  GeglRectangle sub_area = *area->area;
+
+  if (area->split_rows)
+    {
+      sub_area.y      = area->area->y + area->area->height * i       / n;
+      sub_area.height = area->area->y + area->area->height * (i + 1) / n -
+                        sub_area.y;
+    }
+  else
+    {
+      sub_area.x     = area->area->x + area->area->width * i       / n;
+      sub_area.width = area->area->x + area->area->width * (i + 1) / n -
+                       sub_area.x;
+    }
+
+  area->func (&sub_area, area->user_data);
+}
@@ -26,12 +26,19 @@
 
 #include "core-types.h"
 
+#include "gimp-parallel.h"
 #include "gimpboundary.h"
 
 
 /* GimpBoundSeg array growth parameter */
 #define MAX_SEGS_INC  2048
 
+/* number of scanlines read from the buffer at once */
+#define LINES_CHUNK_HEIGHT 64
+
+/* minimal number of scanlines processed by one thread */
+#define MIN_BAND_HEIGHT 64
+
 
 typedef struct _GimpBoundary GimpBoundary;
 
@@ -42,23 +49,66 @@ struct _GimpBoundary
   gint          num_segs;
   gint          max_segs;
 
-  /*  The array of vertical segments  */
-  gint         *vert_segs;
-
   /*  The empty segment arrays */
   gint         *empty_segs_n;
   gint         *empty_segs_c;
   gint         *empty_segs_l;
   gint          max_empty_segs;
+
+  /*  The cached scanlines  */
+  gfloat       *lines;
+  gint          lines_y;
 };
 
+typedef struct
+{
+  GeglBuffer          *buffer;
+  const GeglRectangle *region;
+  const Babl          *format;
+  GimpBoundaryType     type;
+  gint                 x1;
+  gint                 y1;
+  gint                 x2;
+  gint                 y2;
+  gfloat               threshold;
+
+  gint                 start;
+  gint                 end;
+  gint                 width;
+
+  GimpBoundary       **bands;
+} GimpBoundaryGenerate;
+
+/*  maps segment endpoints to the segments ending there, see
+ *  gimp_boundary_sort()
+ */
+typedef struct
+{
+  gint x;
+  gint y;
+  gint first;      /*  first entry, -1 if the slot is unused  */
+} GimpBoundaryPoint;
+
+typedef struct
+{
+  const GimpBoundSeg *seg;
+  gint                next;
+} GimpBoundaryPointEntry;
+
+typedef struct
+{
+  GimpBoundaryPoint      *points;
+  guint                   mask;
+  GimpBoundaryPointEntry *entries;
+  gint                    n_entries;
+} GimpBoundaryPointMap;
+
 
 /*  local function prototypes  */
 
 static GimpBoundary * gimp_boundary_new        (const GeglRectangle *region);
 static GimpBoundSeg * gimp_boundary_free       (GimpBoundary        *boundary,
                                                 gboolean             free_segs);
-
 static void           gimp_boundary_add_seg    (GimpBoundary        *bounrady,
                                                 gint                 x1,
                                                 gint                 y1,
@@ -84,6 +134,11 @@ static void           process_horiz_seg        (GimpBoundary        *boundary,
                                                 gint                 x2,
                                                 gint                 y2,
                                                 gboolean             open);
+static void           process_vert_end         (GimpBoundary        *boundary,
+                                                gint                *vert_segs,
+                                                gint                 x,
+                                                gint                 y,
+                                                gboolean             open);
 static void           make_horiz_segs          (GimpBoundary        *boundary,
                                                 gint                 start,
                                                 gint                 end,
@@ -91,6 +146,12 @@ static void           make_horiz_segs          (GimpBoundary        *boundary,
                                                 gint                 empty[],
                                                 gint                 num_empty,
                                                 gint                 top);
+static const gfloat * get_line                 (GimpBoundaryGenerate *generate,
+                                                GimpBoundary        *boundary,
+                                                gint                 scanline);
+static void           generate_boundary_band   (gint                 i,
+                                                gint                 n,
+                                                GimpBoundaryGenerate *generate);
 static GimpBoundary * generate_boundary        (GeglBuffer          *buffer,
                                                 const GeglRectangle *region,
                                                 const Babl          *format,
@@ -101,26 +162,22 @@ static GimpBoundary * generate_boundary        (GeglBuffer          *buffer,
                                                 gint                 y2,
                                                 gfloat               threshold);
 
-static gint       cmp_segptr_xy1_addr     (const GimpBoundSeg **seg_ptr_a,
-                                           const GimpBoundSeg **seg_ptr_b);
-static gint       cmp_segptr_xy2_addr     (const GimpBoundSeg **seg_ptr_a,
-                                           const GimpBoundSeg **seg_ptr_b);
-
-static gint       cmp_segptr_xy1          (const GimpBoundSeg **seg_ptr_a,
-                                           const GimpBoundSeg **seg_ptr_b);
-static gint       cmp_segptr_xy2          (const GimpBoundSeg **seg_ptr_a,
-                                           const GimpBoundSeg **seg_ptr_b);
-
-static const GimpBoundSeg * find_segment  (const GimpBoundSeg **segs_by_xy1,
-                                           const GimpBoundSeg **segs_by_xy2,
-                                           gint                 num_segs,
-                                           gint                 x,
-                                           gint                 y);
-
-static const GimpBoundSeg * find_segment_with_func (const GimpBoundSeg **segs,
-                                                    gint                 num_segs,
-                                                    const GimpBoundSeg  *search_seg,
-                                                    GCompareFunc         cmp_func);
+static void       point_map_init          (GimpBoundaryPointMap  *map,
+                                           const GimpBoundSeg    *segs,
+                                           gint                   num_segs);
+static void       point_map_clear         (GimpBoundaryPointMap  *map);
+static GimpBoundaryPoint *
+                  point_map_lookup        (GimpBoundaryPointMap  *map,
+                                           gint                   x,
+                                           gint                   y);
+static void       point_map_add           (GimpBoundaryPointMap  *map,
+                                           gint                   x,
+                                           gint                   y,
+                                           const GimpBoundSeg    *seg);
+
+static const GimpBoundSeg * find_segment  (GimpBoundaryPointMap  *map,
+                                           gint                   x,
+                                           gint                   y);
 
 static void       simplify_subdivide  (const GimpBoundSeg  *segs,
                                        gint                 start_idx,
@@ -209,12 +266,11 @@ gimp_boundary_sort (const GimpBoundSeg *segs,
                     gint                num_segs,
                     gint               *num_groups)
 {
-  GimpBoundary        *boundary;
-  const GimpBoundSeg **segs_ptrs_by_xy1;
-  const GimpBoundSeg **segs_ptrs_by_xy2;
-  gint                 index;
-  gint                 x, y;
-  gint                 startx, starty;
+  GimpBoundary         *boundary;
+  GimpBoundaryPointMap  map;
+  gint                  index;
+  gint                  x, y;
+  gint                  startx, starty;
 
   g_return_val_if_fail ((segs == NULL && num_segs == 0) ||
                         (segs != NULL && num_segs >  0), NULL);
@@ -225,24 +281,14 @@ gimp_boundary_sort (const GimpBoundSeg *segs,
   if (num_segs == 0)
     return NULL;
 
-  /* prepare arrays with GimpBoundSeg pointers sorted by xy1 and xy2 accordingly */
-  segs_ptrs_by_xy1 = g_new (const GimpBoundSeg *, num_segs);
-  segs_ptrs_by_xy2 = g_new (const GimpBoundSeg *, num_segs);
-
-  for (index = 0; index < num_segs; index++)
-    {
-      segs_ptrs_by_xy1[index] = segs + index;
-      segs_ptrs_by_xy2[index] = segs + index;
-    }
-
-  qsort (segs_ptrs_by_xy1, num_segs, sizeof (GimpBoundSeg *),
-         (GCompareFunc) cmp_segptr_xy1_addr);
-  qsort (segs_ptrs_by_xy2, num_segs, sizeof (GimpBoundSeg *),
-         (GCompareFunc) cmp_segptr_xy2_addr);
-
   for (index = 0; index < num_segs; index++)
     ((GimpBoundSeg *) segs)[index].visited = FALSE;
 
+  /* hash all segments by their endpoints, so following a group is
+   * linear in the number of segments
+   */
+  point_map_init (&map, segs, num_segs);
+
   boundary = gimp_boundary_new (NULL);
 
   for (index = 0; index < num_segs; index++)
@@ -264,8 +310,7 @@ gimp_boundary_sort (const GimpBoundSeg *segs,
       x = segs[index].x2;
       y = segs[index].y2;
 
-      while ((cur_seg = find_segment (segs_ptrs_by_xy1, segs_ptrs_by_xy2,
-                                      num_segs, x, y)) != NULL)
+      while ((cur_seg = find_segment (&map, x, y)) != NULL)
         {
           /*  make sure ordering is correct  */
           if (x == cur_seg->x1 && y == cur_seg->y1)
@@ -298,8 +343,7 @@ gimp_boundary_sort (const GimpBoundSeg *segs,
       gimp_boundary_add_seg (boundary, -1, -1, -1, -1, 0);
   }
 
-  g_free (segs_ptrs_by_xy1);
-  g_free (segs_ptrs_by_xy2);
+  point_map_clear (&map);
 
   return gimp_boundary_free (boundary, FALSE);
 }
@@ -413,16 +457,6 @@ gimp_boundary_new (const GeglRectangle *region)
 
   if (region)
     {
-      gint i;
-
-      /*  array for determining the vertical line segments
-       *  which must be drawn
-       */
-      boundary->vert_segs = g_new (gint, region->width + region->x + 1);
-
-      for (i = 0; i <= (region->width + region->x); i++)
-        boundary->vert_segs[i] = -1;
-
       /*  find the maximum possible number of empty segments
        *  given the current mask
        */
@@ -447,10 +481,10 @@ gimp_boundary_free (GimpBoundary *boundary,
   else
     segs = boundary->segs;
 
-  g_free (boundary->vert_segs);
   g_free (boundary->empty_segs_n);
   g_free (boundary->empty_segs_c);
   g_free (boundary->empty_segs_l);
+  g_free (boundary->lines);
 
   g_slice_free (GimpBoundary, boundary);
 
@@ -604,26 +638,27 @@ process_horiz_seg (GimpBoundary *boundary,
                    gint          y2,
                    gboolean      open)
 {
-  /*  This procedure accounts for any vertical segments that must be
-      drawn to close in the horizontal segments.                     */
+  /*  The vertical segments that must be drawn to close in the
+      horizontal segments are added when the bands are joined,
+      see generate_boundary().                                       */
 
-  if (boundary->vert_segs[x1] >= 0)
-    {
-      gimp_boundary_add_seg (boundary, x1, boundary->vert_segs[x1], x1, y1, !open);
-      boundary->vert_segs[x1] = -1;
-    }
-  else
-    boundary->vert_segs[x1] = y1;
+  gimp_boundary_add_seg (boundary, x1, y1, x2, y2, open);
+}
 
-  if (boundary->vert_segs[x2] >= 0)
+static void
+process_vert_end (GimpBoundary *boundary,
+                  gint         *vert_segs,
+                  gint          x,
+                  gint          y,
+                  gboolean      open)
+{
+  if (vert_segs[x] >= 0)
     {
-      gimp_boundary_add_seg (boundary, x2, boundary->vert_segs[x2], x2, y2, open);
-      boundary->vert_segs[x2] = -1;
+      gimp_boundary_add_seg (boundary, x, vert_segs[x], x, y, open);
+      vert_segs[x] = -1;
     }
   else
-    boundary->vert_segs[x2] = y2;
-
-  gimp_boundary_add_seg (boundary, x1, y1, x2, y2, open);
+    vert_segs[x] = y;
 }
 
 static void
@@ -658,96 +693,111 @@ make_horiz_segs (GimpBoundary *boundary,
     }
 }
 
-static GimpBoundary *
-generate_boundary (GeglBuffer          *buffer,
-                   const GeglRectangle *region,
-                   const Babl          *format,
-                   GimpBoundaryType     type,
-                   gint                 x1,
-                   gint                 y1,
-                   gint                 x2,
-                   gint                 y2,
-                   gfloat               threshold)
+static const gfloat *
+get_line (GimpBoundaryGenerate *generate,
+          GimpBoundary         *boundary,
+          gint                  scanline)
 {
-  GimpBoundary  *boundary;
-  GeglRectangle  line_rect = { 0, };
-  gfloat        *line_data;
-  gint           scanline;
-  gint           i;
-  gint           start, end;
-  gint          *tmp_segs;
+  if (! boundary->lines)
+    {
+      boundary->lines   = g_new (gfloat,
+                                 (gsize) generate->width * LINES_CHUNK_HEIGHT);
+      boundary->lines_y = G_MININT / 2;
+    }
+
+  if (scanline <  boundary->lines_y ||
+      scanline >= boundary->lines_y + LINES_CHUNK_HEIGHT)
+    {
+      boundary->lines_y = scanline;
+
+      gegl_buffer_get (generate->buffer,
+                       GEGL_RECTANGLE (0, scanline,
+                                       generate->width, LINES_CHUNK_HEIGHT),
+                       1.0, generate->format,
+                       boundary->lines, GEGL_AUTO_ROWSTRIDE,
+                       GEGL_ABYSS_NONE);
+    }
 
-  gint          num_empty_n = 0;
-  gint          num_empty_c = 0;
-  gint          num_empty_l = 0;
+  return boundary->lines +
+         (gsize) (scanline - boundary->lines_y) * generate->width;
+}
 
-  boundary = gimp_boundary_new (region);
+static void
+generate_boundary_band (gint                  i,
+                        gint                  n,
+                        GimpBoundaryGenerate *generate)
+{
+  GimpBoundary        *boundary;
+  const GeglRectangle *region = generate->region;
+  const gfloat        *line_data;
+  gint                 band_start;
+  gint                 band_end;
+  gint                 scanline;
+  gint                 j;
+  gint                *tmp_segs;
 
-  line_rect.width  = gegl_buffer_get_width (buffer);
-  line_rect.height = 1;
+  gint                 num_empty_n = 0;
+  gint                 num_empty_c = 0;
+  gint                 num_empty_l = 0;
 
-  line_data = g_alloca (sizeof (gfloat) * line_rect.width);
+  band_start = generate->start + (generate->end - generate->start) * i       / n;
+  band_end   = generate->start + (generate->end - generate->start) * (i + 1) / n;
 
-  start = 0;
-  end   = 0;
+  boundary = gimp_boundary_new (region);
 
-  if (type == GIMP_BOUNDARY_WITHIN_BOUNDS)
-    {
-      start = y1;
-      end   = y2;
-    }
-  else if (type == GIMP_BOUNDARY_IGNORE_BOUNDS)
-    {
-      start = region->y;
-      end   = region->y + region->height;
-    }
+  generate->bands[i] = boundary;
+
+  if (band_start >= band_end)
+    return;
 
   /*  Find the empty segments for the previous and current scanlines  */
-  find_empty_segs (region, NULL,
-                   start - 1, boundary->empty_segs_l,
+  if (band_start > generate->start)
+    line_data = get_line (generate, boundary, band_start - 1);
+  else
+    line_data = NULL;
+
+  find_empty_segs (region, line_data,
+                   band_start - 1, boundary->empty_segs_l,
                    boundary->max_empty_segs, &num_empty_l,
-                   type, x1, y1, x2, y2,
-                   threshold);
+                   generate->type,
+                   generate->x1, generate->y1, generate->x2, generate->y2,
+                   generate->threshold);
 
-  line_rect.y = start;
-  gegl_buffer_get (buffer, &line_rect, 1.0, format,
-                   line_data, GEGL_AUTO_ROWSTRIDE,
-                   GEGL_ABYSS_NONE);
+  line_data = get_line (generate, boundary, band_start);
 
   find_empty_segs (region, line_data,
-                   start, boundary->empty_segs_c,
+                   band_start, boundary->empty_segs_c,
                    boundary->max_empty_segs, &num_empty_c,
-                   type, x1, y1, x2, y2,
-                   threshold);
+                   generate->type,
+                   generate->x1, generate->y1, generate->x2, generate->y2,
+                   generate->threshold);
 
-  for (scanline = start; scanline < end; scanline++)
+  for (scanline = band_start; scanline < band_end; scanline++)
     {
       /*  find the empty segment list for the next scanline  */
-      line_rect.y = scanline + 1;
-      if (scanline + 1 == end)
+      if (scanline + 1 == generate->end)
         line_data = NULL;
       else
-        gegl_buffer_get (buffer, &line_rect, 1.0, format,
-                         line_data, GEGL_AUTO_ROWSTRIDE,
-                         GEGL_ABYSS_NONE);
+        line_data = get_line (generate, boundary, scanline + 1);
 
       find_empty_segs (region, line_data,
                        scanline + 1, boundary->empty_segs_n,
                        boundary->max_empty_segs, &num_empty_n,
-                       type, x1, y1, x2, y2,
-                       threshold);
+                       generate->type,
+                       generate->x1, generate->y1, generate->x2, generate->y2,
+                       generate->threshold);
 
       /*  process the segments on the current scanline  */
-      for (i = 1; i < num_empty_c - 1; i += 2)
+      for (j = 1; j < num_empty_c - 1; j += 2)
         {
           make_horiz_segs (boundary,
-                           boundary->empty_segs_c [i],
-                           boundary->empty_segs_c [i+1],
+                           boundary->empty_segs_c [j],
+                           boundary->empty_segs_c [j+1],
                            scanline,
                            boundary->empty_segs_l, num_empty_l, 1);
           make_horiz_segs (boundary,
-                           boundary->empty_segs_c [i],
-                           boundary->empty_segs_c [i+1],
+                           boundary->empty_segs_c [j],
+                           boundary->empty_segs_c [j+1],
                            scanline + 1,
                            boundary->empty_segs_n, num_empty_n, 0);
         }
@@ -760,176 +810,216 @@ generate_boundary (GeglBuffer          *buffer,
       num_empty_c            = num_empty_n;
       boundary->empty_segs_n = tmp_segs;
     }
-
-  return boundary;
 }
 
-/*  sorting utility functions  */
-
-static inline gint
-cmp_xy (const gint ax,
-        const gint ay,
-        const gint bx,
-        const gint by)
+static GimpBoundary *
+generate_boundary (GeglBuffer          *buffer,
+                   const GeglRectangle *region,
+                   const Babl          *format,
+                   GimpBoundaryType     type,
+                   gint                 x1,
+                   gint                 y1,
+                   gint                 x2,
+                   gint                 y2,
+                   gfloat               threshold)
 {
-  if (ay < by)
-    {
-      return -1;
-    }
-  else if (ay > by)
-    {
-      return 1;
-    }
-  else if (ax < bx)
-    {
-      return -1;
-    }
-  else if (ax > bx)
+  GimpBoundaryGenerate  generate;
+  GimpBoundary         *boundary;
+  gint                 *vert_segs;
+  gint                  n_bands;
+  gint                  i, j;
+
+  generate.buffer    = buffer;
+  generate.region    = region;
+  generate.format    = format;
+  generate.type      = type;
+  generate.x1        = x1;
+  generate.y1        = y1;
+  generate.x2        = x2;
+  generate.y2        = y2;
+  generate.threshold = threshold;
+  generate.start     = 0;
+  generate.end       = 0;
+  generate.width     = gegl_buffer_get_width (buffer);
+
+  if (type == GIMP_BOUNDARY_WITHIN_BOUNDS)
     {
-      return 1;
+      generate.start = y1;
+      generate.end   = y2;
     }
-  else
+  else if (type == GIMP_BOUNDARY_IGNORE_BOUNDS)
     {
-      return 0;
+      generate.start = region->y;
+      generate.end   = region->y + region->height;
     }
-}
 
+  /*  split the scanlines into bands which are processed in parallel,
+   *  each of them only knows about its own horizontal segments
+   */
+  n_bands = MAX ((generate.end - generate.start) / MIN_BAND_HEIGHT, 1);
+  n_bands = MIN (n_bands, gimp_parallel_get_n_threads ());
 
-/*
- * Compares (x1, y1) pairs in specified segments, using their addresses if
- * (x1, y1) pairs are equal.
- */
-static gint
-cmp_segptr_xy1_addr (const GimpBoundSeg **seg_ptr_a,
-                     const GimpBoundSeg **seg_ptr_b)
-{
-  const GimpBoundSeg *seg_a = *seg_ptr_a;
-  const GimpBoundSeg *seg_b = *seg_ptr_b;
+  generate.bands = g_new0 (GimpBoundary *, n_bands);
+
+  gimp_parallel_distribute (n_bands,
+                            (GimpParallelDistributeFunc) generate_boundary_band,
+                            &generate);
 
-  gint result = cmp_xy (seg_a->x1, seg_a->y1, seg_b->x1, seg_b->y1);
+  boundary = gimp_boundary_new (NULL);
+
+  /*  array for determining the vertical line segments
+   *  which must be drawn
+   */
+  vert_segs = g_new (gint, region->width + region->x + 1);
+
+  for (i = 0; i <= (region->width + region->x); i++)
+    vert_segs[i] = -1;
 
-  if (result == 0)
+  /*  join the bands in scanline order, and add the vertical segments
+   *  ending at each horizontal segment right before it, like a serial
+   *  scan does, so the result doesn't depend on the number of bands.
+   *  the ends are joined across band borders too.
+   */
+  for (i = 0; i < n_bands; i++)
     {
-      if (seg_a < seg_b)
-        result = -1;
-      else if (seg_a > seg_b)
-        result = 1;
-    }
+      GimpBoundary *band = generate.bands[i];
 
-  return result;
-}
+      /*  gimp_parallel_distribute() may have used fewer bands  */
+      if (! band)
+        continue;
 
-/*
- * Compares (x2, y2) pairs in specified segments, using their addresses if
- * (x2, y2) pairs are equal.
- */
-static gint
-cmp_segptr_xy2_addr (const GimpBoundSeg **seg_ptr_a,
-                     const GimpBoundSeg **seg_ptr_b)
-{
-  const GimpBoundSeg *seg_a = *seg_ptr_a;
-  const GimpBoundSeg *seg_b = *seg_ptr_b;
+      for (j = 0; j < band->num_segs; j++)
+        {
+          const GimpBoundSeg *seg = &band->segs[j];
 
-  gint result = cmp_xy (seg_a->x2, seg_a->y2, seg_b->x2, seg_b->y2);
+          process_vert_end (boundary, vert_segs, seg->x1, seg->y1, ! seg->open);
+          process_vert_end (boundary, vert_segs, seg->x2, seg->y2,   seg->open);
 
-  if (result == 0)
-    {
-      if (seg_a < seg_b)
-        result = -1;
-      else if (seg_a > seg_b)
-        result = 1;
+          gimp_boundary_add_seg (boundary,
+                                 seg->x1, seg->y1, seg->x2, seg->y2,
+                                 seg->open);
+        }
+
+      gimp_boundary_free (band, TRUE);
     }
 
-  return result;
+  g_free (vert_segs);
+  g_free (generate.bands);
+
+  return boundary;
 }
 
+/*  sorting utility functions  */
 
-/*
- * Compares (x1, y1) pairs in specified segments.
- */
-static gint
-cmp_segptr_xy1 (const GimpBoundSeg **seg_ptr_a,
-                const GimpBoundSeg **seg_ptr_b)
+static inline guint
+point_hash (gint x,
+            gint y)
 {
-  const GimpBoundSeg *seg_a = *seg_ptr_a, *seg_b = *seg_ptr_b;
-
-  return cmp_xy (seg_a->x1, seg_a->y1, seg_b->x1, seg_b->y1);
+  return ((guint) x * 73856093u) ^ ((guint) y * 19349663u);
 }
 
-/*
- * Compares (x2, y2) pairs in specified segments.
- */
-static gint
-cmp_segptr_xy2 (const GimpBoundSeg **seg_ptr_a,
-                const GimpBoundSeg **seg_ptr_b)
+static void
+point_map_init (GimpBoundaryPointMap *map,
+                const GimpBoundSeg   *segs,
+                gint                  num_segs)
 {
-  const GimpBoundSeg *seg_a = *seg_ptr_a;
-  const GimpBoundSeg *seg_b = *seg_ptr_b;
-
-  return cmp_xy (seg_a->x2, seg_a->y2, seg_b->x2, seg_b->y2);
+  guint size = 16;
+  guint j;
+  gint  i;
+
+  /*  keep the table at most half full  */
+  while (size < 4 * (guint) num_segs)
+    size <<= 1;
+
+  map->mask      = size - 1;
+  map->points    = g_new (GimpBoundaryPoint, size);
+  map->entries   = g_new (GimpBoundaryPointEntry, 2 * num_segs);
+  map->n_entries = 0;
+
+  for (j = 0; j < size; j++)
+    map->points[j].first = -1;
+
+  /*  add the segments backwards, so each point's entries end up in
+   *  ascending address order
+   */
+  for (i = num_segs - 1; i >= 0; i--)
+    {
+      point_map_add (map, segs[i].x2, segs[i].y2, segs + i);
+      point_map_add (map, segs[i].x1, segs[i].y1, segs + i);
+    }
 }
 
+static void
+point_map_clear (GimpBoundaryPointMap *map)
+{
+  g_free (map->points);
+  g_free (map->entries);
+}
 
-static const GimpBoundSeg *
-find_segment (const GimpBoundSeg **segs_by_xy1,
-              const GimpBoundSeg **segs_by_xy2,
-              gint                 num_segs,
-              gint                 x,
-              gint                 y)
+static GimpBoundaryPoint *
+point_map_lookup (GimpBoundaryPointMap *map,
+                  gint                  x,
+                  gint                  y)
 {
-  const GimpBoundSeg *segptr_xy1;
-  const GimpBoundSeg *segptr_xy2;
-  GimpBoundSeg        search_seg;
-
-  search_seg.x1 = search_seg.x2 = x;
-  search_seg.y1 = search_seg.y2 = y;
-
-  segptr_xy1 = find_segment_with_func (segs_by_xy1, num_segs, &search_seg,
-                                       (GCompareFunc) cmp_segptr_xy1);
-  segptr_xy2 = find_segment_with_func (segs_by_xy2, num_segs, &search_seg,
-                                       (GCompareFunc) cmp_segptr_xy2);
-
-  /* return segment with smaller address */
-  if (segptr_xy1 != NULL && segptr_xy2 != NULL)
-    return MIN(segptr_xy1, segptr_xy2);
-  else if (segptr_xy1 != NULL)
-    return segptr_xy1;
-  else if (segptr_xy2 != NULL)
-    return segptr_xy2;
+  guint index = point_hash (x, y) & map->mask;
 
-  return NULL;
+  while (map->points[index].first >= 0)
+    {
+      GimpBoundaryPoint *point = &map->points[index];
+
+      if (point->x == x && point->y == y)
+        return point;
+
+      index = (index + 1) & map->mask;
+    }
+
+  return &map->points[index];
 }
 
+static void
+point_map_add (GimpBoundaryPointMap *map,
+               gint                  x,
+               gint                  y,
+               const GimpBoundSeg   *seg)
+{
+  GimpBoundaryPoint      *point = point_map_lookup (map, x, y);
+  GimpBoundaryPointEntry *entry = &map->entries[map->n_entries];
+
+  if (point->first < 0)
+    {
+      point->x = x;
+      point->y = y;
+    }
+
+  entry->seg  = seg;
+  entry->next = point->first;
 
+  point->first = map->n_entries++;
+}
+
+/*  returns the non-visited segment with the smallest address which
+ *  starts or ends at (x, y)
+ */
 static const GimpBoundSeg *
-find_segment_with_func (const GimpBoundSeg **segs,
-                        gint                 num_segs,
-                        const GimpBoundSeg  *search_seg,
-                        GCompareFunc         cmp_func)
+find_segment (GimpBoundaryPointMap *map,
+              gint                  x,
+              gint                  y)
 {
-  const GimpBoundSeg **seg;
-  const GimpBoundSeg *found_seg = NULL;
+  GimpBoundaryPoint *point = point_map_lookup (map, x, y);
+  gint               index;
 
-  seg = bsearch (&search_seg, segs, num_segs, sizeof (GimpBoundSeg *), cmp_func);
+  if (point->first < 0)
+    return NULL;
 
-  if (seg != NULL)
+  for (index = point->first; index >= 0; index = map->entries[index].next)
     {
-      /* find first matching segment */
-      while (seg > segs && cmp_func (seg - 1, &search_seg) == 0)
-        seg--;
-
-      /* find first non-visited segment */
-      while (seg != segs + num_segs && cmp_func (seg, &search_seg) == 0)
-        if (!(*seg)->visited)
-          {
-            found_seg = *seg;
-            break;
-          }
-        else
-          seg++;
+      const GimpBoundSeg *seg = map->entries[index].seg;
+
+      if (! seg->visited)
+        return seg;
     }
 
-    return found_seg;
+  return NULL;
 }
 
 
@@ -31,7 +31,7 @@
 #include "paint/gimppaintoptions.h"
 
 #include "gegl/gimp-gegl-apply-operation.h"
-#include "gegl/gimp-gegl-mask.h"
+#include "gegl/gimp-gegl-mask-summary.h"
 #include "gegl/gimp-gegl-utils.h"
 
 #include "gimp.h"
@@ -221,6 +221,9 @@ static void       gimp_channel_real_shrink   (GimpChannel         *channel,
                                               gboolean             edge_lock,
                                               gboolean             push_undo);
 
+static GimpGeglMaskSummary *
+                  gimp_channel_get_summary   (GimpChannel         *channel);
+
 
 G_DEFINE_TYPE_WITH_CODE (GimpChannel, gimp_channel, GIMP_TYPE_DRAWABLE,
                          G_IMPLEMENT_INTERFACE (GIMP_TYPE_PICKABLE,
@@ -333,12 +336,14 @@ gimp_channel_init (GimpChannel *channel)
   channel->segs_out       = NULL;
   channel->num_segs_in    = 0;
   channel->num_segs_out   = 0;
+  channel->boundary_version = 0;
   channel->empty          = FALSE;
   channel->bounds_known   = FALSE;
   channel->x1             = 0;
   channel->y1             = 0;
   channel->x2             = 0;
   channel->y2             = 0;
+  channel->summary        = NULL;
 }
 
 static void
@@ -364,6 +369,12 @@ gimp_channel_finalize (GObject *object)
       channel->segs_out = NULL;
     }
 
+  if (channel->summary)
+    {
+      gimp_gegl_mask_summary_free (channel->summary);
+      channel->summary = NULL;
+    }
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -969,12 +980,23 @@ gimp_channel_set_buffer (GimpDrawable *drawable,
                          gint          offset_x,
                          gint          offset_y)
 {
+  GimpChannel *channel = GIMP_CHANNEL (drawable);
+
+  /*  the summary holds a reference on the old buffer, drop it right
+   *  away instead of on the next query
+   */
+  if (channel->summary)
+    {
+      gimp_gegl_mask_summary_free (channel->summary);
+      channel->summary = NULL;
+    }
+
   GIMP_DRAWABLE_CLASS (parent_class)->set_buffer (drawable,
                                                   push_undo, undo_desc,
                                                   buffer,
                                                   offset_x, offset_y);
 
-  GIMP_CHANNEL (drawable)->bounds_known = FALSE;
+  channel->bounds_known = FALSE;
 }
 
 static void
@@ -1001,12 +1023,14 @@ gimp_channel_get_opacity_at (GimpPickable *pickable,
   if (x >= 0 && x < gimp_item_get_width  (GIMP_ITEM (channel)) &&
       y >= 0 && y < gimp_item_get_height (GIMP_ITEM (channel)))
     {
-      if (! channel->bounds_known ||
-          (! channel->empty &&
-           x >= channel->x1 &&
-           x <  channel->x2 &&
-           y >= channel->y1 &&
-           y <  channel->y2))
+      if ((! channel->bounds_known ||
+           (! channel->empty &&
+            x >= channel->x1 &&
+            x <  channel->x2 &&
+            y >= channel->y1 &&
+            y <  channel->y2)) &&
+          ! gimp_gegl_mask_summary_get_value (gimp_channel_get_summary (channel),
+                                              x, y, &value))
         {
           gegl_buffer_sample (gimp_drawable_get_buffer (GIMP_DRAWABLE (channel)),
                               x, y, NULL, &value, babl_format ("Y double"),
@@ -1030,52 +1054,72 @@ gimp_channel_real_boundary (GimpChannel         *channel,
 {
   if (! channel->boundary_known)
     {
-      gint x3, y3, x4, y4;
+      guint    version;
+      gboolean non_empty;
+      gint     x3, y3, x4, y4;
 
-      /* free the out of date boundary segments */
-      g_free (channel->segs_in);
-      g_free (channel->segs_out);
+      version   = gimp_gegl_mask_summary_get_version (gimp_channel_get_summary (channel));
+      non_empty = gimp_channel_bounds (channel, &x3, &y3, &x4, &y4);
 
-      if (gimp_channel_bounds (channel, &x3, &y3, &x4, &y4))
+      /* the boundary may have been invalidated without the mask pixels
+       * or the requested area changing, in which case the old segments
+       * are still good
+       */
+      if (version != channel->boundary_version ||
+          x1 != channel->boundary_x1 || y1 != channel->boundary_y1 ||
+          x2 != channel->boundary_x2 || y2 != channel->boundary_y2)
         {
-          GeglBuffer *buffer;
-          GeglRectangle  rect = { x3, y3, x4 - x3, y4 - y3 };
-
-          buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (channel));
-
-          channel->segs_out = gimp_boundary_find (buffer, &rect,
-                                                  babl_format ("Y float"),
-                                                  GIMP_BOUNDARY_IGNORE_BOUNDS,
-                                                  x1, y1, x2, y2,
-                                                  GIMP_BOUNDARY_HALF_WAY,
-                                                  &channel->num_segs_out);
-          x1 = MAX (x1, x3);
-          y1 = MAX (y1, y3);
-          x2 = MIN (x2, x4);
-          y2 = MIN (y2, y4);
-
-          if (x2 > x1 && y2 > y1)
+          channel->boundary_version = version;
+          channel->boundary_x1      = x1;
+          channel->boundary_y1      = y1;
+          channel->boundary_x2      = x2;
+          channel->boundary_y2      = y2;
+
+          /* free the out of date boundary segments */
+          g_free (channel->segs_in);
+          g_free (channel->segs_out);
+
+          if (non_empty)
             {
-              channel->segs_in = gimp_boundary_find (buffer, NULL,
-                                                     babl_format ("Y float"),
-                                                     GIMP_BOUNDARY_WITHIN_BOUNDS,
-                                                     x1, y1, x2, y2,
-                                                     GIMP_BOUNDARY_HALF_WAY,
-                                                     &channel->num_segs_in);
+              GeglBuffer    *buffer;
+              GeglRectangle  rect = { x3, y3, x4 - x3, y4 - y3 };
+
+              buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (channel));
+
+              channel->segs_out = gimp_boundary_find (buffer, &rect,
+                                                      babl_format ("Y float"),
+                                                      GIMP_BOUNDARY_IGNORE_BOUNDS,
+                                                      x1, y1, x2, y2,
+                                                      GIMP_BOUNDARY_HALF_WAY,
+                                                      &channel->num_segs_out);
+              x1 = MAX (x1, x3);
+              y1 = MAX (y1, y3);
+              x2 = MIN (x2, x4);
+              y2 = MIN (y2, y4);
+
+              if (x2 > x1 && y2 > y1)
+                {
+                  channel->segs_in = gimp_boundary_find (buffer, NULL,
+                                                         babl_format ("Y float"),
+                                                         GIMP_BOUNDARY_WITHIN_BOUNDS,
+                                                         x1, y1, x2, y2,
+                                                         GIMP_BOUNDARY_HALF_WAY,
+                                                         &channel->num_segs_in);
+                }
+              else
+                {
+                  channel->segs_in     = NULL;
+                  channel->num_segs_in = 0;
+                }
             }
           else
             {
-              channel->segs_in     = NULL;
-              channel->num_segs_in = 0;
+              channel->segs_in      = NULL;
+              channel->segs_out     = NULL;
+              channel->num_segs_in  = 0;
+              channel->num_segs_out = 0;
             }
         }
-      else
-        {
-          channel->segs_in      = NULL;
-          channel->segs_out     = NULL;
-          channel->num_segs_in  = 0;
-          channel->num_segs_out = 0;
-        }
 
       channel->boundary_known = TRUE;
     }
@@ -1095,8 +1139,6 @@ gimp_channel_real_bounds (GimpChannel *channel,
                           gint        *x2,
                           gint        *y2)
 {
-  GeglBuffer *buffer;
-
   /*  if the channel's bounds have already been reliably calculated...  */
   if (channel->bounds_known)
     {
@@ -1108,9 +1150,9 @@ gimp_channel_real_bounds (GimpChannel *channel,
       return ! channel->empty;
     }
 
-  buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (channel));
-
-  channel->empty = ! gimp_gegl_mask_bounds (buffer, x1, y1, x2, y2);
+  /*  ...otherwise only rescan the tiles that changed since last time  */
+  channel->empty = ! gimp_gegl_mask_summary_bounds (gimp_channel_get_summary (channel),
+                                                    x1, y1, x2, y2);
 
   channel->x1 = *x1;
   channel->y1 = *y1;
@@ -1125,14 +1167,10 @@ gimp_channel_real_bounds (GimpChannel *channel,
 static gboolean
 gimp_channel_real_is_empty (GimpChannel *channel)
 {
-  GeglBuffer *buffer;
-
   if (channel->bounds_known)
     return channel->empty;
 
-  buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (channel));
-
-  if (! gimp_gegl_mask_is_empty (buffer))
+  if (! gimp_gegl_mask_summary_is_empty (gimp_channel_get_summary (channel)))
     return FALSE;
 
   /*  The mask is empty, meaning we can set the bounds as known  */
@@ -1146,6 +1184,7 @@ gimp_channel_real_is_empty (GimpChannel *channel)
   channel->segs_out       = NULL;
   channel->num_segs_in    = 0;
   channel->num_segs_out   = 0;
+  channel->boundary_version = 0;
   channel->bounds_known   = TRUE;
   channel->boundary_known = TRUE;
   channel->x1             = 0;
@@ -1187,7 +1226,8 @@ static void
 gimp_channel_real_sharpen (GimpChannel *channel,
                            gboolean     push_undo)
 {
-  GimpDrawable *drawable = GIMP_DRAWABLE (channel);
+  GimpDrawable        *drawable = GIMP_DRAWABLE (channel);
+  GimpGeglMaskSummary *summary;
 
   if (push_undo)
     gimp_channel_push_undo (channel,
@@ -1195,11 +1235,19 @@ gimp_channel_real_sharpen (GimpChannel *channel,
   else
     gimp_drawable_invalidate_boundary (drawable);
 
+  /*  thresholding keeps empty and full tiles as they are  */
+  summary = gimp_channel_get_summary (channel);
+
+  gimp_gegl_mask_summary_block (summary);
+
   gimp_gegl_apply_threshold (gimp_drawable_get_buffer (drawable),
                              NULL, NULL,
                              gimp_drawable_get_buffer (drawable),
                              0.5);
 
+  gimp_gegl_mask_summary_unblock (summary);
+  gimp_gegl_mask_summary_invalidate_mixed (summary);
+
   channel->bounds_known = FALSE;
 
   gimp_drawable_update (GIMP_DRAWABLE (channel), 0, 0,
@@ -1237,6 +1285,9 @@ gimp_channel_real_clear (GimpChannel *channel,
                          NULL);
     }
 
+  gimp_gegl_mask_summary_set (gimp_channel_get_summary (channel),
+                              NULL, GIMP_GEGL_MASK_TILE_EMPTY);
+
   /*  we know the bounds  */
   channel->bounds_known = TRUE;
   channel->empty        = TRUE;
@@ -1268,6 +1319,9 @@ gimp_channel_real_all (GimpChannel *channel,
                          NULL, color);
   g_object_unref (color);
 
+  gimp_gegl_mask_summary_set (gimp_channel_get_summary (channel),
+                              NULL, GIMP_GEGL_MASK_TILE_FULL);
+
   /*  we know the bounds  */
   channel->bounds_known = TRUE;
   channel->empty        = FALSE;
@@ -1299,10 +1353,18 @@ gimp_channel_real_invert (GimpChannel *channel,
     }
   else
     {
+      GimpGeglMaskSummary *summary = gimp_channel_get_summary (channel);
+
+      /*  inverting swaps empty and full tiles  */
+      gimp_gegl_mask_summary_block (summary);
+
       gimp_gegl_apply_invert_linear (gimp_drawable_get_buffer (drawable),
                                      NULL, NULL,
                                      gimp_drawable_get_buffer (drawable));
 
+      gimp_gegl_mask_summary_unblock (summary);
+      gimp_gegl_mask_summary_invert (summary);
+
       channel->bounds_known = FALSE;
 
       gimp_drawable_update (GIMP_DRAWABLE (channel), 0, 0,
@@ -1519,6 +1581,27 @@ gimp_channel_real_shrink (GimpChannel *channel,
                         gimp_item_get_height (GIMP_ITEM (channel)));
 }
 
+static GimpGeglMaskSummary *
+gimp_channel_get_summary (GimpChannel *channel)
+{
+  GeglBuffer *buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (channel));
+
+  /*  the buffer may have been replaced or resized since the summary
+   *  was created, start over in that case
+   */
+  if (channel->summary &&
+      gimp_gegl_mask_summary_get_buffer (channel->summary) != buffer)
+    {
+      gimp_gegl_mask_summary_free (channel->summary);
+      channel->summary = NULL;
+    }
+
+  if (! channel->summary)
+    channel->summary = gimp_gegl_mask_summary_new (buffer);
+
+  return channel->summary;
+}
+
 
 /*  public functions  */
 
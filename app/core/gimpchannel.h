@@ -49,10 +49,17 @@ struct _GimpChannel
   GimpBoundSeg *segs_out;          /*  outline of selected region     */
   gint          num_segs_in;       /*  number of lines in boundary    */
   gint          num_segs_out;      /*  number of lines in boundary    */
+  guint         boundary_version;  /*  mask version of the boundary   */
+  gint          boundary_x1;       /*  area the boundary was found in */
+  gint          boundary_y1;
+  gint          boundary_x2;
+  gint          boundary_y2;
   gboolean      empty;             /*  is the region empty?           */
   gboolean      bounds_known;      /*  recalculate the bounds?        */
   gint          x1, y1;            /*  coordinates for bounding box   */
   gint          x2, y2;            /*  lower right hand coordinate    */
+
+  GimpGeglMaskSummary *summary;    /*  per-tile emptiness and bounds  */
 };
 
 struct _GimpChannelClass
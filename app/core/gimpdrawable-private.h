@@ -33,6 +33,8 @@ struct _GimpDrawablePrivate
   GimpApplicator *fs_applicator;
 
   GeglNode       *mode_node;
+
+  GeglBuffer     *scaled_buffer; /* result of the next scale      */
 };
 
 #endif /* __GIMP_DRAWABLE_PRIVATE_H__ */
@@ -34,6 +34,7 @@
 #include "gegl/gimp-gegl-utils.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimp-transform-resize.h"
 #include "gimpchannel.h"
 #include "gimpcontext.h"
@@ -60,6 +61,50 @@
 #error "no FINITE() implementation available?!"
 #endif
 
+#define MIN_PARALLEL_SUB_AREA (64 * 64)
+
+
+/*  copies a rectangle of pixels, mirrored and/or transposed, one tile
+ *  of the destination at a time.  the pixel at (x, y) of dest_rect,
+ *  relative to its origin, comes from (a, b) of src_rect, where (a, b)
+ *  is (y, x) if transpose is set and (x, y) otherwise, and a and b
+ *  are then mirrored if flip_x and flip_y are set, respectively.
+ */
+typedef struct
+{
+  GeglBuffer    *src_buffer;
+  GeglBuffer    *dest_buffer;
+  const Babl    *format;
+  gint           bpp;
+  GeglRectangle  src_rect;
+  GeglRectangle  dest_rect;
+  gint           tile_width;
+  gint           tile_height;
+  gboolean       transpose;
+  gboolean       flip_x;
+  gboolean       flip_y;
+} TransformTiles;
+
+
+/*  local function prototypes  */
+
+static void   gimp_drawable_transform_tiles      (GeglBuffer          *src_buffer,
+                                                  const GeglRectangle *src_rect,
+                                                  GeglBuffer          *dest_buffer,
+                                                  const GeglRectangle *dest_rect,
+                                                  gboolean             transpose,
+                                                  gboolean             flip_x,
+                                                  gboolean             flip_y);
+static void   gimp_drawable_transform_tiles_area (const GeglRectangle *area,
+                                                  TransformTiles      *tiles);
+static void   gimp_drawable_transform_tiles_copy (guchar              *dest,
+                                                  const guchar        *src,
+                                                  gint                 width,
+                                                  gint                 height,
+                                                  gint                 bpp,
+                                                  gint                 src_step_x,
+                                                  gint                 src_step_y);
+
 
 /*  public functions  */
 
@@ -147,14 +192,11 @@ gimp_drawable_transform_buffer_flip (GimpDrawable        *drawable,
                                      gint                *new_offset_x,
                                      gint                *new_offset_y)
 {
-  GeglBuffer    *new_buffer;
-  GeglRectangle  src_rect;
-  GeglRectangle  dest_rect;
-  gint           orig_x, orig_y;
-  gint           orig_width, orig_height;
-  gint           new_x, new_y;
-  gint           new_width, new_height;
-  gint           i;
+  GeglBuffer *new_buffer;
+  gint        orig_x, orig_y;
+  gint        orig_width, orig_height;
+  gint        new_x, new_y;
+  gint        new_width, new_height;
 
   g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), NULL);
   g_return_val_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)), NULL);
@@ -238,53 +280,15 @@ gimp_drawable_transform_buffer_flip (GimpDrawable        *drawable,
   if (new_width == 0 && new_height == 0)
     return new_buffer;
 
-  switch (flip_type)
-    {
-    case GIMP_ORIENTATION_HORIZONTAL:
-      src_rect.x      = orig_x;
-      src_rect.y      = orig_y;
-      src_rect.width  = 1;
-      src_rect.height = orig_height;
-
-      dest_rect.x      = new_x + new_width - 1;
-      dest_rect.y      = new_y;
-      dest_rect.width  = 1;
-      dest_rect.height = new_height;
-
-      for (i = 0; i < orig_width; i++)
-        {
-          src_rect.x  = i + orig_x;
-          dest_rect.x = new_x + new_width - i - 1;
-
-          gegl_buffer_copy (orig_buffer, &src_rect,
-                            new_buffer, &dest_rect);
-        }
-      break;
-
-    case GIMP_ORIENTATION_VERTICAL:
-      src_rect.x      = orig_x;
-      src_rect.y      = orig_y;
-      src_rect.width  = orig_width;
-      src_rect.height = 1;
-
-      dest_rect.x      = new_x;
-      dest_rect.y      = new_y + new_height - 1;
-      dest_rect.width  = new_width;
-      dest_rect.height = 1;
-
-      for (i = 0; i < orig_height; i++)
-        {
-          src_rect.y  = i + orig_y;
-          dest_rect.y = new_y + new_height - i - 1;
-
-          gegl_buffer_copy (orig_buffer, &src_rect,
-                            new_buffer, &dest_rect);
-        }
-      break;
-
-    case GIMP_ORIENTATION_UNKNOWN:
-      break;
-    }
+  gimp_drawable_transform_tiles (orig_buffer,
+                                 GEGL_RECTANGLE (orig_x, orig_y,
+                                                 orig_width, orig_height),
+                                 new_buffer,
+                                 GEGL_RECTANGLE (new_x, new_y,
+                                                 new_width, new_height),
+                                 FALSE,
+                                 flip_type == GIMP_ORIENTATION_HORIZONTAL,
+                                 flip_type == GIMP_ORIENTATION_VERTICAL);
 
   return new_buffer;
 }
@@ -336,14 +340,11 @@ gimp_drawable_transform_buffer_rotate (GimpDrawable     *drawable,
                                        gint             *new_offset_x,
                                        gint             *new_offset_y)
 {
-  GeglBuffer    *new_buffer;
-  GeglRectangle  src_rect;
-  GeglRectangle  dest_rect;
-  gint           orig_x, orig_y;
-  gint           orig_width, orig_height;
-  gint           orig_bpp;
-  gint           new_x, new_y;
-  gint           new_width, new_height;
+  GeglBuffer *new_buffer;
+  gint        orig_x, orig_y;
+  gint        orig_width, orig_height;
+  gint        new_x, new_y;
+  gint        new_width, new_height;
 
   g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), NULL);
   g_return_val_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)), NULL);
@@ -354,7 +355,6 @@ gimp_drawable_transform_buffer_rotate (GimpDrawable     *drawable,
   orig_y      = orig_offset_y;
   orig_width  = gegl_buffer_get_width (orig_buffer);
   orig_height = gegl_buffer_get_height (orig_buffer);
-  orig_bpp    = babl_format_get_bytes_per_pixel (gegl_buffer_get_format (orig_buffer));
 
   switch (rotate_type)
     {
@@ -492,116 +492,18 @@ gimp_drawable_transform_buffer_rotate (GimpDrawable     *drawable,
   if (new_width < 1 || new_height < 1)
     return new_buffer;
 
-  src_rect.x      = orig_x;
-  src_rect.y      = orig_y;
-  src_rect.width  = orig_width;
-  src_rect.height = orig_height;
-
-  dest_rect.x      = new_x;
-  dest_rect.y      = new_y;
-  dest_rect.width  = new_width;
-  dest_rect.height = new_height;
-
-  switch (rotate_type)
-    {
-    case GIMP_ROTATE_90:
-      {
-        guchar *buf = g_new (guchar, new_height * orig_bpp);
-        gint    i;
-
-        g_assert (new_height == orig_width);
-
-        src_rect.y      = orig_y + orig_height - 1;
-        src_rect.height = 1;
-
-        dest_rect.x     = new_x;
-        dest_rect.width = 1;
-
-        for (i = 0; i < orig_height; i++)
-          {
-            src_rect.y  = orig_y + orig_height - 1 - i;
-            dest_rect.x = new_x + i;
-
-            gegl_buffer_get (orig_buffer, &src_rect, 1.0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-            gegl_buffer_set (new_buffer, &dest_rect, 0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE);
-          }
-
-        g_free (buf);
-      }
-      break;
-
-    case GIMP_ROTATE_180:
-      {
-        guchar *buf = g_new (guchar, new_width * orig_bpp);
-        gint    i, j, k;
-
-        g_assert (new_width == orig_width);
-
-        src_rect.y      = orig_y + orig_height - 1;
-        src_rect.height = 1;
-
-        dest_rect.y      = new_y;
-        dest_rect.height = 1;
-
-        for (i = 0; i < orig_height; i++)
-          {
-            src_rect.y  = orig_y + orig_height - 1 - i;
-            dest_rect.y = new_y + i;
-
-            gegl_buffer_get (orig_buffer, &src_rect, 1.0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-            for (j = 0; j < orig_width / 2; j++)
-              {
-                guchar *left  = buf + j * orig_bpp;
-                guchar *right = buf + (orig_width - 1 - j) * orig_bpp;
-
-                for (k = 0; k < orig_bpp; k++)
-                  {
-                    guchar tmp = left[k];
-                    left[k]    = right[k];
-                    right[k]   = tmp;
-                  }
-              }
-
-            gegl_buffer_set (new_buffer, &dest_rect, 0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE);
-          }
-
-        g_free (buf);
-      }
-      break;
-
-    case GIMP_ROTATE_270:
-      {
-        guchar *buf = g_new (guchar, new_width * orig_bpp);
-        gint    i;
-
-        g_assert (new_width == orig_height);
-
-        src_rect.x     = orig_x + orig_width - 1;
-        src_rect.width = 1;
-
-        dest_rect.y      = new_y;
-        dest_rect.height = 1;
-
-        for (i = 0; i < orig_width; i++)
-          {
-            src_rect.x  = orig_x + orig_width - 1 - i;
-            dest_rect.y = new_y + i;
-
-            gegl_buffer_get (orig_buffer, &src_rect, 1.0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-            gegl_buffer_set (new_buffer, &dest_rect, 0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE);
-          }
-
-        g_free (buf);
-      }
-      break;
-    }
+  /*  rotating by 90 degrees transposes and then mirrors vertically,
+   *  by 270 degrees it mirrors horizontally, by 180 degrees both
+   */
+  gimp_drawable_transform_tiles (orig_buffer,
+                                 GEGL_RECTANGLE (orig_x, orig_y,
+                                                 orig_width, orig_height),
+                                 new_buffer,
+                                 GEGL_RECTANGLE (new_x, new_y,
+                                                 new_width, new_height),
+                                 rotate_type != GIMP_ROTATE_180,
+                                 rotate_type != GIMP_ROTATE_90,
+                                 rotate_type != GIMP_ROTATE_270);
 
   return new_buffer;
 }
@@ -980,3 +882,197 @@ gimp_drawable_transform_paste (GimpDrawable *drawable,
 
   return drawable;
 }
+
+
+/*  private functions  */
+
+static void
+gimp_drawable_transform_tiles (GeglBuffer          *src_buffer,
+                               const GeglRectangle *src_rect,
+                               GeglBuffer          *dest_buffer,
+                               const GeglRectangle *dest_rect,
+                               gboolean             transpose,
+                               gboolean             flip_x,
+                               gboolean             flip_y)
+{
+  TransformTiles tiles;
+
+  if (dest_rect->width < 1 || dest_rect->height < 1)
+    return;
+
+  tiles.src_buffer  = src_buffer;
+  tiles.dest_buffer = dest_buffer;
+  tiles.format      = gegl_buffer_get_format (dest_buffer);
+  tiles.bpp         = babl_format_get_bytes_per_pixel (tiles.format);
+  tiles.src_rect    = *src_rect;
+  tiles.dest_rect   = *dest_rect;
+  tiles.transpose   = transpose;
+  tiles.flip_x      = flip_x;
+  tiles.flip_y      = flip_y;
+
+  g_object_get (dest_buffer,
+                "tile-width",  &tiles.tile_width,
+                "tile-height", &tiles.tile_height,
+                NULL);
+
+  gimp_parallel_distribute_area (dest_rect, MIN_PARALLEL_SUB_AREA,
+                                 (GimpParallelDistributeAreaFunc)
+                                 gimp_drawable_transform_tiles_area,
+                                 &tiles);
+}
+
+static void
+gimp_drawable_transform_tiles_area (const GeglRectangle *area,
+                                    TransformTiles      *tiles)
+{
+  const gint  bpp = tiles->bpp;
+  guchar     *src_data;
+  guchar     *dest_data;
+  gint        x, y;
+
+  src_data  = g_malloc ((gsize) tiles->tile_width * tiles->tile_height * bpp);
+  dest_data = g_malloc ((gsize) tiles->tile_width * tiles->tile_height * bpp);
+
+  for (y = area->y; y < area->y + area->height; )
+    {
+      gint height = MIN ((y / tiles->tile_height + 1) * tiles->tile_height,
+                         area->y + area->height) - y;
+
+      for (x = area->x; x < area->x + area->width; )
+        {
+          gint           width = MIN ((x / tiles->tile_width + 1) * tiles->tile_width,
+                                      area->x + area->width) - x;
+          GeglRectangle  src_tile;
+          gint           a, b;
+          gint           step_a;
+          gint           step_b;
+          const guchar  *src;
+
+          /*  find the source rectangle, in (a, b) space  */
+          if (tiles->transpose)
+            {
+              a               = y - tiles->dest_rect.y;
+              b               = x - tiles->dest_rect.x;
+              src_tile.width  = height;
+              src_tile.height = width;
+            }
+          else
+            {
+              a               = x - tiles->dest_rect.x;
+              b               = y - tiles->dest_rect.y;
+              src_tile.width  = width;
+              src_tile.height = height;
+            }
+
+          if (tiles->flip_x)
+            a = tiles->src_rect.width - a - src_tile.width;
+
+          if (tiles->flip_y)
+            b = tiles->src_rect.height - b - src_tile.height;
+
+          src_tile.x = tiles->src_rect.x + a;
+          src_tile.y = tiles->src_rect.y + b;
+
+          gegl_buffer_get (tiles->src_buffer, &src_tile, 1.0,
+                           tiles->format, src_data,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+          /*  walk the source so that it fills the destination in order  */
+          src    = src_data;
+          step_a = bpp;
+          step_b = src_tile.width * bpp;
+
+          if (tiles->flip_x)
+            {
+              src    += (src_tile.width - 1) * step_a;
+              step_a  = -step_a;
+            }
+
+          if (tiles->flip_y)
+            {
+              src    += (src_tile.height - 1) * step_b;
+              step_b  = -step_b;
+            }
+
+          if (tiles->transpose)
+            gimp_drawable_transform_tiles_copy (dest_data, src,
+                                                width, height, bpp,
+                                                step_b, step_a);
+          else
+            gimp_drawable_transform_tiles_copy (dest_data, src,
+                                                width, height, bpp,
+                                                step_a, step_b);
+
+          gegl_buffer_set (tiles->dest_buffer,
+                           GEGL_RECTANGLE (x, y, width, height), 0,
+                           tiles->format, dest_data,
+                           GEGL_AUTO_ROWSTRIDE);
+
+          x += width;
+        }
+
+      y += height;
+    }
+
+  g_free (dest_data);
+  g_free (src_data);
+}
+
+/*  fills width x height pixels of dest, which are contiguous, from src,
+ *  moving by src_step_x bytes to the right, and src_step_y bytes down.
+ *  the pixel size is a constant in each case, so the compiler can turn
+ *  each memcpy() into a single move.
+ */
+#define TRANSFORM_TILES_COPY(size)                                      \
+  for (y = 0; y < height; y++)                                          \
+    {                                                                   \
+      const guchar *s = src + (gssize) y * src_step_y;                  \
+                                                                        \
+      for (x = 0; x < width; x++)                                       \
+        {                                                               \
+          memcpy (dest, s, (size));                                     \
+                                                                        \
+          dest += (size);                                               \
+          s    += src_step_x;                                           \
+        }                                                               \
+    }
+
+static void
+gimp_drawable_transform_tiles_copy (guchar       *dest,
+                                    const guchar *src,
+                                    gint          width,
+                                    gint          height,
+                                    gint          bpp,
+                                    gint          src_step_x,
+                                    gint          src_step_y)
+{
+  gint x, y;
+
+  if (src_step_x == bpp)
+    {
+      /*  rows are only moved, not mirrored  */
+      for (y = 0; y < height; y++)
+        {
+          memcpy (dest, src + (gssize) y * src_step_y, width * bpp);
+
+          dest += width * bpp;
+        }
+
+      return;
+    }
+
+  switch (bpp)
+    {
+    case 1:  TRANSFORM_TILES_COPY (1);   break;
+    case 2:  TRANSFORM_TILES_COPY (2);   break;
+    case 3:  TRANSFORM_TILES_COPY (3);   break;
+    case 4:  TRANSFORM_TILES_COPY (4);   break;
+    case 6:  TRANSFORM_TILES_COPY (6);   break;
+    case 8:  TRANSFORM_TILES_COPY (8);   break;
+    case 12: TRANSFORM_TILES_COPY (12);  break;
+    case 16: TRANSFORM_TILES_COPY (16);  break;
+    default: TRANSFORM_TILES_COPY (bpp); break;
+    }
+}
+
+#undef TRANSFORM_TILES_COPY
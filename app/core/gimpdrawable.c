@@ -318,6 +318,12 @@ gimp_drawable_finalize (GObject *object)
 
   gimp_drawable_free_shadow_buffer (drawable);
 
+  if (drawable->private->scaled_buffer)
+    {
+      g_object_unref (drawable->private->scaled_buffer);
+      drawable->private->scaled_buffer = NULL;
+    }
+
   if (drawable->private->source_node)
     {
       g_object_unref (drawable->private->source_node);
@@ -517,18 +523,33 @@ gimp_drawable_scale (GimpItem              *item,
   GimpDrawable *drawable = GIMP_DRAWABLE (item);
   GeglBuffer   *new_buffer;
 
-  new_buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0,
-                                                new_width, new_height),
-                                gimp_drawable_get_format (drawable));
+  /*  use the buffer scaled ahead of time, if it has the right size  */
+  new_buffer = drawable->private->scaled_buffer;
+  drawable->private->scaled_buffer = NULL;
 
-  gimp_gegl_apply_scale (gimp_drawable_get_buffer (drawable),
-                         progress, C_("undo-type", "Scale"),
-                         new_buffer,
-                         interpolation_type,
-                         ((gdouble) new_width /
-                          gimp_item_get_width  (item)),
-                         ((gdouble) new_height /
-                          gimp_item_get_height (item)));
+  if (new_buffer &&
+      (gegl_buffer_get_width  (new_buffer) != new_width ||
+       gegl_buffer_get_height (new_buffer) != new_height))
+    {
+      g_object_unref (new_buffer);
+      new_buffer = NULL;
+    }
+
+  if (! new_buffer)
+    {
+      new_buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0,
+                                                    new_width, new_height),
+                                    gimp_drawable_get_format (drawable));
+
+      gimp_gegl_apply_scale (gimp_drawable_get_buffer (drawable),
+                             progress, C_("undo-type", "Scale"),
+                             new_buffer,
+                             interpolation_type,
+                             ((gdouble) new_width /
+                              gimp_item_get_width  (item)),
+                             ((gdouble) new_height /
+                              gimp_item_get_height (item)));
+    }
 
   gimp_drawable_set_buffer_full (drawable, gimp_item_is_attached (item), NULL,
                                  new_buffer,
@@ -1393,6 +1414,26 @@ gimp_drawable_set_buffer_full (GimpDrawable *drawable,
                         gimp_item_get_height (item));
 }
 
+/*  sets the result of the next gimp_item_scale() of @drawable, which
+ *  is used if it has the requested size.  this allows for scaling
+ *  drawables ahead of time, see gimp_image_scale().
+ */
+void
+gimp_drawable_set_scaled_buffer (GimpDrawable *drawable,
+                                 GeglBuffer   *buffer)
+{
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
+  g_return_if_fail (buffer == NULL || GEGL_IS_BUFFER (buffer));
+
+  if (buffer)
+    g_object_ref (buffer);
+
+  if (drawable->private->scaled_buffer)
+    g_object_unref (drawable->private->scaled_buffer);
+
+  drawable->private->scaled_buffer = buffer;
+}
+
 GeglNode *
 gimp_drawable_get_source_node (GimpDrawable *drawable)
 {
@@ -177,6 +177,9 @@ void            gimp_drawable_set_buffer_full    (GimpDrawable       *drawable,
                                                   gint                offset_x,
                                                   gint                offset_y);
 
+void            gimp_drawable_set_scaled_buffer  (GimpDrawable       *drawable,
+                                                  GeglBuffer         *buffer);
+
 GeglNode      * gimp_drawable_get_source_node    (GimpDrawable       *drawable);
 GeglNode      * gimp_drawable_get_mode_node      (GimpDrawable       *drawable);
 
@@ -30,18 +30,124 @@
 
 #include "gegl/gimp-babl.h"
 
+#include "gimp-parallel.h"
 #include "gimpdrawable.h"
 #include "gimpimage.h"
 #include "gimpimage-contiguous-region.h"
 #include "gimppickable.h"
 
 
+/*  the flood fill reads the source and writes the mask in strips of
+ *  full-width rows, keeping a few of them cached at once
+ */
+#define STRIP_HEIGHT 64
+#define N_STRIPS     4
+
+/*  don't bother splitting select-by-color into pieces smaller than this  */
+#define MIN_PARALLEL_SUB_AREA (64 * 64)
+
+
+typedef struct
+{
+  gint      y;          /*  first row of the strip, -1 if unused  */
+  gint      height;
+  gfloat   *src;
+  gfloat   *mask;
+  gint      dirty_y1;   /*  rows [dirty_y1, dirty_y2) need writing back  */
+  gint      dirty_y2;
+  guint     stamp;
+} ContiguousStrip;
+
+typedef struct
+{
+  gint start;
+  gint end;
+} ContiguousSpan;
+
+typedef struct
+{
+  gint y;
+  gint start;
+  gint end;
+} ContiguousSeed;
+
+typedef struct
+{
+  GeglBuffer          *src_buffer;
+  GeglBuffer          *mask_buffer;
+  const Babl          *format;
+  gint                 n_components;
+  gboolean             has_alpha;
+  gboolean             select_transparent;
+  GimpSelectCriterion  select_criterion;
+  gboolean             antialias;
+  gfloat               threshold;
+  const gfloat        *col;
+
+  gint                 width;
+  gint                 height;
+
+  ContiguousStrip      strips[N_STRIPS];
+  guint                stamp;
+
+  /*  per row, a sorted array of the already filled ContiguousSpans  */
+  GArray             **filled;
+} ContiguousRegion;
+
+/*  computes the distance between @col and @count pixels of @src, which
+ *  are @stride floats apart, using @n_colors components where relevant
+ */
+typedef void (* ColorDistanceFunc) (const gfloat *col,
+                                    const gfloat *src,
+                                    gfloat       *dest,
+                                    gint          stride,
+                                    gint          n_colors,
+                                    gint          count);
+
+typedef struct
+{
+  GeglBuffer        *src_buffer;
+  GeglBuffer        *mask_buffer;
+  const Babl        *format;
+  gint               n_components;
+  gboolean           has_alpha;
+  gboolean           select_transparent;
+  gboolean           antialias;
+  gfloat             threshold;
+  const gfloat      *col;
+
+  ColorDistanceFunc  distance_func;
+  gint               distance_offset;
+  gint               distance_n_colors;
+} ContiguousByColor;
+
+
 /*  local function prototypes  */
 
 static const Babl * choose_format         (GeglBuffer          *buffer,
                                            GimpSelectCriterion  select_criterion,
                                            gint                *n_components,
                                            gboolean            *has_alpha);
+static void     color_distance_composite  (const gfloat        *col,
+                                           const gfloat        *src,
+                                           gfloat              *dest,
+                                           gint                 stride,
+                                           gint                 n_colors,
+                                           gint                 count);
+static void     color_distance_channel    (const gfloat        *col,
+                                           const gfloat        *src,
+                                           gfloat              *dest,
+                                           gint                 stride,
+                                           gint                 n_colors,
+                                           gint                 count);
+static void     color_distance_hue        (const gfloat        *col,
+                                           const gfloat        *src,
+                                           gfloat              *dest,
+                                           gint                 stride,
+                                           gint                 n_colors,
+                                           gint                 count);
+static void     contiguous_by_color_area  (const GeglRectangle *area,
+                                           ContiguousByColor   *data);
 static gfloat   pixel_difference          (const gfloat        *col1,
                                            const gfloat        *col2,
                                            gboolean             antialias,
@@ -50,33 +156,36 @@ static gfloat   pixel_difference          (const gfloat        *col1,
                                            gboolean             has_alpha,
                                            gboolean             select_transparent,
                                            GimpSelectCriterion  select_criterion);
-static gboolean find_contiguous_segment   (const gfloat        *col,
-                                           GeglBuffer          *src_buffer,
-                                           GeglBuffer          *mask_buffer,
-                                           const Babl          *src_format,
-                                           gint                 n_components,
-                                           gboolean             has_alpha,
-                                           gint                 width,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 initial_x,
-                                           gint                 initial_y,
-                                           gint                *start,
-                                           gint                *end);
-static void find_contiguous_region_helper (GeglBuffer          *src_buffer,
-                                           GeglBuffer          *mask_buffer,
-                                           const Babl          *format,
-                                           gint                 n_components,
-                                           gboolean             has_alpha,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 x,
-                                           gint                 y,
-                                           const gfloat        *col);
+static ContiguousStrip *
+                contiguous_region_get_strip    (ContiguousRegion    *region,
+                                                gint                 y);
+static void     contiguous_region_flush_strip  (ContiguousRegion    *region,
+                                                ContiguousStrip     *strip);
+static gboolean contiguous_region_is_filled    (ContiguousRegion    *region,
+                                                gint                 x,
+                                                gint                 y,
+                                                gint                *span_end);
+static void     contiguous_region_add_span     (ContiguousRegion    *region,
+                                                gint                 y,
+                                                gint                 start,
+                                                gint                 end);
+static gboolean find_contiguous_segment        (ContiguousRegion    *region,
+                                                gint                 initial_x,
+                                                gint                 initial_y,
+                                                gint                *start,
+                                                gint                *end);
+static void find_contiguous_region_helper      (GeglBuffer          *src_buffer,
+                                                GeglBuffer          *mask_buffer,
+                                                const Babl          *format,
+                                                gint                 n_components,
+                                                gboolean             has_alpha,
+                                                gboolean             select_transparent,
+                                                GimpSelectCriterion  select_criterion,
+                                                gboolean             antialias,
+                                                gfloat               threshold,
+                                                gint                 x,
+                                                gint                 y,
+                                                const gfloat        *col);
 
 
 /*  public functions  */
@@ -162,14 +271,14 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
    *  fuzzy_select.  Modify the image's mask to reflect the
    *  additional selection
    */
-  GeglBufferIterator *iter;
-  GimpPickable       *pickable;
-  GeglBuffer         *src_buffer;
-  GeglBuffer         *mask_buffer;
-  const Babl         *format;
-  gint                n_components;
-  gboolean            has_alpha;
-  gfloat              start_col[MAX_CHANNELS];
+  GimpPickable      *pickable;
+  GeglBuffer        *src_buffer;
+  GeglBuffer        *mask_buffer;
+  const Babl        *format;
+  gint               n_components;
+  gboolean           has_alpha;
+  gfloat             start_col[MAX_CHANNELS];
+  ContiguousByColor  data;
 
   g_return_val_if_fail (GIMP_IS_IMAGE (image), NULL);
   g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), NULL);
@@ -207,36 +316,64 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
   mask_buffer = gegl_buffer_new (gegl_buffer_get_extent (src_buffer),
                                  babl_format ("Y float"));
 
-  iter = gegl_buffer_iterator_new (src_buffer,
-                                   NULL, 0, format,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+  data.src_buffer         = src_buffer;
+  data.mask_buffer        = mask_buffer;
+  data.format             = format;
+  data.n_components       = n_components;
+  data.has_alpha          = has_alpha;
+  data.select_transparent = select_transparent;
+  data.antialias          = antialias;
+  data.threshold          = threshold;
+  data.col                = start_col;
+  data.distance_func      = color_distance_composite;
+  data.distance_offset    = 0;
+  data.distance_n_colors  = has_alpha ? n_components - 1 : n_components;
+
+  /*  pick the distance function once, so the per-pixel loops don't
+   *  have to look at select_criterion
+   */
+  if (select_transparent)
+    {
+      data.distance_func   = color_distance_channel;
+      data.distance_offset = n_components - 1;
+    }
+  else
+    {
+      switch (select_criterion)
+        {
+        case GIMP_SELECT_CRITERION_COMPOSITE:
+          break;
 
-  gegl_buffer_iterator_add (iter, mask_buffer,
-                            NULL, 0, babl_format ("Y float"),
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+        case GIMP_SELECT_CRITERION_R:
+          data.distance_func   = color_distance_channel;
+          data.distance_offset = 0;
+          break;
 
-  while (gegl_buffer_iterator_next (iter))
-    {
-      const gfloat *src   = iter->data[0];
-      gfloat       *dest  = iter->data[1];
-      gint          count = iter->length;
+        case GIMP_SELECT_CRITERION_H:
+          data.distance_func   = color_distance_hue;
+          data.distance_offset = 0;
+          break;
 
-      while (count--)
-        {
-          /*  Find how closely the colors match  */
-          *dest = pixel_difference (start_col, src,
-                                    antialias,
-                                    threshold,
-                                    n_components,
-                                    has_alpha,
-                                    select_transparent,
-                                    select_criterion);
-
-          src  += n_components;
-          dest += 1;
+        case GIMP_SELECT_CRITERION_G:
+        case GIMP_SELECT_CRITERION_S:
+          data.distance_func   = color_distance_channel;
+          data.distance_offset = 1;
+          break;
+
+        case GIMP_SELECT_CRITERION_B:
+        case GIMP_SELECT_CRITERION_V:
+          data.distance_func   = color_distance_channel;
+          data.distance_offset = 2;
+          break;
         }
     }
 
+  gimp_parallel_distribute_area (gegl_buffer_get_extent (src_buffer),
+                                 MIN_PARALLEL_SUB_AREA,
+                                 (GimpParallelDistributeAreaFunc)
+                                 contiguous_by_color_area,
+                                 &data);
+
   return mask_buffer;
 }
 
@@ -286,6 +423,135 @@ choose_format (GeglBuffer          *buffer,
   return format;
 }
 
+static void
+color_distance_composite (const gfloat *col,
+                          const gfloat *src,
+                          gfloat       *dest,
+                          gint          stride,
+                          gint          n_colors,
+                          gint          count)
+{
+  while (count--)
+    {
+      gfloat max = 0.0;
+      gint   b;
+
+      for (b = 0; b < n_colors; b++)
+        {
+          gfloat diff = fabs (col[b] - src[b]);
+
+          if (diff > max)
+            max = diff;
+        }
+
+      *dest++ = max;
+      src += stride;
+    }
+}
+
+static void
+color_distance_channel (const gfloat *col,
+                        const gfloat *src,
+                        gfloat       *dest,
+                        gint          stride,
+                        gint          n_colors,
+                        gint          count)
+{
+  const gfloat c = *col;
+
+  while (count--)
+    {
+      *dest++ = fabs (c - *src);
+      src += stride;
+    }
+}
+
+static void
+color_distance_hue (const gfloat *col,
+                    const gfloat *src,
+                    gfloat       *dest,
+                    gint          stride,
+                    gint          n_colors,
+                    gint          count)
+{
+  const gfloat c = *col;
+
+  while (count--)
+    {
+      /* wrap around candidates for the actual distance */
+      gfloat dist1 = fabs (c - *src);
+      gfloat dist2 = fabs (c - 1.0 - *src);
+      gfloat dist3 = fabs (c - *src + 1.0);
+      gfloat max;
+
+      max = MIN (dist1, dist2);
+      if (max > dist3)
+        max = dist3;
+
+      *dest++ = max;
+      src += stride;
+    }
+}
+
+static void
+contiguous_by_color_area (const GeglRectangle *area,
+                          ContiguousByColor   *data)
+{
+  GeglBufferIterator *iter;
+  const gint          n_components = data->n_components;
+  const gfloat        threshold    = data->threshold;
+
+  iter = gegl_buffer_iterator_new (data->src_buffer,
+                                   area, 0, data->format,
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  gegl_buffer_iterator_add (iter, data->mask_buffer,
+                            area, 0, babl_format ("Y float"),
+                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *src   = iter->data[0];
+      gfloat       *dest  = iter->data[1];
+      gint          count = iter->length;
+      gint          i;
+
+      /*  Find how closely the colors match  */
+      data->distance_func (data->col + data->distance_offset,
+                           src + data->distance_offset,
+                           dest,
+                           n_components, data->distance_n_colors,
+                           count);
+
+      if (data->antialias && threshold > 0.0)
+        {
+          for (i = 0; i < count; i++)
+            {
+              gfloat aa = 2.0 * (1.5 - (dest[i] / threshold));
+
+              dest[i] = CLAMP (aa, 0.0, 1.0);
+            }
+        }
+      else
+        {
+          for (i = 0; i < count; i++)
+            dest[i] = dest[i] > threshold ? 0.0 : 1.0;
+        }
+
+      /*  if there is an alpha channel, never select transparent regions  */
+      if (data->has_alpha && ! data->select_transparent)
+        {
+          const gfloat *alpha = src + n_components - 1;
+
+          for (i = 0; i < count; i++)
+            {
+              if (alpha[i * n_components] == 0.0)
+                dest[i] = 0.0;
+            }
+        }
+    }
+}
+
 static gfloat
 pixel_difference (const gfloat        *col1,
                   const gfloat        *col2,
@@ -380,79 +646,220 @@ pixel_difference (const gfloat        *col1,
     }
 }
 
-static gboolean
-find_contiguous_segment (const gfloat        *col,
-                         GeglBuffer          *src_buffer,
-                         GeglBuffer          *mask_buffer,
-                         const Babl          *format,
-                         gint                 n_components,
-                         gboolean             has_alpha,
-                         gint                 width,
-                         gboolean             select_transparent,
-                         GimpSelectCriterion  select_criterion,
-                         gboolean             antialias,
-                         gfloat               threshold,
-                         gint                 initial_x,
-                         gint                 initial_y,
-                         gint                *start,
-                         gint                *end)
+static ContiguousStrip *
+contiguous_region_get_strip (ContiguousRegion *region,
+                             gint              y)
 {
-  gfloat s[MAX_CHANNELS];
-  gfloat mask_row[width];
-  gfloat diff;
+  ContiguousStrip *strip   = NULL;
+  gint             strip_y = y - y % STRIP_HEIGHT;
+  gint             i;
 
-  gegl_buffer_sample (src_buffer, initial_x, initial_y, NULL, s, format,
-                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+  region->stamp++;
 
-  diff = pixel_difference (col, s, antialias, threshold,
-                           n_components, has_alpha, select_transparent,
-                           select_criterion);
+  for (i = 0; i < N_STRIPS; i++)
+    {
+      ContiguousStrip *s = &region->strips[i];
 
-  /* check the starting pixel */
-  if (! diff)
+      if (s->y == strip_y)
+        {
+          s->stamp = region->stamp;
+
+          return s;
+        }
+
+      /*  prefer unused strips, otherwise the least recently used one  */
+      if (! strip || s->y < 0 ||
+          (strip->y >= 0 && s->stamp < strip->stamp))
+        {
+          strip = s;
+        }
+    }
+
+  contiguous_region_flush_strip (region, strip);
+
+  if (! strip->src)
+    {
+      strip->src  = g_new (gfloat, (gsize) region->width * STRIP_HEIGHT *
+                                   region->n_components);
+      strip->mask = g_new (gfloat, (gsize) region->width * STRIP_HEIGHT);
+    }
+
+  strip->y        = strip_y;
+  strip->height   = MIN (STRIP_HEIGHT, region->height - strip_y);
+  strip->dirty_y1 = strip->height;
+  strip->dirty_y2 = 0;
+  strip->stamp    = region->stamp;
+
+  gegl_buffer_get (region->src_buffer,
+                   GEGL_RECTANGLE (0, strip->y, region->width, strip->height),
+                   1.0, region->format, strip->src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  gegl_buffer_get (region->mask_buffer,
+                   GEGL_RECTANGLE (0, strip->y, region->width, strip->height),
+                   1.0, babl_format ("Y float"), strip->mask,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  return strip;
+}
+
+static void
+contiguous_region_flush_strip (ContiguousRegion *region,
+                               ContiguousStrip  *strip)
+{
+  if (strip->y >= 0 && strip->dirty_y1 < strip->dirty_y2)
+    {
+      gegl_buffer_set (region->mask_buffer,
+                       GEGL_RECTANGLE (0, strip->y + strip->dirty_y1,
+                                       region->width,
+                                       strip->dirty_y2 - strip->dirty_y1),
+                       0, babl_format ("Y float"),
+                       strip->mask + (gsize) strip->dirty_y1 * region->width,
+                       GEGL_AUTO_ROWSTRIDE);
+
+      strip->dirty_y1 = strip->height;
+      strip->dirty_y2 = 0;
+    }
+}
+
+static gboolean
+contiguous_region_is_filled (ContiguousRegion *region,
+                             gint              x,
+                             gint              y,
+                             gint             *span_end)
+{
+  GArray *spans = region->filled[y];
+  gint    lo, hi;
+
+  if (! spans)
     return FALSE;
 
-  mask_row[initial_x] = diff;
+  /*  find the last span starting at or before x  */
+  lo = 0;
+  hi = spans->len;
+
+  while (lo < hi)
+    {
+      gint mid = (lo + hi) / 2;
+
+      if (g_array_index (spans, ContiguousSpan, mid).start <= x)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  if (lo > 0)
+    {
+      ContiguousSpan *span = &g_array_index (spans, ContiguousSpan, lo - 1);
 
-  *start = initial_x - 1;
+      if (x < span->end)
+        {
+          *span_end = span->end;
+
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+static void
+contiguous_region_add_span (ContiguousRegion *region,
+                            gint              y,
+                            gint              start,
+                            gint              end)
+{
+  GArray         *spans = region->filled[y];
+  ContiguousSpan  span  = { start, end };
+  gint            lo, hi;
 
-  while (*start >= 0 && diff)
+  if (! spans)
     {
-      gegl_buffer_sample (src_buffer, *start, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+      spans = g_array_new (FALSE, FALSE, sizeof (ContiguousSpan));
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+      region->filled[y] = spans;
+    }
+
+  /*  spans are maximal runs of matching pixels, so they never overlap  */
+  lo = 0;
+  hi = spans->len;
 
-      mask_row[*start] = diff;
+  while (lo < hi)
+    {
+      gint mid = (lo + hi) / 2;
 
-      if (diff)
-        (*start)--;
+      if (g_array_index (spans, ContiguousSpan, mid).start < start)
+        lo = mid + 1;
+      else
+        hi = mid;
     }
 
-  diff = 1;
-  *end = initial_x + 1;
+  g_array_insert_val (spans, lo, span);
+}
+
+static gboolean
+find_contiguous_segment (ContiguousRegion *region,
+                         gint              initial_x,
+                         gint              initial_y,
+                         gint             *start,
+                         gint             *end)
+{
+  ContiguousStrip *strip;
+  const gfloat    *src;
+  gfloat          *mask;
+  gint             n_components = region->n_components;
+  gint             row;
+  gfloat           diff;
+
+  strip = contiguous_region_get_strip (region, initial_y);
+  row   = initial_y - strip->y;
+  src   = strip->src  + (gsize) row * region->width * n_components;
+  mask  = strip->mask + (gsize) row * region->width;
+
+  diff = pixel_difference (region->col, src + initial_x * n_components,
+                           region->antialias, region->threshold,
+                           n_components, region->has_alpha,
+                           region->select_transparent,
+                           region->select_criterion);
+
+  /* check the starting pixel */
+  if (! diff)
+    return FALSE;
 
-  while (*end < width && diff)
+  mask[initial_x] = diff;
+
+  for (*start = initial_x - 1; *start >= 0; (*start)--)
     {
-      gegl_buffer_sample (src_buffer, *end, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+      diff = pixel_difference (region->col, src + *start * n_components,
+                               region->antialias, region->threshold,
+                               n_components, region->has_alpha,
+                               region->select_transparent,
+                               region->select_criterion);
+
+      if (! diff)
+        break;
+
+      mask[*start] = diff;
+    }
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+  for (*end = initial_x + 1; *end < region->width; (*end)++)
+    {
+      diff = pixel_difference (region->col, src + *end * n_components,
+                               region->antialias, region->threshold,
+                               n_components, region->has_alpha,
+                               region->select_transparent,
+                               region->select_criterion);
 
-      mask_row[*end] = diff;
+      if (! diff)
+        break;
 
-      if (diff)
-        (*end)++;
+      mask[*end] = diff;
     }
 
-  gegl_buffer_set (mask_buffer, GEGL_RECTANGLE (*start, initial_y,
-                                                *end - *start, 1),
-                   0, babl_format ("Y float"), &mask_row[*start],
-                   GEGL_AUTO_ROWSTRIDE);
+  strip->dirty_y1 = MIN (strip->dirty_y1, row);
+  strip->dirty_y2 = MAX (strip->dirty_y2, row + 1);
+
+  contiguous_region_add_span (region, initial_y, *start + 1, *end);
 
   return TRUE;
 }
@@ -471,63 +878,106 @@ find_contiguous_region_helper (GeglBuffer          *src_buffer,
                                gint                 y,
                                const gfloat        *col)
 {
-  gint    start, end;
-  gint    new_start, new_end;
-  GQueue *coord_stack;
-
-  coord_stack = g_queue_new ();
-
-  /* To avoid excessive memory allocation (y, start, end) tuples are
-   * stored in interleaved format:
-   *
-   * [y1] [start1] [end1] [y2] [start2] [end2]
+  ContiguousRegion region = { 0, };
+  ContiguousSeed   seed;
+  GArray          *seed_stack;
+  gint             new_start, new_end;
+  gint             i;
+
+  region.src_buffer         = src_buffer;
+  region.mask_buffer        = mask_buffer;
+  region.format             = format;
+  region.n_components       = n_components;
+  region.has_alpha          = has_alpha;
+  region.select_transparent = select_transparent;
+  region.select_criterion   = select_criterion;
+  region.antialias          = antialias;
+  region.threshold          = threshold;
+  region.col                = col;
+  region.width              = gegl_buffer_get_width (src_buffer);
+  region.height             = gegl_buffer_get_height (src_buffer);
+
+  if (x < 0 || x >= region.width ||
+      y < 0 || y >= region.height)
+    return;
+
+  for (i = 0; i < N_STRIPS; i++)
+    region.strips[i].y = -1;
+
+  region.filled = g_new0 (GArray *, region.height);
+
+  seed_stack = g_array_new (FALSE, FALSE, sizeof (ContiguousSeed));
+
+  /*  seeds are (y, start, end) where the pixels between start and end,
+   *  both exclusive, are to be checked
    */
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (y));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x - 1));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x + 1));
+  seed.y     = y;
+  seed.start = x - 1;
+  seed.end   = x + 1;
+
+  g_array_append_val (seed_stack, seed);
 
   do
     {
-      y     = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      start = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      end   = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
+      gint start, end;
+
+      seed = g_array_index (seed_stack, ContiguousSeed, seed_stack->len - 1);
+      g_array_set_size (seed_stack, seed_stack->len - 1);
+
+      y     = seed.y;
+      start = seed.start;
+      end   = seed.end;
 
       for (x = start + 1; x < end; x++)
         {
-          gfloat val;
+          gint span_end;
 
-          gegl_buffer_sample (mask_buffer, x, y, NULL, &val,
-                              babl_format ("Y float"),
-                              GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-          if (val != 0.0)
-            continue;
+          if (contiguous_region_is_filled (&region, x, y, &span_end))
+            {
+              x = span_end - 1;
+              continue;
+            }
 
-          if (! find_contiguous_segment (col, src_buffer, mask_buffer,
-                                         format,
-                                         n_components,
-                                         has_alpha,
-                                         gegl_buffer_get_width (src_buffer),
-                                         select_transparent, select_criterion,
-                                         antialias, threshold, x, y,
+          if (! find_contiguous_segment (&region, x, y,
                                          &new_start, &new_end))
             continue;
 
-          if (y + 1 < gegl_buffer_get_height (src_buffer))
+          seed.start = new_start;
+          seed.end   = new_end;
+
+          if (y + 1 < region.height)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y + 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              seed.y = y + 1;
+              g_array_append_val (seed_stack, seed);
             }
 
           if (y - 1 >= 0)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y - 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              seed.y = y - 1;
+              g_array_append_val (seed_stack, seed);
             }
+
+          /*  everything up to new_end is now filled or doesn't match  */
+          x = new_end;
         }
     }
-  while (! g_queue_is_empty (coord_stack));
+  while (seed_stack->len > 0);
+
+  g_array_free (seed_stack, TRUE);
+
+  for (i = 0; i < N_STRIPS; i++)
+    {
+      contiguous_region_flush_strip (&region, &region.strips[i]);
+
+      g_free (region.strips[i].src);
+      g_free (region.strips[i].mask);
+    }
+
+  for (i = 0; i < region.height; i++)
+    {
+      if (region.filled[i])
+        g_array_free (region.filled[i], TRUE);
+    }
 
-  g_queue_free (coord_stack);
+  g_free (region.filled);
 }
@@ -21,7 +21,13 @@
 
 #include "core-types.h"
 
+#include "config/gimpgeglconfig.h"
+
+#include "gegl/gimp-gegl-apply-operation.h"
+
 #include "gimp.h"
+#include "gimp-parallel.h"
+#include "gimpchannel.h"
 #include "gimpcontainer.h"
 #include "gimpguide.h"
 #include "gimpgrouplayer.h"
@@ -33,6 +39,7 @@
 #include "gimpimage-undo.h"
 #include "gimpimage-undo-push.h"
 #include "gimplayer.h"
+#include "gimplayermask.h"
 #include "gimpprogress.h"
 #include "gimpprojection.h"
 #include "gimpsamplepoint.h"
@@ -42,6 +49,69 @@
 #include "gimp-intl.h"
 
 
+/*  a drawable, or a layer and its mask, to be scaled ahead of time  */
+typedef struct
+{
+  GimpItem   *item;
+  gint        width;
+  gint        height;
+  gint64      memsize;
+
+  GeglBuffer *src_buffer;
+  GeglBuffer *src_mask_buffer;
+  GeglBuffer *buffer;
+  GeglBuffer *mask_buffer;
+  gboolean    done;
+} ImageScaleJob;
+
+typedef struct
+{
+  GimpImage             *image;
+  GimpProgress          *sub_progress;
+  GList                 *all_layers;
+  GList                 *all_channels;
+  GList                 *all_vectors;
+  gint                   new_width;
+  gint                   new_height;
+  gdouble                img_scale_w;
+  gdouble                img_scale_h;
+  GimpInterpolationType  interpolation_type;
+
+  ImageScaleJob         *jobs;
+  gint                   n_jobs;
+  gint                   next_commit; /* only used by the calling thread */
+
+  GMutex                 mutex;
+  GCond                  cond;
+  gint                   next_job;    /* the next job to be started     */
+  gint64                 memsize;     /* memsize of the running jobs    */
+  gint64                 max_memsize;
+} ImageScale;
+
+
+/*  local function prototypes  */
+
+static void            gimp_image_scale_add_job    (ImageScale    *scale,
+                                                    GimpItem      *item,
+                                                    gint           width,
+                                                    gint           height);
+static void            gimp_image_scale_distribute (gint           i,
+                                                    gint           n,
+                                                    ImageScale    *scale);
+static void            gimp_image_scale_items      (ImageScale    *scale);
+static void            gimp_image_scale_finish_job (ImageScale    *scale,
+                                                    GimpItem      *item);
+static ImageScaleJob * gimp_image_scale_start_job  (ImageScale    *scale);
+static void            gimp_image_scale_run_job    (ImageScale    *scale,
+                                                    ImageScaleJob *job);
+static GeglBuffer    * gimp_image_scale_buffer     (GeglBuffer    *src_buffer,
+                                                    gint           width,
+                                                    gint           height,
+                                                    GimpInterpolationType interpolation_type);
+
+
+/*  public functions  */
+
 void
 gimp_image_scale (GimpImage             *image,
                   gint                   new_width,
@@ -49,19 +119,13 @@ gimp_image_scale (GimpImage             *image,
                   GimpInterpolationType  interpolation_type,
                   GimpProgress          *progress)
 {
-  GimpProgress *sub_progress;
-  GList        *all_layers;
-  GList        *all_channels;
-  GList        *all_vectors;
-  GList        *list;
-  gint          old_width;
-  gint          old_height;
-  gint          offset_x;
-  gint          offset_y;
-  gdouble       img_scale_w      = 1.0;
-  gdouble       img_scale_h      = 1.0;
-  gint          progress_steps;
-  gint          progress_current = 0;
+  ImageScale  scale = { 0, };
+  GList      *list;
+  gint        old_width;
+  gint        old_height;
+  gint        offset_x;
+  gint        offset_y;
+  gint        i;
 
   g_return_if_fail (GIMP_IS_IMAGE (image));
   g_return_if_fail (new_width > 0 && new_height > 0);
@@ -69,26 +133,24 @@ gimp_image_scale (GimpImage             *image,
 
   gimp_set_busy (image->gimp);
 
-  sub_progress = gimp_sub_progress_new (progress);
-
-  all_layers   = gimp_image_get_layer_list (image);
-  all_channels = gimp_image_get_channel_list (image);
-  all_vectors  = gimp_image_get_vectors_list (image);
-
-  progress_steps = (g_list_length (all_layers)   +
-                    g_list_length (all_channels) +
-                    g_list_length (all_vectors)  +
-                    1 /* selection */);
+  scale.image              = image;
+  scale.sub_progress       = gimp_sub_progress_new (progress);
+  scale.all_layers         = gimp_image_get_layer_list (image);
+  scale.all_channels       = gimp_image_get_channel_list (image);
+  scale.all_vectors        = gimp_image_get_vectors_list (image);
+  scale.new_width          = new_width;
+  scale.new_height         = new_height;
+  scale.interpolation_type = interpolation_type;
 
   g_object_freeze_notify (G_OBJECT (image));
 
   gimp_image_undo_group_start (image, GIMP_UNDO_GROUP_IMAGE_SCALE,
                                C_("undo-type", "Scale Image"));
 
-  old_width   = gimp_image_get_width  (image);
-  old_height  = gimp_image_get_height (image);
-  img_scale_w = (gdouble) new_width  / (gdouble) old_width;
-  img_scale_h = (gdouble) new_height / (gdouble) old_height;
+  old_width         = gimp_image_get_width  (image);
+  old_height        = gimp_image_get_height (image);
+  scale.img_scale_w = (gdouble) new_width  / (gdouble) old_width;
+  scale.img_scale_h = (gdouble) new_height / (gdouble) old_height;
 
   offset_x = (old_width  - new_width)  / 2;
   offset_y = (old_height - new_height) / 2;
@@ -110,72 +172,73 @@ gimp_image_scale (GimpImage             *image,
                 "height", new_height,
                 NULL);
 
-  /*  Scale all channels  */
-  for (list = all_channels; list; list = g_list_next (list))
-    {
-      GimpItem *item = list->data;
-
-      gimp_sub_progress_set_step (GIMP_SUB_PROGRESS (sub_progress),
-                                  progress_current++, progress_steps);
+  /*  Collect the drawables to be scaled, in the order in which
+   *  gimp_image_scale_items() replaces them
+   */
+  scale.jobs = g_new0 (ImageScaleJob,
+                       g_list_length (scale.all_layers)   +
+                       g_list_length (scale.all_channels) +
+                       1 /* selection */);
 
-      gimp_item_scale (item,
-                       new_width, new_height, 0, 0,
-                       interpolation_type, sub_progress);
+  for (list = scale.all_channels; list; list = g_list_next (list))
+    {
+      /*  empty channels aren't scaled, see gimp_channel_scale()  */
+      if (! gimp_channel_is_empty (list->data))
+        gimp_image_scale_add_job (&scale, list->data, new_width, new_height);
     }
 
-  /*  Scale all vectors  */
-  for (list = all_vectors; list; list = g_list_next (list))
+  if (! gimp_channel_is_empty (gimp_image_get_mask (image)))
+    gimp_image_scale_add_job (&scale,
+                              GIMP_ITEM (gimp_image_get_mask (image)),
+                              new_width, new_height);
+
+  for (list = scale.all_layers; list; list = g_list_next (list))
     {
       GimpItem *item = list->data;
+      gint      width;
+      gint      height;
 
-      gimp_sub_progress_set_step (GIMP_SUB_PROGRESS (sub_progress),
-                                  progress_current++, progress_steps);
+      if (gimp_viewable_get_children (GIMP_VIEWABLE (item)))
+        continue;
 
-      gimp_item_scale (item,
-                       new_width, new_height, 0, 0,
-                       interpolation_type, sub_progress);
+      /*  like gimp_item_scale_by_factors()  */
+      width  = ROUND (scale.img_scale_w * (gdouble) gimp_item_get_width  (item));
+      height = ROUND (scale.img_scale_h * (gdouble) gimp_item_get_height (item));
+
+      if (width > 0 && height > 0)
+        gimp_image_scale_add_job (&scale, item, width, height);
     }
 
-  /*  Don't forget the selection mask!  */
-  gimp_sub_progress_set_step (GIMP_SUB_PROGRESS (sub_progress),
-                              progress_current++, progress_steps);
+  /*  Keep the memory used by the drawables being scaled at the same
+   *  time within half of the tile cache, unless there's only one
+   */
+  scale.max_memsize = GIMP_GEGL_CONFIG (image->gimp->config)->tile_cache_size / 2;
 
-  gimp_item_scale (GIMP_ITEM (gimp_image_get_mask (image)),
-                   new_width, new_height, 0, 0,
-                   interpolation_type, sub_progress);
+  g_mutex_init (&scale.mutex);
+  g_cond_init (&scale.cond);
 
-  /*  Scale all layers  */
-  for (list = all_layers; list; list = g_list_next (list))
-    {
-      GimpItem *item = list->data;
+  /*  Scale the drawables in parallel, while the calling thread replaces
+   *  them in the image, in stack order, see gimp_image_scale_items()
+   */
+  gimp_parallel_distribute (-1,
+                            (GimpParallelDistributeFunc)
+                            gimp_image_scale_distribute,
+                            &scale);
 
-      gimp_sub_progress_set_step (GIMP_SUB_PROGRESS (sub_progress),
-                                  progress_current++, progress_steps);
+  g_cond_clear (&scale.cond);
+  g_mutex_clear (&scale.mutex);
 
-      /*  group layers are updated automatically  */
-      if (gimp_viewable_get_children (GIMP_VIEWABLE (item)))
-        {
-          gimp_group_layer_suspend_resize (GIMP_GROUP_LAYER (item), FALSE);
-          continue;
-        }
+  for (i = 0; i < scale.n_jobs; i++)
+    {
+      ImageScaleJob *job = &scale.jobs[i];
 
-      if (! gimp_item_scale_by_factors (item,
-                                        img_scale_w, img_scale_h,
-                                        interpolation_type, sub_progress))
-        {
-          /* Since 0 < img_scale_w, img_scale_h, failure due to one or more
-           * vanishing scaled layer dimensions. Implicit delete implemented
-           * here. Upstream warning implemented in resize_check_layer_scaling(),
-           * which offers the user the chance to bail out.
-           */
-          gimp_image_remove_layer (image, GIMP_LAYER (item), TRUE, NULL);
-        }
-    }
+      g_object_unref (job->src_buffer);
 
-  for (list = all_layers; list; list = g_list_next (list))
-    if (gimp_viewable_get_children (list->data))
-      gimp_group_layer_resume_resize (list->data, FALSE);
+      if (job->src_mask_buffer)
+        g_object_unref (job->src_mask_buffer);
+    }
 
+  g_free (scale.jobs);
 
   /*  Scale all Guides  */
   for (list = gimp_image_get_guides (image);
@@ -219,11 +282,11 @@ gimp_image_scale (GimpImage             *image,
 
   gimp_image_undo_group_end (image);
 
-  g_list_free (all_layers);
-  g_list_free (all_channels);
-  g_list_free (all_vectors);
+  g_list_free (scale.all_layers);
+  g_list_free (scale.all_channels);
+  g_list_free (scale.all_vectors);
 
-  g_object_unref (sub_progress);
+  g_object_unref (scale.sub_progress);
 
   gimp_image_size_changed_detailed (image,
                                     -offset_x,
@@ -367,3 +430,285 @@ gimp_image_scale_check (const GimpImage *image,
 
   return GIMP_IMAGE_SCALE_OK;
 }
+
+
+/*  private functions  */
+
+static void
+gimp_image_scale_add_job (ImageScale *scale,
+                          GimpItem   *item,
+                          gint        width,
+                          gint        height)
+{
+  ImageScaleJob *job = &scale->jobs[scale->n_jobs++];
+
+  job->item       = item;
+  job->width      = width;
+  job->height     = height;
+  job->src_buffer = g_object_ref (gimp_drawable_get_buffer (GIMP_DRAWABLE (item)));
+  job->memsize    = gimp_drawable_estimate_memsize (GIMP_DRAWABLE (item),
+                                                    width, height);
+
+  if (GIMP_IS_LAYER (item) && gimp_layer_get_mask (GIMP_LAYER (item)))
+    {
+      GimpDrawable *mask = GIMP_DRAWABLE (gimp_layer_get_mask (GIMP_LAYER (item)));
+
+      /*  the layer's memsize already includes the mask  */
+      job->src_mask_buffer = g_object_ref (gimp_drawable_get_buffer (mask));
+    }
+}
+
+static void
+gimp_image_scale_distribute (gint        i,
+                             gint        n,
+                             ImageScale *scale)
+{
+  ImageScaleJob *job;
+
+  /*  the calling thread replaces the items, the others only scale  */
+  if (i == 0)
+    {
+      gimp_image_scale_items (scale);
+
+      return;
+    }
+
+  g_mutex_lock (&scale->mutex);
+
+  while (scale->next_job < scale->n_jobs)
+    {
+      job = gimp_image_scale_start_job (scale);
+
+      if (job)
+        gimp_image_scale_run_job (scale, job);
+      else
+        g_cond_wait (&scale->cond, &scale->mutex);
+    }
+
+  g_mutex_unlock (&scale->mutex);
+}
+
+/*  scales the items, and emits all undo pushes and signals, from the
+ *  calling thread
+ */
+static void
+gimp_image_scale_items (ImageScale *scale)
+{
+  GimpImage *image            = scale->image;
+  GList     *list;
+  gint       progress_steps;
+  gint       progress_current = 0;
+
+  progress_steps = (g_list_length (scale->all_layers)   +
+                    g_list_length (scale->all_channels) +
+                    g_list_length (scale->all_vectors)  +
+                    1 /* selection */);
+
+  /*  Scale all channels  */
+  for (list = scale->all_channels; list; list = g_list_next (list))
+    {
+      GimpItem *item = list->data;
+
+      gimp_sub_progress_set_step (GIMP_SUB_PROGRESS (scale->sub_progress),
+                                  progress_current++, progress_steps);
+
+      gimp_image_scale_finish_job (scale, item);
+
+      gimp_item_scale (item,
+                       scale->new_width, scale->new_height, 0, 0,
+                       scale->interpolation_type, scale->sub_progress);
+
+      gimp_drawable_set_scaled_buffer (GIMP_DRAWABLE (item), NULL);
+    }
+
+  /*  Scale all vectors  */
+  for (list = scale->all_vectors; list; list = g_list_next (list))
+    {
+      GimpItem *item = list->data;
+
+      gimp_sub_progress_set_step (GIMP_SUB_PROGRESS (scale->sub_progress),
+                                  progress_current++, progress_steps);
+
+      gimp_item_scale (item,
+                       scale->new_width, scale->new_height, 0, 0,
+                       scale->interpolation_type, scale->sub_progress);
+    }
+
+  /*  Don't forget the selection mask!  */
+  gimp_sub_progress_set_step (GIMP_SUB_PROGRESS (scale->sub_progress),
+                              progress_current++, progress_steps);
+
+  gimp_image_scale_finish_job (scale, GIMP_ITEM (gimp_image_get_mask (image)));
+
+  gimp_item_scale (GIMP_ITEM (gimp_image_get_mask (image)),
+                   scale->new_width, scale->new_height, 0, 0,
+                   scale->interpolation_type, scale->sub_progress);
+
+  gimp_drawable_set_scaled_buffer (GIMP_DRAWABLE (gimp_image_get_mask (image)),
+                                   NULL);
+
+  /*  Scale all layers  */
+  for (list = scale->all_layers; list; list = g_list_next (list))
+    {
+      GimpItem      *item = list->data;
+      GimpLayerMask *mask;
+
+      gimp_sub_progress_set_step (GIMP_SUB_PROGRESS (scale->sub_progress),
+                                  progress_current++, progress_steps);
+
+      /*  group layers are updated automatically  */
+      if (gimp_viewable_get_children (GIMP_VIEWABLE (item)))
+        {
+          gimp_group_layer_suspend_resize (GIMP_GROUP_LAYER (item), FALSE);
+          continue;
+        }
+
+      gimp_image_scale_finish_job (scale, item);
+
+      mask = gimp_layer_get_mask (GIMP_LAYER (item));
+
+      if (! gimp_item_scale_by_factors (item,
+                                        scale->img_scale_w,
+                                        scale->img_scale_h,
+                                        scale->interpolation_type,
+                                        scale->sub_progress))
+        {
+          /* Since 0 < img_scale_w, img_scale_h, failure due to one or more
+           * vanishing scaled layer dimensions. Implicit delete implemented
+           * here. Upstream warning implemented in resize_check_layer_scaling(),
+           * which offers the user the chance to bail out.
+           */
+          gimp_image_remove_layer (image, GIMP_LAYER (item), TRUE, NULL);
+        }
+      else
+        {
+          gimp_drawable_set_scaled_buffer (GIMP_DRAWABLE (item), NULL);
+
+          if (mask)
+            gimp_drawable_set_scaled_buffer (GIMP_DRAWABLE (mask), NULL);
+        }
+    }
+
+  for (list = scale->all_layers; list; list = g_list_next (list))
+    if (gimp_viewable_get_children (list->data))
+      gimp_group_layer_resume_resize (list->data, FALSE);
+}
+
+/*  waits until the next job, if it is @item's, is done, scaling it in
+ *  this thread if nobody started it yet, and passes its result on to
+ *  gimp_drawable_scale()
+ */
+static void
+gimp_image_scale_finish_job (ImageScale *scale,
+                             GimpItem   *item)
+{
+  ImageScaleJob *job;
+  gint           index = scale->next_commit;
+
+  if (index >= scale->n_jobs || scale->jobs[index].item != item)
+    return;
+
+  job = &scale->jobs[index];
+
+  scale->next_commit++;
+
+  g_mutex_lock (&scale->mutex);
+
+  while (! job->done)
+    {
+      ImageScaleJob *next = NULL;
+
+      if (scale->next_job == index)
+        next = gimp_image_scale_start_job (scale);
+
+      if (next)
+        gimp_image_scale_run_job (scale, next);
+      else
+        g_cond_wait (&scale->cond, &scale->mutex);
+    }
+
+  g_mutex_unlock (&scale->mutex);
+
+  gimp_drawable_set_scaled_buffer (GIMP_DRAWABLE (item), job->buffer);
+  g_object_unref (job->buffer);
+  job->buffer = NULL;
+
+  if (job->mask_buffer)
+    {
+      GimpLayerMask *mask = gimp_layer_get_mask (GIMP_LAYER (item));
+
+      gimp_drawable_set_scaled_buffer (GIMP_DRAWABLE (mask), job->mask_buffer);
+      g_object_unref (job->mask_buffer);
+      job->mask_buffer = NULL;
+    }
+}
+
+/*  returns the next job, if it fits into the memory limit, and marks it
+ *  as running.  called with the mutex locked.
+ */
+static ImageScaleJob *
+gimp_image_scale_start_job (ImageScale *scale)
+{
+  ImageScaleJob *job;
+
+  if (scale->next_job >= scale->n_jobs)
+    return NULL;
+
+  job = &scale->jobs[scale->next_job];
+
+  if (scale->memsize > 0 &&
+      scale->memsize + job->memsize > scale->max_memsize)
+    return NULL;
+
+  scale->next_job++;
+  scale->memsize += job->memsize;
+
+  return job;
+}
+
+/*  scales a job started by gimp_image_scale_start_job(), unlocking the
+ *  mutex meanwhile
+ */
+static void
+gimp_image_scale_run_job (ImageScale    *scale,
+                          ImageScaleJob *job)
+{
+  g_mutex_unlock (&scale->mutex);
+
+  job->buffer = gimp_image_scale_buffer (job->src_buffer,
+                                         job->width, job->height,
+                                         scale->interpolation_type);
+
+  if (job->src_mask_buffer)
+    job->mask_buffer = gimp_image_scale_buffer (job->src_mask_buffer,
+                                                job->width, job->height,
+                                                scale->interpolation_type);
+
+  g_mutex_lock (&scale->mutex);
+
+  job->done       = TRUE;
+  scale->memsize -= job->memsize;
+
+  g_cond_broadcast (&scale->cond);
+}
+
+/*  like gimp_drawable_scale(), without progress  */
+static GeglBuffer *
+gimp_image_scale_buffer (GeglBuffer            *src_buffer,
+                         gint                   width,
+                         gint                   height,
+                         GimpInterpolationType  interpolation_type)
+{
+  GeglBuffer *buffer;
+
+  buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height),
+                            gegl_buffer_get_format (src_buffer));
+
+  gimp_gegl_apply_scale (src_buffer, NULL, NULL,
+                         buffer,
+                         interpolation_type,
+                         (gdouble) width  / gegl_buffer_get_width  (src_buffer),
+                         (gdouble) height / gegl_buffer_get_height (src_buffer));
+
+  return buffer;
+}
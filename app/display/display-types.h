@@ -44,7 +44,6 @@ typedef struct _GimpStatusbar            GimpStatusbar;
 typedef struct _GimpToolDialog           GimpToolDialog;
 typedef struct _GimpToolGui              GimpToolGui;
 
-typedef struct _GimpDisplayXfer          GimpDisplayXfer;
 typedef struct _Selection                Selection;
 
 
@@ -40,13 +40,66 @@ enum
 };
 
 
+/*  groups with fewer items are simply drawn in full  */
+#define INDEX_MIN_ITEMS   64
+
+/*  the size of the cells of the spatial index, and the number of
+ *  cells above which an item is tested on each draw instead
+ */
+#define INDEX_CELL_SIZE   256
+#define INDEX_MAX_CELLS   16
+
+
+typedef struct _GimpCanvasGroupEntry   GimpCanvasGroupEntry;
+typedef struct _GimpCanvasGroupCell    GimpCanvasGroupCell;
 typedef struct _GimpCanvasGroupPrivate GimpCanvasGroupPrivate;
 
+typedef enum
+{
+  ENTRY_HIDDEN,   /*  invisible, not in the index                  */
+  ENTRY_CELLS,    /*  in the index cells covered by its extents   */
+  ENTRY_LARGE     /*  huge or unknown extents, in the large list  */
+} GimpCanvasGroupEntryState;
+
+struct _GimpCanvasGroupEntry
+{
+  GimpCanvasItem            *item;
+  guint                      order;       /*  the drawing order          */
+  GimpCanvasGroupEntryState  state;
+  cairo_rectangle_int_t      extents;     /*  valid if state != HIDDEN   */
+  gboolean                   dirty;       /*  extents need recomputing   */
+  guint                      draw_stamp;  /*  collected in this draw     */
+};
+
+struct _GimpCanvasGroupCell
+{
+  gint64     key;
+  GPtrArray *entries;
+};
+
 struct _GimpCanvasGroupPrivate
 {
-  GList    *items;
-  gboolean  group_stroking;
-  gboolean  group_filling;
+  GList      *items;
+  gboolean    group_stroking;
+  gboolean    group_filling;
+
+  /*  the spatial index of the items' extents, built on demand when
+   *  drawing, for the shell transform below
+   */
+  GHashTable *entries;     /*  item -> entry                         */
+  guint       next_order;
+  GHashTable *cells;       /*  cell key -> cell, NULL if not built   */
+  GPtrArray  *large;
+  GList      *dirty;
+  guint       draw_stamp;
+
+  gint        index_offset_x;
+  gint        index_offset_y;
+  gint        index_width;
+  gint        index_height;
+  gdouble     index_scale_x;
+  gdouble     index_scale_y;
+  gdouble     index_rotate_angle;
 };
 
 #define GET_PRIVATE(group) \
@@ -57,25 +110,39 @@ struct _GimpCanvasGroupPrivate
 
 /*  local function prototypes  */
 
-static void             gimp_canvas_group_dispose      (GObject         *object);
-static void             gimp_canvas_group_set_property (GObject         *object,
-                                                        guint            property_id,
-                                                        const GValue    *value,
-                                                        GParamSpec      *pspec);
-static void             gimp_canvas_group_get_property (GObject         *object,
-                                                        guint            property_id,
-                                                        GValue          *value,
-                                                        GParamSpec      *pspec);
-static void             gimp_canvas_group_draw         (GimpCanvasItem  *item,
-                                                        cairo_t         *cr);
-static cairo_region_t * gimp_canvas_group_get_extents  (GimpCanvasItem  *item);
-static gboolean         gimp_canvas_group_hit          (GimpCanvasItem  *item,
-                                                        gdouble          x,
-                                                        gdouble          y);
-
-static void             gimp_canvas_group_child_update (GimpCanvasItem  *item,
-                                                        cairo_region_t  *region,
-                                                        GimpCanvasGroup *group);
+static void             gimp_canvas_group_dispose       (GObject              *object);
+static void             gimp_canvas_group_set_property  (GObject              *object,
+                                                         guint                 property_id,
+                                                         const GValue         *value,
+                                                         GParamSpec           *pspec);
+static void             gimp_canvas_group_get_property  (GObject              *object,
+                                                         guint                 property_id,
+                                                         GValue               *value,
+                                                         GParamSpec           *pspec);
+static void             gimp_canvas_group_draw          (GimpCanvasItem       *item,
+                                                         cairo_t              *cr);
+static cairo_region_t * gimp_canvas_group_get_extents   (GimpCanvasItem       *item);
+static gboolean         gimp_canvas_group_hit           (GimpCanvasItem       *item,
+                                                         gdouble               x,
+                                                         gdouble               y);
+
+static void             gimp_canvas_group_child_update  (GimpCanvasItem       *item,
+                                                         cairo_region_t       *region,
+                                                         GimpCanvasGroup      *group);
+
+static void             gimp_canvas_group_entry_free    (GimpCanvasGroupEntry *entry);
+static void             gimp_canvas_group_cell_free     (GimpCanvasGroupCell  *cell);
+static void             gimp_canvas_group_index_clear   (GimpCanvasGroup      *group);
+static gboolean         gimp_canvas_group_index_valid   (GimpCanvasGroup      *group);
+static void             gimp_canvas_group_index_update  (GimpCanvasGroup      *group);
+static void             gimp_canvas_group_index_insert  (GimpCanvasGroup      *group,
+                                                         GimpCanvasGroupEntry *entry);
+static void             gimp_canvas_group_index_remove  (GimpCanvasGroup      *group,
+                                                         GimpCanvasGroupEntry *entry);
+static gint             gimp_canvas_group_entry_compare (gconstpointer         a,
+                                                         gconstpointer         b);
+static void             gimp_canvas_group_draw_indexed  (GimpCanvasGroup      *group,
+                                                         cairo_t              *cr);
 
 
 G_DEFINE_TYPE (GimpCanvasGroup, gimp_canvas_group, GIMP_TYPE_CANVAS_ITEM)
@@ -115,6 +182,11 @@ gimp_canvas_group_class_init (GimpCanvasGroupClass *klass)
 static void
 gimp_canvas_group_init (GimpCanvasGroup *group)
 {
+  GimpCanvasGroupPrivate *private = GET_PRIVATE (group);
+
+  private->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                            NULL,
+                                            (GDestroyNotify) gimp_canvas_group_entry_free);
 }
 
 static void
@@ -122,6 +194,14 @@ gimp_canvas_group_dispose (GObject *object)
 {
   GimpCanvasGroupPrivate *private = GET_PRIVATE (object);
 
+  gimp_canvas_group_index_clear (GIMP_CANVAS_GROUP (object));
+
+  if (private->entries)
+    {
+      g_hash_table_unref (private->entries);
+      private->entries = NULL;
+    }
+
   if (private->items)
     {
       g_list_free_full (private->items, (GDestroyNotify) g_object_unref);
@@ -184,11 +264,20 @@ gimp_canvas_group_draw (GimpCanvasItem *item,
   GimpCanvasGroupPrivate *private = GET_PRIVATE (item);
   GList                  *list;
 
-  for (list = private->items; list; list = g_list_next (list))
+  if (g_hash_table_size (private->entries) >= INDEX_MIN_ITEMS)
+    {
+      gimp_canvas_group_draw_indexed (GIMP_CANVAS_GROUP (item), cr);
+    }
+  else
     {
-      GimpCanvasItem *sub_item = list->data;
+      gimp_canvas_group_index_clear (GIMP_CANVAS_GROUP (item));
 
-      gimp_canvas_item_draw (sub_item, cr);
+      for (list = private->items; list; list = g_list_next (list))
+        {
+          GimpCanvasItem *sub_item = list->data;
+
+          gimp_canvas_item_draw (sub_item, cr);
+        }
     }
 
   if (private->group_stroking)
@@ -246,10 +335,364 @@ gimp_canvas_group_child_update (GimpCanvasItem  *item,
                                 cairo_region_t  *region,
                                 GimpCanvasGroup *group)
 {
+  GimpCanvasGroupPrivate *private = GET_PRIVATE (group);
+
+  /*  only the item's own extents are recomputed on the next draw  */
+  if (private->cells)
+    {
+      GimpCanvasGroupEntry *entry = g_hash_table_lookup (private->entries,
+                                                         item);
+
+      if (entry && ! entry->dirty)
+        {
+          entry->dirty   = TRUE;
+          private->dirty = g_list_prepend (private->dirty, entry);
+        }
+    }
+
   if (_gimp_canvas_item_needs_update (GIMP_CANVAS_ITEM (group)))
     _gimp_canvas_item_update (GIMP_CANVAS_ITEM (group), region);
 }
 
+static void
+gimp_canvas_group_entry_free (GimpCanvasGroupEntry *entry)
+{
+  g_slice_free (GimpCanvasGroupEntry, entry);
+}
+
+static void
+gimp_canvas_group_cell_free (GimpCanvasGroupCell *cell)
+{
+  g_ptr_array_free (cell->entries, TRUE);
+
+  g_slice_free (GimpCanvasGroupCell, cell);
+}
+
+static void
+gimp_canvas_group_index_clear (GimpCanvasGroup *group)
+{
+  GimpCanvasGroupPrivate *private = GET_PRIVATE (group);
+
+  if (private->cells)
+    {
+      g_hash_table_unref (private->cells);
+      private->cells = NULL;
+
+      g_ptr_array_free (private->large, TRUE);
+      private->large = NULL;
+    }
+
+  if (private->dirty)
+    {
+      GList *list;
+
+      for (list = private->dirty; list; list = g_list_next (list))
+        {
+          GimpCanvasGroupEntry *entry = list->data;
+
+          entry->dirty = FALSE;
+        }
+
+      g_list_free (private->dirty);
+      private->dirty = NULL;
+    }
+}
+
+/*  the items' extents are in window coordinates, the index is only
+ *  valid as long as the shell's transform and size don't change
+ */
+static gboolean
+gimp_canvas_group_index_valid (GimpCanvasGroup *group)
+{
+  GimpCanvasGroupPrivate *private = GET_PRIVATE (group);
+  GimpDisplayShell       *shell;
+
+  shell = gimp_canvas_item_get_shell (GIMP_CANVAS_ITEM (group));
+
+  return (private->cells                                     &&
+          private->index_offset_x     == shell->offset_x     &&
+          private->index_offset_y     == shell->offset_y     &&
+          private->index_width        == shell->disp_width   &&
+          private->index_height       == shell->disp_height  &&
+          private->index_scale_x      == shell->scale_x      &&
+          private->index_scale_y      == shell->scale_y      &&
+          private->index_rotate_angle == shell->rotate_angle);
+}
+
+static void
+gimp_canvas_group_index_update (GimpCanvasGroup *group)
+{
+  GimpCanvasGroupPrivate *private = GET_PRIVATE (group);
+
+  if (! gimp_canvas_group_index_valid (group))
+    {
+      GimpDisplayShell *shell;
+      GList            *list;
+
+      gimp_canvas_group_index_clear (group);
+
+      shell = gimp_canvas_item_get_shell (GIMP_CANVAS_ITEM (group));
+
+      private->cells = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                              NULL,
+                                              (GDestroyNotify) gimp_canvas_group_cell_free);
+      private->large = g_ptr_array_new ();
+
+      private->index_offset_x     = shell->offset_x;
+      private->index_offset_y     = shell->offset_y;
+      private->index_width        = shell->disp_width;
+      private->index_height       = shell->disp_height;
+      private->index_scale_x      = shell->scale_x;
+      private->index_scale_y      = shell->scale_y;
+      private->index_rotate_angle = shell->rotate_angle;
+
+      for (list = private->items; list; list = g_list_next (list))
+        {
+          GimpCanvasGroupEntry *entry;
+
+          entry = g_hash_table_lookup (private->entries, list->data);
+
+          gimp_canvas_group_index_insert (group, entry);
+        }
+    }
+  else if (private->dirty)
+    {
+      GList *list;
+
+      for (list = private->dirty; list; list = g_list_next (list))
+        {
+          GimpCanvasGroupEntry *entry = list->data;
+
+          gimp_canvas_group_index_remove (group, entry);
+          gimp_canvas_group_index_insert (group, entry);
+        }
+
+      g_list_free (private->dirty);
+      private->dirty = NULL;
+    }
+}
+
+static void
+gimp_canvas_group_index_insert (GimpCanvasGroup      *group,
+                                GimpCanvasGroupEntry *entry)
+{
+  GimpCanvasGroupPrivate *private = GET_PRIVATE (group);
+  cairo_region_t         *region;
+  gint                    x1, y1;
+  gint                    x2, y2;
+
+  entry->dirty = FALSE;
+
+  region = gimp_canvas_item_get_extents (entry->item);
+
+  if (region)
+    {
+      cairo_region_get_extents (region, &entry->extents);
+      cairo_region_destroy (region);
+    }
+  else if (! gimp_canvas_item_get_visible (entry->item))
+    {
+      entry->state = ENTRY_HIDDEN;
+
+      return;
+    }
+  else
+    {
+      /*  visible, but we don't know where it draws  */
+      entry->extents.x      = G_MININT / 2;
+      entry->extents.y      = G_MININT / 2;
+      entry->extents.width  = G_MAXINT;
+      entry->extents.height = G_MAXINT;
+    }
+
+  x1 = floor ((gdouble) entry->extents.x / INDEX_CELL_SIZE);
+  y1 = floor ((gdouble) entry->extents.y / INDEX_CELL_SIZE);
+  x2 = floor ((gdouble) (entry->extents.x + entry->extents.width) /
+              INDEX_CELL_SIZE);
+  y2 = floor ((gdouble) (entry->extents.y + entry->extents.height) /
+              INDEX_CELL_SIZE);
+
+  if ((gint64) (x2 - x1 + 1) * (y2 - y1 + 1) > INDEX_MAX_CELLS)
+    {
+      entry->state = ENTRY_LARGE;
+
+      g_ptr_array_add (private->large, entry);
+    }
+  else
+    {
+      gint x, y;
+
+      entry->state = ENTRY_CELLS;
+
+      for (y = y1; y <= y2; y++)
+        for (x = x1; x <= x2; x++)
+          {
+            GimpCanvasGroupCell *cell;
+            gint64               key = ((gint64) y << 32) | (guint32) x;
+
+            cell = g_hash_table_lookup (private->cells, &key);
+
+            if (! cell)
+              {
+                cell = g_slice_new (GimpCanvasGroupCell);
+
+                cell->key     = key;
+                cell->entries = g_ptr_array_new ();
+
+                g_hash_table_insert (private->cells, &cell->key, cell);
+              }
+
+            g_ptr_array_add (cell->entries, entry);
+          }
+    }
+}
+
+static void
+gimp_canvas_group_index_remove (GimpCanvasGroup      *group,
+                                GimpCanvasGroupEntry *entry)
+{
+  GimpCanvasGroupPrivate *private = GET_PRIVATE (group);
+
+  if (entry->state == ENTRY_LARGE)
+    {
+      g_ptr_array_remove_fast (private->large, entry);
+    }
+  else if (entry->state == ENTRY_CELLS)
+    {
+      gint x1, y1;
+      gint x2, y2;
+      gint x, y;
+
+      x1 = floor ((gdouble) entry->extents.x / INDEX_CELL_SIZE);
+      y1 = floor ((gdouble) entry->extents.y / INDEX_CELL_SIZE);
+      x2 = floor ((gdouble) (entry->extents.x + entry->extents.width) /
+                  INDEX_CELL_SIZE);
+      y2 = floor ((gdouble) (entry->extents.y + entry->extents.height) /
+                  INDEX_CELL_SIZE);
+
+      for (y = y1; y <= y2; y++)
+        for (x = x1; x <= x2; x++)
+          {
+            GimpCanvasGroupCell *cell;
+            gint64               key = ((gint64) y << 32) | (guint32) x;
+
+            cell = g_hash_table_lookup (private->cells, &key);
+
+            if (cell)
+              {
+                g_ptr_array_remove_fast (cell->entries, entry);
+
+                if (cell->entries->len == 0)
+                  g_hash_table_remove (private->cells, &key);
+              }
+          }
+    }
+
+  entry->state = ENTRY_HIDDEN;
+}
+
+static gint
+gimp_canvas_group_entry_compare (gconstpointer a,
+                                 gconstpointer b)
+{
+  const GimpCanvasGroupEntry *entry_a = *(GimpCanvasGroupEntry **) a;
+  const GimpCanvasGroupEntry *entry_b = *(GimpCanvasGroupEntry **) b;
+
+  if (entry_a->order < entry_b->order)
+    return -1;
+  else if (entry_a->order > entry_b->order)
+    return 1;
+
+  return 0;
+}
+
+/*  draws only the items whose extents intersect the clip, in the
+ *  group's order
+ */
+static void
+gimp_canvas_group_draw_indexed (GimpCanvasGroup *group,
+                                cairo_t         *cr)
+{
+  GimpCanvasGroupPrivate *private = GET_PRIVATE (group);
+  GPtrArray              *visible;
+  gdouble                 cx1, cy1;
+  gdouble                 cx2, cy2;
+  gint                    x1, y1;
+  gint                    x2, y2;
+  gint                    x, y;
+  guint                   i;
+
+  gimp_canvas_group_index_update (group);
+
+  cairo_clip_extents (cr, &cx1, &cy1, &cx2, &cy2);
+
+  if (cx1 >= cx2 || cy1 >= cy2)
+    return;
+
+  private->draw_stamp++;
+
+  visible = g_ptr_array_new ();
+
+#define COLLECT(entry)                                                   \
+  G_STMT_START                                                           \
+    {                                                                    \
+      if ((entry)->draw_stamp != private->draw_stamp                  && \
+          (entry)->extents.x                           < cx2          && \
+          (entry)->extents.y                           < cy2          && \
+          (entry)->extents.x + (entry)->extents.width  > cx1          && \
+          (entry)->extents.y + (entry)->extents.height > cy1)            \
+        {                                                                \
+          (entry)->draw_stamp = private->draw_stamp;                     \
+          g_ptr_array_add (visible, (entry));                            \
+        }                                                                \
+    }                                                                    \
+  G_STMT_END
+
+  x1 = floor (cx1 / INDEX_CELL_SIZE);
+  y1 = floor (cy1 / INDEX_CELL_SIZE);
+  x2 = floor (cx2 / INDEX_CELL_SIZE);
+  y2 = floor (cy2 / INDEX_CELL_SIZE);
+
+  for (y = y1; y <= y2; y++)
+    for (x = x1; x <= x2; x++)
+      {
+        GimpCanvasGroupCell *cell;
+        gint64               key = ((gint64) y << 32) | (guint32) x;
+
+        cell = g_hash_table_lookup (private->cells, &key);
+
+        if (cell)
+          {
+            for (i = 0; i < cell->entries->len; i++)
+              {
+                GimpCanvasGroupEntry *entry = cell->entries->pdata[i];
+
+                COLLECT (entry);
+              }
+          }
+      }
+
+  for (i = 0; i < private->large->len; i++)
+    {
+      GimpCanvasGroupEntry *entry = private->large->pdata[i];
+
+      COLLECT (entry);
+    }
+
+#undef COLLECT
+
+  g_ptr_array_sort (visible, gimp_canvas_group_entry_compare);
+
+  for (i = 0; i < visible->len; i++)
+    {
+      GimpCanvasGroupEntry *entry = visible->pdata[i];
+
+      gimp_canvas_item_draw (entry->item, cr);
+    }
+
+  g_ptr_array_free (visible, TRUE);
+}
+
 
 /*  public functions  */
 
@@ -268,6 +711,7 @@ gimp_canvas_group_add_item (GimpCanvasGroup *group,
                             GimpCanvasItem  *item)
 {
   GimpCanvasGroupPrivate *private;
+  GimpCanvasGroupEntry   *entry;
 
   g_return_if_fail (GIMP_IS_CANVAS_GROUP (group));
   g_return_if_fail (GIMP_IS_CANVAS_ITEM (item));
@@ -283,6 +727,20 @@ gimp_canvas_group_add_item (GimpCanvasGroup *group,
 
   private->items = g_list_append (private->items, g_object_ref (item));
 
+  entry = g_slice_new0 (GimpCanvasGroupEntry);
+
+  entry->item  = item;
+  entry->order = private->next_order++;
+  entry->state = ENTRY_HIDDEN;
+
+  g_hash_table_insert (private->entries, item, entry);
+
+  if (private->cells)
+    {
+      entry->dirty   = TRUE;
+      private->dirty = g_list_prepend (private->dirty, entry);
+    }
+
   if (_gimp_canvas_item_needs_update (GIMP_CANVAS_ITEM (group)))
     {
       cairo_region_t *region = gimp_canvas_item_get_extents (item);
@@ -304,6 +762,7 @@ gimp_canvas_group_remove_item (GimpCanvasGroup *group,
                                GimpCanvasItem  *item)
 {
   GimpCanvasGroupPrivate *private;
+  GimpCanvasGroupEntry   *entry;
 
   g_return_if_fail (GIMP_IS_CANVAS_GROUP (group));
   g_return_if_fail (GIMP_IS_CANVAS_ITEM (item));
@@ -314,6 +773,16 @@ gimp_canvas_group_remove_item (GimpCanvasGroup *group,
 
   private->items = g_list_remove (private->items, item);
 
+  entry = g_hash_table_lookup (private->entries, item);
+
+  if (private->cells)
+    gimp_canvas_group_index_remove (group, entry);
+
+  if (entry->dirty)
+    private->dirty = g_list_remove (private->dirty, entry);
+
+  g_hash_table_remove (private->entries, item);
+
   if (private->group_stroking)
     gimp_canvas_item_resume_stroking (item);
 
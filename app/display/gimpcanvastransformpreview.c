@@ -40,13 +40,14 @@
 #include "gimpdisplayshell.h"
 
 
-#define INT_MULT(a,b,t)    ((t) = (a) * (b) + 0x80, ((((t) >> 8) + (t)) >> 8))
-#define INT_MULT3(a,b,c,t) ((t) = (a) * (b) * (c) + 0x7F5B, \
-                           ((((t) >> 7) + (t)) >> 16))
-
 #define MAX_SUB_COLS       6 /* number of columns and  */
 #define MAX_SUB_ROWS       6 /* rows to use in perspective preview subdivision */
 
+#define MAX_TEXTURE_LEVEL  10
+#define MAX_TEXTURE_PIXELS (2048 * 2048)
+
+#define TEXTURE_DATA_KEY   "gimp-canvas-transform-preview-texture"
+
 
 enum
 {
@@ -74,6 +75,36 @@ struct _GimpCanvasTransformPreviewPrivate
   gdouble            opacity;
 };
 
+/*  a copy of the previewed part of a drawable, and of the selection
+ *  mask, downscaled by 2^level.  it is attached to the drawable, so it
+ *  survives the canvas items, which are recreated on each redraw of
+ *  the tool, and is dropped when either of them changes, or when the
+ *  tool calls gimp_canvas_transform_preview_free_texture().
+ */
+typedef struct _TransformPreviewTexture TransformPreviewTexture;
+
+struct _TransformPreviewTexture
+{
+  GimpDrawable    *drawable;
+  GimpChannel     *mask;
+  gulong           drawable_handler;
+  gulong           mask_handler;
+
+  gint             level;
+  gint             x1, y1;       /* the previewed area, in drawable coords */
+  gint             x2, y2;
+  gint             offset_x;
+  gint             offset_y;
+
+  cairo_surface_t *surface;      /* the drawable, in downscaled drawable coords */
+  gint             surface_x;
+  gint             surface_y;
+
+  cairo_surface_t *mask_surface; /* the mask, in downscaled image coords */
+  gint             mask_x;
+  gint             mask_y;
+};
+
 #define GET_PRIVATE(transform_preview) \
         G_TYPE_INSTANCE_GET_PRIVATE (transform_preview, \
                                      GIMP_TYPE_CANVAS_TRANSFORM_PREVIEW, \
@@ -95,63 +126,26 @@ static void             gimp_canvas_transform_preview_draw         (GimpCanvasIt
                                                                     cairo_t        *cr);
 static cairo_region_t * gimp_canvas_transform_preview_get_extents  (GimpCanvasItem *item);
 
-static void   gimp_canvas_transform_preview_draw_quad         (GimpDrawable    *texture,
-                                                               cairo_t         *cr,
-                                                               GimpChannel     *mask,
-                                                               gint             mask_offx,
-                                                               gint             mask_offy,
-                                                               gint            *x,
-                                                               gint            *y,
-                                                               gfloat          *u,
-                                                               gfloat          *v,
-                                                               guchar           opacity);
-static void   gimp_canvas_transform_preview_draw_tri          (GimpDrawable    *texture,
-                                                               cairo_t         *cr,
-                                                               cairo_surface_t *area,
-                                                               gint             area_offx,
-                                                               gint             area_offy,
-                                                               GimpChannel     *mask,
-                                                               gint             mask_offx,
-                                                               gint             mask_offy,
-                                                               gint            *x,
-                                                               gint            *y,
-                                                               gfloat          *u,
-                                                               gfloat          *v,
-                                                               guchar           opacity);
-static void   gimp_canvas_transform_preview_draw_tri_row      (GimpDrawable    *texture,
-                                                               cairo_t         *cr,
-                                                               cairo_surface_t *area,
-                                                               gint             area_offx,
-                                                               gint             area_offy,
-                                                               gint             x1,
-                                                               gfloat           u1,
-                                                               gfloat           v1,
-                                                               gint             x2,
-                                                               gfloat           u2,
-                                                               gfloat           v2,
-                                                               gint             y,
-                                                               guchar           opacity);
-static void   gimp_canvas_transform_preview_draw_tri_row_mask (GimpDrawable    *texture,
-                                                               cairo_t         *cr,
-                                                               cairo_surface_t *area,
-                                                               gint             area_offx,
-                                                               gint             area_offy,
-                                                               GimpChannel     *mask,
-                                                               gint             mask_offx,
-                                                               gint             mask_offy,
-                                                               gint             x1,
-                                                               gfloat           u1,
-                                                               gfloat           v1,
-                                                               gint             x2,
-                                                               gfloat           u2,
-                                                               gfloat           v2,
-                                                               gint             y,
-                                                               guchar           opacity);
-static void   gimp_canvas_transform_preview_trace_tri_edge    (gint            *dest,
-                                                               gint             x1,
-                                                               gint             y1,
-                                                               gint             x2,
-                                                               gint             y2);
+static TransformPreviewTexture *
+                gimp_canvas_transform_preview_get_texture        (GimpDrawable            *drawable,
+                                                                  GimpChannel             *mask,
+                                                                  gint                     x1,
+                                                                  gint                     y1,
+                                                                  gint                     x2,
+                                                                  gint                     y2,
+                                                                  gint                     level);
+static void     gimp_canvas_transform_preview_texture_free       (TransformPreviewTexture *texture);
+static void     gimp_canvas_transform_preview_texture_invalidate (TransformPreviewTexture *texture);
+
+static void     gimp_canvas_transform_preview_draw_patch         (cairo_t                 *cr,
+                                                                  TransformPreviewTexture *texture,
+                                                                  gboolean                 use_mask,
+                                                                  gdouble                  opacity,
+                                                                  const gdouble           *x,
+                                                                  const gdouble           *y,
+                                                                  const gdouble           *u,
+                                                                  const gdouble           *v,
+                                                                  gint                     n_points);
 
 
 G_DEFINE_TYPE (GimpCanvasTransformPreview, gimp_canvas_transform_preview,
@@ -406,32 +400,27 @@ gimp_canvas_transform_preview_draw (GimpCanvasItem *item,
 {
   GimpCanvasTransformPreviewPrivate *private = GET_PRIVATE (item);
   GimpChannel                       *mask;
+  TransformPreviewTexture           *texture;
   gint                               mask_x1, mask_y1;
   gint                               mask_x2, mask_y2;
-  gint                               mask_offx, mask_offy;
   gint                               columns, rows;
-  gint                               j, k, sub;
-
-   /* x and y get filled with the screen coordinates of each corner of
-    * each quadrilateral subdivision of the transformed area. u and v
-    * are the corresponding points in the mask
-    */
-  gfloat                             du, dv, dx, dy;
-  gint                               x[MAX_SUB_COLS * MAX_SUB_ROWS][4];
-  gint                               y[MAX_SUB_COLS * MAX_SUB_ROWS][4];
-  gfloat                             u[MAX_SUB_COLS * MAX_SUB_ROWS][4];
-  gfloat                             v[MAX_SUB_COLS * MAX_SUB_ROWS][4];
-  guchar                             opacity;
-
-  opacity = private->opacity * 255.999;
+  gint                               level;
+  gint                               i, j;
+  gdouble                            du, dv;
+  gdouble                            zoom;
+  gboolean                           use_group;
+
+  /* x and y get filled with the screen coordinates of the corners of
+   * the subdivisions of the transformed area
+   */
+  gdouble                            x[MAX_SUB_ROWS + 1][MAX_SUB_COLS + 1];
+  gdouble                            y[MAX_SUB_ROWS + 1][MAX_SUB_COLS + 1];
 
   /* only draw convex polygons */
   if (! gimp_canvas_transform_preview_transform (item, NULL))
     return;
 
-  mask      = NULL;
-  mask_offx = 0;
-  mask_offy = 0;
+  mask = NULL;
 
   if (gimp_item_mask_bounds (GIMP_ITEM (private->drawable),
                              &mask_x1, &mask_y1,
@@ -440,11 +429,11 @@ gimp_canvas_transform_preview_draw (GimpCanvasItem *item,
       GimpImage *image = gimp_item_get_image (GIMP_ITEM (private->drawable));
 
       mask = gimp_image_get_mask (image);
-
-      gimp_item_get_offset (GIMP_ITEM (private->drawable),
-                            &mask_offx, &mask_offy);
     }
 
+  if (mask_x1 >= mask_x2 || mask_y1 >= mask_y2)
+    return;
+
   if (private->perspective)
     {
       /* approximate perspective transform by subdivision
@@ -456,105 +445,124 @@ gimp_canvas_transform_preview_draw (GimpCanvasItem *item,
     }
   else
     {
-      /*  for affine transforms subdivision has no effect
+      /*  affine transforms are drawn exactly in one piece
        */
       columns = 1;
       rows    = 1;
     }
 
-  dx = (private->x2 - private->x1) / ((gfloat) columns);
-  dy = (private->y2 - private->y1) / ((gfloat) rows);
-
-  du = (mask_x2 - mask_x1) / ((gfloat) columns);
-  dv = (mask_y2 - mask_y1) / ((gfloat) rows);
-
-#define CALC_VERTEX(col, row, sub, index)                       \
-  {                                                             \
-    gdouble tx1, ty1;                                           \
-    gdouble tx2, ty2;                                           \
-                                                                \
-    tx2 = private->x1 + (dx * (col + (index & 1)));             \
-    ty2 = private->y1 + (dy * (row + (index >> 1)));            \
-                                                                \
-    gimp_matrix3_transform_point (&private->transform,          \
-                                  tx2, ty2,                     \
-                                  &tx1, &ty1);                  \
-                                                                \
-    gimp_canvas_item_transform_xy_f (item,                      \
-                                     tx1, ty1,                  \
-                                     &tx2, &ty2);               \
-    x[sub][index] = (gint) tx2;                                 \
-    y[sub][index] = (gint) ty2;                                 \
-                                                                \
-    u[sub][index] = mask_x1 + (du * (col + (index & 1)));       \
-    v[sub][index] = mask_y1 + (dv * (row + (index >> 1)));      \
-  }
-
-#define COPY_VERTEX(subdest, idest, subsrc, isrc) \
-  x[subdest][idest] = x[subsrc][isrc];            \
-  y[subdest][idest] = y[subsrc][isrc];            \
-  u[subdest][idest] = u[subsrc][isrc];            \
-  v[subdest][idest] = v[subsrc][isrc];
-
-  /*
-   * upper left corner subdivision: calculate all vertices
-   */
+  for (j = 0; j <= rows; j++)
+    for (i = 0; i <= columns; i++)
+      {
+        gdouble tx, ty;
+
+        gimp_matrix3_transform_point (&private->transform,
+                                      private->x1 +
+                                      (private->x2 - private->x1) * i / columns,
+                                      private->y1 +
+                                      (private->y2 - private->y1) * j / rows,
+                                      &tx, &ty);
+
+        gimp_canvas_item_transform_xy_f (item,
+                                         tx, ty,
+                                         &x[j][i], &y[j][i]);
+      }
 
-  for (j = 0; j < 4; j++)
-    {
-      CALC_VERTEX (0, 0, 0, j);
-    }
+  du = (gdouble) (mask_x2 - mask_x1) / columns;
+  dv = (gdouble) (mask_y2 - mask_y1) / rows;
 
-  /*
-   * top row subdivisions: calculate only right side vertices
+  /* find the largest magnification of the drawable on screen, and use
+   * the smallest texture whose pixels are still not larger than
+   * screen pixels, unless the texture would get too large
    */
+  zoom = 0.0;
 
-  for (j = 1; j < columns; j++)
-    {
-      COPY_VERTEX (j, 0, j - 1, 1);
-      CALC_VERTEX (j, 0, j, 1);
-      COPY_VERTEX (j, 2, j - 1, 3);
-      CALC_VERTEX (j, 0, j, 3);
-    }
+  for (j = 0; j <= rows; j++)
+    for (i = 0; i < columns; i++)
+      zoom = MAX (zoom, hypot (x[j][i + 1] - x[j][i],
+                               y[j][i + 1] - y[j][i]) / du);
 
-  /*
-   * left column subdivisions: calculate only bottom side vertices
-   */
+  for (j = 0; j < rows; j++)
+    for (i = 0; i <= columns; i++)
+      zoom = MAX (zoom, hypot (x[j + 1][i] - x[j][i],
+                               y[j + 1][i] - y[j][i]) / dv);
 
-  for (j = 1, sub = columns; j < rows; j++, sub += columns)
+  for (level = 0; level < MAX_TEXTURE_LEVEL; level++)
     {
-      COPY_VERTEX (sub, 0, sub - columns, 2);
-      COPY_VERTEX (sub, 1, sub - columns, 3);
-      CALC_VERTEX (0, j, sub, 2);
-      CALC_VERTEX (0, j, sub, 3);
+      gint64 n_pixels = (((gint64) (mask_x2 - mask_x1) >> level) *
+                         ((gint64) (mask_y2 - mask_y1) >> level));
+
+      if (zoom * (2 << level) > 1.0 && n_pixels <= MAX_TEXTURE_PIXELS)
+        break;
     }
 
-  /*
-   * the rest: calculate only the bottom-right vertex
+  texture = gimp_canvas_transform_preview_get_texture (private->drawable,
+                                                       mask,
+                                                       mask_x1, mask_y1,
+                                                       mask_x2, mask_y2,
+                                                       level);
+
+  /* the mask and the opacity can't be applied in one go, so compose
+   * the masked preview in a group first
    */
+  use_group = (mask && private->opacity < 1.0);
+
+  cairo_save (cr);
+
+  /* adjacent subdivisions must not blend at their common edges */
+  cairo_set_antialias (cr, CAIRO_ANTIALIAS_NONE);
+
+  if (use_group)
+    cairo_push_group (cr);
+
+  for (j = 0; j < rows; j++)
+    for (i = 0; i < columns; i++)
+      {
+        gdouble u0 = mask_x1 + du * i;
+        gdouble v0 = mask_y1 + dv * j;
+        gdouble u1 = mask_x1 + du * (i + 1);
+        gdouble v1 = mask_y1 + dv * (j + 1);
+
+        gdouble qx[4] = { x[j][i], x[j][i + 1], x[j + 1][i + 1], x[j + 1][i] };
+        gdouble qy[4] = { y[j][i], y[j][i + 1], y[j + 1][i + 1], y[j + 1][i] };
+        gdouble qu[4] = { u0, u1, u1, u0 };
+        gdouble qv[4] = { v0, v0, v1, v1 };
+
+        if (private->perspective)
+          {
+            /* the transform is close to affine within each
+             * subdivision, draw it as two affine triangles
+             */
+            gdouble tx[3] = { qx[0], qx[2], qx[3] };
+            gdouble ty[3] = { qy[0], qy[2], qy[3] };
+            gdouble tu[3] = { qu[0], qu[2], qu[3] };
+            gdouble tv[3] = { qv[0], qv[2], qv[3] };
+
+            gimp_canvas_transform_preview_draw_patch (cr, texture,
+                                                      mask != NULL,
+                                                      private->opacity,
+                                                      qx, qy, qu, qv, 3);
+            gimp_canvas_transform_preview_draw_patch (cr, texture,
+                                                      mask != NULL,
+                                                      private->opacity,
+                                                      tx, ty, tu, tv, 3);
+          }
+        else
+          {
+            gimp_canvas_transform_preview_draw_patch (cr, texture,
+                                                      mask != NULL,
+                                                      private->opacity,
+                                                      qx, qy, qu, qv, 4);
+          }
+      }
 
-  for (j = 1, sub = columns; j < rows; j++)
+  if (use_group)
     {
-      sub++;
-
-      for (k = 1; k < columns; k++, sub++)
-        {
-          COPY_VERTEX (sub, 0, sub - 1, 1);
-          COPY_VERTEX (sub, 1, sub - columns, 3);
-          COPY_VERTEX (sub, 2, sub - 1, 3);
-          CALC_VERTEX (k, j, sub, 3);
-        }
+      cairo_pop_group_to_source (cr);
+      cairo_paint_with_alpha (cr, private->opacity);
     }
 
-#undef CALC_VERTEX
-#undef COPY_VERTEX
-
-  k = columns * rows;
-  for (j = 0; j < k; j++)
-    gimp_canvas_transform_preview_draw_quad (private->drawable, cr,
-                                             mask, mask_offx, mask_offy,
-                                             x[j], y[j], u[j], v[j],
-                                             opacity);
+  cairo_restore (cr);
 }
 
 static cairo_region_t *
@@ -596,625 +604,266 @@ gimp_canvas_transform_preview_new (GimpDisplayShell  *shell,
                        NULL);
 }
 
-
-/*  private functions  */
-
 /**
- * gimp_canvas_transform_preview_draw_quad:
- * @texture:   the #GimpDrawable to be previewed
- * @cr:        the #cairo_t to draw to
- * @mask:      a #GimpChannel
- * @opacity:   the opacity of the preview
+ * gimp_canvas_transform_preview_free_texture:
+ * @drawable: a #GimpDrawable
  *
- * Take a quadrilateral, divide it into two triangles, and draw those
- * with gimp_canvas_transform_preview_draw_tri().
+ * Frees the texture that previews of @drawable keep attached to it.
+ * To be called when the preview is no longer shown, e.g. when the
+ * tool is halted.
  **/
-static void
-gimp_canvas_transform_preview_draw_quad (GimpDrawable *texture,
-                                         cairo_t      *cr,
-                                         GimpChannel  *mask,
-                                         gint          mask_offx,
-                                         gint          mask_offy,
-                                         gint         *x,
-                                         gint         *y,
-                                         gfloat       *u,
-                                         gfloat       *v,
-                                         guchar        opacity)
+void
+gimp_canvas_transform_preview_free_texture (GimpDrawable *drawable)
 {
-  gint    x2[3], y2[3];
-  gfloat  u2[3], v2[3];
-  gint    minx, maxx, miny, maxy; /* screen bounds of the quad        */
-  gdouble clip_x1, clip_y1, clip_x2, clip_y2;
-  gint    c;
-
-  x2[0] = x[3];  y2[0] = y[3];  u2[0] = u[3];  v2[0] = v[3];
-  x2[1] = x[2];  y2[1] = y[2];  u2[1] = u[2];  v2[1] = v[2];
-  x2[2] = x[1];  y2[2] = y[1];  u2[2] = u[1];  v2[2] = v[1];
-
-   /* Allocate a box around the quad to compute preview data into
-    * and fill it with the original window contents.
-    */
-
-  cairo_clip_extents (cr, &clip_x1, &clip_y1, &clip_x2, &clip_y2);
-
-  /* find bounds of quad in order to only grab as much of dest as needed */
-
-  minx = maxx = x[0];
-  miny = maxy = y[0];
-  for (c = 1; c < 4; c++)
-    {
-      if (x[c] < minx) minx = x[c];
-      else if (x[c] > maxx) maxx = x[c];
-
-      if (y[c] < miny) miny = y[c];
-      else if (y[c] > maxy) maxy = y[c];
-    }
-  if (minx < clip_x1) minx = clip_x1;
-  if (miny < clip_y1) miny = clip_y1;
-  if (maxx > clip_x2) maxx = clip_x2;
-  if (maxy > clip_y2) maxy = clip_y2;
-
-  if (minx <= maxx && miny <= maxy)
-    {
-      cairo_surface_t *area;
-
-      area = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
-                                         maxx - minx + 1,
-                                         maxy - miny + 1);
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
 
-      g_return_if_fail (area != NULL);
+  g_object_set_data (G_OBJECT (drawable), TEXTURE_DATA_KEY, NULL);
+}
 
-      gimp_canvas_transform_preview_draw_tri (texture, cr, area, minx, miny,
-                                              mask, mask_offx, mask_offy,
-                                              x, y, u, v, opacity);
-      gimp_canvas_transform_preview_draw_tri (texture, cr, area, minx, miny,
-                                              mask, mask_offx, mask_offy,
-                                              x2, y2, u2, v2, opacity);
 
-      cairo_surface_destroy (area);
-    }
-}
+/*  private functions  */
 
 /**
- * gimp_canvas_transform_preview_draw_tri:
- * @texture:   the thing being transformed
- * @cr:        the #cairo_t to draw to
- * @area:      has prefetched pixel data of dest
- * @area_offx: x coordinate of area in dest
- * @area_offy: y coordinate of area in dest
- * @x:         Array of the three x coords of triangle
- * @y:         Array of the three y coords of triangle
+ * gimp_canvas_transform_preview_get_texture:
+ * @drawable: the #GimpDrawable to be previewed
+ * @mask:     the selection mask, or %NULL
+ * @x1:       the previewed area, in @drawable coordinates
+ * @level:    the texture is downscaled by 2^@level
  *
- * This draws a triangle onto dest by breaking it down into pixel
- * rows, and then calling gimp_canvas_transform_preview_draw_tri_row()
- * and gimp_canvas_transform_preview_draw_tri_row_mask() to do the
- * actual pixel changing.
+ * Returns the texture of @drawable, creating it if the cached one
+ * doesn't match the arguments.  The texture is owned by @drawable.
  **/
-static void
-gimp_canvas_transform_preview_draw_tri (GimpDrawable    *texture,
-                                        cairo_t         *cr,
-                                        cairo_surface_t *area,
-                                        gint             area_offx,
-                                        gint             area_offy,
-                                        GimpChannel     *mask,
-                                        gint             mask_offx,
-                                        gint             mask_offy,
-                                        gint            *x,
-                                        gint            *y,
-                                        gfloat          *u, /* texture coords */
-                                        gfloat          *v, /* 0.0 ... tex width, height */
-                                        guchar           opacity)
+static TransformPreviewTexture *
+gimp_canvas_transform_preview_get_texture (GimpDrawable *drawable,
+                                           GimpChannel  *mask,
+                                           gint          x1,
+                                           gint          y1,
+                                           gint          x2,
+                                           gint          y2,
+                                           gint          level)
 {
-  gdouble      clip_x1, clip_y1, clip_x2, clip_y2;
-  gint         j, k;
-  gint         ry;
-  gint        *l_edge, *r_edge;    /* arrays holding x-coords of edge pixels */
-  gint        *left,   *right;     /* temp pointers into l_edge and r_edge  */
-  gfloat       dul, dvl, dur, dvr; /* left and right texture coord deltas  */
-  gfloat       u_l, v_l, u_r, v_r; /* left and right texture coord pairs  */
-
-  g_return_if_fail (GIMP_IS_DRAWABLE (texture));
-  g_return_if_fail (area != NULL);
-
-  g_return_if_fail (x != NULL && y != NULL && u != NULL && v != NULL);
-
-  cairo_clip_extents (cr, &clip_x1, &clip_y1, &clip_x2, &clip_y2);
+  TransformPreviewTexture *texture;
+  gint                     scale = 1 << level;
+  gint                     offset_x;
+  gint                     offset_y;
+  gint                     width;
+  gint                     height;
+
+  gimp_item_get_offset (GIMP_ITEM (drawable), &offset_x, &offset_y);
+
+  texture = g_object_get_data (G_OBJECT (drawable), TEXTURE_DATA_KEY);
+
+  if (texture                        &&
+      texture->mask     == mask      &&
+      texture->level    == level     &&
+      texture->x1       == x1        &&
+      texture->y1       == y1        &&
+      texture->x2       == x2        &&
+      texture->y2       == y2        &&
+      texture->offset_x == offset_x  &&
+      texture->offset_y == offset_y)
+    {
+      return texture;
+    }
 
-  /* sort vertices in order of y-coordinate */
+  texture = g_slice_new0 (TransformPreviewTexture);
 
-  for (j = 0; j < 2; j++)
-    for (k = j + 1; k < 3; k++)
-      if (y[k] < y[j])
-        {
-          gint tmp;
-          gfloat ftmp;
+  texture->drawable = drawable;
+  texture->level    = level;
+  texture->x1       = x1;
+  texture->y1       = y1;
+  texture->x2       = x2;
+  texture->y2       = y2;
+  texture->offset_x = offset_x;
+  texture->offset_y = offset_y;
 
-          tmp  = y[k];  y[k] = y[j];  y[j] = tmp;
-          tmp  = x[k];  x[k] = x[j];  x[j] = tmp;
-          ftmp = u[k];  u[k] = u[j];  u[j] = ftmp;
-          ftmp = v[k];  v[k] = v[j];  v[j] = ftmp;
-        }
+  /* the area is inside the drawable, so its coordinates are positive */
+  texture->surface_x = x1 >> level;
+  texture->surface_y = y1 >> level;
 
-  if (y[2] == y[0])
-    return;
+  width  = ((x2 + scale - 1) >> level) - texture->surface_x;
+  height = ((y2 + scale - 1) >> level) - texture->surface_y;
 
-  l_edge = g_new (gint, y[2] - y[0]);
-  r_edge = g_new (gint, y[2] - y[0]);
+  texture->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                                 width, height);
 
-  /* draw the triangle */
+  gegl_buffer_get (gimp_drawable_get_buffer (drawable),
+                   GEGL_RECTANGLE (texture->surface_x, texture->surface_y,
+                                   width, height),
+                   1.0 / scale,
+                   babl_format ("cairo-ARGB32"),
+                   cairo_image_surface_get_data (texture->surface),
+                   cairo_image_surface_get_stride (texture->surface),
+                   GEGL_ABYSS_NONE);
 
-  gimp_canvas_transform_preview_trace_tri_edge (l_edge, x[0], y[0], x[2], y[2]);
+  cairo_surface_mark_dirty (texture->surface);
 
-  left = l_edge;
-  dul  = (u[2] - u[0]) / (y[2] - y[0]);
-  dvl  = (v[2] - v[0]) / (y[2] - y[0]);
-  u_l  = u[0];
-  v_l  = v[0];
+  texture->drawable_handler =
+    g_signal_connect_swapped (drawable, "invalidate-preview",
+                              G_CALLBACK (gimp_canvas_transform_preview_texture_invalidate),
+                              texture);
 
-  if (y[0] != y[1])
+  if (mask)
     {
-      gimp_canvas_transform_preview_trace_tri_edge (r_edge, x[0], y[0], x[1], y[1]);
-
-      right = r_edge;
-      dur   = (u[1] - u[0]) / (y[1] - y[0]);
-      dvr   = (v[1] - v[0]) / (y[1] - y[0]);
-      u_r   = u[0];
-      v_r   = v[0];
-
-      if (mask)
-        for (ry = y[0]; ry < y[1]; ry++)
-          {
-            if (ry >= clip_y1 && ry < clip_y2)
-              gimp_canvas_transform_preview_draw_tri_row_mask (texture, cr,
-                                                               area, area_offx, area_offy,
-                                                               mask, mask_offx, mask_offy,
-                                                               *left, u_l, v_l,
-                                                               *right, u_r, v_r,
-                                                               ry,
-                                                               opacity);
-            left ++;      right ++;
-            u_l += dul;   v_l += dvl;
-            u_r += dur;   v_r += dvr;
-          }
-      else
-        for (ry = y[0]; ry < y[1]; ry++)
-          {
-            if (ry >= clip_y1 && ry < clip_y2)
-              gimp_canvas_transform_preview_draw_tri_row (texture, cr,
-                                                          area, area_offx, area_offy,
-                                                          *left, u_l, v_l,
-                                                          *right, u_r, v_r,
-                                                          ry,
-                                                          opacity);
-            left ++;      right ++;
-            u_l += dul;   v_l += dvl;
-            u_r += dur;   v_r += dvr;
-          }
+      gint mask_x2;
+      gint mask_y2;
+
+      /* the mask is in image coordinates, which can be negative */
+      texture->mask_x = floor ((gdouble) (x1 + offset_x) / scale);
+      texture->mask_y = floor ((gdouble) (y1 + offset_y) / scale);
+      mask_x2         = ceil  ((gdouble) (x2 + offset_x) / scale);
+      mask_y2         = ceil  ((gdouble) (y2 + offset_y) / scale);
+
+      width  = mask_x2 - texture->mask_x;
+      height = mask_y2 - texture->mask_y;
+
+      texture->mask_surface = cairo_image_surface_create (CAIRO_FORMAT_A8,
+                                                          width, height);
+
+      gegl_buffer_get (gimp_drawable_get_buffer (GIMP_DRAWABLE (mask)),
+                       GEGL_RECTANGLE (texture->mask_x, texture->mask_y,
+                                       width, height),
+                       1.0 / scale,
+                       babl_format ("Y u8"),
+                       cairo_image_surface_get_data (texture->mask_surface),
+                       cairo_image_surface_get_stride (texture->mask_surface),
+                       GEGL_ABYSS_NONE);
+
+      cairo_surface_mark_dirty (texture->mask_surface);
+
+      texture->mask = mask;
+      g_object_add_weak_pointer (G_OBJECT (mask), (gpointer) &texture->mask);
+
+      texture->mask_handler =
+        g_signal_connect_swapped (mask, "invalidate-preview",
+                                  G_CALLBACK (gimp_canvas_transform_preview_texture_invalidate),
+                                  texture);
     }
 
-  if (y[1] != y[2])
-    {
-      gimp_canvas_transform_preview_trace_tri_edge (r_edge, x[1], y[1], x[2], y[2]);
-
-      right = r_edge;
-      dur   = (u[2] - u[1]) / (y[2] - y[1]);
-      dvr   = (v[2] - v[1]) / (y[2] - y[1]);
-      u_r   = u[1];
-      v_r   = v[1];
-
-      if (mask)
-        for (ry = y[1]; ry < y[2]; ry++)
-          {
-            if (ry >= clip_y1 && ry < clip_y2)
-              gimp_canvas_transform_preview_draw_tri_row_mask (texture, cr,
-                                                               area, area_offx, area_offy,
-                                                               mask, mask_offx, mask_offy,
-                                                               *left,  u_l, v_l,
-                                                               *right, u_r, v_r,
-                                                               ry,
-                                                               opacity);
-            left ++;      right ++;
-            u_l += dul;   v_l += dvl;
-            u_r += dur;   v_r += dvr;
-          }
-      else
-        for (ry = y[1]; ry < y[2]; ry++)
-          {
-            if (ry >= clip_y1 && ry < clip_y2)
-              gimp_canvas_transform_preview_draw_tri_row (texture, cr,
-                                                          area, area_offx, area_offy,
-                                                          *left,  u_l, v_l,
-                                                          *right, u_r, v_r,
-                                                          ry,
-                                                          opacity);
-            left ++;      right ++;
-            u_l += dul;   v_l += dvl;
-            u_r += dur;   v_r += dvr;
-          }
-    }
+  /* this frees the previous texture */
+  g_object_set_data_full (G_OBJECT (drawable), TEXTURE_DATA_KEY, texture,
+                          (GDestroyNotify) gimp_canvas_transform_preview_texture_free);
 
-  g_free (l_edge);
-  g_free (r_edge);
+  return texture;
 }
 
-/**
- * gimp_canvas_transform_preview_draw_tri_row:
- * @texture: the thing being transformed
- * @cr:      the #cairo_t to draw to
- * @area:    has prefetched pixel data of dest
- *
- * Called from gimp_canvas_transform_preview_draw_tri(), this draws a
- * single row of a triangle onto dest when there is not a mask. The
- * run (x1,y) to (x2,y) in dest corresponds to the run (u1,v1) to
- * (u2,v2) in texture.
- **/
 static void
-gimp_canvas_transform_preview_draw_tri_row (GimpDrawable    *texture,
-                                            cairo_t         *cr,
-                                            cairo_surface_t *area,
-                                            gint             area_offx,
-                                            gint             area_offy,
-                                            gint             x1,
-                                            gfloat           u1,
-                                            gfloat           v1,
-                                            gint             x2,
-                                            gfloat           u2,
-                                            gfloat           v2,
-                                            gint             y,
-                                            guchar           opacity)
+gimp_canvas_transform_preview_texture_free (TransformPreviewTexture *texture)
 {
-  GeglBuffer *buffer;
-  const Babl *format;
-  guchar     *buf;
-  guchar     *b;
-  guchar     *pptr;      /* points into the pixels of a row of area */
-  gint        bpp;
-  gfloat      u, v;
-  gfloat      du, dv;
-  gint        dx;
-  gint        samples;
-
-  if (x2 == x1)
-    return;
-
-  g_return_if_fail (GIMP_IS_DRAWABLE (texture));
-  g_return_if_fail (area != NULL);
-  g_return_if_fail (cairo_image_surface_get_format (area) == CAIRO_FORMAT_ARGB32);
-
-  /* make sure the pixel run goes in the positive direction */
-  if (x1 > x2)
+  /* the handlers are already gone if the drawable is being finalized */
+  if (g_signal_handler_is_connected (texture->drawable,
+                                     texture->drawable_handler))
     {
-      gint   tmp;
-      gfloat ftmp;
-
-      tmp  = x2;  x2 = x1;  x1 = tmp;
-      ftmp = u2;  u2 = u1;  u1 = ftmp;
-      ftmp = v2;  v2 = v1;  v1 = ftmp;
+      g_signal_handler_disconnect (texture->drawable,
+                                   texture->drawable_handler);
     }
 
-  u = u1;
-  v = v1;
-  du = (u2 - u1) / (x2 - x1);
-  dv = (v2 - v1) / (x2 - x1);
-
-  /* don't calculate unseen pixels */
-  if (x1 < area_offx)
+  if (texture->mask)
     {
-      u += du * (area_offx - x1);
-      v += dv * (area_offx - x1);
-      x1 = area_offx;
-    }
-  else if (x1 > area_offx + cairo_image_surface_get_width (area) - 1)
-    {
-      return;
+      g_signal_handler_disconnect (texture->mask, texture->mask_handler);
+      g_object_remove_weak_pointer (G_OBJECT (texture->mask),
+                                    (gpointer) &texture->mask);
     }
 
-  if (x2 < area_offx)
-    {
-      return;
-    }
-  else if (x2 > area_offx + cairo_image_surface_get_width (area) - 1)
-    {
-      x2 = area_offx + cairo_image_surface_get_width (area) - 1;
-    }
+  cairo_surface_destroy (texture->surface);
 
-  dx = x2 - x1;
-  if (! dx)
-    return;
-
-  cairo_surface_flush (area);
-  pptr = (cairo_image_surface_get_data (area)
-          + (y - area_offy) * cairo_image_surface_get_stride (area)
-          + (x1 - area_offx) * 4);
-
-  buffer = gimp_drawable_get_buffer (texture);
-
-  format = gegl_buffer_get_format (buffer);
-  bpp    = babl_format_get_bytes_per_pixel (format);
-  buf    = g_alloca (bpp * dx);
-
-  samples = dx;
-  b       = buf;
-
-  while (samples--)
-    {
-      gegl_buffer_sample (buffer, (gint) u, (gint) v, NULL, b,
-                          format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-
-      b += bpp;
-
-      u += du;
-      v += dv;
-    }
+  if (texture->mask_surface)
+    cairo_surface_destroy (texture->mask_surface);
 
-  if (opacity < 255)
-    {
-      guchar *u8_buffer = g_alloca (4 * dx);
-      guchar *u8_b;
-
-      babl_process (babl_fish (format,
-                               babl_format ("R'G'B'A u8")),
-                    buf, u8_buffer, dx);
-
-      samples = dx;
-      u8_b    = u8_buffer;
-
-      while (samples--)
-        {
-          register gulong tmp;
-
-          u8_b[3] = INT_MULT (opacity, u8_b[3], tmp);
-
-          u8_b += 4;
-        }
-
-      babl_process (babl_fish (babl_format ("R'G'B'A u8"),
-                               babl_format ("cairo-ARGB32")),
-                    u8_buffer, pptr, dx);
-    }
-  else
-    {
-      babl_process (babl_fish (format,
-                               babl_format ("cairo-ARGB32")),
-                    buf, pptr, dx);
-    }
-
-  cairo_surface_mark_dirty (area);
+  g_slice_free (TransformPreviewTexture, texture);
+}
 
-  cairo_set_source_surface (cr, area, area_offx, area_offy);
-  cairo_rectangle (cr, x1, y, x2 - x1, 1);
-  cairo_fill (cr);
+static void
+gimp_canvas_transform_preview_texture_invalidate (TransformPreviewTexture *texture)
+{
+  g_object_set_data (G_OBJECT (texture->drawable), TEXTURE_DATA_KEY, NULL);
 }
 
 /**
- * gimp_canvas_transform_preview_draw_tri_row_mask:
+ * gimp_canvas_transform_preview_draw_patch:
+ * @cr:       the #cairo_t to draw to
+ * @texture:  the texture of the previewed drawable
+ * @use_mask: whether to apply the texture's selection mask
+ * @opacity:  the opacity of the preview, ignored if @use_mask is %TRUE
+ * @x:        the screen x coordinates of the patch's corners
+ * @y:        the screen y coordinates of the patch's corners
+ * @u:        the corresponding drawable x coordinates
+ * @v:        the corresponding drawable y coordinates
+ * @n_points: the number of corners
  *
- * Called from gimp_canvas_transform_preview_draw_tri(), this draws a
- * single row of a triangle onto dest, when there is a mask.
+ * Draws the triangle or parallelogram given by the corners, mapping
+ * the drawable to it by the affine transform that is defined by its
+ * first three corners.
  **/
 static void
-gimp_canvas_transform_preview_draw_tri_row_mask (GimpDrawable    *texture,
-                                                 cairo_t         *cr,
-                                                 cairo_surface_t *area,
-                                                 gint             area_offx,
-                                                 gint             area_offy,
-                                                 GimpChannel     *mask,
-                                                 gint             mask_offx,
-                                                 gint             mask_offy,
-                                                 gint             x1,
-                                                 gfloat           u1,
-                                                 gfloat           v1,
-                                                 gint             x2,
-                                                 gfloat           u2,
-                                                 gfloat           v2,
-                                                 gint             y,
-                                                 guchar           opacity)
+gimp_canvas_transform_preview_draw_patch (cairo_t                 *cr,
+                                          TransformPreviewTexture *texture,
+                                          gboolean                 use_mask,
+                                          gdouble                  opacity,
+                                          const gdouble           *x,
+                                          const gdouble           *y,
+                                          const gdouble           *u,
+                                          const gdouble           *v,
+                                          gint                     n_points)
 {
-  GeglBuffer *buffer;
-  GeglBuffer *mask_buffer;
-  const Babl *format;
-  const Babl *mask_format;
-  guchar     *buf;
-  guchar     *mask_buf;
-  guchar     *b;
-  guchar     *mask_b;
-  guchar     *pptr;              /* points into the pixels of area        */
-  gint        bpp;
-  gint        mask_bpp;
-  gfloat      u, v;
-  gfloat      mu, mv;
-  gfloat      du, dv;
-  gint        dx;
-  gint        samples;
-
-  if (x2 == x1)
+  cairo_matrix_t  matrix;
+  gdouble         du1 = u[1] - u[0];
+  gdouble         dv1 = v[1] - v[0];
+  gdouble         du2 = u[2] - u[0];
+  gdouble         dv2 = v[2] - v[0];
+  gdouble         dx1 = x[1] - x[0];
+  gdouble         dy1 = y[1] - y[0];
+  gdouble         dx2 = x[2] - x[0];
+  gdouble         dy2 = y[2] - y[0];
+  gdouble         det;
+  gint            scale = 1 << texture->level;
+  gint            i;
+
+  det = du1 * dv2 - du2 * dv1;
+
+  if (fabs (det) < 1e-10)
     return;
 
-  g_return_if_fail (GIMP_IS_DRAWABLE (texture));
-  g_return_if_fail (GIMP_IS_CHANNEL (mask));
-  g_return_if_fail (area != NULL);
-  g_return_if_fail (cairo_image_surface_get_format (area) == CAIRO_FORMAT_ARGB32);
+  cairo_matrix_init (&matrix,
+                     (dx1 * dv2 - dx2 * dv1) / det,
+                     (dy1 * dv2 - dy2 * dv1) / det,
+                     (dx2 * du1 - dx1 * du2) / det,
+                     (dy2 * du1 - dy1 * du2) / det,
+                     0.0, 0.0);
 
-  /* make sure the pixel run goes in the positive direction */
-  if (x1 > x2)
-    {
-      gint   tmp;
-      gfloat ftmp;
-
-      tmp  = x2;  x2 = x1;  x1 = tmp;
-      ftmp = u2;  u2 = u1;  u1 = ftmp;
-      ftmp = v2;  v2 = v1;  v1 = ftmp;
-    }
+  matrix.x0 = x[0] - matrix.xx * u[0] - matrix.xy * v[0];
+  matrix.y0 = y[0] - matrix.yx * u[0] - matrix.yy * v[0];
 
-  u = u1;
-  v = v1;
-  du = (u2 - u1) / (x2 - x1);
-  dv = (v2 - v1) / (x2 - x1);
-
-  /* don't calculate unseen pixels */
-  if (x1 < area_offx)
-    {
-      u += du * (area_offx - x1);
-      v += dv * (area_offx - x1);
-      x1 = area_offx;
-    }
-  else if (x1 > area_offx + cairo_image_surface_get_width (area) - 1)
-    {
-      return;
-    }
-
-  if (x2 < area_offx)
-    {
-      return;
-    }
-  else if (x2 > area_offx + cairo_image_surface_get_width (area) - 1)
-    {
-      x2 = area_offx + cairo_image_surface_get_width (area) - 1;
-    }
-
-  dx = x2 - x1;
-  if (! dx)
+  /* cairo refuses singular matrices, and there is nothing to draw */
+  if (fabs (matrix.xx * matrix.yy - matrix.xy * matrix.yx) < 1e-10)
     return;
 
-  mu = u + mask_offx;
-  mv = v + mask_offy;
-
-  cairo_surface_flush (area);
-  pptr = (cairo_image_surface_get_data (area)
-          + (y - area_offy) * cairo_image_surface_get_stride (area)
-          + (x1 - area_offx) * 4);
-
-  buffer      = gimp_drawable_get_buffer (texture);
-  mask_buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (mask));
-
-  format      = gegl_buffer_get_format (buffer);
-  mask_format = gegl_buffer_get_format (mask_buffer);
-  bpp         = babl_format_get_bytes_per_pixel (format);
-  mask_bpp    = babl_format_get_bytes_per_pixel (mask_format);
-  buf         = g_alloca (bpp * dx);
-  mask_buf    = g_alloca (mask_bpp * dx);
-
-  samples = dx;
-  b       = buf;
-  mask_b  = mask_buf;
-
-  while (samples--)
-    {
-      gegl_buffer_sample (buffer, (gint) u, (gint) v, NULL, b,
-                          format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-      gegl_buffer_sample (mask_buffer, (gint) mu, (gint) mv, NULL, mask_b,
-                          mask_format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-
-      b      += bpp;
-      mask_b += mask_bpp;
-
-      u += du;
-      v += dv;
-      mu += du;
-      mv += dv;
-    }
-
-  {
-    guchar *u8_buffer      = g_alloca (4 * dx);
-    guchar *u8_mask_buffer = g_alloca (dx);
-    guchar *u8_b;
-    guchar *u8_mask_b;
-
-    babl_process (babl_fish (format,
-                             babl_format ("R'G'B'A u8")),
-                  buf, u8_buffer, dx);
-    babl_process (babl_fish (mask_format,
-                             babl_format ("Y u8")),
-                  mask_buf, u8_mask_buffer, dx);
-
-    samples   = dx;
-    u8_b      = u8_buffer;
-    u8_mask_b = u8_mask_buffer;
-
-    while (samples--)
-      {
-        register gulong tmp;
-
-        u8_b[3] = INT_MULT3 (opacity, *u8_mask_b, u8_b[3], tmp);
-
-        u8_b      += 4;
-        u8_mask_b += 1;
-      }
-
-    babl_process (babl_fish (babl_format ("R'G'B'A u8"),
-                             babl_format ("cairo-ARGB32")),
-                  u8_buffer, pptr, dx);
-  }
+  cairo_save (cr);
 
-  cairo_surface_mark_dirty (area);
+  cairo_move_to (cr, x[0], y[0]);
+  for (i = 1; i < n_points; i++)
+    cairo_line_to (cr, x[i], y[i]);
+  cairo_close_path (cr);
 
-  cairo_set_source_surface (cr, area, area_offx, area_offy);
-  cairo_rectangle (cr, x1, y, x2 - x1, 1);
-  cairo_fill (cr);
-}
-
-/**
- * gimp_canvas_transform_preview_trace_tri_edge:
- * @dest: x coordinates are placed in this array
- *
- * Find the x coordinates for a line that runs from (x1,y1) to
- * (x2,y2), corresponding to the y coordinates y1 to y2-1. So dest
- * must be large enough to hold y2-y1 values.
- **/
-static void
-gimp_canvas_transform_preview_trace_tri_edge (gint *dest,
-                                              gint  x1,
-                                              gint  y1,
-                                              gint  x2,
-                                              gint  y2)
-{
-  const gint  dx   = x2 - x1;
-  const gint  dy   = y2 - y1;
-  gint        b    = dy;
-  gint       *dptr = dest;
-  gint        errorterm;
+  cairo_clip (cr);
 
-  if (dy <= 0)
-    return;
+  cairo_transform (cr, &matrix);
+  cairo_scale (cr, scale, scale);
 
-  g_return_if_fail (dest != NULL);
+  cairo_set_source_surface (cr, texture->surface,
+                            texture->surface_x, texture->surface_y);
+  cairo_pattern_set_extend (cairo_get_source (cr), CAIRO_EXTEND_PAD);
 
-  if (dx >= 0)
+  if (use_mask && texture->mask_surface)
     {
-      errorterm = 0;
-
-      while (b--)
-        {
-          *dptr++ = x1;
-
-          errorterm += dx;
-
-          while (errorterm > dy)
-            {
-              x1++;
-              errorterm -= dy;
-            }
-        }
+      cairo_mask_surface (cr, texture->mask_surface,
+                          texture->mask_x - (gdouble) texture->offset_x / scale,
+                          texture->mask_y - (gdouble) texture->offset_y / scale);
     }
   else
     {
-      errorterm = dy;
-
-      while (b--)
-        {
-          while (errorterm > dy)
-            {
-              x1--;
-              errorterm -= dy;
-            }
-
-          /* dx is negative here, so this is effectively an addition: */
-          errorterm -= dx;
-
-          *dptr++ = x1;
-        }
+      cairo_paint_with_alpha (cr, opacity);
     }
+
+  cairo_restore (cr);
 }
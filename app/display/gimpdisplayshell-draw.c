@@ -39,7 +39,13 @@
 #include "gimpdisplayshell-render.h"
 #include "gimpdisplayshell-scale.h"
 #include "gimpdisplayshell-transform.h"
-#include "gimpdisplayxfer.h"
+
+
+/*  local function prototypes  */
+
+static gint   gimp_display_shell_draw_chunk_start (gint coord,
+                                                   gint offset,
+                                                   gint size);
 
 
 /*  public functions  */
@@ -178,18 +184,48 @@ gimp_display_shell_draw_image (GimpDisplayShell *shell,
     }
 
   /*  display the image in RENDER_BUF_WIDTH x RENDER_BUF_HEIGHT
-   *  sized chunks
+   *  sized chunks, aligned to the scaled image, so that each chunk is
+   *  drawn from a single tile of the render cache
    */
-  for (i = y1; i < y2; i += GIMP_DISPLAY_RENDER_BUF_HEIGHT)
+  for (i = gimp_display_shell_draw_chunk_start (y1, shell->offset_y,
+                                                GIMP_DISPLAY_RENDER_BUF_HEIGHT);
+       i < y2;
+       i += GIMP_DISPLAY_RENDER_BUF_HEIGHT)
     {
-      for (j = x1; j < x2; j += GIMP_DISPLAY_RENDER_BUF_WIDTH)
+      for (j = gimp_display_shell_draw_chunk_start (x1, shell->offset_x,
+                                                    GIMP_DISPLAY_RENDER_BUF_WIDTH);
+           j < x2;
+           j += GIMP_DISPLAY_RENDER_BUF_WIDTH)
         {
-          gint dx, dy;
+          gint cx1, cy1;
+          gint cx2, cy2;
 
-          dx = MIN (x2 - j, GIMP_DISPLAY_RENDER_BUF_WIDTH);
-          dy = MIN (y2 - i, GIMP_DISPLAY_RENDER_BUF_HEIGHT);
+          cx1 = MAX (j, x1);
+          cy1 = MAX (i, y1);
+          cx2 = MIN (j + GIMP_DISPLAY_RENDER_BUF_WIDTH,  x2);
+          cy2 = MIN (i + GIMP_DISPLAY_RENDER_BUF_HEIGHT, y2);
 
-          gimp_display_shell_render (shell, cr, j, i, dx, dy);
+          gimp_display_shell_render (shell, cr,
+                                     cx1, cy1, cx2 - cx1, cy2 - cy1);
         }
     }
 }
+
+
+/*  private functions  */
+
+/*  returns the start of the size-aligned chunk of the scaled image
+ *  that contains the window coordinate @coord
+ */
+static gint
+gimp_display_shell_draw_chunk_start (gint coord,
+                                     gint offset,
+                                     gint size)
+{
+  gint mod = (coord + offset) % size;
+
+  if (mod < 0)
+    mod += size;
+
+  return coord - mod;
+}
@@ -30,6 +30,7 @@
 #include "gimpdisplayshell.h"
 #include "gimpdisplayshell-expose.h"
 #include "gimpdisplayshell-filter.h"
+#include "gimpdisplayshell-render.h"
 
 
 /*  local function prototypes  */
@@ -114,6 +115,7 @@ gimp_display_shell_filter_changed_idle (gpointer data)
 {
   GimpDisplayShell *shell = data;
 
+  gimp_display_shell_render_invalidate_full (shell);
   gimp_display_shell_expose_full (shell);
   shell->filter_idle_id = 0;
 
@@ -59,6 +59,7 @@
 #include "gimpdisplayshell-expose.h"
 #include "gimpdisplayshell-handlers.h"
 #include "gimpdisplayshell-icon.h"
+#include "gimpdisplayshell-render.h"
 #include "gimpdisplayshell-scale.h"
 #include "gimpdisplayshell-scroll.h"
 #include "gimpdisplayshell-selection.h"
@@ -725,6 +726,9 @@ gimp_display_shell_size_changed_detailed_handler (GimpImage        *image,
                                                   gint              previous_height,
                                                   GimpDisplayShell *shell)
 {
+  /*  the rendered tiles are positioned relative to the image origin  */
+  gimp_display_shell_render_invalidate_full (shell);
+
   if (shell->display->config->resize_windows_on_resize)
     {
       GimpImageWindow *window = gimp_display_shell_get_window (shell);
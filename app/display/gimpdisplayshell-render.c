@@ -21,6 +21,7 @@
 #include <gtk/gtk.h>
 
 #include "libgimpcolor/gimpcolor.h"
+#include "libgimpmath/gimpmath.h"
 #include "libgimpwidgets/gimpwidgets.h"
 
 #include "display-types.h"
@@ -41,9 +42,151 @@
 #include "gimpdisplayshell-filter.h"
 #include "gimpdisplayshell-render.h"
 #include "gimpdisplayshell-scroll.h"
-#include "gimpdisplayxfer.h"
 
 
+/*  gimp_display_shell_draw_image() draws in chunks of this size  */
+#define CACHE_TILE_SIZE  GIMP_DISPLAY_RENDER_BUF_WIDTH
+#define CACHE_MAX_TILES  256
+
+
+/*  a tile of the rendered projection, at the cache's scale.  its
+ *  position is in device pixels of the scaled, unrotated image, which
+ *  doesn't change while scrolling.
+ */
+typedef struct
+{
+  gint64           key;
+  gint             x;
+  gint             y;
+  cairo_surface_t *surface;
+  cairo_region_t  *invalid;  /*  the parts that need to be rendered  */
+  GList            link;     /*  link in the LRU queue of the cache   */
+} RenderTile;
+
+
+/*  local function prototypes  */
+
+static void         gimp_display_shell_render_tile_free     (RenderTile          *tile);
+static gint         gimp_display_shell_render_tile_index    (gint                 coord);
+static RenderTile * gimp_display_shell_render_get_tile      (GimpDisplayShell    *shell,
+                                                             cairo_t             *cr,
+                                                             gint                 tile_x,
+                                                             gint                 tile_y);
+static void         gimp_display_shell_render_validate_tile (GimpDisplayShell    *shell,
+                                                             RenderTile          *tile,
+                                                             const GeglRectangle *area,
+                                                             gdouble              scale);
+static void         gimp_display_shell_render_projection    (GimpDisplayShell    *shell,
+                                                             guchar              *data,
+                                                             gint                 stride,
+                                                             const GeglRectangle *area,
+                                                             gdouble              scale);
+
+
+/*  public functions  */
+
+void
+gimp_display_shell_render_init (GimpDisplayShell *shell)
+{
+  g_return_if_fail (GIMP_IS_DISPLAY_SHELL (shell));
+
+  shell->render_cache =
+    g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL,
+                           (GDestroyNotify) gimp_display_shell_render_tile_free);
+  shell->render_queue = g_queue_new ();
+}
+
+void
+gimp_display_shell_render_free (GimpDisplayShell *shell)
+{
+  g_return_if_fail (GIMP_IS_DISPLAY_SHELL (shell));
+
+  if (shell->render_cache)
+    {
+      gimp_display_shell_render_invalidate_full (shell);
+
+      g_hash_table_unref (shell->render_cache);
+      shell->render_cache = NULL;
+
+      g_queue_free (shell->render_queue);
+      shell->render_queue = NULL;
+    }
+}
+
+/**
+ * gimp_display_shell_render_invalidate_full:
+ * @shell: a #GimpDisplayShell
+ *
+ * Drops all rendered tiles, e.g. when the display filters changed.
+ **/
+void
+gimp_display_shell_render_invalidate_full (GimpDisplayShell *shell)
+{
+  g_return_if_fail (GIMP_IS_DISPLAY_SHELL (shell));
+
+  if (shell->render_cache)
+    {
+      /*  the queue's links are part of the tiles  */
+      g_queue_init (shell->render_queue);
+
+      g_hash_table_remove_all (shell->render_cache);
+    }
+}
+
+/**
+ * gimp_display_shell_render_invalidate_area:
+ * @shell: a #GimpDisplayShell
+ * @x:     x coordinate of the area, in image coordinates
+ * @y:     y coordinate of the area, in image coordinates
+ * @w:     width of the area
+ * @h:     height of the area
+ *
+ * Marks the rendered tiles covering an updated area of the projection
+ * for rendering on their next expose.
+ **/
+void
+gimp_display_shell_render_invalidate_area (GimpDisplayShell *shell,
+                                           gint              x,
+                                           gint              y,
+                                           gint              w,
+                                           gint              h)
+{
+  cairo_rectangle_int_t rect;
+  gdouble               scale;
+  GList                *list;
+
+  g_return_if_fail (GIMP_IS_DISPLAY_SHELL (shell));
+
+  if (! shell->render_queue || g_queue_is_empty (shell->render_queue))
+    return;
+
+  scale = shell->render_scale;
+
+  /*  accommodate for spill introduced by box filtering, like
+   *  gimp_display_paint_area() does
+   */
+  rect.x      = floor (x * scale) - 1;
+  rect.y      = floor (y * scale) - 1;
+  rect.width  = ceil ((x + w) * scale) + 1 - rect.x;
+  rect.height = ceil ((y + h) * scale) + 1 - rect.y;
+
+  for (list = shell->render_queue->head; list; list = g_list_next (list))
+    {
+      RenderTile            *tile = list->data;
+      cairo_rectangle_int_t  tile_rect;
+
+      tile_rect.x      = MAX (rect.x, tile->x);
+      tile_rect.y      = MAX (rect.y, tile->y);
+      tile_rect.width  = MIN (rect.x + rect.width,
+                              tile->x + CACHE_TILE_SIZE) - tile_rect.x;
+      tile_rect.height = MIN (rect.y + rect.height,
+                              tile->y + CACHE_TILE_SIZE) - tile_rect.y;
+
+      if (tile_rect.width > 0 && tile_rect.height > 0)
+        cairo_region_union_rectangle (tile->invalid, &tile_rect);
+    }
+}
+
 void
 gimp_display_shell_render (GimpDisplayShell *shell,
                            cairo_t          *cr,
@@ -52,19 +195,14 @@ gimp_display_shell_render (GimpDisplayShell *shell,
                            gint              w,
                            gint              h)
 {
-  GimpImage       *image;
-  GimpProjection  *projection;
-  GeglBuffer      *buffer;
   gdouble          window_scale = 1.0;
+  gdouble          scale;
   gint             viewport_offset_x;
   gint             viewport_offset_y;
   gint             viewport_width;
   gint             viewport_height;
-  cairo_surface_t *xfer;
-  gint             src_x;
-  gint             src_y;
-  gint             mask_src_x = 0;
-  gint             mask_src_y = 0;
+  GeglRectangle    area;
+  gint             tile_x, tile_y;
   gint             stride;
   guchar          *data;
 
@@ -72,10 +210,6 @@ gimp_display_shell_render (GimpDisplayShell *shell,
   g_return_if_fail (cr != NULL);
   g_return_if_fail (w > 0 && h > 0);
 
-  image      = gimp_display_get_image (shell->display);
-  projection = gimp_image_get_projection (image);
-  buffer     = gimp_pickable_get_buffer (GIMP_PICKABLE (projection));
-
 #ifdef GIMP_DISPLAY_RENDER_ENABLE_SCALING
   /* if we had this future API, things would look pretty on hires (retina) */
   window_scale = gdk_window_get_scale_factor (gtk_widget_get_window (gtk_widget_get_toplevel (GTK_WIDGET (shell))));
@@ -83,53 +217,25 @@ gimp_display_shell_render (GimpDisplayShell *shell,
 
   window_scale = MIN (window_scale, GIMP_DISPLAY_RENDER_MAX_SCALE);
 
+  scale = shell->scale_x * window_scale;
+
   gimp_display_shell_scroll_get_scaled_viewport (shell,
                                                  &viewport_offset_x,
                                                  &viewport_offset_y,
                                                  &viewport_width,
                                                  &viewport_height);
-  if (shell->rotate_transform)
-    {
-      xfer = cairo_surface_create_similar_image (cairo_get_target (cr),
-                                                 CAIRO_FORMAT_ARGB32,
-                                                 w * window_scale,
-                                                 h * window_scale);
-      cairo_surface_mark_dirty (xfer);
-      src_x = 0;
-      src_y = 0;
-    }
-  else
-    {
-      xfer = gimp_display_xfer_get_surface (shell->xfer,
-                                            w * window_scale,
-                                            h * window_scale,
-                                            &src_x, &src_y);
-    }
 
-  stride = cairo_image_surface_get_stride (xfer);
-  data = cairo_image_surface_get_data (xfer);
-  data += src_y * stride + src_x * 4;
+  /*  the area to render, in device pixels of the scaled image  */
+  area.x      = (x + viewport_offset_x) * window_scale;
+  area.y      = (y + viewport_offset_y) * window_scale;
+  area.width  = w * window_scale;
+  area.height = h * window_scale;
 
-  gegl_buffer_get (buffer,
-                   GEGL_RECTANGLE ((x + viewport_offset_x) * window_scale,
-                                   (y + viewport_offset_y) * window_scale,
-                                   w * window_scale,
-                                   h * window_scale),
-                   shell->scale_x * window_scale,
-                   babl_format ("cairo-ARGB32"),
-		   data, stride,
-                   GEGL_ABYSS_NONE);
-
-  /*  apply filters to the rendered projection  */
-  if (shell->filter_stack)
+  if (scale != shell->render_scale)
     {
-      cairo_surface_t *image =
-	cairo_image_surface_create_for_data (data, CAIRO_FORMAT_ARGB32,
-					     w * window_scale,
-					     h * window_scale,
-					     stride);
-      gimp_color_display_stack_convert_surface (shell->filter_stack, image);
-      cairo_surface_destroy (image);
+      gimp_display_shell_render_invalidate_full (shell);
+
+      shell->render_scale = scale;
     }
 
   if (shell->mask)
@@ -150,23 +256,19 @@ gimp_display_shell_render (GimpDisplayShell *shell,
 
       stride = cairo_image_surface_get_stride (shell->mask_surface);
       data = cairo_image_surface_get_data (shell->mask_surface);
-      data += mask_src_y * stride + mask_src_x * 4;
 
       gegl_buffer_get (shell->mask,
-                       GEGL_RECTANGLE ((x + viewport_offset_x) * window_scale,
-                                       (y + viewport_offset_y) * window_scale,
-                                       w * window_scale,
-                                       h * window_scale),
-                       shell->scale_x * window_scale,
+                       &area,
+                       scale,
                        babl_format ("Y u8"),
                        data, stride,
                        GEGL_ABYSS_NONE);
 
       /* invert the mask so what is *not* the foreground object is masked */
-      mask_height = h * window_scale;
+      mask_height = area.height;
       while (mask_height--)
         {
-          gint    mask_width = w * window_scale;
+          gint    mask_width = area.width;
           guchar *d          = data;
 
           while (mask_width--)
@@ -180,40 +282,245 @@ gimp_display_shell_render (GimpDisplayShell *shell,
         }
     }
 
-  /*  put it to the screen  */
+  /*  put it to the screen, blitting the cached tiles, after
+   *  rendering their invalid parts
+   */
   cairo_save (cr);
 
-  cairo_rectangle (cr, x, y, w, h);
-
   cairo_scale (cr, 1.0 / window_scale, 1.0 / window_scale);
 
-  cairo_set_source_surface (cr, xfer,
-                            (x - src_x) * window_scale,
-                            (y - src_y) * window_scale);
-
-  if (shell->rotate_transform)
+  for (tile_y = gimp_display_shell_render_tile_index (area.y);
+       tile_y <= gimp_display_shell_render_tile_index (area.y +
+                                                       area.height - 1);
+       tile_y++)
     {
-      cairo_pattern_t *pattern;
+      for (tile_x = gimp_display_shell_render_tile_index (area.x);
+           tile_x <= gimp_display_shell_render_tile_index (area.x +
+                                                           area.width - 1);
+           tile_x++)
+        {
+          RenderTile *tile;
+          gint        x1, y1;
+          gint        x2, y2;
+
+          tile = gimp_display_shell_render_get_tile (shell, cr,
+                                                     tile_x, tile_y);
+
+          gimp_display_shell_render_validate_tile (shell, tile,
+                                                   &area, scale);
+
+          x1 = MAX (area.x, tile->x);
+          y1 = MAX (area.y, tile->y);
+          x2 = MIN (area.x + area.width,  tile->x + CACHE_TILE_SIZE);
+          y2 = MIN (area.y + area.height, tile->y + CACHE_TILE_SIZE);
+
+          cairo_set_source_surface (cr, tile->surface,
+                                    tile->x - viewport_offset_x * window_scale,
+                                    tile->y - viewport_offset_y * window_scale);
+          cairo_rectangle (cr,
+                           x1 - viewport_offset_x * window_scale,
+                           y1 - viewport_offset_y * window_scale,
+                           x2 - x1, y2 - y1);
+
+          if (shell->rotate_transform)
+            {
+              cairo_pattern_t *pattern;
 
-      pattern = cairo_get_source (cr);
-      cairo_pattern_set_extend (pattern, CAIRO_EXTEND_PAD);
+              /*  the rotated edges of the rectangle are antialiased, so
+               *  also paint its outline, with the tile's edge pixels
+               *  extended, to avoid seams between adjacent rectangles
+               */
+              pattern = cairo_get_source (cr);
+              cairo_pattern_set_extend (pattern, CAIRO_EXTEND_PAD);
 
-      cairo_set_line_width (cr, 1.0);
-      cairo_stroke_preserve (cr);
+              cairo_set_line_width (cr, 1.0);
+              cairo_stroke_preserve (cr);
+            }
 
-      cairo_surface_destroy (xfer);
+          cairo_fill (cr);
+        }
     }
 
-  cairo_clip (cr);
-  cairo_paint (cr);
-
   if (shell->mask)
     {
+      cairo_rectangle (cr,
+                       x * window_scale, y * window_scale,
+                       area.width, area.height);
+      cairo_clip (cr);
+
       gimp_cairo_set_source_rgba (cr, &shell->mask_color);
       cairo_mask_surface (cr, shell->mask_surface,
-                          (x - mask_src_x) * window_scale,
-                          (y - mask_src_y) * window_scale);
+                          x * window_scale, y * window_scale);
     }
 
   cairo_restore (cr);
 }
+
+
+/*  private functions  */
+
+static void
+gimp_display_shell_render_tile_free (RenderTile *tile)
+{
+  cairo_surface_destroy (tile->surface);
+  cairo_region_destroy (tile->invalid);
+
+  g_slice_free (RenderTile, tile);
+}
+
+static gint
+gimp_display_shell_render_tile_index (gint coord)
+{
+  if (coord >= 0)
+    return coord / CACHE_TILE_SIZE;
+  else
+    return - ((- coord - 1) / CACHE_TILE_SIZE) - 1;
+}
+
+/*  returns the tile at (tile_x, tile_y), creating it if necessary, and
+ *  makes it the most recently used one
+ */
+static RenderTile *
+gimp_display_shell_render_get_tile (GimpDisplayShell *shell,
+                                    cairo_t          *cr,
+                                    gint              tile_x,
+                                    gint              tile_y)
+{
+  RenderTile            *tile;
+  cairo_rectangle_int_t  rect;
+  gint64                 key = ((gint64) tile_y << 32) | (guint32) tile_x;
+
+  tile = g_hash_table_lookup (shell->render_cache, &key);
+
+  if (tile)
+    {
+      g_queue_unlink (shell->render_queue, &tile->link);
+      g_queue_push_head_link (shell->render_queue, &tile->link);
+
+      return tile;
+    }
+
+  if (g_queue_get_length (shell->render_queue) >= CACHE_MAX_TILES)
+    {
+      RenderTile *lru = g_queue_peek_tail (shell->render_queue);
+
+      g_queue_unlink (shell->render_queue, &lru->link);
+      g_hash_table_remove (shell->render_cache, &lru->key);
+    }
+
+  tile = g_slice_new0 (RenderTile);
+
+  tile->key       = key;
+  tile->x         = tile_x * CACHE_TILE_SIZE;
+  tile->y         = tile_y * CACHE_TILE_SIZE;
+  tile->surface   = cairo_surface_create_similar_image (cairo_get_target (cr),
+                                                        CAIRO_FORMAT_ARGB32,
+                                                        CACHE_TILE_SIZE,
+                                                        CACHE_TILE_SIZE);
+  tile->link.data = tile;
+
+  rect.x      = tile->x;
+  rect.y      = tile->y;
+  rect.width  = CACHE_TILE_SIZE;
+  rect.height = CACHE_TILE_SIZE;
+
+  tile->invalid = cairo_region_create_rectangle (&rect);
+
+  g_hash_table_insert (shell->render_cache, &tile->key, tile);
+  g_queue_push_head_link (shell->render_queue, &tile->link);
+
+  return tile;
+}
+
+/*  renders the invalid parts of @tile within @area, which are all
+ *  within the tile
+ */
+static void
+gimp_display_shell_render_validate_tile (GimpDisplayShell    *shell,
+                                         RenderTile          *tile,
+                                         const GeglRectangle *area,
+                                         gdouble              scale)
+{
+  cairo_rectangle_int_t  rect = { area->x, area->y, area->width, area->height };
+  cairo_region_t        *region;
+  guchar                *data;
+  gint                   stride;
+  gint                   i;
+
+  if (cairo_region_is_empty (tile->invalid))
+    return;
+
+  region = cairo_region_copy (tile->invalid);
+  cairo_region_intersect_rectangle (region, &rect);
+
+  if (! cairo_region_is_empty (region))
+    {
+      cairo_surface_flush (tile->surface);
+
+      data   = cairo_image_surface_get_data (tile->surface);
+      stride = cairo_image_surface_get_stride (tile->surface);
+
+      for (i = 0; i < cairo_region_num_rectangles (region); i++)
+        {
+          cairo_rectangle_int_t r;
+
+          cairo_region_get_rectangle (region, i, &r);
+
+          gimp_display_shell_render_projection (shell,
+                                                data +
+                                                (r.y - tile->y) * stride +
+                                                (r.x - tile->x) * 4,
+                                                stride,
+                                                GEGL_RECTANGLE (r.x, r.y,
+                                                                r.width,
+                                                                r.height),
+                                                scale);
+
+          cairo_surface_mark_dirty_rectangle (tile->surface,
+                                              r.x - tile->x, r.y - tile->y,
+                                              r.width, r.height);
+        }
+
+      cairo_region_subtract (tile->invalid, region);
+    }
+
+  cairo_region_destroy (region);
+}
+
+/*  renders @area of the scaled projection to @data, and applies the
+ *  display filters to it
+ */
+static void
+gimp_display_shell_render_projection (GimpDisplayShell    *shell,
+                                      guchar              *data,
+                                      gint                 stride,
+                                      const GeglRectangle *area,
+                                      gdouble              scale)
+{
+  GimpImage      *image;
+  GimpProjection *projection;
+  GeglBuffer     *buffer;
+
+  image      = gimp_display_get_image (shell->display);
+  projection = gimp_image_get_projection (image);
+  buffer     = gimp_pickable_get_buffer (GIMP_PICKABLE (projection));
+
+  gegl_buffer_get (buffer,
+                   area,
+                   scale,
+                   babl_format ("cairo-ARGB32"),
+                   data, stride,
+                   GEGL_ABYSS_NONE);
+
+  /*  apply filters to the rendered projection  */
+  if (shell->filter_stack)
+    {
+      cairo_surface_t *image =
+        cairo_image_surface_create_for_data (data, CAIRO_FORMAT_ARGB32,
+                                             area->width,
+                                             area->height,
+                                             stride);
+      gimp_color_display_stack_convert_surface (shell->filter_stack, image);
+      cairo_surface_destroy (image);
+    }
+}
@@ -17,9 +17,13 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <gegl.h>
 #include <gtk/gtk.h>
 
+#include "libgimpmath/gimpmath.h"
+
 #include "display-types.h"
 
 #include "config/gimpdisplayconfig.h"
@@ -39,10 +43,51 @@
 #include "gimpdisplayshell-transform.h"
 
 
+#define SELECTION_N_ZOOMS       4    /*  number of cached zoom levels      */
+#define SELECTION_MAX_CELLS     64   /*  max number of grid cells per axis */
+#define SELECTION_MIN_CELL_SIZE 256  /*  min size of a grid cell           */
+
+
+typedef struct
+{
+  gint x1, y1;
+  gint x2, y2;
+} SelectionBounds;
+
+typedef struct
+{
+  GimpBoundSeg    *segs;              /*  zoomed segments, grouped by cell  */
+  gint             n_segs;            /*  number of segments in segs        */
+
+  gint             x, y;              /*  origin of the grid                */
+  gint             cell_size;         /*  width and height of a grid cell   */
+  gint             n_cols;            /*  number of grid columns            */
+  gint             n_rows;            /*  number of grid rows               */
+  gint            *cell_offsets;      /*  index of each cell's first seg    */
+  SelectionBounds *cell_bounds;       /*  bounds of each cell's segments    */
+} SelectionSegs;
+
+typedef struct
+{
+  gdouble          scale_x;           /*  zoom the segments were made for   */
+  gdouble          scale_y;
+
+  SelectionSegs    segs_in;
+  SelectionSegs    segs_out;
+} SelectionZoom;
+
 struct _Selection
 {
   GimpDisplayShell *shell;            /*  shell that owns the selection     */
 
+  const GimpBoundSeg *boundary_in;    /*  boundary the zooms were made of   */
+  gint              n_boundary_in;
+  const GimpBoundSeg *boundary_out;
+  gint              n_boundary_out;
+  GList            *zooms;            /*  zoomed boundaries, most recent
+                                       *  first
+                                       */
+
   GimpSegment      *segs_in;          /*  gdk segments of area boundary     */
   gint              n_segs_in;        /*  number of segments in segs_in     */
 
@@ -70,8 +115,18 @@ static void      selection_render_mask    (Selection          *selection);
 
 static void      selection_zoom_segs      (Selection          *selection,
                                            const GimpBoundSeg *src_segs,
-                                           GimpSegment        *dest_segs,
-                                           gint                n_segs);
+                                           gint                n_segs,
+                                           SelectionSegs      *segs);
+static gint      selection_cull_segs      (Selection          *selection,
+                                           const SelectionSegs *segs,
+                                           GimpSegment        *dest_segs);
+static SelectionZoom * selection_get_zoom (Selection          *selection,
+                                           const GimpBoundSeg *segs_in,
+                                           gint                n_segs_in,
+                                           const GimpBoundSeg *segs_out,
+                                           gint                n_segs_out);
+static void      selection_zoom_free      (SelectionZoom      *zoom);
+static void      selection_free_zooms     (Selection          *selection);
 static void      selection_generate_segs  (Selection          *selection);
 static void      selection_free_segs      (Selection          *selection);
 
@@ -132,6 +187,7 @@ gimp_display_shell_selection_free (GimpDisplayShell *shell)
                                         selection);
 
   selection_free_segs (selection);
+  selection_free_zooms (selection);
 
   g_slice_free (Selection, selection);
 
@@ -144,6 +200,9 @@ gimp_display_shell_selection_undraw (GimpDisplayShell *shell)
   g_return_if_fail (GIMP_IS_DISPLAY_SHELL (shell));
   g_return_if_fail (shell->selection != NULL);
 
+  /*  the boundary changed, the zoomed segments are out of date  */
+  selection_free_zooms (shell->selection);
+
   if (gimp_display_get_image (shell->display))
     {
       selection_undraw (shell->selection);
@@ -311,48 +370,281 @@ selection_render_mask (Selection *selection)
   cairo_surface_destroy (surface);
 }
 
+/*  zooms the segments to display coordinates, without the scroll
+ *  offset, and sorts them into a grid of cells by their top left
+ *  corner, so the visible ones can be found quickly for any offset
+ */
 static void
 selection_zoom_segs (Selection          *selection,
                      const GimpBoundSeg *src_segs,
-                     GimpSegment        *dest_segs,
-                     gint                n_segs)
+                     gint                n_segs,
+                     SelectionSegs      *segs)
 {
-  const gint xclamp = selection->shell->disp_width + 1;
-  const gint yclamp = selection->shell->disp_height + 1;
-  gint       i;
+  GimpDisplayShell *shell = selection->shell;
+  GimpBoundSeg     *zoomed;
+  gint             *cells;
+  gint             *cursors;
+  gint              x1 = G_MAXINT;
+  gint              y1 = G_MAXINT;
+  gint              x2 = G_MININT;
+  gint              y2 = G_MININT;
+  gint              n_cells;
+  gint              i;
+
+  memset (segs, 0, sizeof (SelectionSegs));
 
-  gimp_display_shell_zoom_segments (selection->shell,
-                                    src_segs, dest_segs, n_segs,
-                                    0.0, 0.0);
+  if (n_segs == 0)
+    return;
+
+  zoomed = g_new (GimpBoundSeg, n_segs);
 
   for (i = 0; i < n_segs; i++)
     {
-      dest_segs[i].x1 = CLAMP (dest_segs[i].x1, -1, xclamp);
-      dest_segs[i].y1 = CLAMP (dest_segs[i].y1, -1, yclamp);
+      zoomed[i]    = src_segs[i];
+      zoomed[i].x1 = SCALEX (shell, src_segs[i].x1);
+      zoomed[i].y1 = SCALEY (shell, src_segs[i].y1);
+      zoomed[i].x2 = SCALEX (shell, src_segs[i].x2);
+      zoomed[i].y2 = SCALEY (shell, src_segs[i].y2);
+
+      x1 = MIN (x1, MIN (zoomed[i].x1, zoomed[i].x2));
+      y1 = MIN (y1, MIN (zoomed[i].y1, zoomed[i].y2));
+      x2 = MAX (x2, MAX (zoomed[i].x1, zoomed[i].x2));
+      y2 = MAX (y2, MAX (zoomed[i].y1, zoomed[i].y2));
+    }
+
+  segs->x         = x1;
+  segs->y         = y1;
+  segs->cell_size = MAX (SELECTION_MIN_CELL_SIZE,
+                         (MAX (x2 - x1, y2 - y1) + SELECTION_MAX_CELLS) /
+                         SELECTION_MAX_CELLS);
+  segs->n_cols    = (x2 - x1) / segs->cell_size + 1;
+  segs->n_rows    = (y2 - y1) / segs->cell_size + 1;
+
+  n_cells = segs->n_cols * segs->n_rows;
+
+  cells   = g_new (gint, n_segs);
+  cursors = g_new (gint, n_cells);
+
+  segs->cell_offsets = g_new0 (gint, n_cells + 1);
+  segs->cell_bounds  = g_new (SelectionBounds, n_cells);
+
+  for (i = 0; i < n_cells; i++)
+    {
+      segs->cell_bounds[i].x1 = G_MAXINT;
+      segs->cell_bounds[i].y1 = G_MAXINT;
+      segs->cell_bounds[i].x2 = G_MININT;
+      segs->cell_bounds[i].y2 = G_MININT;
+    }
+
+  for (i = 0; i < n_segs; i++)
+    {
+      const GimpBoundSeg *seg = &zoomed[i];
+      SelectionBounds    *bounds;
+      gint                col, row;
+
+      col = (MIN (seg->x1, seg->x2) - segs->x) / segs->cell_size;
+      row = (MIN (seg->y1, seg->y2) - segs->y) / segs->cell_size;
 
-      dest_segs[i].x2 = CLAMP (dest_segs[i].x2, -1, xclamp);
-      dest_segs[i].y2 = CLAMP (dest_segs[i].y2, -1, yclamp);
+      cells[i] = row * segs->n_cols + col;
 
-      /*  If this segment is a closing segment && the segments lie inside
-       *  the region, OR if this is an opening segment and the segments
-       *  lie outside the region...
-       *  we need to transform it by one display pixel
+      segs->cell_offsets[cells[i] + 1]++;
+
+      /*  a cell's bounds include all of its segments, which may reach
+       *  into neighboring cells
        */
-      if (! src_segs[i].open)
+      bounds = &segs->cell_bounds[cells[i]];
+
+      bounds->x1 = MIN (bounds->x1, MIN (seg->x1, seg->x2));
+      bounds->y1 = MIN (bounds->y1, MIN (seg->y1, seg->y2));
+      bounds->x2 = MAX (bounds->x2, MAX (seg->x1, seg->x2));
+      bounds->y2 = MAX (bounds->y2, MAX (seg->y1, seg->y2));
+    }
+
+  for (i = 0; i < n_cells; i++)
+    {
+      segs->cell_offsets[i + 1] += segs->cell_offsets[i];
+
+      cursors[i] = segs->cell_offsets[i];
+    }
+
+  segs->segs   = g_new (GimpBoundSeg, n_segs);
+  segs->n_segs = n_segs;
+
+  for (i = 0; i < n_segs; i++)
+    segs->segs[cursors[cells[i]]++] = zoomed[i];
+
+  g_free (cursors);
+  g_free (cells);
+  g_free (zoomed);
+}
+
+/*  offsets the zoomed segments by the current scroll position, and
+ *  returns the ones which are visible in the canvas
+ */
+static gint
+selection_cull_segs (Selection           *selection,
+                     const SelectionSegs *segs,
+                     GimpSegment         *dest_segs)
+{
+  GimpDisplayShell *shell  = selection->shell;
+  const gint        xclamp = shell->disp_width + 1;
+  const gint        yclamp = shell->disp_height + 1;
+  gdouble           vx1, vy1, vx2, vy2;
+  gint              x1, y1, x2, y2;
+  gint              n_dest = 0;
+  gint              cell;
+  gint              i;
+
+  /*  the segments are drawn unrotated, so use the unrotated bounds of
+   *  the canvas, grown by a pixel for the closing segment offsets
+   */
+  gimp_display_shell_unrotate_bounds (shell,
+                                      0, 0,
+                                      shell->disp_width, shell->disp_height,
+                                      &vx1, &vy1, &vx2, &vy2);
+
+  x1 = (gint) floor (vx1) + shell->offset_x - 2;
+  y1 = (gint) floor (vy1) + shell->offset_y - 2;
+  x2 = (gint) ceil  (vx2) + shell->offset_x + 2;
+  y2 = (gint) ceil  (vy2) + shell->offset_y + 2;
+
+  for (cell = 0; cell < segs->n_cols * segs->n_rows; cell++)
+    {
+      const SelectionBounds *bounds = &segs->cell_bounds[cell];
+
+      if (segs->cell_offsets[cell] == segs->cell_offsets[cell + 1] ||
+          bounds->x2 < x1 || bounds->x1 > x2 ||
+          bounds->y2 < y1 || bounds->y1 > y2)
+        continue;
+
+      for (i = segs->cell_offsets[cell]; i < segs->cell_offsets[cell + 1]; i++)
         {
-          /*  If it is vertical  */
-          if (dest_segs[i].x1 == dest_segs[i].x2)
-            {
-              dest_segs[i].x1 -= 1;
-              dest_segs[i].x2 -= 1;
-            }
-          else
+          const GimpBoundSeg *seg  = &segs->segs[i];
+          GimpSegment        *dest = &dest_segs[n_dest];
+
+          if (MAX (seg->x1, seg->x2) < x1 || MIN (seg->x1, seg->x2) > x2 ||
+              MAX (seg->y1, seg->y2) < y1 || MIN (seg->y1, seg->y2) > y2)
+            continue;
+
+          dest->x1 = CLAMP (seg->x1 - shell->offset_x, -1, xclamp);
+          dest->y1 = CLAMP (seg->y1 - shell->offset_y, -1, yclamp);
+
+          dest->x2 = CLAMP (seg->x2 - shell->offset_x, -1, xclamp);
+          dest->y2 = CLAMP (seg->y2 - shell->offset_y, -1, yclamp);
+
+          /*  If this segment is a closing segment && the segments lie inside
+           *  the region, OR if this is an opening segment and the segments
+           *  lie outside the region...
+           *  we need to transform it by one display pixel
+           */
+          if (! seg->open)
             {
-              dest_segs[i].y1 -= 1;
-              dest_segs[i].y2 -= 1;
+              /*  If it is vertical  */
+              if (dest->x1 == dest->x2)
+                {
+                  dest->x1 -= 1;
+                  dest->x2 -= 1;
+                }
+              else
+                {
+                  dest->y1 -= 1;
+                  dest->y2 -= 1;
+                }
             }
+
+          n_dest++;
         }
     }
+
+  return n_dest;
+}
+
+/*  returns the boundary zoomed to the shell's current scale, reusing
+ *  the segments of a previous zoom to the same scale if possible
+ */
+static SelectionZoom *
+selection_get_zoom (Selection          *selection,
+                    const GimpBoundSeg *segs_in,
+                    gint                n_segs_in,
+                    const GimpBoundSeg *segs_out,
+                    gint                n_segs_out)
+{
+  GimpDisplayShell *shell = selection->shell;
+  SelectionZoom    *zoom;
+  GList            *list;
+
+  if (segs_in  != selection->boundary_in  ||
+      n_segs_in  != selection->n_boundary_in  ||
+      segs_out != selection->boundary_out ||
+      n_segs_out != selection->n_boundary_out)
+    {
+      selection_free_zooms (selection);
+
+      selection->boundary_in    = segs_in;
+      selection->n_boundary_in  = n_segs_in;
+      selection->boundary_out   = segs_out;
+      selection->n_boundary_out = n_segs_out;
+    }
+
+  for (list = selection->zooms; list; list = g_list_next (list))
+    {
+      zoom = list->data;
+
+      if (zoom->scale_x == shell->scale_x &&
+          zoom->scale_y == shell->scale_y)
+        {
+          selection->zooms = g_list_remove_link (selection->zooms, list);
+          selection->zooms = g_list_concat (list, selection->zooms);
+
+          return zoom;
+        }
+    }
+
+  zoom = g_slice_new0 (SelectionZoom);
+
+  zoom->scale_x = shell->scale_x;
+  zoom->scale_y = shell->scale_y;
+
+  selection_zoom_segs (selection, segs_in,  n_segs_in,  &zoom->segs_in);
+  selection_zoom_segs (selection, segs_out, n_segs_out, &zoom->segs_out);
+
+  selection->zooms = g_list_prepend (selection->zooms, zoom);
+
+  if (g_list_length (selection->zooms) > SELECTION_N_ZOOMS)
+    {
+      list = g_list_last (selection->zooms);
+
+      selection_zoom_free (list->data);
+      selection->zooms = g_list_delete_link (selection->zooms, list);
+    }
+
+  return zoom;
+}
+
+static void
+selection_zoom_free (SelectionZoom *zoom)
+{
+  g_free (zoom->segs_in.segs);
+  g_free (zoom->segs_in.cell_offsets);
+  g_free (zoom->segs_in.cell_bounds);
+
+  g_free (zoom->segs_out.segs);
+  g_free (zoom->segs_out.cell_offsets);
+  g_free (zoom->segs_out.cell_bounds);
+
+  g_slice_free (SelectionZoom, zoom);
+}
+
+static void
+selection_free_zooms (Selection *selection)
+{
+  g_list_free_full (selection->zooms, (GDestroyNotify) selection_zoom_free);
+
+  selection->zooms          = NULL;
+  selection->boundary_in    = NULL;
+  selection->n_boundary_in  = 0;
+  selection->boundary_out   = NULL;
+  selection->n_boundary_out = 0;
 }
 
 static void
@@ -361,38 +653,57 @@ selection_generate_segs (Selection *selection)
   GimpImage          *image = gimp_display_get_image (selection->shell->display);
   const GimpBoundSeg *segs_in;
   const GimpBoundSeg *segs_out;
+  gint                n_segs_in;
+  gint                n_segs_out;
+  SelectionZoom      *zoom;
 
   /*  Ask the image for the boundary of its selected region...
-   *  Then transform that information into a new buffer of GimpSegments
+   *  Then transform the visible part of it into a new buffer of
+   *  GimpSegments
    */
   gimp_channel_boundary (gimp_image_get_mask (image),
                          &segs_in, &segs_out,
-                         &selection->n_segs_in, &selection->n_segs_out,
+                         &n_segs_in, &n_segs_out,
                          0, 0, 0, 0);
 
-  if (selection->n_segs_in)
-    {
-      selection->segs_in = g_new (GimpSegment, selection->n_segs_in);
-      selection_zoom_segs (selection, segs_in,
-                           selection->segs_in, selection->n_segs_in);
+  zoom = selection_get_zoom (selection,
+                             segs_in, n_segs_in, segs_out, n_segs_out);
 
-      selection_render_mask (selection);
-    }
-  else
+  selection->segs_in   = NULL;
+  selection->n_segs_in = 0;
+
+  if (zoom->segs_in.n_segs)
     {
-      selection->segs_in = NULL;
+      selection->segs_in   = g_new (GimpSegment, zoom->segs_in.n_segs);
+      selection->n_segs_in = selection_cull_segs (selection, &zoom->segs_in,
+                                                  selection->segs_in);
+
+      if (selection->n_segs_in)
+        {
+          selection_render_mask (selection);
+        }
+      else
+        {
+          g_free (selection->segs_in);
+          selection->segs_in = NULL;
+        }
     }
 
   /*  Possible secondary boundary representation  */
-  if (selection->n_segs_out)
-    {
-      selection->segs_out = g_new (GimpSegment, selection->n_segs_out);
-      selection_zoom_segs (selection, segs_out,
-                           selection->segs_out, selection->n_segs_out);
-    }
-  else
+  selection->segs_out   = NULL;
+  selection->n_segs_out = 0;
+
+  if (zoom->segs_out.n_segs)
     {
-      selection->segs_out = NULL;
+      selection->segs_out   = g_new (GimpSegment, zoom->segs_out.n_segs);
+      selection->n_segs_out = selection_cull_segs (selection, &zoom->segs_out,
+                                                   selection->segs_out);
+
+      if (! selection->n_segs_out)
+        {
+          g_free (selection->segs_out);
+          selection->segs_out = NULL;
+        }
     }
 }
 
@@ -310,6 +310,7 @@ gimp_display_shell_init (GimpDisplayShell *shell)
   shell->scale_y     = 1.0;
 
   gimp_display_shell_items_init (shell);
+  gimp_display_shell_render_init (shell);
 
   shell->icon_size  = 32;
 
@@ -791,6 +792,8 @@ gimp_display_shell_dispose (GObject *object)
       shell->mask_surface = NULL;
     }
 
+  gimp_display_shell_render_free (shell);
+
   if (shell->checkerboard)
     {
       cairo_pattern_destroy (shell->checkerboard);
@@ -962,6 +965,9 @@ gimp_display_shell_unrealize (GtkWidget *widget)
   if (shell->nav_popup)
     gtk_widget_unrealize (shell->nav_popup);
 
+  /*  the rendered tiles are similar to the canvas' window  */
+  gimp_display_shell_render_invalidate_full (shell);
+
   GTK_WIDGET_CLASS (parent_class)->unrealize (widget);
 }
 
@@ -1296,6 +1302,8 @@ gimp_display_shell_reconnect (GimpDisplayShell *shell)
 
   gimp_display_shell_scaled (shell);
 
+  gimp_display_shell_render_invalidate_full (shell);
+
   gimp_display_shell_expose_full (shell);
 }
 
@@ -1335,6 +1343,8 @@ gimp_display_shell_empty (GimpDisplayShell *shell)
   shell->rotate_angle = 0.0;
   gimp_display_shell_rotate_update_transform (shell);
 
+  gimp_display_shell_render_invalidate_full (shell);
+
   gimp_display_shell_expose_full (shell);
 
   user_context = gimp_get_user_context (shell->display->gimp);
@@ -108,8 +108,10 @@ struct _GimpDisplayShell
 
   GtkWidget         *statusbar;        /*  statusbar                          */
 
-  GimpDisplayXfer   *xfer;             /*  managers image buffer transfers    */
   cairo_surface_t   *mask_surface;     /*  buffer for rendering the mask      */
+  GHashTable        *render_cache;     /*  rendered tiles of the projection   */
+  GQueue            *render_queue;     /*  the same tiles, most recent first  */
+  gdouble            render_scale;     /*  scale of the rendered tiles        */
   cairo_pattern_t   *checkerboard;     /*  checkerboard pattern               */
 
   GimpCanvasItem    *canvas_item;      /*  items drawn on the canvas          */
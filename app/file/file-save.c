@@ -59,6 +59,8 @@
 
 #include "plug-in/gimppluginprocedure.h"
 
+#include "xcf/xcf.h"
+
 #include "file-save.h"
 #include "file-utils.h"
 #include "gimp-file.h"
@@ -128,6 +130,11 @@ file_save (Gimp                *gimp,
             }
         }
 
+      /* lazily loaded images must stop reading from the file before
+       * it is overwritten
+       */
+      xcf_release_file (filename);
+
       if (file_proc->handles_uri)
         {
           g_free (filename);
@@ -141,6 +141,229 @@ gimp_gegl_mask_combine_span (gfloat         *data,
     }
 }
 
+/*  the pixels of a row of an elliptic rect, with a coverage > 0 and
+ *  with a coverage of 1, respectively
+ */
+typedef struct
+{
+  gint x1, x2;
+  gint inner_x1, inner_x2;
+} EllipseRectRow;
+
+typedef struct
+{
+  gint     x, y;
+  gint     w, h;
+  gdouble  a, b;
+  gdouble  a_sqr, b_sqr;
+  gboolean antialias;
+} EllipseRect;
+
+
+/*  the antialiased coverage of pixel (px, py), where py is on a row with
+ *  rounded corners
+ */
+static gfloat
+gimp_gegl_mask_combine_ellipse_rect_value (const EllipseRect *e,
+                                           gint               px,
+                                           gint               py)
+{
+  gdouble ellipse_center_x;
+  gdouble ellipse_center_y;
+  gfloat  yi;
+  gfloat  xj;
+  gfloat  xdist;
+  gfloat  ydist;
+  gfloat  r;
+  gfloat  dist;
+
+  /*  the straight segment between the rounded corners  */
+  if (px >= e->x + e->a && px <= floor (e->x + e->w - e->a) &&
+      ceil (e->x + e->a) < e->x + e->w - e->a)
+    return 1.0;
+
+  if (py < e->y + e->b)
+    ellipse_center_y = e->y + e->b;
+  else
+    ellipse_center_y = e->y + e->h - e->b;
+
+  if (px < e->x + e->w / 2)
+    ellipse_center_x = e->x + e->a;
+  else
+    ellipse_center_x = e->x + e->w - e->a;
+
+  /* algorithm changed 7-18-04, because the previous one did not work
+   * well for eccentric ellipses.  The new algorithm measures the
+   * distance to the ellipse in the X and Y directions, and uses
+   * trigonometry to approximate the distance to the ellipse as the
+   * distance to the hypotenuse of a right triangle whose legs are the
+   * X and Y distances.  (WES)
+   */
+  yi = ABS (py + 0.5 - ellipse_center_y);
+  xj = ABS (px + 0.5 - ellipse_center_x);
+
+  if (yi < e->b)
+    xdist = xj - e->a * sqrt (1 - SQR (yi) / e->b_sqr);
+  else
+    xdist = 1000.0;  /* anything large will work */
+
+  if (xj < e->a)
+    ydist = yi - e->b * sqrt (1 - SQR (xj) / e->a_sqr);
+  else
+    ydist = 1000.0;  /* anything large will work */
+
+  r = hypot (xdist, ydist);
+
+  if (r < 0.001)
+    dist = 0.0;
+  else
+    dist = xdist * ydist / r; /* trig formula for distance to hypotenuse */
+
+  if (xdist < 0.0)
+    dist *= -1;
+
+  if (dist < -0.5)
+    return 1.0;
+  else if (dist < 0.5)
+    return (1.0 - (dist + 0.5));
+  else
+    return 0.0;
+}
+
+/*  the coverage of a row rises up to its middle and falls after it, so
+ *  the ends of its spans are found by bisection, and only the pixels on
+ *  the edge of the ellipse need to be evaluated one by one.  returns,
+ *  within [x1, x2), the first pixel whose coverage is at least @min if
+ *  @rising, or the first one whose coverage is below @min otherwise.
+ */
+static gint
+gimp_gegl_mask_combine_ellipse_rect_find (const EllipseRect *e,
+                                          gint               py,
+                                          gint               x1,
+                                          gint               x2,
+                                          gfloat             min,
+                                          gboolean           rising)
+{
+  while (x1 < x2)
+    {
+      gint   mid = x1 + (x2 - x1) / 2;
+      gfloat val = gimp_gegl_mask_combine_ellipse_rect_value (e, mid, py);
+
+      if ((val >= min) == rising)
+        x2 = mid;
+      else
+        x1 = mid + 1;
+    }
+
+  return x1;
+}
+
+static void
+gimp_gegl_mask_combine_ellipse_rect_row (const EllipseRect *e,
+                                         gint               py,
+                                         EllipseRectRow    *row)
+{
+  const gint x1  = e->x;
+  const gint x2  = e->x + e->w;
+  const gint mid = e->x + e->w / 2;
+
+  if (py >= e->y + e->b && py < e->y + e->h - e->b)
+    {
+      /*  we are on a row without rounded corners  */
+      row->x1       = row->inner_x1 = x1;
+      row->x2       = row->inner_x2 = x2;
+    }
+  else if (! e->antialias)
+    {
+      /* For a non-antialiased ellipse, use the normal equation
+       * for an ellipse with an arbitrary center
+       * (ellipse_center_x, ellipse_center_y).
+       */
+      gdouble ellipse_center_x = e->x + e->a;
+      gdouble ellipse_center_y;
+      gdouble half_ellipse_width_at_y;
+
+      if (py < e->y + e->b)
+        ellipse_center_y = e->y + e->b;
+      else
+        ellipse_center_y = e->y + e->h - e->b;
+
+      half_ellipse_width_at_y =
+        sqrt (e->a_sqr -
+              e->a_sqr * SQR (py + 0.5f - ellipse_center_y) / e->b_sqr);
+
+      row->x1 = ROUND (ellipse_center_x - half_ellipse_width_at_y);
+      row->x2 = ROUND (ellipse_center_x + e->w - 2 * e->a +
+                       half_ellipse_width_at_y);
+
+      row->inner_x1 = row->x1;
+      row->inner_x2 = row->x2;
+    }
+  else
+    {
+      /*  left of mid the coverage rises, from mid on it falls  */
+      row->x1       = gimp_gegl_mask_combine_ellipse_rect_find (e, py, x1, mid,
+                                                                G_MINFLOAT, TRUE);
+      row->inner_x1 = gimp_gegl_mask_combine_ellipse_rect_find (e, py, x1, mid,
+                                                                1.0, TRUE);
+      row->x2       = gimp_gegl_mask_combine_ellipse_rect_find (e, py, mid, x2,
+                                                                G_MINFLOAT, FALSE);
+      row->inner_x2 = gimp_gegl_mask_combine_ellipse_rect_find (e, py, mid, x2,
+                                                                1.0, FALSE);
+    }
+}
+
+/*  combines the pixels of @area, all of whose rows are spanned by @rows,
+ *  starting at row @y
+ */
+static void
+gimp_gegl_mask_combine_ellipse_rect_area (GeglBuffer           *mask,
+                                          GimpChannelOps        op,
+                                          const EllipseRect    *e,
+                                          const EllipseRectRow *rows,
+                                          gint                  y,
+                                          const GeglRectangle  *area)
+{
+  GeglBufferIterator *iter;
+  GeglRectangle      *roi;
+
+  iter = gegl_buffer_iterator_new (mask, area, 0,
+                                   babl_format ("Y float"),
+                                   GEGL_BUFFER_READWRITE, GEGL_ABYSS_NONE);
+  roi = &iter->roi[0];
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      gfloat *data = iter->data[0];
+      gint    py;
+
+      for (py = roi->y;
+           py < roi->y + roi->height;
+           py++, data += roi->width)
+        {
+          const EllipseRectRow *row = &rows[py - y];
+          const gint            px1 = roi->x;
+          const gint            px2 = roi->x + roi->width;
+          gint                  px;
+
+          /*  the left edge  */
+          for (px = MAX (row->x1, px1); px < MIN (row->inner_x1, px2); px++)
+            gimp_gegl_mask_combine_span (data, op, px - px1, px - px1 + 1,
+                                         gimp_gegl_mask_combine_ellipse_rect_value (e, px, py));
+
+          gimp_gegl_mask_combine_span (data, op,
+                                       MAX (row->inner_x1, px1) - px1,
+                                       MIN (row->inner_x2, px2) - px1,
+                                       1.0);
+
+          /*  the right edge  */
+          for (px = MAX (row->inner_x2, px1); px < MIN (row->x2, px2); px++)
+            gimp_gegl_mask_combine_span (data, op, px - px1, px - px1 + 1,
+                                         gimp_gegl_mask_combine_ellipse_rect_value (e, px, py));
+        }
+    }
+}
+
 /**
  * gimp_gegl_mask_combine_ellipse_rect:
  * @mask:      the channel with which to combine the elliptic rect
@@ -160,6 +383,9 @@ gimp_gegl_mask_combine_span (gfloat         *data,
  * sets pixels within to zero.  If @antialias is %TRUE, pixels that
  * impinge on the edge of the ellipse are set to intermediate values,
  * depending on how much they overlap.
+ *
+ * The shape is combined one tile of @mask at a time: tiles entirely
+ * within it are filled, tiles entirely outside of it aren't touched.
  **/
 gboolean
 gimp_gegl_mask_combine_ellipse_rect (GeglBuffer     *mask,
@@ -172,13 +398,14 @@ gimp_gegl_mask_combine_ellipse_rect (GeglBuffer     *mask,
                                      gdouble         b,
                                      gboolean        antialias)
 {
-  GeglBufferIterator *iter;
-  GeglRectangle      *roi;
-  gdouble             a_sqr;
-  gdouble             b_sqr;
-  gdouble             ellipse_center_x;
-  gint                x0, y0;
-  gint                width, height;
+  EllipseRect     e;
+  EllipseRectRow *rows;
+  gint            x0, y0;
+  gint            width, height;
+  gint            tile_width;
+  gint            tile_height;
+  gint            tx, ty;
+  gint            i;
 
   g_return_val_if_fail (GEGL_IS_BUFFER (mask), FALSE);
   g_return_val_if_fail (a >= 0.0 && b >= 0.0, FALSE);
@@ -188,9 +415,6 @@ gimp_gegl_mask_combine_ellipse_rect (GeglBuffer     *mask,
   a = MIN (a, w / 2.0);
   b = MIN (b, h / 2.0);
 
-  a_sqr = SQR (a);
-  b_sqr = SQR (b);
-
   if (! gimp_rectangle_intersect (x, y, w, h,
                                   0, 0,
                                   gegl_buffer_get_width  (mask),
@@ -198,171 +422,90 @@ gimp_gegl_mask_combine_ellipse_rect (GeglBuffer     *mask,
                                   &x0, &y0, &width, &height))
     return FALSE;
 
-  ellipse_center_x = x + a;
+  e.x         = x;
+  e.y         = y;
+  e.w         = w;
+  e.h         = h;
+  e.a         = a;
+  e.b         = b;
+  e.a_sqr     = SQR (a);
+  e.b_sqr     = SQR (b);
+  e.antialias = antialias;
 
-  iter = gegl_buffer_iterator_new (mask,
-                                   GEGL_RECTANGLE (x0, y0, width, height), 0,
-                                   babl_format ("Y float"),
-                                   GEGL_BUFFER_READWRITE, GEGL_ABYSS_NONE);
-  roi = &iter->roi[0];
+  /*  find the spans of all rows, clipped to the mask  */
+  rows = g_new (EllipseRectRow, height);
 
-  while (gegl_buffer_iterator_next (iter))
+  for (i = 0; i < height; i++)
     {
-      gfloat *data = iter->data[0];
-      gint    py;
+      EllipseRectRow *row = &rows[i];
 
-      for (py = roi->y;
-           py < roi->y + roi->height;
-           py++, data += roi->width)
-        {
-          const gint px = roi->x;
-          gdouble    ellipse_center_y;
+      gimp_gegl_mask_combine_ellipse_rect_row (&e, y0 + i, row);
 
-          if (py >= y + b && py < y + h - b)
-            {
-              /*  we are on a row without rounded corners  */
-              gimp_gegl_mask_combine_span (data, op, 0, roi->width, 1.0);
-              continue;
-            }
+      row->x1       = CLAMP (row->x1,       x0, x0 + width);
+      row->x2       = CLAMP (row->x2,       row->x1, x0 + width);
+      row->inner_x1 = CLAMP (row->inner_x1, row->x1, row->x2);
+      row->inner_x2 = CLAMP (row->inner_x2, row->inner_x1, row->x2);
+    }
 
-          /* Match the ellipse center y with our current y */
-          if (py < y + b)
-            {
-              ellipse_center_y = y + b;
-            }
-          else
-            {
-              ellipse_center_y = y + h - b;
-            }
+  g_object_get (mask,
+                "tile-width",  &tile_width,
+                "tile-height", &tile_height,
+                NULL);
 
-          /* For a non-antialiased ellipse, use the normal equation
-           * for an ellipse with an arbitrary center
-           * (ellipse_center_x, ellipse_center_y).
-           */
-          if (! antialias)
-            {
-              gdouble half_ellipse_width_at_y;
-              gint    x_start;
-              gint    x_end;
+  for (ty = y0; ty < y0 + height; )
+    {
+      gint tile_y2 = MIN ((ty / tile_height + 1) * tile_height, y0 + height);
+      gint fill_x1 = x0;
+
+      for (tx = x0; tx < x0 + width; )
+        {
+          gint     tile_x2 = MIN ((tx / tile_width + 1) * tile_width,
+                                  x0 + width);
+          gboolean inside  = TRUE;
+          gboolean outside = TRUE;
 
-              half_ellipse_width_at_y =
-                sqrt (a_sqr -
-                      a_sqr * SQR (py + 0.5f - ellipse_center_y) / b_sqr);
+          for (i = ty - y0; i < tile_y2 - y0; i++)
+            {
+              const EllipseRectRow *row = &rows[i];
 
-              x_start = ROUND (ellipse_center_x - half_ellipse_width_at_y);
-              x_end   = ROUND (ellipse_center_x + w - 2 * a +
-                               half_ellipse_width_at_y);
+              if (row->inner_x1 > tx || row->inner_x2 < tile_x2)
+                inside = FALSE;
 
-              gimp_gegl_mask_combine_span (data, op,
-                                           MAX (x_start - px, 0),
-                                           MIN (x_end   - px, roi->width), 1.0);
+              if (row->x1 < tile_x2 && row->x2 > tx)
+                outside = FALSE;
             }
-          else  /* use antialiasing */
+
+          if (! inside)
             {
-              /* algorithm changed 7-18-04, because the previous one
-               * did not work well for eccentric ellipses.  The new
-               * algorithm measures the distance to the ellipse in the
-               * X and Y directions, and uses trigonometry to
-               * approximate the distance to the ellipse as the
-               * distance to the hypotenuse of a right triangle whose
-               * legs are the X and Y distances.  (WES)
-               */
-              const gfloat yi       = ABS (py + 0.5 - ellipse_center_y);
-              gfloat       last_val = -1;
-              gint         x_start  = px;
-              gint         cur_x;
-
-              for (cur_x = px; cur_x < (px + roi->width); cur_x++)
-                {
-                  gfloat  xj;
-                  gfloat  xdist;
-                  gfloat  ydist;
-                  gfloat  r;
-                  gfloat  dist;
-                  gfloat  val;
-
-                  if (cur_x < x + w / 2)
-                    {
-                      ellipse_center_x = x + a;
-                    }
-                  else
-                    {
-                      ellipse_center_x = x + w - a;
-                    }
-
-                  xj = ABS (cur_x + 0.5 - ellipse_center_x);
-
-                  if (yi < b)
-                    xdist = xj - a * sqrt (1 - SQR (yi) / b_sqr);
-                  else
-                    xdist = 1000.0;  /* anything large will work */
-
-                  if (xj < a)
-                    ydist = yi - b * sqrt (1 - SQR (xj) / a_sqr);
-                  else
-                    ydist = 1000.0;  /* anything large will work */
-
-                  r = hypot (xdist, ydist);
-
-                  if (r < 0.001)
-                    dist = 0.0;
-                  else
-                    dist = xdist * ydist / r; /* trig formula for distance to
-                                               * hypotenuse
-                                               */
-
-                  if (xdist < 0.0)
-                    dist *= -1;
-
-                  if (dist < -0.5)
-                    val = 1.0;
-                  else if (dist < 0.5)
-                    val = (1.0 - (dist + 0.5));
-                  else
-                    val = 0.0;
-
-                  if (last_val != val)
-                    {
-                      if (last_val != -1)
-                        gimp_gegl_mask_combine_span (data, op,
-                                                     MAX (x_start - px, 0),
-                                                     MIN (cur_x   - px, roi->width),
-                                                     last_val);
-
-                      x_start = cur_x;
-                      last_val = val;
-                    }
-
-                  /*  skip ahead if we are on the straight segment
-                   *  between rounded corners
-                   */
-                  if (cur_x >= x + a && cur_x < x + w - a)
-                    {
-                      gimp_gegl_mask_combine_span (data, op,
-                                                   MAX (x_start - px, 0),
-                                                   MIN (cur_x   - px, roi->width),
-                                                   last_val);
-
-                      x_start = cur_x;
-                      cur_x = x + w - a;
-                      last_val = val = 1.0;
-                    }
-
-                  /* Time to change center? */
-                  if (cur_x >= x + w / 2)
-                    {
-                      ellipse_center_x = x + w - a;
-                    }
-                }
-
-              gimp_gegl_mask_combine_span (data, op,
-                                           MAX (x_start - px, 0),
-                                           MIN (cur_x   - px, roi->width),
-                                           last_val);
+              /*  fill the run of tiles within the shape left of this one  */
+              if (fill_x1 < tx)
+                gimp_gegl_mask_combine_rect (mask, op,
+                                             fill_x1, ty,
+                                             tx - fill_x1, tile_y2 - ty);
+
+              fill_x1 = tile_x2;
+
+              if (! outside)
+                gimp_gegl_mask_combine_ellipse_rect_area (mask, op, &e,
+                                                          rows + (ty - y0), ty,
+                                                          GEGL_RECTANGLE (tx, ty,
+                                                                          tile_x2 - tx,
+                                                                          tile_y2 - ty));
             }
+
+          tx = tile_x2;
         }
+
+      if (fill_x1 < x0 + width)
+        gimp_gegl_mask_combine_rect (mask, op,
+                                     fill_x1, ty,
+                                     x0 + width - fill_x1, tile_y2 - ty);
+
+      ty = tile_y2;
     }
 
+  g_free (rows);
+
   return TRUE;
 }
 
@@ -0,0 +1,704 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-gegl-mask-summary.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*  A GimpGeglMaskSummary keeps, for each tile of a mask buffer, whether
+ *  the tile is empty, full or mixed, and the bounding box of its
+ *  non-zero pixels.  It listens to the buffer's "changed" signal and
+ *  only forgets about the tiles that were touched, so bounds and
+ *  emptiness queries only rescan those.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+
+#include "gimp-gegl-types.h"
+
+#include "core/gimp-parallel.h"
+
+#include "gimp-gegl-mask-summary.h"
+
+
+typedef struct
+{
+  GimpGeglMaskTileState state;
+  gint                  x1, y1;  /*  bounds of the non-zero pixels  */
+  gint                  x2, y2;
+} GimpGeglMaskTile;
+
+struct _GimpGeglMaskSummary
+{
+  GeglBuffer       *buffer;
+  GeglRectangle     extent;
+  gint              tile_width;
+  gint              tile_height;
+  gint              n_cols;
+  gint              n_rows;
+
+  GimpGeglMaskTile *tiles;
+  gint              n_unknown;
+  gint              n_nonempty;
+
+  guint             version;
+
+  gint              block_count;
+  GMutex            mutex;
+};
+
+typedef struct
+{
+  GimpGeglMaskSummary *summary;
+  gint                *indices;
+} GimpGeglMaskSummaryUpdate;
+
+
+/*  local function prototypes  */
+
+static void   gimp_gegl_mask_summary_bump_version   (GimpGeglMaskSummary       *summary);
+
+static void   gimp_gegl_mask_summary_buffer_changed (GeglBuffer                *buffer,
+                                                     const GeglRectangle       *rect,
+                                                     GimpGeglMaskSummary       *summary);
+
+static void   gimp_gegl_mask_summary_tile_rect      (GimpGeglMaskSummary       *summary,
+                                                     gint                       index,
+                                                     GeglRectangle             *rect);
+static void   gimp_gegl_mask_summary_set_state      (GimpGeglMaskSummary       *summary,
+                                                     GimpGeglMaskTile          *tile,
+                                                     GimpGeglMaskTileState      state);
+static void   gimp_gegl_mask_summary_invalidate_rect(GimpGeglMaskSummary       *summary,
+                                                     const GeglRectangle       *rect);
+static void   gimp_gegl_mask_summary_update         (GimpGeglMaskSummary       *summary);
+static void   gimp_gegl_mask_summary_update_range   (gsize                      offset,
+                                                     gsize                      size,
+                                                     GimpGeglMaskSummaryUpdate *update);
+
+
+/*  versions are unique across all summaries, so a version also tells
+ *  summaries of different buffers apart
+ */
+static gint gimp_gegl_mask_summary_last_version = 0;
+
+
+/*  public functions  */
+
+GimpGeglMaskSummary *
+gimp_gegl_mask_summary_new (GeglBuffer *buffer)
+{
+  GimpGeglMaskSummary *summary;
+  gint                 i;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+
+  summary = g_slice_new0 (GimpGeglMaskSummary);
+
+  summary->buffer = g_object_ref (buffer);
+  summary->extent = *gegl_buffer_get_extent (buffer);
+
+  g_object_get (buffer,
+                "tile-width",  &summary->tile_width,
+                "tile-height", &summary->tile_height,
+                NULL);
+
+  summary->tile_width  = MAX (summary->tile_width,  1);
+  summary->tile_height = MAX (summary->tile_height, 1);
+
+  summary->n_cols = (summary->extent.width  + summary->tile_width  - 1) /
+                    summary->tile_width;
+  summary->n_rows = (summary->extent.height + summary->tile_height - 1) /
+                    summary->tile_height;
+
+  summary->tiles = g_new0 (GimpGeglMaskTile, summary->n_cols * summary->n_rows);
+
+  for (i = 0; i < summary->n_cols * summary->n_rows; i++)
+    summary->tiles[i].state = GIMP_GEGL_MASK_TILE_UNKNOWN;
+
+  summary->n_unknown  = summary->n_cols * summary->n_rows;
+  summary->n_nonempty = 0;
+
+  g_mutex_init (&summary->mutex);
+
+  gimp_gegl_mask_summary_bump_version (summary);
+
+  gegl_buffer_signal_connect (buffer, "changed",
+                              G_CALLBACK (gimp_gegl_mask_summary_buffer_changed),
+                              summary);
+
+  return summary;
+}
+
+void
+gimp_gegl_mask_summary_free (GimpGeglMaskSummary *summary)
+{
+  g_return_if_fail (summary != NULL);
+
+  g_signal_handlers_disconnect_by_func (summary->buffer,
+                                        gimp_gegl_mask_summary_buffer_changed,
+                                        summary);
+  g_object_unref (summary->buffer);
+
+  g_mutex_clear (&summary->mutex);
+
+  g_free (summary->tiles);
+
+  g_slice_free (GimpGeglMaskSummary, summary);
+}
+
+GeglBuffer *
+gimp_gegl_mask_summary_get_buffer (GimpGeglMaskSummary *summary)
+{
+  g_return_val_if_fail (summary != NULL, NULL);
+
+  return summary->buffer;
+}
+
+/*  returns a number which changes whenever the buffer's pixels change  */
+guint
+gimp_gegl_mask_summary_get_version (GimpGeglMaskSummary *summary)
+{
+  guint version;
+
+  g_return_val_if_fail (summary != NULL, 0);
+
+  g_mutex_lock (&summary->mutex);
+  version = summary->version;
+  g_mutex_unlock (&summary->mutex);
+
+  return version;
+}
+
+/*  while blocked, changes to the buffer are not tracked, the caller
+ *  has to update the summary itself, e.g. using
+ *  gimp_gegl_mask_summary_invert()
+ */
+void
+gimp_gegl_mask_summary_block (GimpGeglMaskSummary *summary)
+{
+  g_return_if_fail (summary != NULL);
+
+  g_mutex_lock (&summary->mutex);
+  summary->block_count++;
+  g_mutex_unlock (&summary->mutex);
+}
+
+void
+gimp_gegl_mask_summary_unblock (GimpGeglMaskSummary *summary)
+{
+  g_return_if_fail (summary != NULL);
+  g_return_if_fail (summary->block_count > 0);
+
+  g_mutex_lock (&summary->mutex);
+  summary->block_count--;
+  g_mutex_unlock (&summary->mutex);
+}
+
+void
+gimp_gegl_mask_summary_invalidate (GimpGeglMaskSummary *summary,
+                                   const GeglRectangle *rect)
+{
+  g_return_if_fail (summary != NULL);
+
+  g_mutex_lock (&summary->mutex);
+  gimp_gegl_mask_summary_invalidate_rect (summary, rect);
+  g_mutex_unlock (&summary->mutex);
+}
+
+/*  forgets about all mixed tiles, for operations which keep empty and
+ *  full tiles as they are, like thresholding
+ */
+void
+gimp_gegl_mask_summary_invalidate_mixed (GimpGeglMaskSummary *summary)
+{
+  gint i;
+
+  g_return_if_fail (summary != NULL);
+
+  g_mutex_lock (&summary->mutex);
+
+  gimp_gegl_mask_summary_bump_version (summary);
+
+  for (i = 0; i < summary->n_cols * summary->n_rows; i++)
+    {
+      GimpGeglMaskTile *tile = &summary->tiles[i];
+
+      if (tile->state == GIMP_GEGL_MASK_TILE_MIXED)
+        gimp_gegl_mask_summary_set_state (summary, tile,
+                                          GIMP_GEGL_MASK_TILE_UNKNOWN);
+    }
+
+  g_mutex_unlock (&summary->mutex);
+}
+
+/*  records that @rect (or the whole buffer if %NULL) has been set to
+ *  all zeros (%GIMP_GEGL_MASK_TILE_EMPTY) or all ones
+ *  (%GIMP_GEGL_MASK_TILE_FULL).  tiles only partially covered by @rect
+ *  keep their state if it matches, and are rescanned otherwise.
+ */
+void
+gimp_gegl_mask_summary_set (GimpGeglMaskSummary   *summary,
+                            const GeglRectangle   *rect,
+                            GimpGeglMaskTileState  state)
+{
+  GeglRectangle area;
+  gint          col1, row1, col2, row2;
+  gint          col, row;
+
+  g_return_if_fail (summary != NULL);
+  g_return_if_fail (state == GIMP_GEGL_MASK_TILE_EMPTY ||
+                    state == GIMP_GEGL_MASK_TILE_FULL);
+
+  if (! rect)
+    rect = &summary->extent;
+
+  if (! gegl_rectangle_intersect (&area, rect, &summary->extent))
+    return;
+
+  col1 = (area.x - summary->extent.x) / summary->tile_width;
+  row1 = (area.y - summary->extent.y) / summary->tile_height;
+  col2 = (area.x + area.width  - summary->extent.x - 1) / summary->tile_width;
+  row2 = (area.y + area.height - summary->extent.y - 1) / summary->tile_height;
+
+  g_mutex_lock (&summary->mutex);
+
+  gimp_gegl_mask_summary_bump_version (summary);
+
+  for (row = row1; row <= row2; row++)
+    for (col = col1; col <= col2; col++)
+      {
+        gint              index = row * summary->n_cols + col;
+        GimpGeglMaskTile *tile  = &summary->tiles[index];
+        GeglRectangle     tile_rect;
+
+        gimp_gegl_mask_summary_tile_rect (summary, index, &tile_rect);
+
+        if (gegl_rectangle_contains (&area, &tile_rect))
+          {
+            gimp_gegl_mask_summary_set_state (summary, tile, state);
+
+            tile->x1 = tile_rect.x;
+            tile->y1 = tile_rect.y;
+            tile->x2 = tile_rect.x + tile_rect.width;
+            tile->y2 = tile_rect.y + tile_rect.height;
+          }
+        else if (tile->state != state)
+          {
+            gimp_gegl_mask_summary_set_state (summary, tile,
+                                              GIMP_GEGL_MASK_TILE_UNKNOWN);
+          }
+      }
+
+  g_mutex_unlock (&summary->mutex);
+}
+
+/*  records that the buffer has been inverted, empty tiles become full
+ *  and vice versa, mixed tiles are rescanned
+ */
+void
+gimp_gegl_mask_summary_invert (GimpGeglMaskSummary *summary)
+{
+  gint i;
+
+  g_return_if_fail (summary != NULL);
+
+  g_mutex_lock (&summary->mutex);
+
+  gimp_gegl_mask_summary_bump_version (summary);
+
+  for (i = 0; i < summary->n_cols * summary->n_rows; i++)
+    {
+      GimpGeglMaskTile *tile = &summary->tiles[i];
+      GeglRectangle     tile_rect;
+
+      gimp_gegl_mask_summary_tile_rect (summary, i, &tile_rect);
+
+      switch (tile->state)
+        {
+        case GIMP_GEGL_MASK_TILE_EMPTY:
+          gimp_gegl_mask_summary_set_state (summary, tile,
+                                            GIMP_GEGL_MASK_TILE_FULL);
+          tile->x1 = tile_rect.x;
+          tile->y1 = tile_rect.y;
+          tile->x2 = tile_rect.x + tile_rect.width;
+          tile->y2 = tile_rect.y + tile_rect.height;
+          break;
+
+        case GIMP_GEGL_MASK_TILE_FULL:
+          gimp_gegl_mask_summary_set_state (summary, tile,
+                                            GIMP_GEGL_MASK_TILE_EMPTY);
+          break;
+
+        case GIMP_GEGL_MASK_TILE_MIXED:
+          gimp_gegl_mask_summary_set_state (summary, tile,
+                                            GIMP_GEGL_MASK_TILE_UNKNOWN);
+          break;
+
+        case GIMP_GEGL_MASK_TILE_UNKNOWN:
+          break;
+        }
+    }
+
+  g_mutex_unlock (&summary->mutex);
+}
+
+gboolean
+gimp_gegl_mask_summary_bounds (GimpGeglMaskSummary *summary,
+                               gint                *x1,
+                               gint                *y1,
+                               gint                *x2,
+                               gint                *y2)
+{
+  gint tx1, ty1, tx2, ty2;
+  gint i;
+
+  g_return_val_if_fail (summary != NULL, FALSE);
+  g_return_val_if_fail (x1 != NULL, FALSE);
+  g_return_val_if_fail (y1 != NULL, FALSE);
+  g_return_val_if_fail (x2 != NULL, FALSE);
+  g_return_val_if_fail (y2 != NULL, FALSE);
+
+  g_mutex_lock (&summary->mutex);
+
+  gimp_gegl_mask_summary_update (summary);
+
+  if (summary->n_nonempty == 0)
+    {
+      g_mutex_unlock (&summary->mutex);
+
+      *x1 = summary->extent.x;
+      *y1 = summary->extent.y;
+      *x2 = summary->extent.x + summary->extent.width;
+      *y2 = summary->extent.y + summary->extent.height;
+
+      return FALSE;
+    }
+
+  tx1 = G_MAXINT;
+  ty1 = G_MAXINT;
+  tx2 = G_MININT;
+  ty2 = G_MININT;
+
+  for (i = 0; i < summary->n_cols * summary->n_rows; i++)
+    {
+      const GimpGeglMaskTile *tile = &summary->tiles[i];
+
+      if (tile->state == GIMP_GEGL_MASK_TILE_FULL ||
+          tile->state == GIMP_GEGL_MASK_TILE_MIXED)
+        {
+          tx1 = MIN (tx1, tile->x1);
+          ty1 = MIN (ty1, tile->y1);
+          tx2 = MAX (tx2, tile->x2);
+          ty2 = MAX (ty2, tile->y2);
+        }
+    }
+
+  g_mutex_unlock (&summary->mutex);
+
+  *x1 = tx1;
+  *y1 = ty1;
+  *x2 = tx2;
+  *y2 = ty2;
+
+  return TRUE;
+}
+
+gboolean
+gimp_gegl_mask_summary_is_empty (GimpGeglMaskSummary *summary)
+{
+  gboolean empty;
+
+  g_return_val_if_fail (summary != NULL, FALSE);
+
+  g_mutex_lock (&summary->mutex);
+
+  /*  we only need to scan anything if all known tiles are empty  */
+  if (summary->n_nonempty == 0 && summary->n_unknown > 0)
+    gimp_gegl_mask_summary_update (summary);
+
+  empty = (summary->n_nonempty == 0);
+
+  g_mutex_unlock (&summary->mutex);
+
+  return empty;
+}
+
+/*  returns %TRUE and sets @value if the pixel value at @x, @y can be
+ *  told from the summary alone
+ */
+gboolean
+gimp_gegl_mask_summary_get_value (GimpGeglMaskSummary *summary,
+                                  gint                 x,
+                                  gint                 y,
+                                  gdouble             *value)
+{
+  const GimpGeglMaskTile *tile;
+  gboolean                known = TRUE;
+  gint                    col, row;
+
+  g_return_val_if_fail (summary != NULL, FALSE);
+  g_return_val_if_fail (value != NULL, FALSE);
+
+  if (x <  summary->extent.x                         ||
+      y <  summary->extent.y                         ||
+      x >= summary->extent.x + summary->extent.width ||
+      y >= summary->extent.y + summary->extent.height)
+    {
+      *value = 0.0;
+
+      return TRUE;
+    }
+
+  col = (x - summary->extent.x) / summary->tile_width;
+  row = (y - summary->extent.y) / summary->tile_height;
+
+  g_mutex_lock (&summary->mutex);
+
+  tile = &summary->tiles[row * summary->n_cols + col];
+
+  switch (tile->state)
+    {
+    case GIMP_GEGL_MASK_TILE_EMPTY:
+      *value = 0.0;
+      break;
+
+    case GIMP_GEGL_MASK_TILE_FULL:
+      *value = 1.0;
+      break;
+
+    case GIMP_GEGL_MASK_TILE_MIXED:
+      if (x < tile->x1 || x >= tile->x2 ||
+          y < tile->y1 || y >= tile->y2)
+        *value = 0.0;
+      else
+        known = FALSE;
+      break;
+
+    case GIMP_GEGL_MASK_TILE_UNKNOWN:
+      known = FALSE;
+      break;
+    }
+
+  g_mutex_unlock (&summary->mutex);
+
+  return known;
+}
+
+
+/*  private functions  */
+
+static void
+gimp_gegl_mask_summary_bump_version (GimpGeglMaskSummary *summary)
+{
+  summary->version = (guint) g_atomic_int_add (&gimp_gegl_mask_summary_last_version,
+                                               1) + 1;
+}
+
+static void
+gimp_gegl_mask_summary_buffer_changed (GeglBuffer          *buffer,
+                                       const GeglRectangle *rect,
+                                       GimpGeglMaskSummary *summary)
+{
+  g_mutex_lock (&summary->mutex);
+
+  if (summary->block_count == 0)
+    gimp_gegl_mask_summary_invalidate_rect (summary, rect);
+  else
+    gimp_gegl_mask_summary_bump_version (summary);
+
+  g_mutex_unlock (&summary->mutex);
+}
+
+static void
+gimp_gegl_mask_summary_tile_rect (GimpGeglMaskSummary *summary,
+                                  gint                 index,
+                                  GeglRectangle       *rect)
+{
+  gint col = index % summary->n_cols;
+  gint row = index / summary->n_cols;
+
+  rect->x      = summary->extent.x + col * summary->tile_width;
+  rect->y      = summary->extent.y + row * summary->tile_height;
+  rect->width  = MIN (summary->tile_width,
+                      summary->extent.x + summary->extent.width - rect->x);
+  rect->height = MIN (summary->tile_height,
+                      summary->extent.y + summary->extent.height - rect->y);
+}
+
+static void
+gimp_gegl_mask_summary_set_state (GimpGeglMaskSummary   *summary,
+                                  GimpGeglMaskTile      *tile,
+                                  GimpGeglMaskTileState  state)
+{
+  if (tile->state == GIMP_GEGL_MASK_TILE_UNKNOWN)
+    summary->n_unknown--;
+  else if (tile->state != GIMP_GEGL_MASK_TILE_EMPTY)
+    summary->n_nonempty--;
+
+  tile->state = state;
+
+  if (state == GIMP_GEGL_MASK_TILE_UNKNOWN)
+    summary->n_unknown++;
+  else if (state != GIMP_GEGL_MASK_TILE_EMPTY)
+    summary->n_nonempty++;
+}
+
+static void
+gimp_gegl_mask_summary_invalidate_rect (GimpGeglMaskSummary *summary,
+                                        const GeglRectangle *rect)
+{
+  GeglRectangle area;
+  gint          col1, row1, col2, row2;
+  gint          col, row;
+
+  if (! rect)
+    rect = &summary->extent;
+
+  if (! gegl_rectangle_intersect (&area, rect, &summary->extent))
+    return;
+
+  gimp_gegl_mask_summary_bump_version (summary);
+
+  col1 = (area.x - summary->extent.x) / summary->tile_width;
+  row1 = (area.y - summary->extent.y) / summary->tile_height;
+  col2 = (area.x + area.width  - summary->extent.x - 1) / summary->tile_width;
+  row2 = (area.y + area.height - summary->extent.y - 1) / summary->tile_height;
+
+  for (row = row1; row <= row2; row++)
+    for (col = col1; col <= col2; col++)
+      {
+        GimpGeglMaskTile *tile = &summary->tiles[row * summary->n_cols + col];
+
+        if (tile->state != GIMP_GEGL_MASK_TILE_UNKNOWN)
+          gimp_gegl_mask_summary_set_state (summary, tile,
+                                            GIMP_GEGL_MASK_TILE_UNKNOWN);
+      }
+}
+
+/*  rescans all unknown tiles, called with the mutex held  */
+static void
+gimp_gegl_mask_summary_update (GimpGeglMaskSummary *summary)
+{
+  GimpGeglMaskSummaryUpdate update;
+  gint                      n_indices = 0;
+  gint                      i;
+
+  if (summary->n_unknown == 0)
+    return;
+
+  update.summary = summary;
+  update.indices = g_new (gint, summary->n_unknown);
+
+  for (i = 0; i < summary->n_cols * summary->n_rows; i++)
+    {
+      if (summary->tiles[i].state == GIMP_GEGL_MASK_TILE_UNKNOWN)
+        update.indices[n_indices++] = i;
+    }
+
+  gimp_parallel_distribute_range (n_indices, 16,
+                                  (GimpParallelDistributeRangeFunc)
+                                  gimp_gegl_mask_summary_update_range,
+                                  &update);
+
+  /*  the worker threads only record the states, fix up the counters  */
+  for (i = 0; i < n_indices; i++)
+    {
+      GimpGeglMaskTile *tile = &summary->tiles[update.indices[i]];
+
+      summary->n_unknown--;
+
+      if (tile->state != GIMP_GEGL_MASK_TILE_EMPTY)
+        summary->n_nonempty++;
+    }
+
+  g_free (update.indices);
+}
+
+static void
+gimp_gegl_mask_summary_update_range (gsize                      offset,
+                                     gsize                      size,
+                                     GimpGeglMaskSummaryUpdate *update)
+{
+  GimpGeglMaskSummary *summary = update->summary;
+  gfloat              *data;
+  gsize                i;
+
+  data = g_new (gfloat, summary->tile_width * summary->tile_height);
+
+  for (i = offset; i < offset + size; i++)
+    {
+      GimpGeglMaskTile *tile = &summary->tiles[update->indices[i]];
+      GeglRectangle     rect;
+      gboolean          all_zero = TRUE;
+      gboolean          all_one  = TRUE;
+      gint              tx1, ty1, tx2, ty2;
+      gint              x, y;
+
+      gimp_gegl_mask_summary_tile_rect (summary, update->indices[i], &rect);
+
+      gegl_buffer_get (summary->buffer, &rect, 1.0,
+                       babl_format ("Y float"), data,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+      tx1 = rect.width;
+      ty1 = rect.height;
+      tx2 = -1;
+      ty2 = -1;
+
+      for (y = 0; y < rect.height; y++)
+        {
+          const gfloat *row = data + y * rect.width;
+
+          for (x = 0; x < rect.width; x++)
+            {
+              if (row[x])
+                {
+                  all_zero = FALSE;
+
+                  if (x < tx1) tx1 = x;
+                  if (x > tx2) tx2 = x;
+                  if (y < ty1) ty1 = y;
+                  if (y > ty2) ty2 = y;
+
+                  if (row[x] != 1.0)
+                    all_one = FALSE;
+                }
+              else
+                {
+                  all_one = FALSE;
+                }
+            }
+        }
+
+      if (all_zero)
+        {
+          tile->state = GIMP_GEGL_MASK_TILE_EMPTY;
+        }
+      else
+        {
+          tile->state = all_one ? GIMP_GEGL_MASK_TILE_FULL :
+                                  GIMP_GEGL_MASK_TILE_MIXED;
+
+          tile->x1 = rect.x + tx1;
+          tile->y1 = rect.y + ty1;
+          tile->x2 = rect.x + tx2 + 1;
+          tile->y2 = rect.y + ty2 + 1;
+        }
+    }
+
+  g_free (data);
+}
@@ -0,0 +1,62 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-gegl-mask-summary.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_GEGL_MASK_SUMMARY_H__
+#define __GIMP_GEGL_MASK_SUMMARY_H__
+
+
+typedef enum
+{
+  GIMP_GEGL_MASK_TILE_UNKNOWN,
+  GIMP_GEGL_MASK_TILE_EMPTY,
+  GIMP_GEGL_MASK_TILE_FULL,
+  GIMP_GEGL_MASK_TILE_MIXED
+} GimpGeglMaskTileState;
+
+
+GimpGeglMaskSummary * gimp_gegl_mask_summary_new     (GeglBuffer            *buffer);
+void                  gimp_gegl_mask_summary_free    (GimpGeglMaskSummary   *summary);
+
+GeglBuffer * gimp_gegl_mask_summary_get_buffer       (GimpGeglMaskSummary   *summary);
+guint        gimp_gegl_mask_summary_get_version      (GimpGeglMaskSummary   *summary);
+
+void         gimp_gegl_mask_summary_block            (GimpGeglMaskSummary   *summary);
+void         gimp_gegl_mask_summary_unblock          (GimpGeglMaskSummary   *summary);
+
+void         gimp_gegl_mask_summary_invalidate       (GimpGeglMaskSummary   *summary,
+                                                      const GeglRectangle   *rect);
+void         gimp_gegl_mask_summary_invalidate_mixed (GimpGeglMaskSummary   *summary);
+void         gimp_gegl_mask_summary_set              (GimpGeglMaskSummary   *summary,
+                                                      const GeglRectangle   *rect,
+                                                      GimpGeglMaskTileState  state);
+void         gimp_gegl_mask_summary_invert           (GimpGeglMaskSummary   *summary);
+
+gboolean     gimp_gegl_mask_summary_bounds           (GimpGeglMaskSummary   *summary,
+                                                      gint                  *x1,
+                                                      gint                  *y1,
+                                                      gint                  *x2,
+                                                      gint                  *y2);
+gboolean     gimp_gegl_mask_summary_is_empty         (GimpGeglMaskSummary   *summary);
+gboolean     gimp_gegl_mask_summary_get_value        (GimpGeglMaskSummary   *summary,
+                                                      gint                   x,
+                                                      gint                   y,
+                                                      gdouble               *value);
+
+
+#endif /* __GIMP_GEGL_MASK_SUMMARY_H__ */
@@ -29,6 +29,7 @@
 #include "operations/gimp-operations.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 
 #include "gimp-babl.h"
 #include "gimp-gegl.h"
@@ -81,6 +82,8 @@ gimp_gegl_init (Gimp *gimp)
   gimp_babl_init ();
 
   gimp_operations_init ();
+
+  gimp_parallel_init (gimp);
 }
 
 static void
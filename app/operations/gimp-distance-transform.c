@@ -0,0 +1,422 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-distance-transform.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*  Exact euclidean distance transform, in linear time, following
+ *
+ *    P. F. Felzenszwalb and D. P. Huttenlocher,
+ *    "Distance Transforms of Sampled Functions", 2012
+ *
+ *  The first pass finds the vertical distance of each pixel to the
+ *  nearest feature pixel in its column, the second pass finds the
+ *  lower envelope of the resulting parabolas along each row.  Both
+ *  passes are independent between columns and rows, respectively, and
+ *  are run in parallel.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "operations-types.h"
+
+#include "core/gimp-parallel.h"
+
+#include "gimp-distance-transform.h"
+
+
+#define MIN_PARALLEL_SUB_SIZE 64
+
+
+typedef struct
+{
+  const gfloat *src;
+  gfloat       *dest;
+  gint          width;
+  gint          height;
+  gboolean      invert;
+  gboolean      edge_is_feature;
+
+  gboolean      ellipse;
+  gint          radius_x;
+  gint          radius_y;
+} GimpDistanceTransform;
+
+
+/*  local function prototypes  */
+
+static void   gimp_distance_transform_run      (GimpDistanceTransform *transform);
+static void   gimp_distance_transform_columns  (gsize                  offset,
+                                                gsize                  size,
+                                                GimpDistanceTransform *transform);
+static void   gimp_distance_transform_rows     (gsize                  offset,
+                                                gsize                  size,
+                                                GimpDistanceTransform *transform);
+static void   gimp_distance_transform_envelope (const gdouble         *f,
+                                                gint                   first,
+                                                gint                   last,
+                                                gdouble                center,
+                                                gdouble               *result,
+                                                gint                   width,
+                                                gint                  *v,
+                                                gdouble               *z);
+
+
+/*  public functions  */
+
+/**
+ * gimp_distance_transform:
+ * @src:             @width x @height mask values
+ * @dest:            returns the distance of each pixel
+ * @width:           width of @src and @dest
+ * @height:          height of @src and @dest
+ * @invert:          whether feature pixels are the zero or the non-zero
+ *                   pixels of @src
+ * @edge_is_feature: whether the area outside @src counts as feature
+ *
+ * Computes, for each pixel, the euclidean distance to the center of
+ * the nearest feature pixel.  Feature pixels are the pixels whose
+ * value in @src is zero, or non-zero if @invert is %TRUE, and have a
+ * distance of 0.  Pixels outside of @src are at a distance of 1 from
+ * the edge pixels.  @src and @dest may be the same buffer.
+ *
+ * If there are no feature pixels at all, all distances are at least
+ * @width + @height.
+ **/
+void
+gimp_distance_transform (const gfloat *src,
+                         gfloat       *dest,
+                         gint          width,
+                         gint          height,
+                         gboolean      invert,
+                         gboolean      edge_is_feature)
+{
+  GimpDistanceTransform transform = { 0, };
+
+  g_return_if_fail (src != NULL);
+  g_return_if_fail (dest != NULL);
+
+  transform.src             = src;
+  transform.dest            = dest;
+  transform.width           = width;
+  transform.height          = height;
+  transform.invert          = invert;
+  transform.edge_is_feature = edge_is_feature;
+
+  gimp_distance_transform_run (&transform);
+}
+
+/**
+ * gimp_distance_transform_ellipse:
+ * @src:             @width x @height mask values
+ * @dest:            returns the distance of each pixel
+ * @width:           width of @src and @dest
+ * @height:          height of @src and @dest
+ * @radius_x:        horizontal radius of the ellipse
+ * @radius_y:        vertical radius of the ellipse
+ * @invert:          whether feature pixels are the zero or the non-zero
+ *                   pixels of @src
+ * @edge_is_feature: whether the area outside @src counts as feature
+ *
+ * Like gimp_distance_transform(), but measures the distance between
+ * pixel squares instead of pixel centers, relative to an ellipse: a
+ * feature pixel at an offset of (dx, dy) is at a distance of
+ *
+ *   (max (|dx| - 0.5, 0) / @radius_x)^2 + (max (|dy| - 0.5, 0) / @radius_y)^2
+ *
+ * Feature pixels are within the ellipse around a pixel if their
+ * distance is less than 1.  This is the ellipse used by the grow,
+ * shrink and border operations.
+ *
+ * If there are no feature pixels at all, all distances are greater
+ * than 1.
+ **/
+void
+gimp_distance_transform_ellipse (const gfloat *src,
+                                 gfloat       *dest,
+                                 gint          width,
+                                 gint          height,
+                                 gint          radius_x,
+                                 gint          radius_y,
+                                 gboolean      invert,
+                                 gboolean      edge_is_feature)
+{
+  GimpDistanceTransform transform = { 0, };
+
+  g_return_if_fail (src != NULL);
+  g_return_if_fail (dest != NULL);
+  g_return_if_fail (radius_x > 0 && radius_y > 0);
+
+  transform.src             = src;
+  transform.dest            = dest;
+  transform.width           = width;
+  transform.height          = height;
+  transform.invert          = invert;
+  transform.edge_is_feature = edge_is_feature;
+  transform.ellipse         = TRUE;
+  transform.radius_x        = radius_x;
+  transform.radius_y        = radius_y;
+
+  gimp_distance_transform_run (&transform);
+}
+
+
+/*  private functions  */
+
+static void
+gimp_distance_transform_run (GimpDistanceTransform *transform)
+{
+  if (transform->width <= 0 || transform->height <= 0)
+    return;
+
+  gimp_parallel_distribute_range (transform->width, MIN_PARALLEL_SUB_SIZE,
+                                  (GimpParallelDistributeRangeFunc)
+                                  gimp_distance_transform_columns,
+                                  transform);
+
+  gimp_parallel_distribute_range (transform->height, MIN_PARALLEL_SUB_SIZE,
+                                  (GimpParallelDistributeRangeFunc)
+                                  gimp_distance_transform_rows,
+                                  transform);
+}
+
+/*  finds the vertical distance to the nearest feature pixel, for the
+ *  columns offset .. offset + size - 1.  the columns are processed
+ *  side by side, one row at a time, to keep memory access sequential.
+ */
+static void
+gimp_distance_transform_columns (gsize                  offset,
+                                 gsize                  size,
+                                 GimpDistanceTransform *transform)
+{
+  const gint    width  = transform->width;
+  const gint    height = transform->height;
+  gfloat        inf    = width + height;
+  gfloat        edge;
+  gint          x, y;
+
+  /*  columns without feature pixels must be farther away than any
+   *  feature pixel, and outside the ellipse, which is (inf - 0.5) /
+   *  radius_y for the vertical part of the ellipse distance
+   */
+  if (transform->ellipse)
+    inf = (gfloat) width * transform->radius_y / transform->radius_x +
+          height + transform->radius_y + 1;
+
+  edge = transform->edge_is_feature ? 0.0 : inf;
+
+  /*  top down  */
+  for (y = 0; y < height; y++)
+    {
+      const gfloat *src  = transform->src  + (gsize) y * width + offset;
+      gfloat       *dest = transform->dest + (gsize) y * width + offset;
+      const gfloat *prev = dest - width;
+
+      for (x = 0; x < size; x++)
+        {
+          gboolean feature = transform->invert ? src[x] > 0.0 : src[x] <= 0.0;
+
+          if (feature)
+            dest[x] = 0.0;
+          else
+            dest[x] = MIN ((y > 0 ? prev[x] : edge) + 1.0, inf);
+        }
+    }
+
+  /*  bottom up  */
+  for (y = height - 1; y >= 0; y--)
+    {
+      gfloat       *dest = transform->dest + (gsize) y * width + offset;
+      const gfloat *next = dest + width;
+
+      for (x = 0; x < size; x++)
+        {
+          gfloat below = (y < height - 1 ? next[x] : edge) + 1.0;
+
+          if (below < dest[x])
+            dest[x] = below;
+        }
+    }
+}
+
+/*  combines the vertical distances g of the rows offset .. offset +
+ *  size - 1, using the lower envelope of the parabolas (x - q)^2 +
+ *  g(q)^2 of each row.  if the edge is feature, the envelope includes
+ *  a parabola at -1 and at width, with g = 0.
+ *
+ *  for the ellipse distance, the distances are scaled by radius_x^2,
+ *  and a feature at q is at (|x - q| - 0.5)^2 horizontally, unless x
+ *  is q.  for features left of x, this is the parabola centered at
+ *  q + 0.5, for features right of x the one centered at q - 0.5, and
+ *  either parabola is too far for features on the other side, so the
+ *  minimum of both envelopes, and of the feature at x itself, is the
+ *  exact distance.
+ */
+static void
+gimp_distance_transform_rows (gsize                  offset,
+                              gsize                  size,
+                              GimpDistanceTransform *transform)
+{
+  const gint  width = transform->width;
+  gdouble    *f;
+  gdouble    *result;
+  gdouble    *z;
+  gint       *v;
+  gdouble     scale     = 1.0;
+  gdouble     radius_x2 = 1.0;
+  gint        first;
+  gint        last;
+  gint        y;
+
+  /*  f, indexed by q + 1, holds g(q)^2 for q = -1 .. width  */
+  f      = g_new (gdouble, width + 2);
+  result = g_new (gdouble, width);
+  z      = g_new (gdouble, width + 3);
+  v      = g_new (gint,    width + 2);
+
+  f[0]         = 0.0;
+  f[width + 1] = 0.0;
+
+  if (transform->edge_is_feature)
+    {
+      first = -1;
+      last  = width;
+    }
+  else
+    {
+      first = 0;
+      last  = width - 1;
+    }
+
+  if (transform->ellipse)
+    {
+      scale     = (gdouble) transform->radius_x / transform->radius_y;
+      radius_x2 = (gdouble) transform->radius_x * transform->radius_x;
+    }
+
+  for (y = offset; y < offset + size; y++)
+    {
+      gfloat *dest = transform->dest + (gsize) y * width;
+      gint    x;
+
+      if (transform->ellipse)
+        {
+          for (x = 0; x < width; x++)
+            {
+              gdouble g = MAX (dest[x] - 0.5, 0.0) * scale;
+
+              f[x + 1]  = g * g;
+              result[x] = f[x + 1];
+            }
+
+          gimp_distance_transform_envelope (f, first, last,  0.5,
+                                            result, width, v, z);
+          gimp_distance_transform_envelope (f, first, last, -0.5,
+                                            result, width, v, z);
+
+          for (x = 0; x < width; x++)
+            dest[x] = result[x] / radius_x2;
+        }
+      else
+        {
+          for (x = 0; x < width; x++)
+            {
+              f[x + 1]  = (gdouble) dest[x] * dest[x];
+              result[x] = G_MAXDOUBLE;
+            }
+
+          gimp_distance_transform_envelope (f, first, last, 0.0,
+                                            result, width, v, z);
+
+          for (x = 0; x < width; x++)
+            dest[x] = sqrt (result[x]);
+        }
+    }
+
+  g_free (v);
+  g_free (z);
+  g_free (result);
+  g_free (f);
+}
+
+/*  lowers result[x], for x = 0 .. width - 1, to the lower envelope of
+ *  the parabolas (x - (q + center))^2 + f[q + 1], q = first .. last
+ */
+static void
+gimp_distance_transform_envelope (const gdouble *f,
+                                  gint           first,
+                                  gint           last,
+                                  gdouble        center,
+                                  gdouble       *result,
+                                  gint           width,
+                                  gint          *v,
+                                  gdouble       *z)
+{
+  gint k;
+  gint q;
+  gint x;
+
+  k    = 0;
+  v[0] = first;
+  z[0] = -G_MAXDOUBLE;
+  z[1] =  G_MAXDOUBLE;
+
+  /*  the parabolas only differ by their offset, so the intersection of
+   *  two of them doesn't depend on the common center
+   */
+  for (q = first + 1; q <= last; q++)
+    {
+      gdouble fq = f[q + 1] + (gdouble) q * q;
+      gdouble s;
+
+      while (TRUE)
+        {
+          gint r = v[k];
+
+          s = (fq - (f[r + 1] + (gdouble) r * r)) / (2.0 * (q - r));
+
+          if (s > z[k])
+            break;
+
+          k--;
+        }
+
+      k++;
+      v[k]     = q;
+      z[k]     = s;
+      z[k + 1] = G_MAXDOUBLE;
+    }
+
+  k = 0;
+
+  for (x = 0; x < width; x++)
+    {
+      gdouble d;
+
+      while (z[k + 1] + center < x)
+        k++;
+
+      d = x - (v[k] + center);
+      d = d * d + f[v[k] + 1];
+
+      if (d < result[x])
+        result[x] = d;
+    }
+}
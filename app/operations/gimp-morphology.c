@@ -0,0 +1,655 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-morphology.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*  Helpers for the grow and shrink operations.
+ *
+ *  Rectangular dilation and erosion use the van Herk/Gil-Werman
+ *  algorithm: each line is split into blocks of the window size, and
+ *  the maximum over any window is the maximum of a suffix maximum of
+ *  one block and a prefix maximum of the next, which takes a constant
+ *  number of comparisons per pixel, independent of the radius.
+ *
+ *  Elliptic dilation splits the mask into its top value, the bottom
+ *  value and the values in between, which in an antialiased or
+ *  feathered mask are a thin band along the edges.  The distance
+ *  transforms of the top and of the in-between pixels decide every
+ *  pixel that does not see an in-between pixel but no top pixel in its
+ *  ellipse, in linear time.  Only the pixels that do are scanned, one
+ *  column of the ellipse at a time, against lists of the in-between
+ *  pixels of each column.  Erosion is dilation of the negated mask.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "operations-types.h"
+
+#include "core/gimp-parallel.h"
+
+#include "gimp-distance-transform.h"
+#include "gimp-morphology.h"
+
+
+#define MIN_PARALLEL_SUB_SIZE 64
+#define STRIP_WIDTH           64
+
+/*  the cost of scanning one column of the ellipse for a band pixel,
+ *  relative to the per-pixel and radius cost of the old filter of the
+ *  grow and shrink operations
+ */
+#define BAND_COLUMN_COST      2
+
+
+typedef struct
+{
+  gfloat   *buf;
+  gint      width;
+  gint      height;
+  gint      radius_x;
+  gint      radius_y;
+  gboolean  erode;
+  gfloat    outside;
+} GimpMorphology;
+
+typedef struct
+{
+  gfloat       *buf;
+  gint          width;
+  gint          height;
+  gint          radius_x;
+  const gint   *heights;
+  const gfloat *top_dist;
+  const gfloat *band_dist;
+  const gint   *column_start;
+  const gint   *band_y;
+  const gfloat *band_value;
+  gfloat        top;
+  gfloat        bottom;
+  gfloat        outside;
+  gboolean      outside_in_band;
+} GimpMorphologyEllipse;
+
+
+/*  local function prototypes  */
+
+static void   gimp_morphology_rows    (gsize           offset,
+                                       gsize           size,
+                                       GimpMorphology *morphology);
+static void   gimp_morphology_columns (gsize           offset,
+                                       gsize           size,
+                                       GimpMorphology *morphology);
+
+static gboolean gimp_morphology_ellipse_dilate (gfloat                *buf,
+                                                gint                   width,
+                                                gint                   height,
+                                                gint                   radius_x,
+                                                gint                   radius_y,
+                                                gfloat                 outside,
+                                                gboolean               force);
+static void     gimp_morphology_ellipse_rows   (gsize                  offset,
+                                                gsize                  size,
+                                                GimpMorphologyEllipse *ellipse);
+
+
+/*  public functions  */
+
+/*  returns whether the ellipse of the grow and shrink operations is a
+ *  rectangle for the given radii, which is the case if its outermost
+ *  columns are as high as its center column
+ */
+gboolean
+gimp_morphology_ellipse_is_rectangle (gint radius_x,
+                                      gint radius_y)
+{
+  gdouble tmp = radius_x - 0.5;
+
+  g_return_val_if_fail (radius_x > 0 && radius_y > 0, FALSE);
+
+  return RINT (radius_y /
+               (gdouble) radius_x * sqrt (SQR (radius_x) - SQR (tmp))) >= radius_y;
+}
+
+/**
+ * gimp_morphology_rectangle:
+ * @buf:      @width x @height values, modified in place
+ * @width:    width of @buf
+ * @height:   height of @buf
+ * @radius_x: horizontal radius of the rectangle
+ * @radius_y: vertical radius of the rectangle
+ * @erode:    whether to take the minimum instead of the maximum
+ * @outside:  the value of the pixels outside @buf
+ *
+ * Replaces each value of @buf by the maximum (or minimum, if @erode is
+ * %TRUE) of the (2 * @radius_x + 1) x (2 * @radius_y + 1) rectangle
+ * around it.
+ **/
+void
+gimp_morphology_rectangle (gfloat   *buf,
+                           gint      width,
+                           gint      height,
+                           gint      radius_x,
+                           gint      radius_y,
+                           gboolean  erode,
+                           gfloat    outside)
+{
+  GimpMorphology morphology;
+
+  g_return_if_fail (buf != NULL);
+  g_return_if_fail (radius_x >= 0 && radius_y >= 0);
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  morphology.buf      = buf;
+  morphology.width    = width;
+  morphology.height   = height;
+  morphology.radius_x = radius_x;
+  morphology.radius_y = radius_y;
+  morphology.erode    = erode;
+  morphology.outside  = outside;
+
+  if (radius_x > 0)
+    gimp_parallel_distribute_range (height, MIN_PARALLEL_SUB_SIZE,
+                                    (GimpParallelDistributeRangeFunc)
+                                    gimp_morphology_rows,
+                                    &morphology);
+
+  if (radius_y > 0)
+    gimp_parallel_distribute_range (width, MIN_PARALLEL_SUB_SIZE,
+                                    (GimpParallelDistributeRangeFunc)
+                                    gimp_morphology_columns,
+                                    &morphology);
+}
+
+/**
+ * gimp_morphology_ellipse:
+ * @buf:      @width x @height values, modified in place
+ * @width:    width of @buf
+ * @height:   height of @buf
+ * @radius_x: horizontal radius of the ellipse
+ * @radius_y: vertical radius of the ellipse
+ * @erode:    whether to take the minimum instead of the maximum
+ * @outside:  the value of the pixels outside @buf
+ * @force:    whether to filter @buf however wide its band of
+ *            in-between values is
+ *
+ * Replaces each value of @buf by the maximum (or minimum, if @erode is
+ * %TRUE) of the ellipse of the grow and shrink operations around it.
+ *
+ * The work is linear in the number of pixels, plus @radius_x for each
+ * pixel that has in-between values but no top value (bottom value, if
+ * @erode is %TRUE) in its ellipse.  Unless @force is %TRUE, @buf is
+ * left alone if that band is so wide that filtering it would take
+ * longer than filtering the whole mask with a per-radius filter.
+ *
+ * Return value: %TRUE if @buf was filtered.
+ **/
+gboolean
+gimp_morphology_ellipse (gfloat   *buf,
+                         gint      width,
+                         gint      height,
+                         gint      radius_x,
+                         gint      radius_y,
+                         gboolean  erode,
+                         gfloat    outside,
+                         gboolean  force)
+{
+  gsize    n_pixels;
+  gboolean success;
+  gsize    i;
+
+  g_return_val_if_fail (buf != NULL, FALSE);
+  g_return_val_if_fail (radius_x > 0 && radius_y > 0, FALSE);
+
+  if (width <= 0 || height <= 0)
+    return TRUE;
+
+  n_pixels = (gsize) width * height;
+
+  if (erode)
+    {
+      for (i = 0; i < n_pixels; i++)
+        buf[i] = -buf[i];
+    }
+
+  success = gimp_morphology_ellipse_dilate (buf, width, height,
+                                            radius_x, radius_y,
+                                            erode ? -outside : outside,
+                                            force);
+
+  if (erode)
+    {
+      for (i = 0; i < n_pixels; i++)
+        buf[i] = -buf[i];
+    }
+
+  return success;
+}
+
+
+/*  private functions  */
+
+static inline gfloat
+gimp_morphology_op (gfloat   a,
+                    gfloat   b,
+                    gboolean erode)
+{
+  if (erode)
+    return MIN (a, b);
+  else
+    return MAX (a, b);
+}
+
+static void
+gimp_morphology_rows (gsize           offset,
+                      gsize           size,
+                      GimpMorphology *morphology)
+{
+  const gint      width  = morphology->width;
+  const gint      radius = morphology->radius_x;
+  const gint      window = 2 * radius + 1;
+  const gint      length = width + 2 * radius;
+  const gboolean  erode  = morphology->erode;
+  gfloat         *line;
+  gfloat         *prefix;
+  gfloat         *suffix;
+  gint            x, y;
+
+  line   = g_new (gfloat, length);
+  prefix = g_new (gfloat, length);
+  suffix = g_new (gfloat, length);
+
+  for (x = 0; x < radius; x++)
+    {
+      line[x]                  = morphology->outside;
+      line[width + radius + x] = morphology->outside;
+    }
+
+  for (y = offset; y < offset + size; y++)
+    {
+      gfloat *row = morphology->buf + (gsize) y * width;
+      gint    start;
+
+      memcpy (line + radius, row, width * sizeof (gfloat));
+
+      for (start = 0; start < length; start += window)
+        {
+          gint end = MIN (start + window, length);
+
+          prefix[start] = line[start];
+
+          for (x = start + 1; x < end; x++)
+            prefix[x] = gimp_morphology_op (prefix[x - 1], line[x], erode);
+
+          suffix[end - 1] = line[end - 1];
+
+          for (x = end - 2; x >= start; x--)
+            suffix[x] = gimp_morphology_op (suffix[x + 1], line[x], erode);
+        }
+
+      /*  the window of row[x] is line[x .. x + 2 * radius]  */
+      for (x = 0; x < width; x++)
+        row[x] = gimp_morphology_op (suffix[x], prefix[x + 2 * radius], erode);
+    }
+
+  g_free (suffix);
+  g_free (prefix);
+  g_free (line);
+}
+
+/*  the columns are processed in strips, side by side, to keep memory
+ *  access sequential
+ */
+static void
+gimp_morphology_columns (gsize           offset,
+                         gsize           size,
+                         GimpMorphology *morphology)
+{
+  const gint      width   = morphology->width;
+  const gint      height  = morphology->height;
+  const gint      radius  = morphology->radius_y;
+  const gint      window  = 2 * radius + 1;
+  const gint      length  = height + 2 * radius;
+  const gboolean  erode   = morphology->erode;
+  const gfloat    outside = morphology->outside;
+  gfloat         *prefix;
+  gfloat         *suffix;
+  gint            x0;
+
+  prefix = g_new (gfloat, (gsize) length * STRIP_WIDTH);
+  suffix = g_new (gfloat, (gsize) length * STRIP_WIDTH);
+
+  for (x0 = offset; x0 < offset + size; x0 += STRIP_WIDTH)
+    {
+      gint n = MIN (STRIP_WIDTH, offset + size - x0);
+      gint start;
+      gint x, y;
+
+      for (start = 0; start < length; start += window)
+        {
+          gint end = MIN (start + window, length);
+
+          for (y = start; y < end; y++)
+            {
+              gfloat       *p   = prefix + (gsize) y * STRIP_WIDTH;
+              const gfloat *src = NULL;
+
+              if (y >= radius && y < height + radius)
+                src = morphology->buf + (gsize) (y - radius) * width + x0;
+
+              for (x = 0; x < n; x++)
+                {
+                  gfloat value = src ? src[x] : outside;
+
+                  if (y == start)
+                    p[x] = value;
+                  else
+                    p[x] = gimp_morphology_op (p[x - STRIP_WIDTH], value, erode);
+                }
+            }
+
+          for (y = end - 1; y >= start; y--)
+            {
+              gfloat       *s   = suffix + (gsize) y * STRIP_WIDTH;
+              const gfloat *src = NULL;
+
+              if (y >= radius && y < height + radius)
+                src = morphology->buf + (gsize) (y - radius) * width + x0;
+
+              for (x = 0; x < n; x++)
+                {
+                  gfloat value = src ? src[x] : outside;
+
+                  if (y == end - 1)
+                    s[x] = value;
+                  else
+                    s[x] = gimp_morphology_op (s[x + STRIP_WIDTH], value, erode);
+                }
+            }
+        }
+
+      for (y = 0; y < height; y++)
+        {
+          gfloat       *dest = morphology->buf + (gsize) y * width + x0;
+          const gfloat *s    = suffix + (gsize) y * STRIP_WIDTH;
+          const gfloat *p    = prefix + (gsize) (y + 2 * radius) * STRIP_WIDTH;
+
+          for (x = 0; x < n; x++)
+            dest[x] = gimp_morphology_op (s[x], p[x], erode);
+        }
+    }
+
+  g_free (suffix);
+  g_free (prefix);
+}
+
+static gboolean
+gimp_morphology_ellipse_dilate (gfloat   *buf,
+                                gint      width,
+                                gint      height,
+                                gint      radius_x,
+                                gint      radius_y,
+                                gfloat    outside,
+                                gboolean  force)
+{
+  GimpMorphologyEllipse  ellipse;
+  const gsize            n_pixels = (gsize) width * height;
+  gfloat                 top;
+  gfloat                 bottom;
+  gboolean               outside_in_band;
+  gfloat                *top_dist;
+  gfloat                *band_dist;
+  gint                  *heights;
+  gint                  *column_start;
+  gint                  *fill;
+  gint                  *band_y;
+  gfloat                *band_value;
+  gsize                  n_band_pixels = 0;
+  gsize                  n_scanned     = 0;
+  gsize                  i;
+  gint                   x, y;
+
+  top = bottom = buf[0];
+
+  for (i = 1; i < n_pixels; i++)
+    {
+      top    = MAX (top,    buf[i]);
+      bottom = MIN (bottom, buf[i]);
+    }
+
+  /*  pixels outside that are below the bottom value never raise the
+   *  maximum, because each pixel is in its own ellipse
+   */
+  top             = MAX (top, outside);
+  outside_in_band = outside > bottom && outside < top;
+
+  top_dist  = g_new (gfloat, n_pixels);
+  band_dist = g_new (gfloat, n_pixels);
+
+  for (i = 0; i < n_pixels; i++)
+    band_dist[i] = buf[i] == top ? 1.0 : 0.0;
+
+  gimp_distance_transform_ellipse (band_dist, top_dist, width, height,
+                                   radius_x, radius_y,
+                                   TRUE, outside == top);
+
+  for (i = 0; i < n_pixels; i++)
+    {
+      if (buf[i] > bottom && buf[i] < top)
+        {
+          band_dist[i] = 1.0;
+          n_band_pixels++;
+        }
+      else
+        {
+          band_dist[i] = 0.0;
+        }
+    }
+
+  if (n_band_pixels > 0 || outside_in_band)
+    {
+      gimp_distance_transform_ellipse (band_dist, band_dist, width, height,
+                                       radius_x, radius_y,
+                                       TRUE, outside_in_band);
+
+      for (i = 0; i < n_pixels; i++)
+        {
+          if (top_dist[i] >= 1.0 && band_dist[i] < 1.0)
+            n_scanned++;
+        }
+    }
+  else
+    {
+      for (i = 0; i < n_pixels; i++)
+        band_dist[i] = 1.0;
+    }
+
+  if (! force &&
+      (gdouble) n_scanned * (2 * radius_x + 1) * BAND_COLUMN_COST >
+      (gdouble) n_pixels * (radius_x + radius_y))
+    {
+      g_free (band_dist);
+      g_free (top_dist);
+
+      return FALSE;
+    }
+
+  /*  the in-between pixels of each column, from top to bottom  */
+  column_start = g_new0 (gint, width + 1);
+  band_y       = g_new (gint, n_band_pixels);
+  band_value   = g_new (gfloat, n_band_pixels);
+
+  for (i = 0; i < n_pixels; i++)
+    {
+      if (buf[i] > bottom && buf[i] < top)
+        column_start[i % width + 1]++;
+    }
+
+  for (x = 0; x < width; x++)
+    column_start[x + 1] += column_start[x];
+
+  fill = g_memdup (column_start, width * sizeof (gint));
+
+  for (y = 0; y < height; y++)
+    {
+      const gfloat *row = buf + (gsize) y * width;
+
+      for (x = 0; x < width; x++)
+        {
+          if (row[x] > bottom && row[x] < top)
+            {
+              band_y[fill[x]]     = y;
+              band_value[fill[x]] = row[x];
+              fill[x]++;
+            }
+        }
+    }
+
+  g_free (fill);
+
+  /*  the half heights of the columns of the ellipse, which are the
+   *  ones of gimp_distance_transform_ellipse()
+   */
+  heights = g_new (gint, 2 * radius_x + 1);
+
+  for (x = 0; x <= radius_x; x++)
+    {
+      gdouble tmp = x ? x - 0.5 : 0.0;
+
+      heights[radius_x + x] =
+      heights[radius_x - x] = RINT (radius_y / (gdouble) radius_x *
+                                    sqrt (SQR (radius_x) - SQR (tmp)));
+    }
+
+  ellipse.buf             = buf;
+  ellipse.width           = width;
+  ellipse.height          = height;
+  ellipse.radius_x        = radius_x;
+  ellipse.heights         = heights;
+  ellipse.top_dist        = top_dist;
+  ellipse.band_dist       = band_dist;
+  ellipse.column_start    = column_start;
+  ellipse.band_y          = band_y;
+  ellipse.band_value      = band_value;
+  ellipse.top             = top;
+  ellipse.bottom          = bottom;
+  ellipse.outside         = outside;
+  ellipse.outside_in_band = outside_in_band;
+
+  gimp_parallel_distribute_range (height, MIN_PARALLEL_SUB_SIZE,
+                                  (GimpParallelDistributeRangeFunc)
+                                  gimp_morphology_ellipse_rows,
+                                  &ellipse);
+
+  g_free (heights);
+  g_free (band_value);
+  g_free (band_y);
+  g_free (column_start);
+  g_free (band_dist);
+  g_free (top_dist);
+
+  return TRUE;
+}
+
+/*  only reads the column lists and the distances, so the rows can be
+ *  written in place
+ */
+static void
+gimp_morphology_ellipse_rows (gsize                  offset,
+                              gsize                  size,
+                              GimpMorphologyEllipse *ellipse)
+{
+  const gint width    = ellipse->width;
+  const gint height   = ellipse->height;
+  const gint radius_x = ellipse->radius_x;
+  gint       x, y;
+
+  for (y = offset; y < offset + size; y++)
+    {
+      gfloat       *row       = ellipse->buf       + (gsize) y * width;
+      const gfloat *top_dist  = ellipse->top_dist  + (gsize) y * width;
+      const gfloat *band_dist = ellipse->band_dist + (gsize) y * width;
+
+      for (x = 0; x < width; x++)
+        {
+          gfloat value = ellipse->bottom;
+          gint   dx;
+
+          if (top_dist[x] < 1.0)
+            {
+              row[x] = ellipse->top;
+
+              continue;
+            }
+          else if (band_dist[x] >= 1.0)
+            {
+              row[x] = ellipse->bottom;
+
+              continue;
+            }
+
+          for (dx = -radius_x; dx <= radius_x; dx++)
+            {
+              gint column = x + dx;
+              gint y1     = y - ellipse->heights[radius_x + dx];
+              gint y2     = y + ellipse->heights[radius_x + dx];
+              gint lo, hi;
+              gint i;
+
+              if (column < 0 || column >= width || y1 < 0 || y2 >= height)
+                {
+                  if (ellipse->outside_in_band)
+                    value = MAX (value, ellipse->outside);
+
+                  if (column < 0 || column >= width)
+                    continue;
+                }
+
+              /*  the first in-between pixel of the column from y1 on  */
+              lo = ellipse->column_start[column];
+              hi = ellipse->column_start[column + 1];
+
+              while (lo < hi)
+                {
+                  gint mid = (lo + hi) / 2;
+
+                  if (ellipse->band_y[mid] < y1)
+                    lo = mid + 1;
+                  else
+                    hi = mid;
+                }
+
+              for (i = lo;
+                   i < ellipse->column_start[column + 1] &&
+                   ellipse->band_y[i] <= y2;
+                   i++)
+                {
+                  value = MAX (value, ellipse->band_value[i]);
+                }
+            }
+
+          row[x] = value;
+        }
+    }
+}
@@ -0,0 +1,44 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-morphology.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_MORPHOLOGY_H__
+#define __GIMP_MORPHOLOGY_H__
+
+
+gboolean   gimp_morphology_ellipse_is_rectangle (gint          radius_x,
+                                                 gint          radius_y);
+
+void       gimp_morphology_rectangle            (gfloat       *buf,
+                                                 gint          width,
+                                                 gint          height,
+                                                 gint          radius_x,
+                                                 gint          radius_y,
+                                                 gboolean      erode,
+                                                 gfloat        outside);
+gboolean   gimp_morphology_ellipse              (gfloat       *buf,
+                                                 gint          width,
+                                                 gint          height,
+                                                 gint          radius_x,
+                                                 gint          radius_y,
+                                                 gboolean      erode,
+                                                 gfloat        outside,
+                                                 gboolean      force);
+
+
+#endif /* __GIMP_MORPHOLOGY_H__ */
@@ -29,6 +29,7 @@
 
 #include "operations-types.h"
 
+#include "gimp-distance-transform.h"
 #include "gimpoperationborder.h"
 
 
@@ -340,28 +341,19 @@ gimp_operation_border_process (GeglOperation       *operation,
   const Babl          *input_format  = babl_format ("Y float");
   const Babl          *output_format = babl_format ("Y float");
 
-  gint32 i, j, x, y;
+  gint32 i, y;
 
-  /* A cache used in the algorithm as it works its way down. `buf[1]' is the
-     current row. Thus, at algorithm initialization, `buf[0]' represents the
-     row 'above' the first row of the region. */
-  gfloat  *buf[3];
-
-  /* The resulting selection is calculated row by row, and this buffer holds the
-     output for each individual row, on each iteration. */
-  gfloat  *out;
+  /* The whole region, and the rows just above and below it. */
+  gfloat  *src;
+  gfloat  *edge;
 
   /* Keeps track of transitional pixels (pixels that are selected and have
-     unselected neighbouring pixels). */
-  gfloat **transition;
-
-  /* TODO: Figure out role clearly in algorithm. */
-  gint16  *max;
+     unselected neighbouring pixels), and then holds the normalized squared
+     distance of each pixel to the nearest one. */
+  gfloat  *dist;
 
-  /* TODO: Figure out role clearly in algorithm. */
-  gfloat **density;
-
-  gint16   last_index;
+  gsize    n_pixels;
+  gsize    k;
 
   /* optimize this case specifically */
   if (self->radius_x == 1 && self->radius_y == 1)
@@ -454,293 +446,63 @@ gimp_operation_border_process (GeglOperation       *operation,
       return TRUE;
     }
 
-  max = g_new (gint16, roi->width + 2 * self->radius_x);
-
-  for (i = 0; i < (roi->width + 2 * self->radius_x); i++)
-    max[i] = self->radius_y + 2;
-
-  max += self->radius_x;
-
-  for (i = 0; i < 3; i++)
-    buf[i] = g_new (gfloat, roi->width);
-
-  transition = g_new (gfloat *, self->radius_y + 1);
-
-  for (i = 0; i < self->radius_y + 1; i++)
-    {
-      transition[i] = g_new (gfloat, roi->width + 2 * self->radius_x);
-      memset (transition[i], 0,
-              (roi->width + 2 * self->radius_x) * sizeof (gfloat));
-      transition[i] += self->radius_x;
-    }
-
-  out = g_new (gfloat, roi->width);
+  n_pixels = (gsize) roi->width * roi->height;
 
-  density = g_new (gfloat *, 2 * self->radius_x + 1);
-  density += self->radius_x;
-
-  /* allocate density[][] */
-  for (x = 0; x < (self->radius_x + 1); x++)
-    {
-      density[ x]  = g_new (gfloat, 2 * self->radius_y + 1);
-      density[ x] += self->radius_y;
-      density[-x]  = density[x];
-    }
+  src  = g_new (gfloat, n_pixels);
+  dist = g_new (gfloat, n_pixels);
+  edge = g_new (gfloat, roi->width);
 
-  /* compute density[][] */
-  for (x = 0; x < (self->radius_x + 1); x++)
-    {
-      gdouble tmpx, tmpy, dist;
-      gfloat  a;
-
-      if (x > 0)
-        tmpx = x - 0.5;
-      else if (x < 0)
-        tmpx = x + 0.5;
-      else
-        tmpx = 0.0;
-
-      for (y = 0; y < (self->radius_y + 1); y++)
-        {
-          if (y > 0)
-            tmpy = y - 0.5;
-          else if (y < 0)
-            tmpy = y + 0.5;
-          else
-            tmpy = 0.0;
-
-          dist = ((tmpy * tmpy) / (self->radius_y * self->radius_y) +
-                  (tmpx * tmpx) / (self->radius_x * self->radius_x));
-
-          if (dist < 1.0)
-            {
-              if (self->feather)
-                a = 1.0 - sqrt (dist);
-              else
-                a = 1.0;
-            }
-          else
-            {
-              a = 0.0;
-            }
-
-          density[ x][ y] = a;
-          density[ x][-y] = a;
-          density[-x][ y] = a;
-          density[-x][-y] = a;
-        }
-    }
+  gegl_buffer_get (input, roi, 1.0, input_format, src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-  /* Since the algorithm considerers `buf[0]' to be 'over' the row
-   * currently calculated, we must start with `buf[0]' as non-selected
-   * if there is no `self->edge_lock. If there is an
-   * 'self->edge_lock', initialize the first row to 'selected'. Refer
-   * to bug #350009.
+  /* With `self->edge_lock', the rows above and below the image are
+   * selected, otherwise, they are unselected.  Refer to bug #350009.
    */
   if (self->edge_lock)
     {
       for (i = 0; i < roi->width; i++)
-        buf[0][i] = 1.0;
+        edge[i] = 1.0;
     }
   else
     {
-      memset (buf[0], 0, roi->width * sizeof (gfloat));
-    }
-
-  gegl_buffer_get (input,
-                   GEGL_RECTANGLE (roi->x, roi->y + 0,
-                                   roi->width, 1),
-                   1.0, input_format, buf[1],
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-  if (roi->height > 1)
-    gegl_buffer_get (input,
-                     GEGL_RECTANGLE (roi->x, roi->y + 1,
-                                     roi->width, 1),
-                     1.0, input_format, buf[2],
-                     GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-  else
-    memcpy (buf[2], buf[1], roi->width * sizeof (gfloat));
-
-  compute_transition (transition[1], buf, roi->width, self->edge_lock);
-
-   /* set up top of image */
-  for (y = 1; y < self->radius_y && y + 1 < roi->height; y++)
-    {
-      rotate_pointers (buf, 3);
-      gegl_buffer_get (input,
-                       GEGL_RECTANGLE (roi->x, roi->y + y + 1,
-                                       roi->width, 1),
-                       1.0, input_format, buf[2],
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-      compute_transition (transition[y + 1], buf, roi->width, self->edge_lock);
+      memset (edge, 0, roi->width * sizeof (gfloat));
     }
 
-  /* set up max[] for top of image */
-  for (x = 0; x < roi->width; x++)
-    {
-      max[x] = -(self->radius_y + 7);
-
-      for (j = 1; j < self->radius_y + 1; j++)
-        if (transition[j][x])
-          {
-            max[x] = j;
-            break;
-          }
-    }
-
-  /* main calculation loop */
   for (y = 0; y < roi->height; y++)
     {
-      rotate_pointers (buf, 3);
-      rotate_pointers (transition, self->radius_y + 1);
-
-      if (y < roi->height - (self->radius_y + 1))
-        {
-          gegl_buffer_get (input,
-                           GEGL_RECTANGLE (roi->x,
-                                           roi->y + y + self->radius_y + 1,
-                                           roi->width, 1),
-                           1.0, input_format, buf[2],
-                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-          compute_transition (transition[self->radius_y], buf, roi->width, self->edge_lock);
-        }
-      else
-        {
-          if (self->edge_lock)
-            {
-              memcpy (transition[self->radius_y], transition[self->radius_y - 1], roi->width * sizeof (gfloat));
-            }
-          else
-            {
-              /* No edge lock, set everything 'below canvas' as seen
-               * from the algorithm as unselected.
-               */
-              memset (buf[2], 0, roi->width * sizeof (gfloat));
-              compute_transition (transition[self->radius_y], buf, roi->width, self->edge_lock);
-            }
-        }
+      gfloat *buf[3];
 
-      /* update max array */
-      for (x = 0; x < roi->width; x++)
-        {
-          if (max[x] < 1)
-            {
-              if (max[x] <= -self->radius_y)
-                {
-                  if (transition[self->radius_y][x])
-                    max[x] = self->radius_y;
-                  else
-                    max[x]--;
-                }
-              else
-                {
-                  if (transition[-max[x]][x])
-                    max[x] = -max[x];
-                  else if (transition[-max[x] + 1][x])
-                    max[x] = -max[x] + 1;
-                  else
-                    max[x]--;
-                }
-            }
-          else
-            {
-              max[x]--;
-            }
+      buf[0] = y > 0               ? src + (gsize) (y - 1) * roi->width : edge;
+      buf[1] =                       src + (gsize)  y      * roi->width;
+      buf[2] = y + 1 < roi->height ? src + (gsize) (y + 1) * roi->width : edge;
 
-          if (max[x] < -self->radius_y - 1)
-            max[x] = -self->radius_y - 1;
-        }
-
-      last_index = 1;
-
-       /* render scan line */
-      for (x = 0 ; x < roi->width; x++)
-        {
-          gfloat last_max;
-
-          last_index--;
-
-          if (last_index >= 0)
-            {
-              last_max = 0.0;
-
-              for (i = self->radius_x; i >= 0; i--)
-                if (max[x + i] <= self->radius_y && max[x + i] >= -self->radius_y &&
-                    density[i][max[x+i]] > last_max)
-                  {
-                    last_max = density[i][max[x + i]];
-                    last_index = i;
-                  }
-
-              out[x] = last_max;
-            }
-          else
-            {
-              last_max = 0.0;
-
-              for (i = self->radius_x; i >= -self->radius_x; i--)
-                if (max[x + i] <= self->radius_y && max[x + i] >= -self->radius_y &&
-                    density[i][max[x + i]] > last_max)
-                  {
-                    last_max = density[i][max[x + i]];
-                    last_index = i;
-                  }
-
-              out[x] = last_max;
-            }
-
-          if (last_max <= 0.0)
-            {
-              for (i = x + 1; i < roi->width; i++)
-                {
-                  if (max[i] >= -self->radius_y)
-                    break;
-                }
-
-              if (i - x > self->radius_x)
-                {
-                  for (; x < i - self->radius_x; x++)
-                    out[x] = 0;
-
-                  x--;
-                }
-
-              last_index = self->radius_x;
-            }
-        }
-
-      gegl_buffer_set (output,
-                       GEGL_RECTANGLE (roi->x, roi->y + y,
-                                       roi->width, 1),
-                       1.0, output_format, out,
-                       GEGL_AUTO_ROWSTRIDE);
+      compute_transition (dist + (gsize) y * roi->width,
+                          buf, roi->width, self->edge_lock);
     }
 
-  g_free (out);
+  g_free (edge);
+  g_free (src);
 
-  for (i = 0; i < 3; i++)
-    g_free (buf[i]);
-
-  max -= self->radius_x;
-  g_free (max);
+  /* A pixel is part of the border if there is a transitional pixel
+   * within the ellipse around it, and, when feathering, its value
+   * falls off with the distance to the nearest one.
+   */
+  gimp_distance_transform_ellipse (dist, dist, roi->width, roi->height,
+                                   self->radius_x, self->radius_y,
+                                   TRUE, FALSE);
 
-  for (i = 0; i < self->radius_y + 1; i++)
+  for (k = 0; k < n_pixels; k++)
     {
-      transition[i] -= self->radius_x;
-      g_free (transition[i]);
+      if (dist[k] < 1.0)
+        dist[k] = self->feather ? 1.0 - sqrt (dist[k]) : 1.0;
+      else
+        dist[k] = 0.0;
     }
 
-  g_free (transition);
-
-  for (i = 0; i < self->radius_x + 1 ; i++)
-    {
-      density[i] -= self->radius_y;
-      g_free (density[i]);
-    }
+  gegl_buffer_set (output, roi, 0, output_format, dist,
+                   GEGL_AUTO_ROWSTRIDE);
 
-  density -= self->radius_x;
-  g_free (density);
+  g_free (dist);
 
   return TRUE;
 }
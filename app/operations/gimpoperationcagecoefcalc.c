@@ -25,12 +25,25 @@
 
 #include "operations-types.h"
 
+#include "core/gimp-parallel.h"
+
 #include "gimpoperationcagecoefcalc.h"
 #include "gimpcageconfig.h"
 
 #include "gimp-intl.h"
 
 
+#define MIN_PARALLEL_SUB_AREA (64 * 64)
+
+
+typedef struct
+{
+  GimpCageConfig *config;
+  GeglBuffer     *output;
+  const Babl     *format;
+} CageCoefCalc;
+
+
 static void           gimp_operation_cage_coef_calc_finalize         (GObject              *object);
 static void           gimp_operation_cage_coef_calc_get_property     (GObject              *object,
                                                                       guint                 property_id,
@@ -47,6 +60,8 @@ static gboolean       gimp_operation_cage_coef_calc_process          (GeglOperat
                                                                       GeglBuffer           *output,
                                                                       const GeglRectangle  *roi,
                                                                       gint                  level);
+static void           gimp_operation_cage_coef_calc_process_area     (const GeglRectangle  *area,
+                                                                      CageCoefCalc         *calc);
 
 
 G_DEFINE_TYPE (GimpOperationCageCoefCalc, gimp_operation_cage_coef_calc,
@@ -200,21 +215,39 @@ gimp_operation_cage_coef_calc_process (GeglOperation       *operation,
 {
   GimpOperationCageCoefCalc *occc   = GIMP_OPERATION_CAGE_COEF_CALC (operation);
   GimpCageConfig            *config = GIMP_CAGE_CONFIG (occc->config);
+  CageCoefCalc               calc;
 
-  const Babl *format;
+  if (! config)
+    return FALSE;
+
+  calc.config = config;
+  calc.output = output;
+  calc.format = babl_format_n (babl_type ("float"),
+                               2 * gimp_cage_config_get_n_points (config));
 
+  /*  every pixel only depends on the cage, so the roi is split between
+   *  threads
+   */
+  gimp_parallel_distribute_area (roi, MIN_PARALLEL_SUB_AREA,
+                                 (GimpParallelDistributeAreaFunc)
+                                 gimp_operation_cage_coef_calc_process_area,
+                                 &calc);
+
+  return TRUE;
+}
+
+static void
+gimp_operation_cage_coef_calc_process_area (const GeglRectangle *area,
+                                            CageCoefCalc        *calc)
+{
+  GimpCageConfig     *config = calc->config;
   GeglBufferIterator *it;
   guint               n_cage_vertices;
   GimpCagePoint      *current, *last;
 
-  if (! config)
-    return FALSE;
-
-  format = babl_format_n (babl_type ("float"), 2 * gimp_cage_config_get_n_points (config));
-
   n_cage_vertices   = gimp_cage_config_get_n_points (config);
 
-  it = gegl_buffer_iterator_new (output, roi, 0, format,
+  it = gegl_buffer_iterator_new (calc->output, area, 0, calc->format,
                                  GEGL_BUFFER_READWRITE, GEGL_ABYSS_NONE);
 
   while (gegl_buffer_iterator_next (it))
@@ -292,6 +325,4 @@ gimp_operation_cage_coef_calc_process (GeglOperation       *operation,
             }
         }
     }
-
-  return TRUE;
 }
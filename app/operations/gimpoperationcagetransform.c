@@ -38,6 +38,7 @@ enum
   PROP_0,
   PROP_CONFIG,
   PROP_FILL,
+  PROP_STEP,
   PROP_PROGRESS
 };
 
@@ -70,11 +71,15 @@ static void         gimp_operation_cage_transform_interpolate_source_coords_recu
                                                                            GimpVector2          p3_d,
                                                                            gint                 recursion_depth,
                                                                            gfloat              *coords);
-static GimpVector2  gimp_cage_transform_compute_destination               (GimpCageConfig      *config,
-                                                                           gfloat              *coef,
-                                                                           const Babl          *format_coef,
+static void         gimp_operation_cage_transform_compute_row             (GimpOperationCageTransform  *oct,
                                                                            GeglBuffer          *coef_buf,
-                                                                           GimpVector2          coords);
+                                                                           const Babl          *format_coef,
+                                                                           const GeglRectangle *cage_bb,
+                                                                           gint                 y,
+                                                                           gfloat              *coef_row,
+                                                                           GimpVector2         *dest_row);
+static GimpVector2  gimp_cage_transform_compute_destination               (GimpCageConfig      *config,
+                                                                           const gfloat        *coef);
 GeglRectangle       gimp_operation_cage_transform_get_cached_region       (GeglOperation       *operation,
                                                                            const GeglRectangle *roi);
 GeglRectangle       gimp_operation_cage_transform_get_required_for_output (GeglOperation       *operation,
@@ -130,6 +135,14 @@ gimp_operation_cage_transform_class_init (GimpOperationCageTransformClass *klass
                                                          FALSE,
                                                          G_PARAM_READWRITE));
 
+  g_object_class_install_property (object_class, PROP_STEP,
+                                   g_param_spec_int ("step",
+                                                     "Step",
+                                                     "Distance between the points where the transformation is computed exactly, larger is faster and coarser",
+                                                     1, 64, 1,
+                                                     G_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+
   g_object_class_install_property (object_class, PROP_PROGRESS,
                                    g_param_spec_double ("progress",
                                                         "Progress",
@@ -174,6 +187,9 @@ gimp_operation_cage_transform_get_property (GObject    *object,
     case PROP_FILL:
       g_value_set_boolean (value, self->fill_plain_color);
       break;
+    case PROP_STEP:
+      g_value_set_int (value, self->step);
+      break;
     case PROP_PROGRESS:
       g_value_set_double (value, self->progress);
       break;
@@ -202,6 +218,9 @@ gimp_operation_cage_transform_set_property (GObject      *object,
     case PROP_FILL:
       self->fill_plain_color = g_value_get_boolean (value);
       break;
+    case PROP_STEP:
+      self->step = g_value_get_int (value);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -242,6 +261,11 @@ gimp_operation_cage_transform_process (GeglOperation       *operation,
   gboolean                    output_set;
   GimpCagePoint              *point;
   guint                       n_cage_vertices;
+  gint                        step;
+  gint                        last_x, last_y;
+  gint                        n_columns;
+  GimpVector2                *dest_row;
+  GimpVector2                *next_dest_row;
 
   /* pre-fill the out buffer with no-displacement coordinate */
   it      = gegl_buffer_iterator_new (out_buf, roi, 0, NULL,
@@ -302,62 +326,95 @@ gimp_operation_cage_transform_process (GeglOperation       *operation,
   oct->progress = 0.0;
   g_object_notify (G_OBJECT (oct), "progress");
 
+  /* the transformation is computed exactly on a grid of points, step
+   * pixels apart, and interpolated in between.  the grid always
+   * includes the last row and column of the cage's bounding box.
+   */
+  step   = MAX (oct->step, 1);
+  last_x = cage_bb.x + cage_bb.width  - 1;
+  last_y = cage_bb.y + cage_bb.height - 1;
+
+  /* each level of recursion halves the triangles, so larger grid
+   * cells need to go deeper
+   */
+  oct->max_recursion_depth = 5;
+
+  for (x = 1; x < step; x *= 2)
+    oct->max_recursion_depth++;
+
+  if (cage_bb.width < 2 || cage_bb.height < 2)
+    {
+      oct->progress = 1.0;
+      g_object_notify (G_OBJECT (oct), "progress");
+
+      return TRUE;
+    }
+
+  n_columns = (cage_bb.width - 2) / step + 2;
+
   /* pre-allocate memory outside of the loop */
-  coords      = g_slice_alloc (2 * sizeof (gfloat));
-  coef        = g_malloc (n_cage_vertices * 2 * sizeof (gfloat));
-  format_coef = babl_format_n (babl_type ("float"), 2 * n_cage_vertices);
+  coords        = g_slice_alloc (2 * sizeof (gfloat));
+  coef          = g_new (gfloat, (gsize) cage_bb.width * n_cage_vertices * 2);
+  dest_row      = g_new (GimpVector2, n_columns);
+  next_dest_row = g_new (GimpVector2, n_columns);
+  format_coef   = babl_format_n (babl_type ("float"), 2 * n_cage_vertices);
+
+  gimp_operation_cage_transform_compute_row (oct, aux_buf, format_coef,
+                                             &cage_bb, cage_bb.y,
+                                             coef, dest_row);
 
   /* compute, reverse and interpolate the transformation */
-  for (y = cage_bb.y; y < cage_bb.y + cage_bb.height - 1; y++)
+  for (y = cage_bb.y; y < last_y; y = MIN (y + step, last_y))
     {
-      GimpVector2 p1_d, p2_d, p3_d, p4_d;
-      GimpVector2 p1_s, p2_s, p3_s, p4_s;
-
-      p1_s.y = y;
-      p2_s.y = y+1;
-      p3_s.y = y+1;
-      p3_s.x = cage_bb.x;
-      p4_s.y = y;
-      p4_s.x = cage_bb.x;
+      gint         next_y = MIN (y + step, last_y);
+      GimpVector2 *tmp;
+      gint         i;
 
-      p3_d = gimp_cage_transform_compute_destination (config, coef, format_coef, aux_buf, p3_s);
-      p4_d = gimp_cage_transform_compute_destination (config, coef, format_coef, aux_buf, p4_s);
+      gimp_operation_cage_transform_compute_row (oct, aux_buf, format_coef,
+                                                 &cage_bb, next_y,
+                                                 coef, next_dest_row);
 
-      for (x = cage_bb.x; x < cage_bb.x + cage_bb.width - 1; x++)
+      for (i = 0, x = cage_bb.x; x < last_x; i++, x = MIN (x + step, last_x))
         {
-          p1_s = p4_s;
-          p2_s = p3_s;
-          p3_s.x = x+1;
-          p4_s.x = x+1;
-
-          p1_d = p4_d;
-          p2_d = p3_d;
-          p3_d = gimp_cage_transform_compute_destination (config, coef, format_coef, aux_buf, p3_s);
-          p4_d = gimp_cage_transform_compute_destination (config, coef, format_coef, aux_buf, p4_s);
+          gint        next_x = MIN (x + step, last_x);
+          GimpVector2 p1_s, p2_s, p3_s, p4_s;
 
           if (gimp_cage_config_point_inside (config, x, y))
             {
+              p1_s.x = x;
+              p1_s.y = y;
+              p2_s.x = x;
+              p2_s.y = next_y;
+              p3_s.x = next_x;
+              p3_s.y = next_y;
+              p4_s.x = next_x;
+              p4_s.y = y;
+
               gimp_operation_cage_transform_interpolate_source_coords_recurs (oct,
                                                                               out_buf,
                                                                               roi,
-                                                                              p1_s, p1_d,
-                                                                              p2_s, p2_d,
-                                                                              p3_s, p3_d,
+                                                                              p1_s, dest_row[i],
+                                                                              p2_s, next_dest_row[i],
+                                                                              p3_s, next_dest_row[i + 1],
                                                                               0,
                                                                               coords);
 
               gimp_operation_cage_transform_interpolate_source_coords_recurs (oct,
                                                                               out_buf,
                                                                               roi,
-                                                                              p1_s, p1_d,
-                                                                              p3_s, p3_d,
-                                                                              p4_s, p4_d,
+                                                                              p1_s, dest_row[i],
+                                                                              p3_s, next_dest_row[i + 1],
+                                                                              p4_s, dest_row[i + 1],
                                                                               0,
                                                                               coords);
             }
         }
 
-      if ((y - cage_bb.y) % 20 == 0)
+      tmp           = dest_row;
+      dest_row      = next_dest_row;
+      next_dest_row = tmp;
+
+      if ((y - cage_bb.y) / step % 20 == 0)
         {
           gdouble fraction = ((gdouble) (y - cage_bb.y) /
                               (gdouble) (cage_bb.height));
@@ -371,6 +428,8 @@ gimp_operation_cage_transform_process (GeglOperation       *operation,
         }
     }
 
+  g_free (next_dest_row);
+  g_free (dest_row);
   g_free (coef);
   g_slice_free1 (2 * sizeof (gfloat), coords);
 
@@ -431,7 +490,7 @@ gimp_operation_cage_transform_interpolate_source_coords_recurs (GimpOperationCag
     return;
 
   /* test if the triangle is implausibly large as manifested by too deep recursion */
-  if (recursion_depth > 5)
+  if (recursion_depth > oct->max_recursion_depth)
     return;
 
   /* test if the triangle is small enough.
@@ -544,33 +603,51 @@ gimp_operation_cage_transform_interpolate_source_coords_recurs (GimpOperationCag
     }
 }
 
+/* computes the destination of the grid points of row y, reading the
+ * whole row of coefficients at once
+ */
+static void
+gimp_operation_cage_transform_compute_row (GimpOperationCageTransform *oct,
+                                           GeglBuffer                 *coef_buf,
+                                           const Babl                 *format_coef,
+                                           const GeglRectangle        *cage_bb,
+                                           gint                        y,
+                                           gfloat                     *coef_row,
+                                           GimpVector2                *dest_row)
+{
+  GimpCageConfig *config = GIMP_CAGE_CONFIG (oct->config);
+  gint            n_coef = 2 * gimp_cage_config_get_n_points (config);
+  gint            step   = MAX (oct->step, 1);
+  gint            last_x = cage_bb->x + cage_bb->width - 1;
+  gint            x;
+  gint            i;
+
+  gegl_buffer_get (coef_buf,
+                   GEGL_RECTANGLE (cage_bb->x, y, cage_bb->width, 1), 1.0,
+                   format_coef, coef_row,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (i = 0, x = cage_bb->x; ; i++, x = MIN (x + step, last_x))
+    {
+      dest_row[i] =
+        gimp_cage_transform_compute_destination (config,
+                                                 coef_row +
+                                                 (x - cage_bb->x) * n_coef);
+
+      if (x == last_x)
+        break;
+    }
+}
+
 static GimpVector2
 gimp_cage_transform_compute_destination (GimpCageConfig *config,
-                                         gfloat         *coef,
-                                         const Babl     *format_coef,
-                                         GeglBuffer     *coef_buf,
-                                         GimpVector2     coords)
+                                         const gfloat   *coef)
 {
   GimpVector2    result = {0, 0};
   gint           n_cage_vertices = gimp_cage_config_get_n_points (config);
   gint           i;
   GimpCagePoint *point;
 
-  /* When Gegl bug #645810 will be solved, this should be a good optimisation */
-  #ifdef GEGL_BUG_645810_SOLVED
-    gegl_buffer_sample (coef_buf, coords.x, coords.y, 1.0, coef, format_coef, GEGL_INTERPOLATION_NEAREST);
-  #else
-    GeglRectangle  rect;
-
-    rect.height = 1;
-    rect.width  = 1;
-    rect.x      = coords.x;
-    rect.y      = coords.y;
-
-    gegl_buffer_get (coef_buf, &rect, 1.0, format_coef, coef,
-                     GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-  #endif
-
   for (i = 0; i < n_cage_vertices; i++)
     {
       point = &g_array_index (config->cage_points, GimpCagePoint, i);
@@ -585,6 +662,9 @@ gimp_cage_transform_compute_destination (GimpCageConfig *config,
   return result;
 }
 
+/*  the triangles of the mesh are drawn wherever they land, so the
+ *  whole output is computed at once, whatever the roi
+ */
 GeglRectangle
 gimp_operation_cage_transform_get_cached_region (GeglOperation       *operation,
                                                  const GeglRectangle *roi)
@@ -42,6 +42,9 @@ struct _GimpOperationCageTransform
 
   GimpCageConfig        *config;
   gboolean               fill_plain_color;
+  gint                   step;
+
+  gint                   max_recursion_depth;
 
   const Babl            *format_coords;
 
@@ -29,6 +29,7 @@
 
 #include "operations-types.h"
 
+#include "gimp-morphology.h"
 #include "gimpoperationgrow.h"
 
 
@@ -223,17 +224,15 @@ rotate_pointers (gfloat  **p,
   p[i] = tmp;
 }
 
-static gboolean
-gimp_operation_grow_process (GeglOperation       *operation,
-                             GeglBuffer          *input,
-                             GeglBuffer          *output,
-                             const GeglRectangle *roi,
-                             gint                 level)
+static void
+fatten_region (GimpOperationGrow   *self,
+               GeglBuffer          *input,
+               GeglBuffer          *output,
+               const GeglRectangle *roi)
 {
   /* Any bugs in this fuction are probably also in thin_region.
    * Blame all bugs in this function on jaycox@gimp.org
    */
-  GimpOperationGrow *self          = GIMP_OPERATION_GROW (operation);
   const Babl        *input_format  = babl_format ("Y float");
   const Babl        *output_format = babl_format ("Y float");
   gint32             i, j, x, y;
@@ -384,6 +383,45 @@ gimp_operation_grow_process (GeglOperation       *operation,
 
   g_free (buf);
   g_free (out);
+}
+
+static gboolean
+gimp_operation_grow_process (GeglOperation       *operation,
+                             GeglBuffer          *input,
+                             GeglBuffer          *output,
+                             const GeglRectangle *roi,
+                             gint                 level)
+{
+  GimpOperationGrow *self   = GIMP_OPERATION_GROW (operation);
+  const Babl        *format = babl_format ("Y float");
+  gfloat            *buf;
+
+  buf = g_new (gfloat, (gsize) roi->width * roi->height);
+
+  gegl_buffer_get (input, roi, 1.0, format, buf,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (gimp_morphology_ellipse_is_rectangle (self->radius_x, self->radius_y))
+    {
+      gimp_morphology_rectangle (buf, roi->width, roi->height,
+                                 self->radius_x, self->radius_y,
+                                 FALSE, 0.0);
+    }
+  else if (! gimp_morphology_ellipse (buf, roi->width, roi->height,
+                                      self->radius_x, self->radius_y,
+                                      FALSE, 0.0, FALSE))
+    {
+      g_free (buf);
+
+      fatten_region (self, input, output, roi);
+
+      return TRUE;
+    }
+
+  gegl_buffer_set (output, roi, 0, format, buf,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_free (buf);
 
   return TRUE;
 }
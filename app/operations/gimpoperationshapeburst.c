@@ -29,6 +29,7 @@
 
 #include "operations-types.h"
 
+#include "gimp-distance-transform.h"
 #include "gimpoperationshapeburst.h"
 
 
@@ -163,7 +164,7 @@ gimp_operation_shapeburst_set_property (GObject      *object,
 static void
 gimp_operation_shapeburst_prepare (GeglOperation *operation)
 {
-  gegl_operation_set_format (operation, "input",  babl_format ("Y u8"));
+  gegl_operation_set_format (operation, "input",  babl_format ("Y float"));
   gegl_operation_set_format (operation, "output", babl_format ("Y float"));
 }
 
@@ -189,130 +190,52 @@ gimp_operation_shapeburst_process (GeglOperation       *operation,
                                    const GeglRectangle *roi,
                                    gint                 level)
 {
-  const Babl *input_format   = babl_format ("Y u8");
+  const Babl *input_format   = babl_format ("Y float");
   const Babl *output_format  = babl_format ("Y float");
   gfloat      max_iterations = 0.0;
-  gfloat     *distp_cur;
-  gfloat     *distp_prev;
-  gfloat     *memory;
-  gint        length;
-  gint        i;
+  gfloat     *src;
+  gfloat     *dest;
+  gsize       n_pixels;
+  gsize       i;
 
-  length = roi->width + 1;
-  memory = g_new (gfloat, length * 2);
+  n_pixels = (gsize) roi->width * roi->height;
 
-  distp_prev = memory;
-  for (i = 0; i < length; i++)
-    distp_prev[i] = 0.0;
+  src  = g_new (gfloat, n_pixels);
+  dest = g_new (gfloat, n_pixels);
 
-  distp_prev += 1;
-  distp_cur = distp_prev + length;
+  gegl_buffer_get (input, roi, 1.0, input_format, src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-  for (i = 0; i < roi->height; i++)
+  /*  the distance of each selected pixel to the nearest unselected
+   *  one, everything outside the input counts as unselected
+   */
+  gimp_distance_transform (src, dest, roi->width, roi->height,
+                           FALSE, TRUE);
+
+  g_object_set (operation,
+                "progress", 0.5,
+                NULL);
+
+  for (i = 0; i < n_pixels; i++)
     {
-      gfloat *tmp;
-      gint    src = 0;
-      gint    j;
-
-      /*  set the current dist row to 0's  */
-      memset (distp_cur - 1, 0, sizeof (gfloat) * (length - 1));
-
-      for (j = 0; j < roi->width; j++)
-        {
-          gfloat float_tmp;
-          gfloat min_prev = MIN (distp_cur[j-1], distp_prev[j]);
-          gint   min_left = MIN ((roi->width - j - 1), (roi->height - i - 1));
-          gint   min      = (gint) MIN (min_left, min_prev);
-          gint   fraction = 255;
-          gint   k;
-
-          /*  This might need to be changed to 0
-              instead of k = (min) ? (min - 1) : 0  */
-
-          for (k = (min) ? (min - 1) : 0; k <= min; k++)
-            {
-              gint x   = j;
-              gint y   = i + k;
-              gint end = y - k;
-
-              while (y >= end)
-                {
-                  guchar src_uchar;
-
-#if 1
-                  /* FIXME: this should be much faster, it converts
-                   * to 32 bit rgba intermediately, bah...
-                   */
-                  gegl_buffer_sample (input, x, y, NULL, &src_uchar,
-                                      input_format,
-                                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-#else
-                  gegl_buffer_get (input, GEGL_RECTANGLE (x, y, 1, 1), 1.0,
-                                   input_format, &src_uchar,
-                                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-#endif
-
-                  src = src_uchar;
-
-                  if (src == 0)
-                    {
-                      min = k;
-                      y = -1;
-                      break;
-                    }
-
-                  if (src < fraction)
-                    fraction = src;
-
-                  x++;
-                  y--;
-                }
-            }
-
-          if (src != 0)
-            {
-              /*  If min_left != min_prev use the previous fraction
-               *   if it is less than the one found
-               */
-              if (min_left != min)
-                {
-                  gint prev_frac = (int) (255 * (min_prev - min));
-
-                  if (prev_frac == 255)
-                    prev_frac = 0;
-
-                  fraction = MIN (fraction, prev_frac);
-                }
-
-              min++;
-            }
-
-          float_tmp = distp_cur[j] = min + fraction / 256.0;
-
-          if (float_tmp > max_iterations)
-            max_iterations = float_tmp;
-        }
-
-      /*  set the dist row  */
-      gegl_buffer_set (output,
-                       GEGL_RECTANGLE (roi->x, roi->y + i,
-                                       roi->width, 1),
-                       1.0, output_format, distp_cur,
-                       GEGL_AUTO_ROWSTRIDE);
-
-      /*  swap pointers around  */
-      tmp = distp_prev;
-      distp_prev = distp_cur;
-      distp_cur = tmp;
-
-      g_object_set (operation,
-                    "progress", (gdouble) i / roi->height,
-                    NULL);
+      /*  partially selected pixels are partially closer to the edge,
+       *  which antialiases the distance map
+       */
+      if (src[i] > 0.0)
+        dest[i] += MIN (src[i], 1.0) - 1.0;
+
+      if (dest[i] > max_iterations)
+        max_iterations = dest[i];
     }
 
-  g_free (memory);
+  gegl_buffer_set (output, roi, 0, output_format, dest,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_free (dest);
+  g_free (src);
 
   g_object_set (operation,
+                "progress",       1.0,
                 "max-iterations", (gdouble) max_iterations,
                 NULL);
 
@@ -29,6 +29,7 @@
 
 #include "operations-types.h"
 
+#include "gimp-morphology.h"
 #include "gimpoperationshrink.h"
 
 
@@ -240,12 +241,11 @@ rotate_pointers (gfloat  **p,
   p[i] = tmp;
 }
 
-static gboolean
-gimp_operation_shrink_process (GeglOperation       *operation,
-                               GeglBuffer          *input,
-                               GeglBuffer          *output,
-                               const GeglRectangle *roi,
-                               gint                 level)
+static void
+thin_region (GimpOperationShrink *self,
+             GeglBuffer          *input,
+             GeglBuffer          *output,
+             const GeglRectangle *roi)
 {
   /* Pretty much the same as fatten_region only different.
    * Blame all bugs in this function on jaycox@gimp.org
@@ -254,7 +254,6 @@ gimp_operation_shrink_process (GeglOperation       *operation,
    * are passed are identical to the edge pixels.  If edge_lock is
    * false, we assume that pixels outside the region are 0
    */
-  GimpOperationShrink *self          = GIMP_OPERATION_SHRINK (operation);
   const Babl          *input_format  = babl_format ("Y float");
   const Babl          *output_format = babl_format ("Y float");
   gint32               i, j, x, y;
@@ -436,6 +435,50 @@ gimp_operation_shrink_process (GeglOperation       *operation,
 
   g_free (buf);
   g_free (out);
+}
+
+static gboolean
+gimp_operation_shrink_process (GeglOperation       *operation,
+                               GeglBuffer          *input,
+                               GeglBuffer          *output,
+                               const GeglRectangle *roi,
+                               gint                 level)
+{
+  GimpOperationShrink *self   = GIMP_OPERATION_SHRINK (operation);
+  const Babl          *format = babl_format ("Y float");
+  gfloat              *buf;
+
+  buf = g_new (gfloat, (gsize) roi->width * roi->height);
+
+  gegl_buffer_get (input, roi, 1.0, format, buf,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  /*  with edge_lock, the pixels outside the region are the same as
+   *  the edge pixels, which never lowers the minimum, so they can be
+   *  treated as fully selected
+   */
+  if (gimp_morphology_ellipse_is_rectangle (self->radius_x, self->radius_y))
+    {
+      gimp_morphology_rectangle (buf, roi->width, roi->height,
+                                 self->radius_x, self->radius_y,
+                                 TRUE, self->edge_lock ? 1.0 : 0.0);
+    }
+  else if (! gimp_morphology_ellipse (buf, roi->width, roi->height,
+                                      self->radius_x, self->radius_y,
+                                      TRUE, self->edge_lock ? 1.0 : 0.0,
+                                      FALSE))
+    {
+      g_free (buf);
+
+      thin_region (self, input, output, roi);
+
+      return TRUE;
+    }
+
+  gegl_buffer_set (output, roi, 0, format, buf,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_free (buf);
 
   return TRUE;
 }
@@ -0,0 +1,321 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "widgets/widgets-types.h"
+
+#include "core/gimp.h"
+
+#include "operations/gimp-distance-transform.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define ADD_TEST(function) \
+  g_test_add_func ("/gimp-distance-transform/" #function, function);
+
+#define N_RANDOM_MASKS  200
+#define MAX_RANDOM_SIZE 24
+#define EPSILON         1e-4
+
+
+typedef struct
+{
+  gint x;
+  gint y;
+} Feature;
+
+
+/*  returns the feature pixels of @src, the same way as
+ *  gimp_distance_transform() does
+ */
+static GArray *
+get_features (const gfloat *src,
+              gint          width,
+              gint          height,
+              gboolean      invert)
+{
+  GArray *features = g_array_new (FALSE, FALSE, sizeof (Feature));
+  gint    x, y;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        gfloat value = src[y * width + x];
+
+        if (invert ? value > 0.0 : value <= 0.0)
+          {
+            Feature feature = { x, y };
+
+            g_array_append_val (features, feature);
+          }
+      }
+
+  return features;
+}
+
+/*  the distance of (x, y) to the nearest feature pixel, by trying all
+ *  of them.  returns G_MAXDOUBLE if there is none.
+ */
+static gdouble
+brute_force_distance (GArray   *features,
+                      gint      width,
+                      gint      height,
+                      gint      x,
+                      gint      y,
+                      gboolean  edge_is_feature)
+{
+  gdouble min = G_MAXDOUBLE;
+  guint   i;
+
+  /*  the nearest pixel outside the mask is straight out of it  */
+  if (edge_is_feature)
+    min = MIN (MIN (x + 1, width - x), MIN (y + 1, height - y));
+
+  for (i = 0; i < features->len; i++)
+    {
+      const Feature *feature = &g_array_index (features, Feature, i);
+
+      min = MIN (min, sqrt (SQR (feature->x - x) + SQR (feature->y - y)));
+    }
+
+  return min;
+}
+
+static void
+check_mask (const gfloat *src,
+            gint          width,
+            gint          height)
+{
+  gfloat *dest     = g_new (gfloat, width * height);
+  gfloat *in_place = g_new (gfloat, width * height);
+  gint    invert;
+  gint    edge_is_feature;
+
+  for (invert = FALSE; invert <= TRUE; invert++)
+    {
+      GArray *features = get_features (src, width, height, invert);
+
+      for (edge_is_feature = FALSE; edge_is_feature <= TRUE; edge_is_feature++)
+        {
+          gint x, y;
+
+          gimp_distance_transform (src, dest, width, height,
+                                   invert, edge_is_feature);
+
+          for (y = 0; y < height; y++)
+            for (x = 0; x < width; x++)
+              {
+                gdouble expected = brute_force_distance (features,
+                                                         width, height,
+                                                         x, y,
+                                                         edge_is_feature);
+                gdouble actual   = dest[y * width + x];
+
+                if (expected == G_MAXDOUBLE)
+                  g_assert_cmpfloat (actual, >=, width + height);
+                else
+                  g_assert_cmpfloat (fabs (actual - expected), <=,
+                                     EPSILON * MAX (expected, 1.0));
+              }
+
+          /*  src and dest may be the same buffer  */
+          memcpy (in_place, src, width * height * sizeof (gfloat));
+
+          gimp_distance_transform (in_place, in_place, width, height,
+                                   invert, edge_is_feature);
+
+          g_assert (memcmp (in_place, dest,
+                            width * height * sizeof (gfloat)) == 0);
+        }
+
+      g_array_free (features, TRUE);
+    }
+
+  g_free (in_place);
+  g_free (dest);
+}
+
+static gfloat *
+random_mask (gint width,
+             gint height)
+{
+  gfloat  *mask    = g_new (gfloat, width * height);
+  gdouble  density = g_test_rand_double_range (0.05, 0.95);
+  gint     i;
+
+  /*  anything above 0.0 counts as set, not only 1.0  */
+  for (i = 0; i < width * height; i++)
+    {
+      if (g_test_rand_double () < density)
+        mask[i] = g_test_rand_bit () ? 1.0 : 0.25;
+      else
+        mask[i] = 0.0;
+    }
+
+  return mask;
+}
+
+/**
+ * random_masks:
+ *
+ * Compare the distances in small random masks with the brute-force
+ * distances.
+ **/
+static void
+random_masks (void)
+{
+  gint i;
+
+  for (i = 0; i < N_RANDOM_MASKS; i++)
+    {
+      gint    width  = g_test_rand_int_range (2, MAX_RANDOM_SIZE + 1);
+      gint    height = g_test_rand_int_range (2, MAX_RANDOM_SIZE + 1);
+      gfloat *mask   = random_mask (width, height);
+
+      check_mask (mask, width, height);
+
+      g_free (mask);
+    }
+}
+
+/**
+ * uniform_masks:
+ *
+ * Check the all-zero and all-one masks, where either every pixel or
+ * no pixel is a feature pixel.
+ **/
+static void
+uniform_masks (void)
+{
+  static const gint sizes[][2] = { { 1, 1 }, { 1, 7 }, { 7, 1 },
+                                   { 5, 5 }, { 3, 17 }, { 16, 9 } };
+  gint              i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      gint    width  = sizes[i][0];
+      gint    height = sizes[i][1];
+      gfloat *mask   = g_new (gfloat, width * height);
+      gint    j;
+
+      for (j = 0; j < width * height; j++)
+        mask[j] = 0.0;
+
+      check_mask (mask, width, height);
+
+      for (j = 0; j < width * height; j++)
+        mask[j] = 1.0;
+
+      check_mask (mask, width, height);
+
+      g_free (mask);
+    }
+}
+
+/**
+ * thin_masks:
+ *
+ * Check random masks that are one pixel wide or high.
+ **/
+static void
+thin_masks (void)
+{
+  gint i;
+
+  for (i = 0; i < N_RANDOM_MASKS; i++)
+    {
+      gint    length = g_test_rand_int_range (1, 4 * MAX_RANDOM_SIZE + 1);
+      gfloat *mask   = random_mask (length, 1);
+
+      check_mask (mask, length, 1);
+      check_mask (mask, 1, length);
+
+      g_free (mask);
+    }
+}
+
+/**
+ * large_mask:
+ *
+ * Check a mask that is large enough to be split between threads,
+ * with only a few feature pixels, so that most distances cross the
+ * boundaries between the parts.
+ **/
+static void
+large_mask (void)
+{
+  const gint  width  = 300;
+  const gint  height = 200;
+  gfloat     *mask   = g_new (gfloat, width * height);
+  gint        i;
+
+  for (i = 0; i < width * height; i++)
+    mask[i] = 1.0;
+
+  for (i = 0; i < 8; i++)
+    mask[g_test_rand_int_range (0, width * height)] = 0.0;
+
+  check_mask (mask, width, height);
+
+  g_free (mask);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  /*  make sure the work is split between threads  */
+  g_object_set (gimp->config,
+                "num-processors", 4,
+                NULL);
+
+  ADD_TEST (random_masks);
+  ADD_TEST (uniform_masks);
+  ADD_TEST (thin_masks);
+  ADD_TEST (large_mask);
+
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
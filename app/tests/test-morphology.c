@@ -0,0 +1,623 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "widgets/widgets-types.h"
+
+#include "core/gimp.h"
+
+#include "gegl/gimp-gegl-apply-operation.h"
+
+#include "operations/gimp-morphology.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define ADD_TEST(function) \
+  g_test_add_func ("/gimp-morphology/" #function, function);
+
+#define N_RANDOM_MASKS  100
+#define MAX_RANDOM_SIZE 24
+
+
+/*  odd, even, zero, unequal, and larger than the masks  */
+static const gint rectangle_radii[][2] = { { 0, 0 }, { 0, 3 }, { 4, 0 },
+                                           { 1, 1 }, { 2, 2 }, { 3, 5 },
+                                           { 6, 4 }, { 30, 1 }, { 1, 30 },
+                                           { 40, 40 } };
+
+/*  the ellipse needs radii of at least 1  */
+static const gint ellipse_radii[][2]   = { { 1, 1 }, { 2, 2 }, { 3, 3 },
+                                           { 4, 4 }, { 5, 3 }, { 2, 7 },
+                                           { 1, 9 }, { 9, 1 }, { 12, 37 },
+                                           { 37, 12 }, { 40, 40 } };
+
+
+/*  the height of the ellipse used by fatten_region() and
+ *  thin_region(), which grow and shrink used for all masks before,
+ *  for each column dx + @radius_x
+ */
+static gint *
+compute_border (gint radius_x,
+                gint radius_y)
+{
+  gint *circ = g_new (gint, 2 * radius_x + 1);
+  gint  i;
+
+  for (i = 0; i < 2 * radius_x + 1; i++)
+    {
+      gdouble tmp;
+
+      if (i > radius_x)
+        tmp = (i - radius_x) - 0.5;
+      else if (i < radius_x)
+        tmp = (radius_x - i) - 0.5;
+      else
+        tmp = 0.0;
+
+      circ[i] = RINT (radius_y /
+                      (gdouble) radius_x * sqrt (SQR (radius_x) - SQR (tmp)));
+    }
+
+  return circ;
+}
+
+/*  the maximum, or the minimum if @erode is %TRUE, of the pixels
+ *  (x + dx, y + dy) with |dx| <= @radius_x and |dy| <= @heights[dx +
+ *  @radius_x], by trying all of them
+ */
+static void
+brute_force_filter (const gfloat *src,
+                    gfloat       *dest,
+                    gint          width,
+                    gint          height,
+                    gint          radius_x,
+                    const gint   *heights,
+                    gboolean      erode,
+                    gfloat        outside)
+{
+  gint x, y;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        gfloat result = erode ? G_MAXFLOAT : -G_MAXFLOAT;
+        gint   dx, dy;
+
+        for (dx = -radius_x; dx <= radius_x; dx++)
+          {
+            gint h = heights[dx + radius_x];
+
+            for (dy = -h; dy <= h; dy++)
+              {
+                gint   sx = x + dx;
+                gint   sy = y + dy;
+                gfloat value;
+
+                if (sx >= 0 && sx < width && sy >= 0 && sy < height)
+                  value = src[sy * width + sx];
+                else
+                  value = outside;
+
+                result = erode ? MIN (result, value) : MAX (result, value);
+              }
+          }
+
+        dest[y * width + x] = result;
+      }
+}
+
+static void
+brute_force_rectangle (const gfloat *src,
+                       gfloat       *dest,
+                       gint          width,
+                       gint          height,
+                       gint          radius_x,
+                       gint          radius_y,
+                       gboolean      erode,
+                       gfloat        outside)
+{
+  gint *heights = g_new (gint, 2 * radius_x + 1);
+  gint  i;
+
+  for (i = 0; i < 2 * radius_x + 1; i++)
+    heights[i] = radius_y;
+
+  brute_force_filter (src, dest, width, height,
+                      radius_x, heights, erode, outside);
+
+  g_free (heights);
+}
+
+static void
+brute_force_ellipse (const gfloat *src,
+                     gfloat       *dest,
+                     gint          width,
+                     gint          height,
+                     gint          radius_x,
+                     gint          radius_y,
+                     gboolean      erode,
+                     gfloat        outside)
+{
+  gint *circ = compute_border (radius_x, radius_y);
+
+  brute_force_filter (src, dest, width, height,
+                      radius_x, circ, erode, outside);
+
+  g_free (circ);
+}
+
+static void
+assert_equal (const gfloat *actual,
+              const gfloat *expected,
+              gint          n_pixels)
+{
+  gint i;
+
+  for (i = 0; i < n_pixels; i++)
+    g_assert_cmpfloat (actual[i], ==, expected[i]);
+}
+
+static gfloat *
+random_mask (gint     width,
+             gint     height,
+             gboolean binary)
+{
+  static const gfloat  values[] = { 0.0, 1.0, 0.25, 0.5 };
+  gfloat              *mask     = g_new (gfloat, width * height);
+  gdouble              density  = g_test_rand_double_range (0.05, 0.95);
+  gint                 i;
+
+  for (i = 0; i < width * height; i++)
+    {
+      if (binary)
+        mask[i] = g_test_rand_double () < density ? 1.0 : 0.0;
+      else
+        mask[i] = values[g_test_rand_int_range (0, G_N_ELEMENTS (values))];
+    }
+
+  return mask;
+}
+
+/*  a mask of a few ellipses, with the edges antialiased by 4 x 4
+ *  supersampling, the way selections usually look
+ */
+static gfloat *
+antialiased_mask (gint width,
+                  gint height)
+{
+  gfloat  *mask       = g_new0 (gfloat, width * height);
+  gint     n_ellipses = g_test_rand_int_range (1, 4);
+  gdouble  center_x[3];
+  gdouble  center_y[3];
+  gdouble  radius_x[3];
+  gdouble  radius_y[3];
+  gint     i;
+  gint     x, y;
+
+  for (i = 0; i < n_ellipses; i++)
+    {
+      center_x[i] = g_test_rand_double_range (0.0, width);
+      center_y[i] = g_test_rand_double_range (0.0, height);
+      radius_x[i] = g_test_rand_double_range (2.0, width / 2.0);
+      radius_y[i] = g_test_rand_double_range (2.0, height / 2.0);
+    }
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        gint covered = 0;
+        gint sx, sy;
+
+        for (sy = 0; sy < 4; sy++)
+          for (sx = 0; sx < 4; sx++)
+            {
+              gdouble px = x + (sx + 0.5) / 4.0;
+              gdouble py = y + (sy + 0.5) / 4.0;
+
+              for (i = 0; i < n_ellipses; i++)
+                {
+                  if (SQR ((px - center_x[i]) / radius_x[i]) +
+                      SQR ((py - center_y[i]) / radius_y[i]) < 1.0)
+                    {
+                      covered++;
+                      break;
+                    }
+                }
+            }
+
+        mask[y * width + x] = covered / 16.0;
+      }
+
+  return mask;
+}
+
+/*  runs gimp:grow or gimp:shrink on @src  */
+static void
+apply_operation (const gfloat *src,
+                 gfloat       *dest,
+                 gint          width,
+                 gint          height,
+                 gint          radius_x,
+                 gint          radius_y,
+                 gboolean      erode,
+                 gboolean      edge_lock)
+{
+  const Babl *format = babl_format ("Y float");
+  GeglBuffer *src_buffer;
+  GeglBuffer *dest_buffer;
+  GeglNode   *node;
+
+  src_buffer  = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height), format);
+  dest_buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height), format);
+
+  gegl_buffer_set (src_buffer, NULL, 0, format, src, GEGL_AUTO_ROWSTRIDE);
+
+  if (erode)
+    node = gegl_node_new_child (NULL,
+                                "operation", "gimp:shrink",
+                                "radius-x",  radius_x,
+                                "radius-y",  radius_y,
+                                "edge-lock", edge_lock,
+                                NULL);
+  else
+    node = gegl_node_new_child (NULL,
+                                "operation", "gimp:grow",
+                                "radius-x",  radius_x,
+                                "radius-y",  radius_y,
+                                NULL);
+
+  gimp_gegl_apply_operation (src_buffer, NULL, NULL, node, dest_buffer, NULL);
+
+  gegl_buffer_get (dest_buffer, NULL, 1.0, format, dest,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  g_object_unref (node);
+  g_object_unref (dest_buffer);
+  g_object_unref (src_buffer);
+}
+
+/**
+ * rectangle_random_masks:
+ *
+ * Compare gimp_morphology_rectangle() with a brute-force minimum and
+ * maximum filter, on random grayscale and binary masks.
+ **/
+static void
+rectangle_random_masks (void)
+{
+  gint i;
+
+  for (i = 0; i < N_RANDOM_MASKS; i++)
+    {
+      gint    width  = g_test_rand_int_range (1, MAX_RANDOM_SIZE + 1);
+      gint    height = g_test_rand_int_range (1, MAX_RANDOM_SIZE + 1);
+      gfloat *mask   = random_mask (width, height, i % 2);
+      gfloat *buf    = g_new (gfloat, width * height);
+      gfloat *ref    = g_new (gfloat, width * height);
+      gint    j;
+
+      for (j = 0; j < G_N_ELEMENTS (rectangle_radii); j++)
+        {
+          gint radius_x = rectangle_radii[j][0];
+          gint radius_y = rectangle_radii[j][1];
+          gint erode;
+          gint outside;
+
+          for (erode = FALSE; erode <= TRUE; erode++)
+            for (outside = 0; outside <= 1; outside++)
+              {
+                memcpy (buf, mask, width * height * sizeof (gfloat));
+
+                gimp_morphology_rectangle (buf, width, height,
+                                           radius_x, radius_y,
+                                           erode, outside);
+
+                brute_force_rectangle (mask, ref, width, height,
+                                       radius_x, radius_y,
+                                       erode, outside);
+
+                assert_equal (buf, ref, width * height);
+              }
+        }
+
+      g_free (ref);
+      g_free (buf);
+      g_free (mask);
+    }
+}
+
+/**
+ * rectangle_large_mask:
+ *
+ * Check a mask that is large enough to be split between threads.
+ **/
+static void
+rectangle_large_mask (void)
+{
+  const gint  width  = 200;
+  const gint  height = 150;
+  gfloat     *mask   = random_mask (width, height, FALSE);
+  gfloat     *buf    = g_new (gfloat, width * height);
+  gfloat     *ref    = g_new (gfloat, width * height);
+  gint        erode;
+
+  for (erode = FALSE; erode <= TRUE; erode++)
+    {
+      memcpy (buf, mask, width * height * sizeof (gfloat));
+
+      gimp_morphology_rectangle (buf, width, height, 5, 4, erode, 0.0);
+
+      brute_force_rectangle (mask, ref, width, height, 5, 4, erode, 0.0);
+
+      assert_equal (buf, ref, width * height);
+    }
+
+  g_free (ref);
+  g_free (buf);
+  g_free (mask);
+}
+
+/**
+ * ellipse_is_rectangle:
+ *
+ * Check that gimp_morphology_ellipse_is_rectangle() is %TRUE exactly
+ * if the old ellipse covers its whole bounding box.
+ **/
+static void
+ellipse_is_rectangle (void)
+{
+  gint radius_x;
+  gint radius_y;
+
+  for (radius_x = 1; radius_x <= 40; radius_x++)
+    for (radius_y = 1; radius_y <= 40; radius_y++)
+      {
+        gint     *circ      = compute_border (radius_x, radius_y);
+        gboolean  rectangle = TRUE;
+        gint      i;
+
+        for (i = 0; i < 2 * radius_x + 1; i++)
+          {
+            if (circ[i] < radius_y)
+              rectangle = FALSE;
+          }
+
+        g_assert_cmpint (gimp_morphology_ellipse_is_rectangle (radius_x,
+                                                               radius_y),
+                         ==, rectangle);
+
+        g_free (circ);
+      }
+}
+
+/**
+ * ellipse_random_masks:
+ *
+ * Compare gimp_morphology_ellipse() with a brute-force filter over
+ * the ellipse of fatten_region() and thin_region(), on random binary
+ * and grayscale masks, where most pixels are in the band of
+ * in-between values, and with in-between values outside.
+ **/
+static void
+ellipse_random_masks (void)
+{
+  static const gfloat outside_values[] = { 0.0, 0.25, 1.0 };
+  gint                i;
+
+  for (i = 0; i < N_RANDOM_MASKS; i++)
+    {
+      gint    width  = g_test_rand_int_range (1, MAX_RANDOM_SIZE + 1);
+      gint    height = g_test_rand_int_range (1, MAX_RANDOM_SIZE + 1);
+      gfloat *mask   = random_mask (width, height, i % 2);
+      gfloat *buf    = g_new (gfloat, width * height);
+      gfloat *ref    = g_new (gfloat, width * height);
+      gint    j;
+
+      /*  include the empty and the full mask  */
+      if (i < 2)
+        {
+          for (j = 0; j < width * height; j++)
+            mask[j] = i;
+        }
+
+      for (j = 0; j < G_N_ELEMENTS (ellipse_radii); j++)
+        {
+          gint radius_x = ellipse_radii[j][0];
+          gint radius_y = ellipse_radii[j][1];
+          gint erode;
+          gint k;
+
+          for (erode = FALSE; erode <= TRUE; erode++)
+            for (k = 0; k < G_N_ELEMENTS (outside_values); k++)
+              {
+                memcpy (buf, mask, width * height * sizeof (gfloat));
+
+                g_assert (gimp_morphology_ellipse (buf, width, height,
+                                                   radius_x, radius_y,
+                                                   erode, outside_values[k],
+                                                   TRUE));
+
+                brute_force_ellipse (mask, ref, width, height,
+                                     radius_x, radius_y,
+                                     erode, outside_values[k]);
+
+                assert_equal (buf, ref, width * height);
+              }
+        }
+
+      g_free (ref);
+      g_free (buf);
+      g_free (mask);
+    }
+}
+
+/**
+ * ellipse_antialiased_masks:
+ *
+ * Compare gimp_morphology_ellipse() with the brute-force filter on
+ * antialiased masks that are large enough to be split between
+ * threads.  Their band of in-between values is thin, so they must be
+ * filtered without forcing it.
+ **/
+static void
+ellipse_antialiased_masks (void)
+{
+  const gint width  = 150;
+  const gint height = 100;
+  gint       i;
+
+  for (i = 0; i < 8; i++)
+    {
+      gfloat *mask = antialiased_mask (width, height);
+      gfloat *buf  = g_new (gfloat, width * height);
+      gfloat *ref  = g_new (gfloat, width * height);
+      gint    j;
+
+      for (j = 0; j < G_N_ELEMENTS (ellipse_radii); j++)
+        {
+          gint radius_x = ellipse_radii[j][0];
+          gint radius_y = ellipse_radii[j][1];
+          gint erode;
+
+          if (gimp_morphology_ellipse_is_rectangle (radius_x, radius_y))
+            continue;
+
+          for (erode = FALSE; erode <= TRUE; erode++)
+            {
+              memcpy (buf, mask, width * height * sizeof (gfloat));
+
+              g_assert (gimp_morphology_ellipse (buf, width, height,
+                                                 radius_x, radius_y,
+                                                 erode, erode ? 1.0 : 0.0,
+                                                 FALSE));
+
+              brute_force_ellipse (mask, ref, width, height,
+                                   radius_x, radius_y,
+                                   erode, erode ? 1.0 : 0.0);
+
+              assert_equal (buf, ref, width * height);
+            }
+        }
+
+      g_free (ref);
+      g_free (buf);
+      g_free (mask);
+    }
+}
+
+/**
+ * operations:
+ *
+ * Run gimp:grow and gimp:shrink on random grayscale masks, whose band
+ * of in-between values is too wide for gimp_morphology_ellipse(), so
+ * they still use fatten_region() and thin_region(), and on binary and
+ * antialiased masks, which don't, and compare them with the
+ * brute-force filter.  The old functions need a round ellipse that
+ * fits into the mask.
+ **/
+static void
+operations (void)
+{
+  gint i;
+
+  for (i = 0; i < N_RANDOM_MASKS / 4; i++)
+    {
+      gint    radius = g_test_rand_int_range (2, 6);
+      gint    width  = g_test_rand_int_range (2 * radius + 2, 2 * radius + 20);
+      gint    height = g_test_rand_int_range (2 * radius + 2, 2 * radius + 20);
+      gfloat *mask;
+      gfloat *buf    = g_new (gfloat, width * height);
+      gfloat *ref    = g_new (gfloat, width * height);
+      gint    edge_lock;
+
+      if (i % 3 == 2)
+        mask = antialiased_mask (width, height);
+      else
+        mask = random_mask (width, height, i % 3);
+
+      apply_operation (mask, buf, width, height, radius, radius,
+                       FALSE, FALSE);
+
+      brute_force_ellipse (mask, ref, width, height, radius, radius,
+                           FALSE, 0.0);
+
+      assert_equal (buf, ref, width * height);
+
+      for (edge_lock = FALSE; edge_lock <= TRUE; edge_lock++)
+        {
+          apply_operation (mask, buf, width, height, radius, radius,
+                           TRUE, edge_lock);
+
+          brute_force_ellipse (mask, ref, width, height, radius, radius,
+                               TRUE, edge_lock ? 1.0 : 0.0);
+
+          assert_equal (buf, ref, width * height);
+        }
+
+      g_free (ref);
+      g_free (buf);
+      g_free (mask);
+    }
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  /*  make sure the work is split between threads  */
+  g_object_set (gimp->config,
+                "num-processors", 4,
+                NULL);
+
+  ADD_TEST (rectangle_random_masks);
+  ADD_TEST (rectangle_large_mask);
+  ADD_TEST (ellipse_is_rectangle);
+  ADD_TEST (ellipse_random_masks);
+  ADD_TEST (ellipse_antialiased_masks);
+  ADD_TEST (operations);
+
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
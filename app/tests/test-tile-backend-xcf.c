@@ -0,0 +1,310 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <zlib.h>
+
+#include "widgets/widgets-types.h"
+
+#include "core/gimp.h"
+
+#include "xcf/xcf-private.h"
+#include "xcf/gimptilebackendxcf.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define ADD_TEST(function) \
+  g_test_add_func ("/gimp-tile-backend-xcf/" #function, function);
+
+/*  2 x 2 tiles, the right and bottom ones partial  */
+#define WIDTH          100
+#define HEIGHT          70
+#define N_TILE_COLS      2
+#define N_TILE_ROWS      2
+#define N_TILES        (N_TILE_COLS * N_TILE_ROWS)
+#define BPP              4
+
+/*  the last tile has no data in the file  */
+#define MISSING_TILE   (N_TILES - 1)
+
+#define MODIFIED_VALUE 0x5a
+
+
+typedef struct
+{
+  gchar           *filename;
+  GeglTileBackend *backend;
+} TestFile;
+
+
+static const GeglRectangle modified_rect = { 50, 20, 30, 30 };
+
+
+static guchar
+expected_value (gint     x,
+                gint     y,
+                gint     c,
+                gboolean modified)
+{
+  gint tile = (y / XCF_TILE_HEIGHT) * N_TILE_COLS + x / XCF_TILE_WIDTH;
+
+  if (modified &&
+      x >= modified_rect.x && x < modified_rect.x + modified_rect.width &&
+      y >= modified_rect.y && y < modified_rect.y + modified_rect.height)
+    return MODIFIED_VALUE;
+
+  if (tile == MISSING_TILE)
+    return 0;
+
+  return (x * 3 + y * 5 + c * 70) & 0xff;
+}
+
+/*  writes the tiles after some unrelated data, the way they are
+ *  written to an XCF file, and opens a backend which reads them lazily
+ */
+static TestFile
+test_file_new (XcfCompressionType compression)
+{
+  TestFile     test_file;
+  goffset      offsets[N_TILES + 1] = { 0, };
+  FILE        *fp;
+  XcfTileFile *file;
+  gint         fd;
+  gint         i;
+
+  fd = g_file_open_tmp ("gimp-test-XXXXXX.xcf", &test_file.filename, NULL);
+  g_assert (fd != -1);
+  g_close (fd, NULL);
+
+  fp = g_fopen (test_file.filename, "wb");
+  g_assert (fp != NULL);
+
+  fputs ("not tile data", fp);
+
+  for (i = 0; i < N_TILES; i++)
+    {
+      gint    x0     = (i % N_TILE_COLS) * XCF_TILE_WIDTH;
+      gint    y0     = (i / N_TILE_COLS) * XCF_TILE_HEIGHT;
+      gint    width  = MIN (XCF_TILE_WIDTH,  WIDTH  - x0);
+      gint    height = MIN (XCF_TILE_HEIGHT, HEIGHT - y0);
+      gint    size   = width * height * BPP;
+      guchar *data;
+      gint    x, y, c;
+
+      if (i == MISSING_TILE)
+        continue;
+
+      data = g_malloc (size);
+
+      for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+          for (c = 0; c < BPP; c++)
+            data[(y * width + x) * BPP + c] = expected_value (x0 + x, y0 + y,
+                                                              c, FALSE);
+
+      offsets[i] = ftello (fp);
+
+      if (compression == COMPRESS_ZLIB)
+        {
+          uLongf  length     = compressBound (size);
+          guchar *compressed = g_malloc (length);
+
+          g_assert (compress (compressed, &length, data, size) == Z_OK);
+          g_assert (fwrite (compressed, 1, length, fp) == length);
+
+          g_free (compressed);
+        }
+      else
+        {
+          g_assert (fwrite (data, 1, size, fp) == size);
+        }
+
+      g_free (data);
+    }
+
+  fclose (fp);
+
+  fp = g_fopen (test_file.filename, "rb");
+  g_assert (fp != NULL);
+
+  file = xcf_tile_file_new (fp, test_file.filename);
+
+  test_file.backend = gimp_tile_backend_xcf_new (file, compression,
+                                                 babl_format ("R'G'B'A u8"),
+                                                 WIDTH, HEIGHT, offsets);
+
+  xcf_tile_file_unref (file);
+
+  return test_file;
+}
+
+static void
+test_file_free (TestFile *test_file)
+{
+  g_object_unref (test_file->backend);
+
+  g_unlink (test_file->filename);
+  g_free (test_file->filename);
+}
+
+/*  reads @backend through a new buffer, which has its own cache, so all
+ *  the tiles come from the backend
+ */
+static void
+check_backend (GeglTileBackend *backend,
+               gboolean         modified)
+{
+  GeglBuffer *buffer = gegl_buffer_new_for_backend (NULL, backend);
+  guchar     *pixels = g_malloc (WIDTH * HEIGHT * BPP);
+  gint        x, y, c;
+
+  gegl_buffer_get (buffer, GEGL_RECTANGLE (0, 0, WIDTH, HEIGHT), 1.0,
+                   babl_format ("R'G'B'A u8"), pixels,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      for (c = 0; c < BPP; c++)
+        g_assert_cmpint (pixels[(y * WIDTH + x) * BPP + c], ==,
+                         expected_value (x, y, c, modified));
+
+  g_free (pixels);
+  g_object_unref (buffer);
+}
+
+/*  modifies @backend through a buffer, and writes the modified tiles
+ *  back to it
+ */
+static void
+modify_backend (GeglTileBackend *backend)
+{
+  GeglBuffer *buffer = gegl_buffer_new_for_backend (NULL, backend);
+  guchar     *pixels;
+
+  pixels = g_malloc (modified_rect.width * modified_rect.height * BPP);
+  memset (pixels, MODIFIED_VALUE,
+          modified_rect.width * modified_rect.height * BPP);
+
+  gegl_buffer_set (buffer, &modified_rect, 0, babl_format ("R'G'B'A u8"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_flush (buffer);
+
+  g_free (pixels);
+  g_object_unref (buffer);
+}
+
+/**
+ * lazy_load:
+ *
+ * Read uncompressed and zlib-compressed tiles, whose length is taken
+ * from the offset of the next tile, lazily, including a tile without
+ * data and the partial tiles at the right and bottom.
+ **/
+static void
+lazy_load (void)
+{
+  TestFile test_file;
+
+  test_file = test_file_new (COMPRESS_NONE);
+  check_backend (test_file.backend, FALSE);
+  test_file_free (&test_file);
+
+  test_file = test_file_new (COMPRESS_ZLIB);
+  check_backend (test_file.backend, FALSE);
+  test_file_free (&test_file);
+}
+
+/**
+ * stored_tiles:
+ *
+ * Check that tiles written to the backend are read back from it,
+ * while the others are still read from the file.
+ **/
+static void
+stored_tiles (void)
+{
+  TestFile test_file = test_file_new (COMPRESS_ZLIB);
+
+  modify_backend (test_file.backend);
+  check_backend (test_file.backend, TRUE);
+
+  test_file_free (&test_file);
+}
+
+/**
+ * detach_file:
+ *
+ * Check that the pixels survive overwriting the file after
+ * gimp_tile_backend_xcf_detach_file(), and that tiles written after
+ * detaching replace the detached ones.
+ **/
+static void
+detach_file (void)
+{
+  TestFile test_file = test_file_new (COMPRESS_ZLIB);
+
+  gimp_tile_backend_xcf_detach_file (test_file.filename);
+
+  g_assert (g_file_set_contents (test_file.filename, "overwritten", -1,
+                                 NULL));
+
+  check_backend (test_file.backend, FALSE);
+
+  modify_backend (test_file.backend);
+  check_backend (test_file.backend, TRUE);
+
+  test_file_free (&test_file);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  ADD_TEST (lazy_load);
+  ADD_TEST (stored_tiles);
+  ADD_TEST (detach_file);
+
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
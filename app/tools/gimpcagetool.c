@@ -56,6 +56,13 @@
 #include "gimp-intl.h"
 
 
+/*  the coarse preview while dragging computes the transformation on a
+ *  grid of at most this many points
+ */
+#define COARSE_PREVIEW_MAX_POINTS (128 * 128)
+#define COARSE_PREVIEW_MAX_STEP   16
+
+
 enum
 {
   CAGE_STATE_INIT,
@@ -127,7 +134,8 @@ static void       gimp_cage_tool_create_image_map   (GimpCageTool          *ct,
                                                      GimpDrawable          *drawable);
 static void       gimp_cage_tool_image_map_flush    (GimpImageMap          *image_map,
                                                      GimpTool              *tool);
-static void       gimp_cage_tool_image_map_update   (GimpCageTool          *ct);
+static void       gimp_cage_tool_image_map_update   (GimpCageTool          *ct,
+                                                     gboolean               coarse);
 
 static void       gimp_cage_tool_create_render_node (GimpCageTool          *ct);
 static void       gimp_cage_tool_render_node_update (GimpCageTool          *ct);
@@ -370,7 +378,7 @@ gimp_cage_tool_options_notify (GimpTool         *tool,
               gimp_cage_tool_create_image_map (ct, drawable);
             }
 
-          gimp_cage_tool_image_map_update (ct);
+          gimp_cage_tool_image_map_update (ct, FALSE);
         }
       else
         {
@@ -384,7 +392,7 @@ gimp_cage_tool_options_notify (GimpTool         *tool,
   else if (strcmp  (pspec->name, "fill-plain-color") == 0)
     {
       gimp_cage_tool_render_node_update (ct);
-      gimp_cage_tool_image_map_update (ct);
+      gimp_cage_tool_image_map_update (ct, FALSE);
     }
 
   gimp_draw_tool_resume (GIMP_DRAW_TOOL (tool));
@@ -478,6 +486,12 @@ gimp_cage_tool_motion (GimpTool         *tool,
       break;
     }
 
+  /*  show a coarse preview while dragging, the exact result is only
+   *  computed on release
+   */
+  if (ct->tool_state == DEFORM_STATE_MOVE_HANDLE)
+    gimp_cage_tool_image_map_update (ct, TRUE);
+
   gimp_draw_tool_resume (GIMP_DRAW_TOOL (tool));
 }
 
@@ -735,7 +749,7 @@ gimp_cage_tool_button_release (GimpTool              *tool,
           break;
 
         case DEFORM_STATE_MOVE_HANDLE:
-          gimp_cage_tool_image_map_update (ct);
+          gimp_cage_tool_image_map_update (ct, FALSE);
           ct->tool_state = DEFORM_STATE_WAIT;
           break;
 
@@ -793,7 +807,7 @@ gimp_cage_tool_button_release (GimpTool              *tool,
         case DEFORM_STATE_MOVE_HANDLE:
           ct->tool_state = DEFORM_STATE_WAIT;
           gimp_cage_config_commit_displacement (ct->config);
-          gimp_cage_tool_image_map_update (ct);
+          gimp_cage_tool_image_map_update (ct, FALSE);
           break;
 
         case DEFORM_STATE_SELECTING:
@@ -1258,8 +1272,43 @@ gimp_cage_tool_image_map_flush (GimpImageMap *image_map,
   gimp_projection_flush (gimp_image_get_projection (image));
 }
 
+/*  with @coarse, the transform is evaluated on a sparse grid.  either
+ *  way it is one pass over the whole cage, because gimp:cage-transform
+ *  scatters its result and so always caches its whole bounding box
+ */
 static void
-gimp_cage_tool_image_map_update (GimpCageTool *ct)
+gimp_cage_tool_image_map_update (GimpCageTool *ct,
+                                 gboolean      coarse)
 {
+  GeglOperation *operation;
+  GeglRectangle  bbox;
+  gint           step = 1;
+
+  if (coarse)
+    {
+      bbox = gimp_cage_config_get_bounding_box (ct->config);
+
+      step = ceil (sqrt ((gdouble) bbox.width * bbox.height /
+                         COARSE_PREVIEW_MAX_POINTS));
+      step = CLAMP (step, 1, COARSE_PREVIEW_MAX_STEP);
+    }
+
+  gegl_node_set (ct->cage_node,
+                 "step", step,
+                 NULL);
+
+  /*  the cage config changed behind the node's back  */
+  g_object_get (ct->cage_node,
+                "gegl-operation", &operation,
+                NULL);
+
+  if (operation)
+    {
+      bbox = gegl_node_get_bounding_box (ct->cage_node);
+
+      gegl_operation_invalidate (operation, &bbox, TRUE);
+      g_object_unref (operation);
+    }
+
   gimp_image_map_apply (ct->image_map, NULL);
 }
@@ -35,6 +35,7 @@
 #include "gegl/gimp-gegl-mask.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 #include "core/gimpdrawable-foreground-extract.h"
 #include "core/gimpimage.h"
 #include "core/gimplayer.h"
@@ -55,6 +56,22 @@
 #include "gimp-intl.h"
 
 
+/*  the preview is computed on the image and trimap downscaled to at
+ *  most this many pixels
+ */
+#define PREVIEW_MAX_PIXELS     (256 * 256)
+
+#define TRIMAP_EPSILON         0.01
+
+/*  sigmas of the joint bilateral upsampling of the preview; the
+ *  spatial sigma is in low resolution pixels
+ */
+#define UPSAMPLE_SPATIAL_SIGMA 1.0
+#define UPSAMPLE_RANGE_SIGMA   0.1
+
+#define MIN_PARALLEL_SUB_AREA  (64 * 64)
+
+
 typedef struct
 {
   gint         width;
@@ -63,6 +80,20 @@ typedef struct
   GimpVector2 *points;
 } FgSelectStroke;
 
+typedef struct
+{
+  GeglBuffer   *image;
+  GeglBuffer   *trimap;
+  GeglBuffer   *mask;
+
+  /*  the low resolution image and matte  */
+  const gfloat *colors;
+  const gfloat *alpha;
+  gint          width;
+  gint          height;
+  gdouble       scale;
+} FgSelectUpsample;
+
 
 static void   gimp_foreground_select_tool_constructed    (GObject          *object);
 static void   gimp_foreground_select_tool_finalize       (GObject          *object);
@@ -122,6 +153,19 @@ static void   gimp_foreground_select_tool_apply          (GimpForegroundSelectTo
 static void   gimp_foreground_select_tool_preview        (GimpForegroundSelectTool *fg_select,
                                                           GimpDisplay              *display);
 
+static GeglBuffer * gimp_foreground_select_tool_matte    (GimpForegroundSelectTool *fg_select,
+                                                          GeglBuffer               *image_buffer,
+                                                          GeglBuffer               *trimap_buffer,
+                                                          GimpProgress             *progress);
+static GeglBuffer * gimp_foreground_select_tool_matte_coarse
+                                                         (GimpForegroundSelectTool *fg_select,
+                                                          GeglBuffer               *image_buffer,
+                                                          GeglBuffer               *trimap_buffer,
+                                                          gint                      level,
+                                                          GimpProgress             *progress);
+static void   gimp_foreground_select_tool_upsample_area  (const GeglRectangle      *area,
+                                                          FgSelectUpsample         *upsample);
+
 static void   gimp_foreground_select_options_notify      (GimpForegroundSelectOptions *options,
                                                           GParamSpec                  *pspec,
                                                           GimpForegroundSelectTool    *fg_select);
@@ -203,6 +247,8 @@ gimp_foreground_select_tool_init (GimpForegroundSelectTool *fg_select)
   fg_select->mask    = NULL;
   fg_select->trimap  = NULL;
   fg_select->state   = MATTING_STATE_FREE_SELECT;
+
+  fg_select->mask_is_coarse = FALSE;
 }
 
 static void
@@ -703,6 +749,8 @@ gimp_foreground_select_tool_drop_masks (GimpForegroundSelectTool *fg_select,
       fg_select->mask = NULL;
     }
 
+  fg_select->mask_is_coarse = FALSE;
+
   if (GIMP_IS_DISPLAY (display))
     {
       gimp_display_shell_set_mask (gimp_display_get_shell (display),
@@ -722,21 +770,12 @@ static void
 gimp_foreground_select_tool_preview (GimpForegroundSelectTool *fg_select,
                                      GimpDisplay              *display)
 {
-  GimpTool                    *tool     = GIMP_TOOL (fg_select);
-  GimpForegroundSelectOptions *options  = GIMP_FOREGROUND_SELECT_TOOL_GET_OPTIONS (tool);
-  GimpImage                   *image    = gimp_display_get_image (display);
-  GimpDrawable                *drawable = gimp_image_get_active_drawable (image);
-  GeglBuffer                  *trimap_buffer;
-  GeglBuffer                  *drawable_buffer;
-  GeglNode                    *gegl;
-  GeglNode                    *matting_node;
-  GeglNode                    *input_image;
-  GeglNode                    *input_trimap;
-  GeglNode                    *output_mask;
-  GeglBuffer                  *buffer;
-  GimpProgress                *progress;
-  GeglProcessor               *processor;
-  gdouble                     value;
+  GimpImage    *image    = gimp_display_get_image (display);
+  GimpDrawable *drawable = gimp_image_get_active_drawable (image);
+  GeglBuffer   *drawable_buffer;
+  GimpProgress *progress;
+  gint64        n_pixels;
+  gint          level;
 
   if (fg_select->mask)
     {
@@ -748,9 +787,109 @@ gimp_foreground_select_tool_preview (GimpForegroundSelectTool *fg_select,
                                   _("Computing alpha of unknown pixels"),
                                   FALSE);
 
-  trimap_buffer   = fg_select->trimap;
   drawable_buffer = gimp_drawable_get_buffer (drawable);
 
+  /*  find the smallest power of two downscaling that brings the trimap
+   *  below PREVIEW_MAX_PIXELS, the full resolution matte is only
+   *  computed when the mask is applied
+   */
+  n_pixels = ((gint64) gegl_buffer_get_width  (fg_select->trimap) *
+              (gint64) gegl_buffer_get_height (fg_select->trimap));
+
+  for (level = 0; n_pixels > PREVIEW_MAX_PIXELS; level++)
+    n_pixels /= 4;
+
+  if (level > 0)
+    {
+      fg_select->mask =
+        gimp_foreground_select_tool_matte_coarse (fg_select,
+                                                  drawable_buffer,
+                                                  fg_select->trimap,
+                                                  level, progress);
+    }
+  else
+    {
+      fg_select->mask =
+        gimp_foreground_select_tool_matte (fg_select,
+                                           drawable_buffer,
+                                           fg_select->trimap,
+                                           progress);
+    }
+
+  fg_select->mask_is_coarse = (level > 0);
+
+  if (progress)
+    gimp_progress_end (progress);
+
+  gimp_foreground_select_tool_set_preview (fg_select, display);
+}
+
+static void
+gimp_foreground_select_tool_apply (GimpForegroundSelectTool *fg_select,
+                                   GimpDisplay              *display)
+{
+  GimpTool      *tool    = GIMP_TOOL (fg_select);
+  GimpImage     *image   = gimp_display_get_image (display);
+  GimpLayer     *layer   = gimp_image_get_active_layer (image);
+  GimpLayerMask *layer_mask;
+  GimpRGB        color   = { 0.0, 0.0, 0.0, GIMP_OPACITY_OPAQUE };
+
+  g_return_if_fail (fg_select->mask != NULL);
+
+  /*  the preview was computed at a lower resolution, replace it by the
+   *  full resolution matte
+   */
+  if (fg_select->mask_is_coarse)
+    {
+      GimpDrawable *drawable = gimp_image_get_active_drawable (image);
+      GimpProgress *progress;
+      GeglBuffer   *mask;
+
+      progress = gimp_progress_start (GIMP_PROGRESS (fg_select),
+                                      _("Computing alpha of unknown pixels"),
+                                      FALSE);
+
+      mask = gimp_foreground_select_tool_matte (fg_select,
+                                                gimp_drawable_get_buffer (drawable),
+                                                fg_select->trimap,
+                                                progress);
+
+      if (progress)
+        gimp_progress_end (progress);
+
+      g_object_unref (fg_select->mask);
+      fg_select->mask           = mask;
+      fg_select->mask_is_coarse = FALSE;
+    }
+
+  layer_mask = gimp_layer_mask_new_from_buffer (fg_select->mask, image,
+                                                "mask", &color);
+
+  gimp_layer_add_mask (layer, layer_mask, TRUE, NULL);
+
+  gimp_tool_control (tool, GIMP_TOOL_ACTION_HALT, display);
+
+  gimp_image_flush (image);
+}
+
+static GeglBuffer *
+gimp_foreground_select_tool_matte (GimpForegroundSelectTool *fg_select,
+                                   GeglBuffer               *image_buffer,
+                                   GeglBuffer               *trimap_buffer,
+                                   GimpProgress             *progress)
+{
+  GimpForegroundSelectOptions *options;
+  GeglNode                    *gegl;
+  GeglNode                    *matting_node;
+  GeglNode                    *input_image;
+  GeglNode                    *input_trimap;
+  GeglNode                    *output_mask;
+  GeglBuffer                  *buffer;
+  GeglProcessor               *processor;
+  gdouble                      value;
+
+  options = GIMP_FOREGROUND_SELECT_TOOL_GET_OPTIONS (fg_select);
+
   gegl = gegl_node_new ();
 
   input_trimap = gegl_node_new_child (gegl,
@@ -759,7 +898,7 @@ gimp_foreground_select_tool_preview (GimpForegroundSelectTool *fg_select,
                                       NULL);
   input_image = gegl_node_new_child (gegl,
                                      "operation", "gegl:buffer-source",
-                                     "buffer",    drawable_buffer,
+                                     "buffer",    image_buffer,
                                      NULL);
   output_mask = gegl_node_new_child (gegl,
                                      "operation", "gegl:buffer-sink",
@@ -798,38 +937,213 @@ gimp_foreground_select_tool_preview (GimpForegroundSelectTool *fg_select,
         gimp_progress_set_value (progress, value);
     }
 
-  if (progress)
-    gimp_progress_end (progress);
-
   g_object_unref (processor);
-
-  fg_select->mask = buffer;
-
-  gimp_foreground_select_tool_set_preview (fg_select, display);
-
   g_object_unref (gegl);
+
+  return buffer;
 }
 
-static void
-gimp_foreground_select_tool_apply (GimpForegroundSelectTool *fg_select,
-                                   GimpDisplay              *display)
+/*  computes the matte on the image and trimap downscaled by 2^level,
+ *  and upsamples it to the trimap's size.  known trimap pixels keep
+ *  their value, the unknown band is refined by joint bilateral
+ *  upsampling, guided by the full resolution image.
+ */
+static GeglBuffer *
+gimp_foreground_select_tool_matte_coarse (GimpForegroundSelectTool *fg_select,
+                                          GeglBuffer               *image_buffer,
+                                          GeglBuffer               *trimap_buffer,
+                                          gint                      level,
+                                          GimpProgress             *progress)
 {
-  GimpTool      *tool    = GIMP_TOOL (fg_select);
-  GimpImage     *image   = gimp_display_get_image (display);
-  GimpLayer     *layer   = gimp_image_get_active_layer (image);
-  GimpLayerMask *layer_mask;
-  GimpRGB        color   = { 0.0, 0.0, 0.0, GIMP_OPACITY_OPAQUE };
+  const GeglRectangle *extent = gegl_buffer_get_extent (trimap_buffer);
+  FgSelectUpsample     upsample;
+  GeglBuffer          *small_image;
+  GeglBuffer          *small_trimap;
+  GeglBuffer          *small_mask;
+  GeglBuffer          *mask;
+  gfloat              *colors;
+  gfloat              *trimap;
+  gfloat              *alpha;
+  gdouble              scale;
+  gint                 width;
+  gint                 height;
+  gsize                n_pixels;
+  gsize                i;
+
+  scale  = 1.0 / (1 << level);
+  width  = (extent->width  + (1 << level) - 1) >> level;
+  height = (extent->height + (1 << level) - 1) >> level;
+
+  n_pixels = (gsize) width * height;
+
+  colors = g_new (gfloat, 3 * n_pixels);
+  trimap = g_new (gfloat, n_pixels);
+  alpha  = g_new (gfloat, n_pixels);
+
+  gegl_buffer_get (image_buffer, GEGL_RECTANGLE (0, 0, width, height),
+                   scale, babl_format ("R'G'B' float"), colors,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gegl_buffer_get (trimap_buffer, GEGL_RECTANGLE (0, 0, width, height),
+                   scale, babl_format ("Y float"), trimap,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  /*  the downscaled trimap is the average of the trimap, so a low
+   *  resolution pixel is only known if all of its pixels are known,
+   *  and agree
+   */
+  for (i = 0; i < n_pixels; i++)
+    {
+      if (trimap[i] >= 1.0 - TRIMAP_EPSILON)
+        trimap[i] = 1.0;
+      else if (trimap[i] <= TRIMAP_EPSILON)
+        trimap[i] = 0.0;
+      else
+        trimap[i] = 0.5;
+    }
 
-  g_return_if_fail (fg_select->mask != NULL);
+  small_image  = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height),
+                                  babl_format ("R'G'B' float"));
+  small_trimap = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height),
+                                  babl_format ("Y float"));
 
-  layer_mask = gimp_layer_mask_new_from_buffer (fg_select->mask, image,
-                                                "mask", &color);
+  gegl_buffer_set (small_image, NULL, 0, babl_format ("R'G'B' float"),
+                   colors, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_set (small_trimap, NULL, 0, babl_format ("Y float"),
+                   trimap, GEGL_AUTO_ROWSTRIDE);
 
-  gimp_layer_add_mask (layer, layer_mask, TRUE, NULL);
+  g_free (trimap);
 
-  gimp_tool_control (tool, GIMP_TOOL_ACTION_HALT, display);
+  small_mask = gimp_foreground_select_tool_matte (fg_select,
+                                                  small_image, small_trimap,
+                                                  progress);
 
-  gimp_image_flush (image);
+  gegl_buffer_get (small_mask, GEGL_RECTANGLE (0, 0, width, height),
+                   1.0, babl_format ("Y float"), alpha,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  g_object_unref (small_mask);
+  g_object_unref (small_trimap);
+  g_object_unref (small_image);
+
+  mask = gegl_buffer_new (extent, babl_format ("Y float"));
+
+  upsample.image  = image_buffer;
+  upsample.trimap = trimap_buffer;
+  upsample.mask   = mask;
+  upsample.colors = colors;
+  upsample.alpha  = alpha;
+  upsample.width  = width;
+  upsample.height = height;
+  upsample.scale  = scale;
+
+  gimp_parallel_distribute_area (extent, MIN_PARALLEL_SUB_AREA,
+                                 (GimpParallelDistributeAreaFunc)
+                                 gimp_foreground_select_tool_upsample_area,
+                                 &upsample);
+
+  g_free (alpha);
+  g_free (colors);
+
+  return mask;
+}
+
+static void
+gimp_foreground_select_tool_upsample_area (const GeglRectangle *area,
+                                           FgSelectUpsample    *upsample)
+{
+  GeglBufferIterator *iter;
+  const gint          width         = upsample->width;
+  const gint          height        = upsample->height;
+  const gdouble       scale         = upsample->scale;
+  const gdouble       spatial_scale = -0.5 / SQR (UPSAMPLE_SPATIAL_SIGMA);
+  const gdouble       range_scale   = -0.5 / SQR (UPSAMPLE_RANGE_SIGMA);
+
+  iter = gegl_buffer_iterator_new (upsample->mask,
+                                   area, 0, babl_format ("Y float"),
+                                   GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+
+  gegl_buffer_iterator_add (iter, upsample->trimap,
+                            area, 0, babl_format ("Y float"),
+                            GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  gegl_buffer_iterator_add (iter, upsample->image,
+                            area, 0, babl_format ("R'G'B' float"),
+                            GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      gfloat              *dest   = iter->data[0];
+      const gfloat        *trimap = iter->data[1];
+      const gfloat        *color  = iter->data[2];
+      const GeglRectangle *roi    = &iter->roi[0];
+      gint                 x, y;
+
+      for (y = roi->y; y < roi->y + roi->height; y++)
+        {
+          gdouble sy = (y + 0.5) * scale - 0.5;
+          gint    y0 = floor (sy);
+          gint    y1 = MAX (y0 - 1, 0);
+          gint    y2 = MIN (y0 + 2, height - 1);
+
+          for (x = roi->x; x < roi->x + roi->width; x++)
+            {
+              if (*trimap <= TRIMAP_EPSILON)
+                {
+                  *dest = 0.0;
+                }
+              else if (*trimap >= 1.0 - TRIMAP_EPSILON)
+                {
+                  *dest = 1.0;
+                }
+              else
+                {
+                  gdouble sx         = (x + 0.5) * scale - 0.5;
+                  gint    x0         = floor (sx);
+                  gint    x1         = MAX (x0 - 1, 0);
+                  gint    x2         = MIN (x0 + 2, width - 1);
+                  gdouble sum        = 0.0;
+                  gdouble weight_sum = 0.0;
+                  gint    i, j;
+
+                  /*  weigh the 4x4 nearest low resolution pixels by
+                   *  their distance, and by their color difference to
+                   *  this pixel, so the matte follows the edges of
+                   *  the full resolution image
+                   */
+                  for (j = y1; j <= y2; j++)
+                    {
+                      for (i = x1; i <= x2; i++)
+                        {
+                          gsize         index = (gsize) j * width + i;
+                          const gfloat *c     = upsample->colors + 3 * index;
+                          gdouble       d2;
+                          gdouble       r2;
+                          gdouble       weight;
+
+                          d2 = SQR (i - sx) + SQR (j - sy);
+                          r2 = (SQR (c[0] - color[0]) +
+                                SQR (c[1] - color[1]) +
+                                SQR (c[2] - color[2]));
+
+                          weight = exp (d2 * spatial_scale + r2 * range_scale);
+
+                          sum        += weight * upsample->alpha[index];
+                          weight_sum += weight;
+                        }
+                    }
+
+                  if (weight_sum > 0.0)
+                    *dest = CLAMP (sum / weight_sum, 0.0, 1.0);
+                  else
+                    *dest = 0.5;
+                }
+
+              dest   += 1;
+              trimap += 1;
+              color  += 3;
+            }
+        }
+    }
 }
 
 static void
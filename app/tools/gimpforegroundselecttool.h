@@ -51,6 +51,7 @@ struct _GimpForegroundSelectTool
   GArray             *stroke;
   GeglBuffer         *trimap;
   GeglBuffer         *mask;
+  gboolean            mask_is_coarse;
   MattingState        state;
 };
 
@@ -42,11 +42,23 @@
 
 /* Livewire boundary implementation done by Laramie Leavitt */
 
-#if 0
+/* The gradient map is computed lazily, one tile at a time, by a
+ * GimpTileHandlerIscissors.  The optimal path is found with Dijkstra's
+ * algorithm using a bucket queue, which works since the link costs are
+ * small integers.  The search state is allocated in blocks, so only
+ * the part of the image the search actually reaches costs memory.
+ * The interactive livewire is searched for in a worker thread, which
+ * keeps expanding the same search for as long as the seed point stays
+ * the same, so following the pointer is mostly a matter of tracing
+ * back an already known path.  The worker owns its search while it
+ * runs, and only briefly takes its mutex to pick up a new target or
+ * hand over a result; a new target aborts the running chunk.
+ */
 
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <gegl.h>
 #include <gtk/gtk.h>
@@ -57,20 +69,11 @@
 
 #include "tools-types.h"
 
-#include "base/pixel-region.h"
-#include "base/tile-manager.h"
-#include "base/tile.h"
-
-#include "paint-funcs/paint-funcs.h"
-
-#include "gegl/gimp-gegl-utils.h"
-
 #include "core/gimpchannel.h"
 #include "core/gimpchannel-select.h"
 #include "core/gimpimage.h"
 #include "core/gimppickable.h"
 #include "core/gimpscanconvert.h"
-#include "core/gimptempbuf.h"
 #include "core/gimptoolinfo.h"
 
 #include "widgets/gimphelp-ids.h"
@@ -80,30 +83,30 @@
 
 #include "gimpiscissorsoptions.h"
 #include "gimpiscissorstool.h"
+#include "gimptilehandleriscissors.h"
 #include "gimptoolcontrol.h"
 
 #include "gimp-intl.h"
 
 
 /*  defines  */
-#define  MAX_GRADIENT      179.606  /* == sqrt (127^2 + 127^2) */
 #define  GRADIENT_SEARCH   32  /* how far to look when snapping to an edge */
-#define  EXTEND_BY         0.2 /* proportion to expand cost map by */
-#define  FIXED             5   /* additional fixed size to expand cost map */
-#define  MIN_GRADIENT      63  /* gradients < this are directionless */
-
-#define  COST_WIDTH        2   /* number of bytes for each pixel in cost map  */
 
 /* weight to give between gradient (_G) and direction (_D) */
 #define  OMEGA_D           0.2
 #define  OMEGA_G           0.8
 
-/* sentinel to mark seed point in ?cost? map */
+/* sentinel to mark seed point in the search */
 #define  SEED_POINT        9
+/* sentinel to mark pixels not reached by the search yet */
+#define  LINK_NONE         10
+/* flag for pixels whose optimal path is known */
+#define  LINK_SETTLED      0x80
 
-/*  Functional defines  */
-#define  PIXEL_COST(x)     ((x) >> 8)
-#define  PIXEL_DIR(x)      ((x) & 0x000000ff)
+#define  SEARCH_BLOCK_SIZE 64   /* size of the blocks of the search state */
+#define  SEARCH_N_BUCKETS  512  /* must be larger than any link cost */
+#define  SEARCH_CHUNK_SIZE 16384 /* pixels the worker settles at a time */
+#define  SEARCH_ABORT_SIZE 1024  /* pixels settled between abort checks */
 
 
 struct _ICurve
@@ -113,6 +116,56 @@ struct _ICurve
   GPtrArray *points;
 };
 
+typedef struct
+{
+  guint32  cost[SEARCH_BLOCK_SIZE * SEARCH_BLOCK_SIZE];
+  guint8   link[SEARCH_BLOCK_SIZE * SEARCH_BLOCK_SIZE];
+  guint8   gradient[SEARCH_BLOCK_SIZE * SEARCH_BLOCK_SIZE * 2];
+} ISearchBlock;
+
+typedef struct
+{
+  gint x, y;
+} ISearchPixel;
+
+typedef struct
+{
+  GeglBuffer    *gradient_map;
+  GMutex        *gradient_mutex;
+  gint           width;
+  gint           height;
+  gint           seed_x;
+  gint           seed_y;
+
+  ISearchBlock **blocks;
+  gint           n_blocks_x;
+  gint           n_blocks_y;
+
+  GArray        *buckets[SEARCH_N_BUCKETS];
+  guint32        cur_cost;
+  gint           n_queued;
+} ISearch;
+
+struct _IWorker
+{
+  GimpIscissorsTool *iscissors;
+  ISearch           *search;
+
+  GThread           *thread;
+  GMutex             mutex;   /*  protects the fields below             */
+  GCond              cond;
+
+  gint               target_x;
+  gint               target_y;
+  gboolean           pending;
+  gboolean           busy;    /*  the search is running, unlocked       */
+  gboolean           quit;
+  gint               abort;   /*  atomic, stops the running search      */
+
+  ICurve            *result;
+  guint              idle_id;
+};
+
 
 /*  local function prototypes  */
 
@@ -158,16 +211,12 @@ static void   gimp_iscissors_tool_draw           (GimpDrawTool          *draw_to
 
 static void          iscissors_convert         (GimpIscissorsTool *iscissors,
                                                 GimpDisplay       *display);
-static TileManager * gradient_map_new          (GimpImage         *image);
-
-static void          find_optimal_path         (TileManager       *gradient_map,
-                                                GimpTempBuf       *dp_buf,
-                                                gint               x1,
-                                                gint               y1,
-                                                gint               x2,
-                                                gint               y2,
-                                                gint               xs,
-                                                gint               ys);
+
+static void          gradient_map_create       (GimpIscissorsTool *iscissors,
+                                                GimpImage         *image);
+static void          gradient_map_lock         (GimpIscissorsTool *iscissors);
+static void          gradient_map_unlock       (GimpIscissorsTool *iscissors);
+
 static void          find_max_gradient         (GimpIscissorsTool *iscissors,
                                                 GimpImage         *image,
                                                 gint              *x,
@@ -176,6 +225,7 @@ static void          calculate_curve           (GimpIscissorsTool *iscissors,
                                                 ICurve            *curve);
 static void          iscissors_draw_curve      (GimpDrawTool      *draw_tool,
                                                 ICurve            *curve);
+static void          iscissors_free_curve      (ICurve            *curve);
 
 static gint          mouse_over_vertex         (GimpIscissorsTool *iscissors,
                                                 gdouble            x,
@@ -190,14 +240,32 @@ static gboolean      clicked_on_curve          (GimpIscissorsTool *iscissors,
                                                 gdouble            x,
                                                 gdouble            y);
 
-static GPtrArray   * plot_pixels               (GimpIscissorsTool *iscissors,
-                                                GimpTempBuf       *dp_buf,
-                                                gint               x1,
-                                                gint               y1,
-                                                gint               xs,
-                                                gint               ys,
-                                                gint               xe,
-                                                gint               ye);
+static ISearch     * search_new                (GeglBuffer        *gradient_map,
+                                                GMutex            *gradient_mutex,
+                                                gint               seed_x,
+                                                gint               seed_y);
+static void          search_free               (ISearch           *search);
+static gboolean      search_run                (ISearch           *search,
+                                                gint               x,
+                                                gint               y,
+                                                gint               max_pixels,
+                                                gint              *abort);
+static GPtrArray   * search_get_path           (ISearch           *search,
+                                                gint               x,
+                                                gint               y);
+
+static IWorker     * worker_new                (GimpIscissorsTool *iscissors,
+                                                gint               seed_x,
+                                                gint               seed_y);
+static void          worker_free               (IWorker           *worker);
+static void          worker_set_target         (IWorker           *worker,
+                                                gint               x,
+                                                gint               y);
+static GPtrArray   * worker_get_path           (IWorker           *worker,
+                                                gint               x,
+                                                gint               y);
+static gpointer      worker_thread             (IWorker           *worker);
+static gboolean      worker_idle               (IWorker           *worker);
 
 
 G_DEFINE_TYPE (GimpIscissorsTool, gimp_iscissors_tool,
@@ -232,38 +300,10 @@ static const gint move[8][2] =
  */
 
 
-/*  temporary convolution buffers --  */
-static guchar  maxgrad_conv0[TILE_WIDTH * TILE_HEIGHT * 4] = "";
-static guchar  maxgrad_conv1[TILE_WIDTH * TILE_HEIGHT * 4] = "";
-static guchar  maxgrad_conv2[TILE_WIDTH * TILE_HEIGHT * 4] = "";
-
-
-static const gfloat horz_deriv[9] =
-{
-   1,  0, -1,
-   2,  0, -2,
-   1,  0, -1,
-};
-
-static const gfloat vert_deriv[9] =
-{
-   1,  2,  1,
-   0,  0,  0,
-  -1, -2, -1,
-};
-
-static const gfloat blur_32[9] =
-{
-   1,  1,  1,
-   1, 24,  1,
-   1,  1,  1,
-};
-
 static gfloat  distance_weights[GRADIENT_SEARCH * GRADIENT_SEARCH];
 
 static gint    diagonal_weight[256];
 static gint    direction_value[256][4];
-static Tile   *cur_tile    = NULL;
 
 
 void
@@ -348,6 +388,8 @@ gimp_iscissors_tool_init (GimpIscissorsTool *iscissors)
   iscissors->op     = ISCISSORS_OP_NONE;
   iscissors->curves = g_queue_new ();
   iscissors->state  = NO_ACTION;
+
+  g_mutex_init (&iscissors->gradient_mutex);
 }
 
 static void
@@ -355,8 +397,16 @@ gimp_iscissors_tool_finalize (GObject *object)
 {
   GimpIscissorsTool *iscissors = GIMP_ISCISSORS_TOOL (object);
 
+  if (iscissors->worker)
+    {
+      worker_free (iscissors->worker);
+      iscissors->worker = NULL;
+    }
+
   g_queue_free (iscissors->curves);
 
+  g_mutex_clear (&iscissors->gradient_mutex);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -374,17 +424,23 @@ gimp_iscissors_tool_control (GimpTool       *tool,
       break;
 
     case GIMP_TOOL_ACTION_HALT:
-      /*  Free and reset the curve list  */
-      while (! g_queue_is_empty (iscissors->curves))
+      /*  Stop the livewire search before anything it uses goes away  */
+      if (iscissors->worker)
         {
-          ICurve *curve = g_queue_pop_head (iscissors->curves);
-
-          if (curve->points)
-            g_ptr_array_free (curve->points, TRUE);
+          worker_free (iscissors->worker);
+          iscissors->worker = NULL;
+        }
 
-          g_slice_free (ICurve, curve);
+      if (iscissors->livewire)
+        {
+          iscissors_free_curve (iscissors->livewire);
+          iscissors->livewire = NULL;
         }
 
+      /*  Free and reset the curve list  */
+      while (! g_queue_is_empty (iscissors->curves))
+        iscissors_free_curve (g_queue_pop_head (iscissors->curves));
+
       /*  free mask  */
       if (iscissors->mask)
         {
@@ -395,14 +451,7 @@ gimp_iscissors_tool_control (GimpTool       *tool,
       /* free the gradient map */
       if (iscissors->gradient_map)
         {
-          /* release any tile we were using */
-          if (cur_tile)
-            {
-              tile_release (cur_tile, FALSE);
-              cur_tile = NULL;
-            }
-
-          tile_manager_unref (iscissors->gradient_map);
+          g_object_unref (iscissors->gradient_map);
           iscissors->gradient_map = NULL;
         }
 
@@ -411,13 +460,6 @@ gimp_iscissors_tool_control (GimpTool       *tool,
       iscissors->first_point = TRUE;
       iscissors->connected   = FALSE;
       iscissors->state       = NO_ACTION;
-
-      /*  Reset the dp buffers  */
-      if (iscissors->dp_buf)
-        {
-          gimp_temp_buf_unref (iscissors->dp_buf);
-          iscissors->dp_buf = NULL;
-        }
       break;
     }
 
@@ -748,38 +790,37 @@ gimp_iscissors_tool_draw (GimpDrawTool *draw_tool)
             }
           else
             {
-              /* See if the mouse has moved.  If so, create a new segment... */
-              if (! iscissors->livewire ||
-                  (iscissors->livewire &&
-                   (iscissors->ix != iscissors->livewire->x1 ||
-                    iscissors->x  != iscissors->livewire->x2  ||
-                    iscissors->iy != iscissors->livewire->y1 ||
-                    iscissors->y  != iscissors->livewire->y2)))
+              /* If the seed point has moved, start a new search... */
+              if (! iscissors->worker ||
+                  iscissors->ix != iscissors->worker->search->seed_x ||
+                  iscissors->iy != iscissors->worker->search->seed_y)
                 {
-                  ICurve *curve = g_slice_new (ICurve);
-
-                  curve->x1 = iscissors->ix;
-                  curve->y1 = iscissors->iy;
-                  curve->x2 = iscissors->x;
-                  curve->y2 = iscissors->y;
-                  curve->points = NULL;
+                  if (iscissors->worker)
+                    {
+                      worker_free (iscissors->worker);
+                      iscissors->worker = NULL;
+                    }
 
                   if (iscissors->livewire)
                     {
-                      if (iscissors->livewire->points)
-                        g_ptr_array_free (iscissors->livewire->points, TRUE);
-
-                      g_slice_free (ICurve, iscissors->livewire);
-
+                      iscissors_free_curve (iscissors->livewire);
                       iscissors->livewire = NULL;
                     }
 
-                  iscissors->livewire = curve;
-                  calculate_curve (iscissors, curve);
+                  iscissors->worker = worker_new (iscissors,
+                                                  iscissors->ix,
+                                                  iscissors->iy);
                 }
 
-              /*  plot the curve  */
-              iscissors_draw_curve (draw_tool, iscissors->livewire);
+              /* ...and let it find the path to the mouse, the curve
+               * is redrawn once it is there
+               */
+              worker_set_target (iscissors->worker,
+                                 iscissors->x, iscissors->y);
+
+              /*  plot the latest curve found  */
+              if (iscissors->livewire)
+                iscissors_draw_curve (draw_tool, iscissors->livewire);
             }
         }
     }
@@ -894,6 +935,15 @@ iscissors_draw_curve (GimpDrawTool *draw_tool,
   g_free (points);
 }
 
+static void
+iscissors_free_curve (ICurve *curve)
+{
+  if (curve->points)
+    g_ptr_array_free (curve->points, TRUE);
+
+  g_slice_free (ICurve, curve);
+}
+
 static void
 gimp_iscissors_tool_oper_update (GimpTool         *tool,
                                  const GimpCoords *coords,
@@ -1210,6 +1260,9 @@ mouse_over_curve (GimpIscissorsTool *iscissors,
       gpointer *pt;
       gint      len;
 
+      if (! curve->points)
+        continue;
+
       pt = curve->points->pdata;
       len = curve->points->len;
 
@@ -1282,53 +1335,19 @@ static void
 calculate_curve (GimpIscissorsTool *iscissors,
                  ICurve            *curve)
 {
-  GimpDisplay *display   = GIMP_TOOL (iscissors)->display;
-  GimpImage   *image     = gimp_display_get_image (display);
-  gint         x, y, dir;
+  GimpDisplay *display = GIMP_TOOL (iscissors)->display;
+  GimpImage   *image   = gimp_display_get_image (display);
+  IWorker     *worker  = iscissors->worker;
   gint         xs, ys, xe, ye;
-  gint         x1, y1, x2, y2;
-  gint         width, height;
-  gint         ewidth, eheight;
 
   /*  Calculate the lowest cost path from one vertex to the next as specified
    *  by the parameter "curve".
-   *    Here are the steps:
-   *      1)  Calculate the appropriate working area for this operation
-   *      2)  Allocate a temp buf for the dynamic programming array
-   *      3)  Run the dynamic programming algorithm to find the optimal path
-   *      4)  Translate the optimal path into pixels in the icurve data
-   *            structure.
    */
 
-  /*  Get the bounding box  */
   xs = CLAMP (curve->x1, 0, gimp_image_get_width  (image) - 1);
   ys = CLAMP (curve->y1, 0, gimp_image_get_height (image) - 1);
   xe = CLAMP (curve->x2, 0, gimp_image_get_width  (image) - 1);
   ye = CLAMP (curve->y2, 0, gimp_image_get_height (image) - 1);
-  x1 = MIN (xs, xe);
-  y1 = MIN (ys, ye);
-  x2 = MAX (xs, xe) + 1;  /*  +1 because if xe = 199 & xs = 0, x2 - x1, width = 200  */
-  y2 = MAX (ys, ye) + 1;
-
-  /*  expand the boundaries past the ending points by
-   *  some percentage of width and height.  This serves the following purpose:
-   *  It gives the algorithm more area to search so better solutions
-   *  are found.  This is particularly helpful in finding "bumps" which
-   *  fall outside the bounding box represented by the start and end
-   *  coordinates of the "curve".
-   */
-  ewidth  = (x2 - x1) * EXTEND_BY + FIXED;
-  eheight = (y2 - y1) * EXTEND_BY + FIXED;
-
-  if (xe >= xs)
-    x2 += CLAMP (ewidth, 0, gimp_image_get_width (image) - x2);
-  else
-    x1 -= CLAMP (ewidth, 0, x1);
-
-  if (ye >= ys)
-    y2 += CLAMP (eheight, 0, gimp_image_get_height (image) - y2);
-  else
-    y1 -= CLAMP (eheight, 0, y1);
 
   /* blow away any previous points list we might have */
   if (curve->points)
@@ -1337,112 +1356,230 @@ calculate_curve (GimpIscissorsTool *iscissors,
       curve->points = NULL;
     }
 
-  /*  If the bounding box has width and height...  */
-  if ((x2 - x1) && (y2 - y1))
+  /* Initialise the gradient map for this image if we don't already
+   * have one.
+   */
+  if (! iscissors->gradient_map)
+    gradient_map_create (iscissors, image);
+
+  if (worker && worker->search->seed_x == xs && worker->search->seed_y == ys)
+    {
+      /*  let the livewire search, which most likely already found
+       *  this path, finish it
+       */
+      curve->points = worker_get_path (worker, xe, ye);
+    }
+  else
     {
-      width = (x2 - x1);
-      height = (y2 - y1);
+      ISearch *search = search_new (iscissors->gradient_map,
+                                    &iscissors->gradient_mutex, xs, ys);
 
-      /* Initialise the gradient map tile manager for this image if we
-       * don't already have one. */
-      if (!iscissors->gradient_map)
-          iscissors->gradient_map = gradient_map_new (image);
+      search_run (search, xe, ye, -1, NULL);
 
-      /*  allocate the dynamic programming array  */
-      if (iscissors->dp_buf)
-        gimp_temp_buf_unref (iscissors->dp_buf);
+      curve->points = search_get_path (search, xe, ye);
 
-      iscissors->dp_buf = gimp_temp_buf_new (width, height,
-                                             babl_format ("Y u32"));
+      search_free (search);
+    }
+}
 
-      /*  find the optimal path of pixels from (x1, y1) to (x2, y2)  */
-      find_optimal_path (iscissors->gradient_map, iscissors->dp_buf,
-                         x1, y1, x2, y2, xs, ys);
 
-      /*  get a list of the pixels in the optimal path  */
-      curve->points = plot_pixels (iscissors, iscissors->dp_buf,
-                                   x1, y1, xs, ys, xe, ye);
-    }
-  /*  If the bounding box has no width  */
-  else if ((x2 - x1) == 0)
-    {
-      /*  plot a vertical line  */
-      y = ys;
-      dir = (ys > ye) ? -1 : 1;
-      curve->points = g_ptr_array_new ();
-      while (y != ye)
-        {
-          g_ptr_array_add (curve->points, GINT_TO_POINTER ((y << 16) + xs));
-          y += dir;
-        }
-    }
-  /*  If the bounding box has no height  */
-  else if ((y2 - y1) == 0)
+/*  the gradient map  */
+
+static void
+gradient_map_create (GimpIscissorsTool *iscissors,
+                     GimpImage         *image)
+{
+  GimpPickable    *pickable;
+  GeglBuffer      *src;
+  GeglTileHandler *handler;
+
+  pickable = GIMP_PICKABLE (gimp_image_get_projection (image));
+
+  gimp_pickable_flush (pickable);
+
+  /*  the gradient map is also filled from the worker thread, so make
+   *  it work on a copy of the projection
+   */
+  src = gegl_buffer_dup (gimp_pickable_get_buffer (pickable));
+
+  iscissors->gradient_map =
+    gegl_buffer_new (GEGL_RECTANGLE (0, 0,
+                                     gimp_image_get_width  (image),
+                                     gimp_image_get_height (image)),
+                     gimp_tile_handler_iscissors_get_format ());
+
+  handler = gimp_tile_handler_iscissors_new (src);
+  gegl_buffer_add_handler (iscissors->gradient_map, handler);
+  g_object_unref (handler);
+
+  g_object_unref (src);
+}
+
+/*  the gradient map is filled on demand, and may only be accessed by
+ *  one thread at a time
+ */
+static void
+gradient_map_lock (GimpIscissorsTool *iscissors)
+{
+  g_mutex_lock (&iscissors->gradient_mutex);
+}
+
+static void
+gradient_map_unlock (GimpIscissorsTool *iscissors)
+{
+  g_mutex_unlock (&iscissors->gradient_mutex);
+}
+
+static void
+find_max_gradient (GimpIscissorsTool *iscissors,
+                   GimpImage         *image,
+                   gint              *x,
+                   gint              *y)
+{
+  guint8  gradient[GRADIENT_SEARCH * GRADIENT_SEARCH * 2];
+  gint    radius;
+  gint    i, j;
+  gint    cx, cy;
+  gint    x1, y1, x2, y2;
+  gfloat  max_gradient;
+
+  /* Initialise the gradient map for this image if we don't already
+   * have one.
+   */
+  if (! iscissors->gradient_map)
+    gradient_map_create (iscissors, image);
+
+  radius = GRADIENT_SEARCH >> 1;
+
+  /*  calculate the extent of the search  */
+  cx = CLAMP (*x, 0, gimp_image_get_width  (image));
+  cy = CLAMP (*y, 0, gimp_image_get_height (image));
+  x1 = CLAMP (cx - radius, 0, gimp_image_get_width  (image));
+  y1 = CLAMP (cy - radius, 0, gimp_image_get_height (image));
+  x2 = CLAMP (cx + radius, 0, gimp_image_get_width  (image));
+  y2 = CLAMP (cy + radius, 0, gimp_image_get_height (image));
+  /*  calculate the factor to multiply the distance from the cursor by  */
+
+  max_gradient = 0;
+  *x = cx;
+  *y = cy;
+
+  if (x1 == x2 || y1 == y2)
+    return;
+
+  gradient_map_lock (iscissors);
+
+  gegl_buffer_get (iscissors->gradient_map,
+                   GEGL_RECTANGLE (x1, y1, x2 - x1, y2 - y1), 1.0,
+                   gimp_tile_handler_iscissors_get_format (), gradient,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  gradient_map_unlock (iscissors);
+
+  /*  Find the point of max gradient  */
+  for (i = y1; i < y2; i++)
     {
-      /*  plot a horizontal line  */
-      x = xs;
-      dir = (xs > xe) ? -1 : 1;
-      curve->points = g_ptr_array_new ();
-      while (x != xe)
+      const guint8 *g = gradient + (i - y1) * (x2 - x1) * 2;
+
+      for (j = x1; j < x2; j++)
         {
-          g_ptr_array_add (curve->points, GINT_TO_POINTER ((ys << 16) + x));
-          x += dir;
+          gfloat value = *g;
+
+          g += 2;
+
+          value *= distance_weights [(i-y1) * GRADIENT_SEARCH + (j-x1)];
+
+          if (value > max_gradient)
+            {
+              max_gradient = value;
+
+              *x = j;
+              *y = i;
+            }
         }
     }
 }
 
 
-/* badly need to get a replacement - this is _way_ too expensive */
-static gboolean
-gradient_map_value (TileManager *map,
-                    gint         x,
-                    gint         y,
-                    guint8      *grad,
-                    guint8      *dir)
+/*  the optimal path search  */
+
+static ISearchBlock *
+search_get_block (ISearch *search,
+                  gint     x,
+                  gint     y)
 {
-  static gint   cur_tilex;
-  static gint   cur_tiley;
-  const guint8 *p;
+  ISearchBlock **block;
+  gint           block_x = x / SEARCH_BLOCK_SIZE;
+  gint           block_y = y / SEARCH_BLOCK_SIZE;
+
+  block = &search->blocks[block_y * search->n_blocks_x + block_x];
 
-  if (! cur_tile ||
-      x / TILE_WIDTH != cur_tilex ||
-      y / TILE_HEIGHT != cur_tiley)
+  if (! *block)
     {
-      if (cur_tile)
-        tile_release (cur_tile, FALSE);
+      GeglRectangle rect;
 
-      cur_tile = tile_manager_get_tile (map, x, y, TRUE, FALSE);
+      rect.x      = block_x * SEARCH_BLOCK_SIZE;
+      rect.y      = block_y * SEARCH_BLOCK_SIZE;
+      rect.width  = MIN (SEARCH_BLOCK_SIZE, search->width  - rect.x);
+      rect.height = MIN (SEARCH_BLOCK_SIZE, search->height - rect.y);
 
-      if (!cur_tile)
-        return FALSE;
+      *block = g_new (ISearchBlock, 1);
+
+      memset ((*block)->cost, 0xff, sizeof ((*block)->cost));
+      memset ((*block)->link, LINK_NONE, sizeof ((*block)->link));
+
+      /*  this is where the gradient map gets filled  */
+      g_mutex_lock (search->gradient_mutex);
 
-      cur_tilex = x / TILE_WIDTH;
-      cur_tiley = y / TILE_HEIGHT;
+      gegl_buffer_get (search->gradient_map, &rect, 1.0,
+                       gimp_tile_handler_iscissors_get_format (),
+                       (*block)->gradient, SEARCH_BLOCK_SIZE * 2,
+                       GEGL_ABYSS_NONE);
+
+      g_mutex_unlock (search->gradient_mutex);
     }
 
-  p = tile_data_pointer (cur_tile, x, y);
+  return *block;
+}
 
-  *grad = p[0];
-  *dir  = p[1];
+static inline gint
+search_get_index (gint x,
+                  gint y)
+{
+  return (y % SEARCH_BLOCK_SIZE) * SEARCH_BLOCK_SIZE + (x % SEARCH_BLOCK_SIZE);
+}
 
-  return TRUE;
+static void
+search_push (ISearch *search,
+             gint     x,
+             gint     y,
+             guint32  cost)
+{
+  ISearchPixel pixel = { x, y };
+
+  g_array_append_val (search->buckets[cost % SEARCH_N_BUCKETS], pixel);
+
+  search->n_queued++;
 }
 
+/*  the cost of the link from pixel (x, y), which is at @index in
+ *  @block, to its neighbour (nx, ny) in direction @link
+ */
 static gint
-calculate_link (TileManager *gradient_map,
-                gint         x,
-                gint         y,
-                guint32      pixel,
-                gint         link)
+calculate_link (ISearch      *search,
+                ISearchBlock *block,
+                gint          index,
+                gint          nx,
+                gint          ny,
+                gint          link)
 {
-  gint   value = 0;
-  guint8 grad1, dir1, grad2, dir2;
+  ISearchBlock *nblock = search_get_block (search, nx, ny);
+  gint          value  = 0;
+  guint8        grad1, dir1, dir2;
 
-  if (!gradient_map_value (gradient_map, x, y, &grad1, &dir1))
-    {
-      grad1 = 0;
-      dir1 = 255;
-    }
+  grad1 = block->gradient[index * 2];
+  dir1  = block->gradient[index * 2 + 1];
+  dir2  = nblock->gradient[search_get_index (nx, ny) * 2 + 1];
 
   /* Convert the gradient into a cost: large gradients are good, and
    * so have low cost. */
@@ -1455,59 +1592,190 @@ calculate_link (TileManager *gradient_map,
     value += grad1 * OMEGA_G;
 
   /*  calculate the contribution of the gradient direction  */
-  x += (gint8)(pixel & 0xff);
-  y += (gint8)((pixel & 0xff00) >> 8);
-
-  if (!gradient_map_value (gradient_map, x, y, &grad2, &dir2))
-    {
-      grad2 = 0;
-      dir2 = 255;
-    }
-
   value +=
     (direction_value[dir1][link] + direction_value[dir2][link]) * OMEGA_D;
 
   return value;
 }
 
+static ISearch *
+search_new (GeglBuffer *gradient_map,
+            GMutex     *gradient_mutex,
+            gint        seed_x,
+            gint        seed_y)
+{
+  const GeglRectangle *extent = gegl_buffer_get_extent (gradient_map);
+  ISearch             *search;
+  ISearchBlock        *block;
+  gint                 index;
+  gint                 i;
 
-static GPtrArray *
-plot_pixels (GimpIscissorsTool *iscissors,
-             GimpTempBuf       *dp_buf,
-             gint               x1,
-             gint               y1,
-             gint               xs,
-             gint               ys,
-             gint               xe,
-             gint               ye)
+  search = g_slice_new0 (ISearch);
+
+  search->gradient_map   = g_object_ref (gradient_map);
+  search->gradient_mutex = gradient_mutex;
+  search->width          = extent->width;
+  search->height         = extent->height;
+  search->seed_x         = seed_x;
+  search->seed_y         = seed_y;
+
+  search->n_blocks_x = (search->width  + SEARCH_BLOCK_SIZE - 1) /
+                       SEARCH_BLOCK_SIZE;
+  search->n_blocks_y = (search->height + SEARCH_BLOCK_SIZE - 1) /
+                       SEARCH_BLOCK_SIZE;
+
+  search->blocks = g_new0 (ISearchBlock *,
+                           search->n_blocks_x * search->n_blocks_y);
+
+  for (i = 0; i < SEARCH_N_BUCKETS; i++)
+    search->buckets[i] = g_array_new (FALSE, FALSE, sizeof (ISearchPixel));
+
+  block = search_get_block (search, seed_x, seed_y);
+  index = search_get_index (seed_x, seed_y);
+
+  block->cost[index] = 0;
+  block->link[index] = SEED_POINT;
+
+  search_push (search, seed_x, seed_y, 0);
+
+  return search;
+}
+
+static void
+search_free (ISearch *search)
 {
-  gint       x, y;
-  guint32    coords;
-  gint       link;
-  gint       width = gimp_temp_buf_get_width (dp_buf);
-  guint     *data;
-  GPtrArray *list;
+  gint i;
+
+  for (i = 0; i < search->n_blocks_x * search->n_blocks_y; i++)
+    g_free (search->blocks[i]);
+
+  g_free (search->blocks);
+
+  for (i = 0; i < SEARCH_N_BUCKETS; i++)
+    g_array_free (search->buckets[i], TRUE);
+
+  g_object_unref (search->gradient_map);
+
+  g_slice_free (ISearch, search);
+}
+
+/*  extends the search until the optimal path to (x, y) is known, or
+ *  until @max_pixels more pixels have been settled, if @max_pixels is
+ *  not negative, or until @abort gets set, if it is not NULL.  returns
+ *  whether the path is known.
+ */
+static gboolean
+search_run (ISearch *search,
+            gint     x,
+            gint     y,
+            gint     max_pixels,
+            gint    *abort)
+{
+  ISearchBlock *target       = search_get_block (search, x, y);
+  gint          target_index = search_get_index (x, y);
+  gint          n_settled    = 0;
+
+  while (! (target->link[target_index] & LINK_SETTLED))
+    {
+      GArray       *bucket;
+      ISearchPixel  pixel;
+      ISearchBlock *block;
+      gint          index;
+      gint          k;
+
+      if (max_pixels == 0 || search->n_queued == 0)
+        return FALSE;
+
+      bucket = search->buckets[search->cur_cost % SEARCH_N_BUCKETS];
+
+      if (bucket->len == 0)
+        {
+          search->cur_cost++;
+          continue;
+        }
+
+      pixel = g_array_index (bucket, ISearchPixel, bucket->len - 1);
+      g_array_set_size (bucket, bucket->len - 1);
+      search->n_queued--;
 
-  /*  Start the data pointer at the correct location  */
-  data = (guint *) gimp_temp_buf_get_data (dp_buf) + (ye - y1) * width + (xe - x1);
+      block = search_get_block (search, pixel.x, pixel.y);
+      index = search_get_index (pixel.x, pixel.y);
 
-  x = xe;
-  y = ye;
+      /*  skip pixels that were queued again with a lower cost  */
+      if ((block->link[index] & LINK_SETTLED) ||
+          block->cost[index] != search->cur_cost)
+        continue;
 
-  list = g_ptr_array_new ();
+      block->link[index] |= LINK_SETTLED;
+
+      if (max_pixels > 0)
+        max_pixels--;
+
+      if (abort && ++n_settled % SEARCH_ABORT_SIZE == 0 &&
+          g_atomic_int_get (abort))
+        return FALSE;
+
+      /*  see if any neighbour gets a lower cost through this pixel  */
+      for (k = 0; k < 8; k++)
+        {
+          ISearchBlock *nblock;
+          gint          nx = pixel.x + move[k][0];
+          gint          ny = pixel.y + move[k][1];
+          gint          nindex;
+          guint32       cost;
+
+          if (nx < 0 || nx >= search->width ||
+              ny < 0 || ny >= search->height)
+            continue;
+
+          nblock = search_get_block (search, nx, ny);
+          nindex = search_get_index (nx, ny);
+
+          if (nblock->link[nindex] & LINK_SETTLED)
+            continue;
+
+          cost = search->cur_cost +
+                 calculate_link (search, nblock, nindex,
+                                 pixel.x, pixel.y, k & 3);
+
+          if (cost < nblock->cost[nindex])
+            {
+              /*  link the neighbour back to this pixel  */
+              nblock->cost[nindex] = cost;
+              nblock->link[nindex] = (k + 4) & 7;
+
+              search_push (search, nx, ny, cost);
+            }
+        }
+    }
+
+  return TRUE;
+}
+
+/*  returns the pixels of the optimal path from (x, y) back to the
+ *  seed point, which must be known already
+ */
+static GPtrArray *
+search_get_path (ISearch *search,
+                 gint     x,
+                 gint     y)
+{
+  GPtrArray *list = g_ptr_array_new ();
 
   while (TRUE)
     {
-      coords = (y << 16) + x;
-      g_ptr_array_add (list, GINT_TO_POINTER (coords));
+      ISearchBlock *block = search_get_block (search, x, y);
+      gint          link;
+
+      g_ptr_array_add (list, GINT_TO_POINTER ((y << 16) + x));
 
-      link = PIXEL_DIR (*data);
-      if (link == SEED_POINT)
+      link = block->link[search_get_index (x, y)] & ~LINK_SETTLED;
+
+      if (link == SEED_POINT || link == LINK_NONE)
         return list;
 
       x += move[link][0];
       y += move[link][1];
-      data += move[link][1] * width + move[link][0];
     }
 
   /*  won't get here  */
@@ -1515,369 +1783,225 @@ plot_pixels (GimpIscissorsTool *iscissors,
 }
 
 
-#define PACK(x, y) ((((y) & 0xff) << 8) | ((x) & 0xff))
-#define OFFSET(pixel) ((gint8)((pixel) & 0xff) + \
-                       ((gint8)(((pixel) & 0xff00) >> 8)) * gimp_temp_buf_get_width (dp_buf))
+/*  the livewire worker  */
+
+static IWorker *
+worker_new (GimpIscissorsTool *iscissors,
+            gint               seed_x,
+            gint               seed_y)
+{
+  GimpImage *image = gimp_display_get_image (GIMP_TOOL (iscissors)->display);
+  IWorker   *worker;
+
+  if (! iscissors->gradient_map)
+    gradient_map_create (iscissors, image);
+
+  worker = g_slice_new0 (IWorker);
+
+  worker->iscissors = iscissors;
+  worker->search    = search_new (iscissors->gradient_map,
+                                  &iscissors->gradient_mutex,
+                                  seed_x, seed_y);
+  worker->target_x  = seed_x;
+  worker->target_y  = seed_y;
 
+  g_mutex_init (&worker->mutex);
+  g_cond_init (&worker->cond);
+
+  worker->thread = g_thread_new ("iscissors",
+                                 (GThreadFunc) worker_thread, worker);
+
+  return worker;
+}
 
 static void
-find_optimal_path (TileManager *gradient_map,
-                   GimpTempBuf *dp_buf,
-                   gint         x1,
-                   gint         y1,
-                   gint         x2,
-                   gint         y2,
-                   gint         xs,
-                   gint         ys)
+worker_free (IWorker *worker)
 {
-  gint     i, j, k;
-  gint     x, y;
-  gint     link;
-  gint     linkdir;
-  gint     dirx, diry;
-  gint     min_cost;
-  gint     new_cost;
-  gint     offset;
-  gint     cum_cost[8];
-  gint     link_cost[8];
-  gint     pixel_cost[8];
-  guint32  pixel[8];
-  guint32 *data;
-  guint32 *d;
-  gint     dp_buf_width  = gimp_temp_buf_get_width  (dp_buf);
-  gint     dp_buf_height = gimp_temp_buf_get_height (dp_buf);
-
-  /*  initialize the dynamic programming buffer  */
-  data = (guint32 *) gimp_temp_buf_data_clear (dp_buf);
-
-  /*  what directions are we filling the array in according to?  */
-  dirx = (xs - x1 == 0) ? 1 : -1;
-  diry = (ys - y1 == 0) ? 1 : -1;
-  linkdir = (dirx * diry);
-
-  y = ys;
-
-  for (i = 0; i < dp_buf_height; i++)
-    {
-      x = xs;
+  g_mutex_lock (&worker->mutex);
 
-      d = data + (y-y1) * dp_buf_width + (x-x1);
+  worker->quit = TRUE;
+  g_atomic_int_set (&worker->abort, TRUE);
+  g_cond_broadcast (&worker->cond);
 
-      for (j = 0; j < dp_buf_width; j++)
-        {
-          min_cost = G_MAXINT;
-
-          /* pixel[] array encodes how to get to a neighbour, if possible.
-           * 0 means no connection (eg edge).
-           * Rest packed as bottom two bytes: y offset then x offset.
-           * Initially, we assume we can't get anywhere. */
-          for (k = 0; k < 8; k++)
-            pixel[k] = 0;
-
-          /*  Find the valid neighboring pixels  */
-          /*  the previous pixel  */
-          if (j)
-            pixel[((dirx == 1) ? 4 : 0)] = PACK (-dirx, 0);
-
-          /*  the previous row of pixels  */
-          if (i)
-            {
-              pixel[((diry == 1) ? 5 : 1)] = PACK (0, -diry);
+  g_mutex_unlock (&worker->mutex);
 
-              link = (linkdir == 1) ? 3 : 2;
-              if (j)
-                pixel[((diry == 1) ? (link + 4) : link)] = PACK(-dirx, -diry);
+  g_thread_join (worker->thread);
 
-              link = (linkdir == 1) ? 2 : 3;
-              if (j != dp_buf_width - 1)
-                pixel[((diry == 1) ? (link + 4) : link)] = PACK (dirx, -diry);
-            }
+  if (worker->idle_id)
+    g_source_remove (worker->idle_id);
 
-          /*  find the minimum cost of going through each neighbor to reach the
-           *  seed point...
-           */
-          link = -1;
-          for (k = 0; k < 8; k ++)
-            if (pixel[k])
-              {
-                link_cost[k] = calculate_link (gradient_map,
-                                               xs + j*dirx, ys + i*diry,
-                                               pixel [k],
-                                               ((k > 3) ? k - 4 : k));
-                offset = OFFSET (pixel [k]);
-                pixel_cost[k] = PIXEL_COST (d[offset]);
-                cum_cost[k] = pixel_cost[k] + link_cost[k];
-                if (cum_cost[k] < min_cost)
-                  {
-                    min_cost = cum_cost[k];
-                    link = k;
-                  }
-              }
-
-          /*  If anything can be done...  */
-          if (link >= 0)
-            {
-              /*  set the cumulative cost of this pixel and the new direction  */
-              *d = (cum_cost[link] << 8) + link;
+  if (worker->result)
+    iscissors_free_curve (worker->result);
 
-              /*  possibly change the links from the other pixels to this pixel...
-               *  these changes occur if a neighboring pixel will receive a lower
-               *  cumulative cost by going through this pixel.
-               */
-              for (k = 0; k < 8; k ++)
-                if (pixel[k] && k != link)
-                  {
-                    /*  if the cumulative cost at the neighbor is greater than
-                     *  the cost through the link to the current pixel, change the
-                     *  neighbor's link to point to the current pixel.
-                     */
-                    new_cost = link_cost[k] + cum_cost[link];
-                    if (pixel_cost[k] > new_cost)
-                    {
-                      /*  reverse the link direction   /-----------------------\ */
-                      offset = OFFSET (pixel[k]);
-                      d[offset] = (new_cost << 8) + ((k > 3) ? k - 4 : k + 4);
-                    }
-                  }
-            }
-          /*  Set the seed point  */
-          else if (!i && !j)
-            *d = SEED_POINT;
+  search_free (worker->search);
 
-          /*  increment the data pointer and the x counter  */
-          d += dirx;
-          x += dirx;
-        }
+  g_cond_clear (&worker->cond);
+  g_mutex_clear (&worker->mutex);
 
-      /*  increment the y counter  */
-      y += diry;
-    }
+  g_slice_free (IWorker, worker);
 }
 
-
-/* Called to fill in a newly referenced tile in the gradient map */
 static void
-gradmap_tile_validate (TileManager *tm,
-                       Tile        *tile,
-                       GimpImage   *image)
+worker_set_target (IWorker *worker,
+                   gint     x,
+                   gint     y)
 {
-  GimpPickable *pickable;
-  const Babl   *pickable_format;
-  GeglBuffer   *src_buffer;
-  Tile         *srctile;
-  PixelRegion   srcPR;
-  PixelRegion   destPR;
-  gint          x, y;
-  gint          dw, dh;
-  gint          sw, sh;
-  gint          i, j;
-  gint          b;
-  gfloat        gradient;
-  guint8       *tiledata;
-  guint8       *gradmap;
-
-  tile_manager_get_tile_coordinates (tm, tile, &x, &y);
-
-  dw = tile_ewidth (tile);
-  dh = tile_eheight (tile);
+  g_mutex_lock (&worker->mutex);
 
-  pickable = GIMP_PICKABLE (gimp_image_get_projection (image));
+  x = CLAMP (x, 0, worker->search->width  - 1);
+  y = CLAMP (y, 0, worker->search->height - 1);
 
-  gimp_pickable_flush (pickable);
+  if (x != worker->target_x || y != worker->target_y ||
+      ! worker->iscissors->livewire)
+    {
+      worker->target_x = x;
+      worker->target_y = y;
+      worker->pending  = TRUE;
 
-  /* get corresponding tile in the image */
-  src_buffer = gimp_pickable_get_buffer (pickable);
-  srctile = tile_manager_get_tile (gimp_gegl_buffer_get_tiles (src_buffer),
-                                   x, y, TRUE, FALSE);
-  if (! srctile)
-    return;
+      /*  stop searching for the old target  */
+      g_atomic_int_set (&worker->abort, TRUE);
 
-  sw = tile_ewidth (srctile);
-  sh = tile_eheight (srctile);
+      g_cond_broadcast (&worker->cond);
+    }
 
-  pickable_format = gimp_pickable_get_format (pickable);
+  g_mutex_unlock (&worker->mutex);
+}
 
-  pixel_region_init_data (&srcPR,
-                          tile_data_pointer (srctile, 0, 0),
-                          babl_format_get_bytes_per_pixel (pickable_format),
-                          babl_format_get_bytes_per_pixel (pickable_format) *
-                          MIN (dw, sw),
-                          0, 0, MIN (dw, sw), MIN (dh, sh));
+/*  makes the worker find the path to (x, y), waits for it, and returns
+ *  the path
+ */
+static GPtrArray *
+worker_get_path (IWorker *worker,
+                 gint     x,
+                 gint     y)
+{
+  GPtrArray *path;
 
+  g_mutex_lock (&worker->mutex);
 
-  /* XXX tile edges? */
+  if (x != worker->target_x || y != worker->target_y)
+    {
+      worker->target_x = x;
+      worker->target_y = y;
+      worker->pending  = TRUE;
 
-  /*  Blur the source to get rid of noise  */
-  pixel_region_init_data (&destPR, maxgrad_conv0, 4, TILE_WIDTH * 4,
-                          0, 0, srcPR.w, srcPR.h);
-  convolve_region (&srcPR, &destPR, blur_32, 3, 32, GIMP_NORMAL_CONVOL, FALSE);
+      g_atomic_int_set (&worker->abort, TRUE);
 
-  /*  Use the blurred region as the new source pixel region  */
-  pixel_region_init_data (&srcPR, maxgrad_conv0, 4, TILE_WIDTH * 4,
-                          0, 0, srcPR.w, srcPR.h);
+      g_cond_broadcast (&worker->cond);
+    }
 
-  /*  Get the horizontal derivative  */
-  pixel_region_init_data (&destPR, maxgrad_conv1, 4, TILE_WIDTH * 4,
-                          0, 0, srcPR.w, srcPR.h);
-  convolve_region (&srcPR, &destPR, horz_deriv, 3, 1, GIMP_NEGATIVE_CONVOL,
-                   FALSE);
+  while (worker->pending || worker->busy)
+    g_cond_wait (&worker->cond, &worker->mutex);
 
-  /*  Get the vertical derivative  */
-  pixel_region_init_data (&destPR, maxgrad_conv2, 4, TILE_WIDTH * 4,
-                          0, 0, srcPR.w, srcPR.h);
-  convolve_region (&srcPR, &destPR, vert_deriv, 3, 1, GIMP_NEGATIVE_CONVOL,
-                   FALSE);
+  /*  the worker doesn't touch the search while it is idle  */
+  path = search_get_path (worker->search, x, y);
 
-  /* calculate overall gradient */
-  tiledata = tile_data_pointer (tile, 0, 0);
+  g_mutex_unlock (&worker->mutex);
 
-  for (i = 0; i < srcPR.h; i++)
-    {
-      const guint8 *datah = maxgrad_conv1 + srcPR.rowstride * i;
-      const guint8 *datav = maxgrad_conv2 + srcPR.rowstride * i;
+  return path;
+}
 
-      gradmap = tiledata + tile_ewidth (tile) * COST_WIDTH * i;
+/*  extends the search a chunk at a time, with the mutex released, and
+ *  hands each path found over to the main thread
+ */
+static gpointer
+worker_thread (IWorker *worker)
+{
+  g_mutex_lock (&worker->mutex);
+
+  while (! worker->quit)
+    {
+      gint       x = worker->target_x;
+      gint       y = worker->target_y;
+      gboolean   found;
+      GPtrArray *points = NULL;
 
-      for (j = 0; j < srcPR.w; j++)
+      if (! worker->pending)
         {
-          gint8 hmax = datah[0] - 128;
-          gint8 vmax = datav[0] - 128;
+          g_cond_wait (&worker->cond, &worker->mutex);
+          continue;
+        }
 
-          for (b = 1; b < srcPR.bytes; b++)
-            {
-              if (abs (datah[b] - 128) > abs (hmax))
-                hmax = datah[b] - 128;
+      g_atomic_int_set (&worker->abort, FALSE);
+      worker->busy = TRUE;
 
-              if (abs (datav[b] - 128) > abs (vmax))
-                vmax = datav[b] - 128;
-            }
+      g_mutex_unlock (&worker->mutex);
 
-          if (i == 0 || j == 0 || i == srcPR.h-1 || j == srcPR.w-1)
-            {
-              gradmap[j * COST_WIDTH + 0] = 0;
-              gradmap[j * COST_WIDTH + 1] = 255;
-              goto contin;
-            }
+      found = search_run (worker->search, x, y, SEARCH_CHUNK_SIZE,
+                          &worker->abort);
 
-          /* 1 byte absolute magnitude first */
-          gradient = sqrt (SQR (hmax) + SQR (vmax));
-          gradmap[j * COST_WIDTH] = gradient * 255 / MAX_GRADIENT;
+      if (found)
+        points = search_get_path (worker->search, x, y);
 
-          /* then 1 byte direction */
-          if (gradient > MIN_GRADIENT)
-            {
-              gfloat direction;
-
-              if (!hmax)
-                direction = (vmax > 0) ? G_PI_2 : -G_PI_2;
-              else
-                direction = atan ((gdouble) vmax / (gdouble) hmax);
-
-              /* Scale the direction from between 0 and 254,
-               *  corresponding to -PI/2, PI/2 255 is reserved for
-               *  d9irectionless pixels */
-              gradmap[j * COST_WIDTH + 1] =
-                (guint8) (254 * (direction + G_PI_2) / G_PI);
-            }
-          else
-            {
-              gradmap[j * COST_WIDTH + 1] = 255; /* reserved for weak gradient */
-            }
+      g_mutex_lock (&worker->mutex);
 
-        contin:
-          datah += srcPR.bytes;
-          datav += srcPR.bytes;
+      worker->busy = FALSE;
+
+      if (x != worker->target_x || y != worker->target_y)
+        {
+          /*  the target changed meanwhile, start over  */
+          if (points)
+            g_ptr_array_free (points, TRUE);
         }
-    }
+      else if (found)
+        {
+          if (! worker->result)
+            worker->result = g_slice_new0 (ICurve);
+          else if (worker->result->points)
+            g_ptr_array_free (worker->result->points, TRUE);
 
-  tile_release (srctile, FALSE);
-}
+          worker->result->x1     = worker->search->seed_x;
+          worker->result->y1     = worker->search->seed_y;
+          worker->result->x2     = x;
+          worker->result->y2     = y;
+          worker->result->points = points;
 
-static TileManager *
-gradient_map_new (GimpImage *image)
-{
-  TileManager *tm;
+          worker->pending = FALSE;
 
-  tm = tile_manager_new (gimp_image_get_width  (image),
-                         gimp_image_get_height (image),
-                         sizeof (guint8) * COST_WIDTH);
+          if (! worker->idle_id)
+            worker->idle_id = g_idle_add ((GSourceFunc) worker_idle, worker);
+        }
+      else if (worker->search->n_queued == 0)
+        {
+          /*  can't happen, but don't spin if it does  */
+          worker->pending = FALSE;
+        }
+
+      /*  wake up worker_get_path()  */
+      g_cond_broadcast (&worker->cond);
+    }
 
-  tile_manager_set_validate_proc (tm,
-                                  (TileValidateProc) gradmap_tile_validate,
-                                  image);
+  g_mutex_unlock (&worker->mutex);
 
-  return tm;
+  return NULL;
 }
 
-static void
-find_max_gradient (GimpIscissorsTool *iscissors,
-                   GimpImage         *image,
-                   gint              *x,
-                   gint              *y)
+static gboolean
+worker_idle (IWorker *worker)
 {
-  PixelRegion  srcPR;
-  gint         radius;
-  gint         i, j;
-  gint         endx, endy;
-  gint         cx, cy;
-  gint         x1, y1, x2, y2;
-  gpointer     pr;
-  gfloat       max_gradient;
-
-  /* Initialise the gradient map tile manager for this image if we
-   * don't already have one. */
-  if (! iscissors->gradient_map)
-    iscissors->gradient_map = gradient_map_new (image);
+  GimpIscissorsTool *iscissors = worker->iscissors;
+  ICurve            *curve;
 
-  radius = GRADIENT_SEARCH >> 1;
+  g_mutex_lock (&worker->mutex);
 
-  /*  calculate the extent of the search  */
-  cx = CLAMP (*x, 0, gimp_image_get_width  (image));
-  cy = CLAMP (*y, 0, gimp_image_get_height (image));
-  x1 = CLAMP (cx - radius, 0, gimp_image_get_width  (image));
-  y1 = CLAMP (cy - radius, 0, gimp_image_get_height (image));
-  x2 = CLAMP (cx + radius, 0, gimp_image_get_width  (image));
-  y2 = CLAMP (cy + radius, 0, gimp_image_get_height (image));
-  /*  calculate the factor to multiply the distance from the cursor by  */
+  curve = worker->result;
 
-  max_gradient = 0;
-  *x = cx;
-  *y = cy;
+  worker->result  = NULL;
+  worker->idle_id = 0;
 
-  /*  Find the point of max gradient  */
-  pixel_region_init (&srcPR, iscissors->gradient_map,
-                     x1, y1, x2 - x1, y2 - y1, FALSE);
+  g_mutex_unlock (&worker->mutex);
 
-  /* this iterates over 1, 2 or 4 tiles only */
-  for (pr = pixel_regions_register (1, &srcPR);
-       pr != NULL;
-       pr = pixel_regions_process (pr))
+  if (curve)
     {
-      endx = srcPR.x + srcPR.w;
-      endy = srcPR.y + srcPR.h;
-
-      for (i = srcPR.y; i < endy; i++)
-        {
-          const guint8 *gradient = srcPR.data + srcPR.rowstride * (i - srcPR.y);
-
-          for (j = srcPR.x; j < endx; j++)
-            {
-              gfloat g = *gradient;
-
-              gradient += COST_WIDTH;
+      gimp_draw_tool_pause (GIMP_DRAW_TOOL (iscissors));
 
-              g *= distance_weights [(i-y1) * GRADIENT_SEARCH + (j-x1)];
+      if (iscissors->livewire)
+        iscissors_free_curve (iscissors->livewire);
 
-              if (g > max_gradient)
-                {
-                  max_gradient = g;
+      iscissors->livewire = curve;
 
-                  *x = j;
-                  *y = i;
-                }
-            }
-        }
+      gimp_draw_tool_resume (GIMP_DRAW_TOOL (iscissors));
     }
-}
 
-#endif
+  return FALSE;
+}
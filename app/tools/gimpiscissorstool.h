@@ -15,8 +15,6 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#if 0
-
 #ifndef __GIMP_ISCISSORS_TOOL_H__
 #define __GIMP_ISCISSORS_TOOL_H__
 
@@ -44,7 +42,8 @@ typedef enum
   ISCISSORS_OP_IMPOSSIBLE
 } IscissorsOps;
 
-typedef struct _ICurve ICurve;
+typedef struct _ICurve  ICurve;
+typedef struct _IWorker IWorker;
 
 
 #define GIMP_TYPE_ISCISSORS_TOOL            (gimp_iscissors_tool_get_type ())
@@ -70,8 +69,6 @@ struct _GimpIscissorsTool
   gint            ix, iy;       /*  initial coordinates                   */
   gint            nx, ny;       /*  new coordinates                       */
 
-  GimpTempBuf    *dp_buf;       /*  dynamic programming buffer            */
-
   ICurve         *livewire;     /*  livewire boundary curve               */
 
   ICurve         *curve1;       /*  1st curve connected to current point  */
@@ -86,7 +83,9 @@ struct _GimpIscissorsTool
 
   /* XXX might be useful */
   GimpChannel    *mask;         /*  selection mask                        */
-  TileManager    *gradient_map; /*  lazily filled gradient map            */
+  GeglBuffer     *gradient_map; /*  lazily filled gradient map            */
+  GMutex          gradient_mutex;
+  IWorker        *worker;       /*  livewire search thread                */
 };
 
 struct _GimpIscissorsToolClass
@@ -102,5 +101,3 @@ GType   gimp_iscissors_tool_get_type (void) G_GNUC_CONST;
 
 
 #endif  /*  __GIMP_ISCISSORS_TOOL_H__  */
-
-#endif
@@ -0,0 +1,422 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "tools-types.h"
+
+#include "gimptilehandleriscissors.h"
+
+
+#define  MAX_GRADIENT      179.606  /* == sqrt (127^2 + 127^2) */
+#define  MIN_GRADIENT      63       /* gradients < this are directionless */
+
+
+enum
+{
+  PROP_0,
+  PROP_FORMAT,
+  PROP_TILE_WIDTH,
+  PROP_TILE_HEIGHT
+};
+
+
+static void     gimp_tile_handler_iscissors_finalize     (GObject         *object);
+static void     gimp_tile_handler_iscissors_set_property (GObject         *object,
+                                                          guint            property_id,
+                                                          const GValue    *value,
+                                                          GParamSpec      *pspec);
+static void     gimp_tile_handler_iscissors_get_property (GObject         *object,
+                                                          guint            property_id,
+                                                          GValue          *value,
+                                                          GParamSpec      *pspec);
+
+static gpointer gimp_tile_handler_iscissors_command      (GeglTileSource  *source,
+                                                          GeglTileCommand  command,
+                                                          gint             x,
+                                                          gint             y,
+                                                          gint             z,
+                                                          gpointer         data);
+
+static void     gimp_tile_handler_iscissors_gradient     (GimpTileHandlerIscissors *iscissors,
+                                                          const GeglRectangle      *rect,
+                                                          guint8                   *data,
+                                                          gint                      stride);
+
+
+G_DEFINE_TYPE (GimpTileHandlerIscissors, gimp_tile_handler_iscissors,
+               GEGL_TYPE_TILE_HANDLER)
+
+#define parent_class gimp_tile_handler_iscissors_parent_class
+
+
+static const gint horz_deriv[9] =
+{
+   1,  0, -1,
+   2,  0, -2,
+   1,  0, -1,
+};
+
+static const gint vert_deriv[9] =
+{
+   1,  2,  1,
+   0,  0,  0,
+  -1, -2, -1,
+};
+
+static const gint blur_32[9] =
+{
+   1,  1,  1,
+   1, 24,  1,
+   1,  1,  1,
+};
+
+
+static void
+gimp_tile_handler_iscissors_class_init (GimpTileHandlerIscissorsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize     = gimp_tile_handler_iscissors_finalize;
+  object_class->set_property = gimp_tile_handler_iscissors_set_property;
+  object_class->get_property = gimp_tile_handler_iscissors_get_property;
+
+  g_object_class_install_property (object_class, PROP_FORMAT,
+                                   g_param_spec_pointer ("format", NULL, NULL,
+                                                         GIMP_PARAM_READWRITE));
+
+  g_object_class_install_property (object_class, PROP_TILE_WIDTH,
+                                   g_param_spec_int ("tile-width", NULL, NULL,
+                                                     1, G_MAXINT, 1,
+                                                     GIMP_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (object_class, PROP_TILE_HEIGHT,
+                                   g_param_spec_int ("tile-height", NULL, NULL,
+                                                     1, G_MAXINT, 1,
+                                                     GIMP_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+}
+
+static void
+gimp_tile_handler_iscissors_init (GimpTileHandlerIscissors *iscissors)
+{
+  GeglTileSource *source = GEGL_TILE_SOURCE (iscissors);
+
+  source->command = gimp_tile_handler_iscissors_command;
+}
+
+static void
+gimp_tile_handler_iscissors_finalize (GObject *object)
+{
+  GimpTileHandlerIscissors *iscissors = GIMP_TILE_HANDLER_ISCISSORS (object);
+
+  if (iscissors->src)
+    {
+      g_object_unref (iscissors->src);
+      iscissors->src = NULL;
+    }
+
+  g_free (iscissors->valid);
+  iscissors->valid = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gimp_tile_handler_iscissors_set_property (GObject      *object,
+                                          guint         property_id,
+                                          const GValue *value,
+                                          GParamSpec   *pspec)
+{
+  GimpTileHandlerIscissors *iscissors = GIMP_TILE_HANDLER_ISCISSORS (object);
+
+  switch (property_id)
+    {
+    case PROP_FORMAT:
+      iscissors->format = g_value_get_pointer (value);
+      break;
+    case PROP_TILE_WIDTH:
+      iscissors->tile_width = g_value_get_int (value);
+      break;
+    case PROP_TILE_HEIGHT:
+      iscissors->tile_height = g_value_get_int (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+gimp_tile_handler_iscissors_get_property (GObject    *object,
+                                          guint       property_id,
+                                          GValue     *value,
+                                          GParamSpec *pspec)
+{
+  GimpTileHandlerIscissors *iscissors = GIMP_TILE_HANDLER_ISCISSORS (object);
+
+  switch (property_id)
+    {
+    case PROP_FORMAT:
+      g_value_set_pointer (value, (gpointer) iscissors->format);
+      break;
+    case PROP_TILE_WIDTH:
+      g_value_set_int (value, iscissors->tile_width);
+      break;
+    case PROP_TILE_HEIGHT:
+      g_value_set_int (value, iscissors->tile_height);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static GeglTile *
+gimp_tile_handler_iscissors_validate (GeglTileSource *source,
+                                      GeglTile       *tile,
+                                      gint            x,
+                                      gint            y)
+{
+  GimpTileHandlerIscissors *iscissors = GIMP_TILE_HANDLER_ISCISSORS (source);
+  GeglRectangle             rect;
+  gint                      index;
+
+  if (! iscissors->valid)
+    {
+      iscissors->n_tiles_x = (iscissors->width  + iscissors->tile_width  - 1) /
+                             iscissors->tile_width;
+      iscissors->n_tiles_y = (iscissors->height + iscissors->tile_height - 1) /
+                             iscissors->tile_height;
+
+      iscissors->valid = g_new0 (guint8,
+                                 iscissors->n_tiles_x * iscissors->n_tiles_y);
+    }
+
+  if (x < 0 || x >= iscissors->n_tiles_x ||
+      y < 0 || y >= iscissors->n_tiles_y)
+    return tile;
+
+  index = y * iscissors->n_tiles_x + x;
+
+  if (iscissors->valid[index])
+    return tile;
+
+  rect.x      = x * iscissors->tile_width;
+  rect.y      = y * iscissors->tile_height;
+  rect.width  = MIN (iscissors->tile_width,  iscissors->width  - rect.x);
+  rect.height = MIN (iscissors->tile_height, iscissors->height - rect.y);
+
+  if (! tile)
+    tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (source),
+                                          x, y, 0);
+
+  gegl_tile_lock (tile);
+
+  gimp_tile_handler_iscissors_gradient (iscissors, &rect,
+                                        gegl_tile_get_data (tile),
+                                        iscissors->tile_width *
+                                        babl_format_get_bytes_per_pixel (iscissors->format));
+
+  gegl_tile_unlock (tile);
+
+  iscissors->valid[index] = TRUE;
+
+  return tile;
+}
+
+static gpointer
+gimp_tile_handler_iscissors_command (GeglTileSource  *source,
+                                     GeglTileCommand  command,
+                                     gint             x,
+                                     gint             y,
+                                     gint             z,
+                                     gpointer         data)
+{
+  gpointer retval;
+
+  retval = gegl_tile_handler_source_command (source, command, x, y, z, data);
+
+  if (command == GEGL_TILE_GET && z == 0)
+    retval = gimp_tile_handler_iscissors_validate (source, retval, x, y);
+
+  return retval;
+}
+
+/*  computes the gradient magnitude and direction of @rect into @data,
+ *  two bytes per pixel.  the source is blurred to get rid of noise,
+ *  and the strongest derivative of all channels is used.  the source
+ *  is read with a margin, so there are no seams between the tiles.
+ */
+static void
+gimp_tile_handler_iscissors_gradient (GimpTileHandlerIscissors *iscissors,
+                                      const GeglRectangle      *rect,
+                                      guint8                   *data,
+                                      gint                      stride)
+{
+  const gint  src_width   = rect->width  + 4;
+  const gint  src_height  = rect->height + 4;
+  const gint  blur_width  = rect->width  + 2;
+  const gint  blur_height = rect->height + 2;
+  guint8     *src;
+  guint8     *blur;
+  gint        x, y;
+  gint        i, j;
+  gint        b;
+
+  src  = g_new (guint8, src_width  * src_height  * 4);
+  blur = g_new (guint8, blur_width * blur_height * 4);
+
+  gegl_buffer_get (iscissors->src,
+                   GEGL_RECTANGLE (rect->x - 2, rect->y - 2,
+                                   src_width, src_height),
+                   1.0, babl_format ("R'G'B'A u8"), src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+
+  /*  blur the source to get rid of noise  */
+  for (y = 0; y < blur_height; y++)
+    {
+      guint8 *d = blur + y * blur_width * 4;
+
+      for (x = 0; x < blur_width; x++)
+        {
+          for (b = 0; b < 4; b++)
+            {
+              gint sum = 0;
+
+              for (i = 0; i < 3; i++)
+                {
+                  const guint8 *s = src + ((y + i) * src_width + x) * 4 + b;
+
+                  for (j = 0; j < 3; j++)
+                    sum += blur_32[i * 3 + j] * s[j * 4];
+                }
+
+              d[b] = sum / 32;
+            }
+
+          d += 4;
+        }
+    }
+
+  /*  calculate the overall gradient  */
+  for (y = 0; y < rect->height; y++)
+    {
+      guint8 *gradmap = data + y * stride;
+
+      for (x = 0; x < rect->width; x++)
+        {
+          gint   hmax = 0;
+          gint   vmax = 0;
+          gfloat gradient;
+
+          for (b = 0; b < 4; b++)
+            {
+              gint h = 0;
+              gint v = 0;
+
+              for (i = 0; i < 3; i++)
+                {
+                  const guint8 *s = blur + ((y + i) * blur_width + x) * 4 + b;
+
+                  for (j = 0; j < 3; j++)
+                    {
+                      h += horz_deriv[i * 3 + j] * s[j * 4];
+                      v += vert_deriv[i * 3 + j] * s[j * 4];
+                    }
+                }
+
+              h = CLAMP (h, -128, 127);
+              v = CLAMP (v, -128, 127);
+
+              if (abs (h) > abs (hmax))
+                hmax = h;
+
+              if (abs (v) > abs (vmax))
+                vmax = v;
+            }
+
+          /* 1 byte absolute magnitude first */
+          gradient = sqrt (SQR (hmax) + SQR (vmax));
+          gradmap[0] = MIN (gradient * 255 / MAX_GRADIENT, 255);
+
+          /* then 1 byte direction */
+          if (gradient > MIN_GRADIENT)
+            {
+              gfloat direction;
+
+              if (! hmax)
+                direction = (vmax > 0) ? G_PI_2 : -G_PI_2;
+              else
+                direction = atan ((gdouble) vmax / (gdouble) hmax);
+
+              /* Scale the direction from between 0 and 254,
+               *  corresponding to -PI/2, PI/2 255 is reserved for
+               *  directionless pixels */
+              gradmap[1] = (guint8) (254 * (direction + G_PI_2) / G_PI);
+            }
+          else
+            {
+              gradmap[1] = 255; /* reserved for weak gradient */
+            }
+
+          gradmap += 2;
+        }
+    }
+
+  g_free (blur);
+  g_free (src);
+}
+
+GeglTileHandler *
+gimp_tile_handler_iscissors_new (GeglBuffer *src)
+{
+  GimpTileHandlerIscissors *iscissors;
+  const GeglRectangle      *extent;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (src), NULL);
+
+  iscissors = g_object_new (GIMP_TYPE_TILE_HANDLER_ISCISSORS, NULL);
+
+  extent = gegl_buffer_get_extent (src);
+
+  iscissors->src    = g_object_ref (src);
+  iscissors->width  = extent->width;
+  iscissors->height = extent->height;
+
+  return GEGL_TILE_HANDLER (iscissors);
+}
+
+/*  the format of the gradient map: the gradient magnitude, and its
+ *  direction, or 255 for weak gradients
+ */
+const Babl *
+gimp_tile_handler_iscissors_get_format (void)
+{
+  return babl_format_n (babl_type ("u8"), 2);
+}
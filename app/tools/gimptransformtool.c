@@ -52,6 +52,7 @@
 #include "widgets/gimpwidgets-utils.h"
 
 #include "display/gimpcanvasgroup.h"
+#include "display/gimpcanvastransformpreview.h"
 #include "display/gimpdisplay.h"
 #include "display/gimpdisplayshell.h"
 #include "display/gimpdisplayshell-transform.h"
@@ -1535,6 +1536,9 @@ gimp_transform_tool_halt (GimpTransformTool *tr_tool)
       tr_tool->prev_trans_info = NULL;
     }
 
+  if (tool->drawable)
+    gimp_canvas_transform_preview_free_texture (tool->drawable);
+
   tool->display  = NULL;
   tool->drawable = NULL;
  }
@@ -24,10 +24,14 @@
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
 
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
 #include "libgimpwidgets/gimpwidgets.h"
 
 #include "tools-types.h"
 
+#include "gegl/gimp-gegl-apply-operation.h"
+
 #include "core/gimp.h"
 #include "core/gimpchannel.h"
 #include "core/gimpimage.h"
@@ -97,19 +101,17 @@ static void       gimp_warp_tool_start              (GimpWarpTool          *wt,
 static void       gimp_warp_tool_halt               (GimpWarpTool          *wt);
 
 static gboolean   gimp_warp_tool_stroke_timer       (GimpWarpTool          *wt);
+static void       gimp_warp_tool_stroke_segment     (GimpWarpTool          *wt,
+                                                     gdouble                x,
+                                                     gdouble                y);
 
 static void       gimp_warp_tool_create_graph       (GimpWarpTool          *wt);
 static void       gimp_warp_tool_create_image_map   (GimpWarpTool          *wt,
                                                      GimpDrawable          *drawable);
-static void       gimp_warp_tool_update_stroke      (GimpWarpTool          *wt,
-                                                     GeglNode              *node);
-static void       gimp_warp_tool_stroke_changed     (GeglPath              *stroke,
-                                                     const GeglRectangle   *roi,
-                                                     GimpWarpTool          *wt);
+static void       gimp_warp_tool_set_coords_buffer  (GimpWarpTool          *wt,
+                                                     GeglBuffer            *buffer);
 static void       gimp_warp_tool_image_map_flush    (GimpImageMap          *image_map,
                                                      GimpTool              *tool);
-static void       gimp_warp_tool_add_op             (GimpWarpTool          *wt,
-                                                     GeglNode              *new_op);
 
 
 G_DEFINE_TYPE (GimpWarpTool, gimp_warp_tool, GIMP_TYPE_DRAW_TOOL)
@@ -201,10 +203,9 @@ gimp_warp_tool_button_press (GimpTool            *tool,
                              GimpButtonPressType  press_type,
                              GimpDisplay         *display)
 {
-  GimpWarpTool    *wt      = GIMP_WARP_TOOL (tool);
-  GimpWarpOptions *options = GIMP_WARP_TOOL_GET_OPTIONS (wt);
-  GeglNode        *new_op;
-  gint             off_x, off_y;
+  GimpWarpTool *wt = GIMP_WARP_TOOL (tool);
+  GeglBuffer   *buffer;
+  gint          off_x, off_y;
 
   if (tool->display && display != tool->display)
     {
@@ -215,28 +216,22 @@ gimp_warp_tool_button_press (GimpTool            *tool,
   if (! tool->display)
     gimp_warp_tool_start (wt, display);
 
-  wt->current_stroke = gegl_path_new ();
-
-  new_op = gegl_node_new_child (NULL,
-                                "operation", "gegl:warp",
-                                "behavior",  options->behavior,
-                                "strength",  options->effect_strength,
-                                "size",      options->effect_size,
-                                "hardness",  options->effect_hardness,
-                                "stroke",    wt->current_stroke,
-                                NULL);
+  /*  keep the coords from before the stroke for undo, and warp a
+   *  copy, whose tiles are shared until they are changed
+   */
+  wt->undo_stack = g_list_prepend (wt->undo_stack,
+                                   g_object_ref (wt->coords_buffer));
 
-  gimp_warp_tool_add_op (wt, new_op);
-  g_object_unref (new_op);
-
-  g_signal_connect (wt->current_stroke, "changed",
-                    G_CALLBACK (gimp_warp_tool_stroke_changed),
-                    wt);
+  buffer = gegl_buffer_dup (wt->coords_buffer);
+  gimp_warp_tool_set_coords_buffer (wt, buffer);
+  g_object_unref (buffer);
 
   gimp_item_get_offset (GIMP_ITEM (tool->drawable), &off_x, &off_y);
 
-  gegl_path_append (wt->current_stroke,
-                    'M', coords->x - off_x, coords->y - off_y);
+  wt->last_x = coords->x - off_x;
+  wt->last_y = coords->y - off_y;
+
+  gimp_warp_tool_stroke_segment (wt, wt->last_x, wt->last_y);
 
   wt->stroke_timer = g_timeout_add (STROKE_PERIOD,
                                     (GSourceFunc) gimp_warp_tool_stroke_timer,
@@ -262,17 +257,6 @@ gimp_warp_tool_button_release (GimpTool              *tool,
   g_source_remove (wt->stroke_timer);
   wt->stroke_timer = 0;
 
-  g_signal_handlers_disconnect_by_func (wt->current_stroke,
-                                        gimp_warp_tool_stroke_changed,
-                                        wt);
-
-#ifdef WARP_DEBUG
-  g_printerr ("%s\n", gegl_path_to_string (wt->current_stroke));
-#endif
-
-  g_object_unref (wt->current_stroke);
-  wt->current_stroke = NULL;
-
   if (release_type == GIMP_BUTTON_RELEASE_CANCEL)
     {
       gimp_warp_tool_undo (tool, display);
@@ -424,16 +408,8 @@ gimp_warp_tool_get_undo_desc (GimpTool    *tool,
                               GimpDisplay *display)
 {
   GimpWarpTool *wt = GIMP_WARP_TOOL (tool);
-  GeglNode     *to_delete;
-  const gchar  *type;
 
-  if (! wt->render_node)
-    return NULL;
-
-  to_delete = gegl_node_get_producer (wt->render_node, "aux", NULL);
-  type = gegl_node_get_operation (to_delete);
-
-  if (strcmp (type, "gegl:warp"))
+  if (! wt->render_node || ! wt->undo_stack)
     return NULL;
 
   return _("Warp Tool Stroke");
@@ -456,30 +432,22 @@ gimp_warp_tool_undo (GimpTool    *tool,
                      GimpDisplay *display)
 {
   GimpWarpTool *wt = GIMP_WARP_TOOL (tool);
-  GeglNode     *to_delete;
-  GeglNode     *previous;
-  const gchar  *type;
+  GeglBuffer   *to_restore;
 
-  if (! wt->render_node)
+  if (! wt->render_node || ! wt->undo_stack)
     return FALSE;
 
-  to_delete = gegl_node_get_producer (wt->render_node, "aux", NULL);
-  type = gegl_node_get_operation (to_delete);
-
-  if (strcmp (type, "gegl:warp"))
-    return FALSE;
+  to_restore = wt->undo_stack->data;
 
-  previous = gegl_node_get_producer (to_delete, "input", NULL);
+  wt->redo_stack = g_list_prepend (wt->redo_stack,
+                                   g_object_ref (wt->coords_buffer));
 
-  gegl_node_disconnect (to_delete,       "input");
-  gegl_node_connect_to (previous,        "output",
-                        wt->render_node, "aux");
+  gimp_warp_tool_set_coords_buffer (wt, to_restore);
+  g_object_unref (to_restore);
 
-  wt->redo_stack = g_list_prepend (wt->redo_stack, g_object_ref (to_delete));
+  wt->undo_stack = g_list_remove_link (wt->undo_stack, wt->undo_stack);
 
-  gegl_node_remove_child (wt->graph, to_delete);
-
-  gimp_warp_tool_update_stroke (wt, to_delete);
+  gimp_image_map_apply (wt->image_map, NULL);
 
   return TRUE;
 }
@@ -489,19 +457,22 @@ gimp_warp_tool_redo (GimpTool    *tool,
                      GimpDisplay *display)
 {
   GimpWarpTool *wt = GIMP_WARP_TOOL (tool);
-  GeglNode     *to_add;
+  GeglBuffer   *to_restore;
 
   if (! wt->render_node || ! wt->redo_stack)
     return FALSE;
 
-  to_add = wt->redo_stack->data;
+  to_restore = wt->redo_stack->data;
+
+  wt->undo_stack = g_list_prepend (wt->undo_stack,
+                                   g_object_ref (wt->coords_buffer));
 
-  gimp_warp_tool_add_op (wt, to_add);
-  g_object_unref (to_add);
+  gimp_warp_tool_set_coords_buffer (wt, to_restore);
+  g_object_unref (to_restore);
 
   wt->redo_stack = g_list_remove_link (wt->redo_stack, wt->redo_stack);
 
-  gimp_warp_tool_update_stroke (wt, to_add);
+  gimp_image_map_apply (wt->image_map, NULL);
 
   return TRUE;
 }
@@ -568,6 +539,7 @@ gimp_warp_tool_halt (GimpWarpTool *wt)
     {
       g_object_unref (wt->graph);
       wt->graph       = NULL;
+      wt->coords_node = NULL;
       wt->render_node = NULL;
     }
 
@@ -580,6 +552,12 @@ gimp_warp_tool_halt (GimpWarpTool *wt)
       gimp_image_flush (gimp_display_get_image (tool->display));
     }
 
+  if (wt->undo_stack)
+    {
+      g_list_free_full (wt->undo_stack, (GDestroyNotify) g_object_unref);
+      wt->undo_stack = NULL;
+    }
+
   if (wt->redo_stack)
     {
       g_list_free_full (wt->redo_stack, (GDestroyNotify) g_object_unref);
@@ -597,16 +575,95 @@ static gboolean
 gimp_warp_tool_stroke_timer (GimpWarpTool *wt)
 {
   GimpTool *tool = GIMP_TOOL (wt);
+  gdouble   x;
+  gdouble   y;
   gint      off_x, off_y;
 
   gimp_item_get_offset (GIMP_ITEM (tool->drawable), &off_x, &off_y);
 
-  gegl_path_append (wt->current_stroke,
-                    'L', wt->cursor_x - off_x, wt->cursor_y - off_y);
+  x = wt->cursor_x - off_x;
+  y = wt->cursor_y - off_y;
+
+  /*  stamp on every tick, also when the pointer doesn't move, so
+   *  behaviors like grow, shrink and swirl keep working
+   */
+  gimp_warp_tool_stroke_segment (wt, x, y);
 
   return TRUE;
 }
 
+/*  warps the coords buffer along the stroke from the last position to
+ *  (x, y), and updates the preview only within reach of the brush
+ */
+static void
+gimp_warp_tool_stroke_segment (GimpWarpTool *wt,
+                               gdouble       x,
+                               gdouble       y)
+{
+  GimpWarpOptions     *options = GIMP_WARP_TOOL_GET_OPTIONS (wt);
+  const GeglRectangle *extent  = gegl_buffer_get_extent (wt->coords_buffer);
+  GeglPath            *stroke;
+  GeglNode            *node;
+  GeglBuffer          *area_buffer;
+  GeglRectangle        area;
+  gdouble              radius  = options->effect_size * 0.5;
+  gint                 x1, y1;
+  gint                 x2, y2;
+
+  x1 = floor (MIN (wt->last_x, x) - radius);
+  y1 = floor (MIN (wt->last_y, y) - radius);
+  x2 = ceil  (MAX (wt->last_x, x) + radius) + 1;
+  y2 = ceil  (MAX (wt->last_y, y) + radius) + 1;
+
+  if (gimp_rectangle_intersect (x1, y1, x2 - x1, y2 - y1,
+                                extent->x, extent->y,
+                                extent->width, extent->height,
+                                &area.x, &area.y,
+                                &area.width, &area.height))
+    {
+      stroke = gegl_path_new ();
+
+      gegl_path_append (stroke, 'M', wt->last_x, wt->last_y);
+      gegl_path_append (stroke, 'L', x, y);
+
+      node = gegl_node_new_child (NULL,
+                                  "operation", "gegl:warp",
+                                  "behavior",  options->behavior,
+                                  "strength",  options->effect_strength,
+                                  "size",      options->effect_size,
+                                  "hardness",  options->effect_hardness,
+                                  "stroke",    stroke,
+                                  NULL);
+
+      g_object_unref (stroke);
+
+#ifdef WARP_DEBUG
+      g_printerr ("update rect: (%d,%d), %dx%d\n",
+                  area.x, area.y, area.width, area.height);
+#endif
+
+      /*  gegl:warp reads around each pixel it writes, so it can't
+       *  work in place without depending on the order of its chunks
+       */
+      area_buffer = gegl_buffer_new (&area,
+                                     gegl_buffer_get_format (wt->coords_buffer));
+
+      gimp_gegl_apply_operation (wt->coords_buffer, NULL, NULL,
+                                 node,
+                                 area_buffer, &area);
+
+      gegl_buffer_copy (area_buffer, &area, wt->coords_buffer, &area);
+
+      g_object_unref (area_buffer);
+      g_object_unref (node);
+
+      gimp_image_map_apply (wt->image_map, &area);
+    }
+
+  wt->last_x = x;
+  wt->last_y = y;
+}
+
 static void
 gimp_warp_tool_create_graph (GimpWarpTool *wt)
 {
@@ -641,6 +698,7 @@ gimp_warp_tool_create_graph (GimpWarpTool *wt)
                         output, "input");
 
   wt->graph       = graph;
+  wt->coords_node = coords;
   wt->render_node = render;
 }
 
@@ -668,57 +726,19 @@ gimp_warp_tool_create_image_map (GimpWarpTool *wt,
 }
 
 static void
-gimp_warp_tool_update_stroke (GimpWarpTool *wt,
-                              GeglNode     *node)
-{
-  GeglPath *stroke;
-  gdouble   size;
-
-  gegl_node_get (node,
-                 "stroke", &stroke,
-                 "size",   &size,
-                 NULL);
-
-  if (stroke)
-    {
-      gdouble        min_x;
-      gdouble        max_x;
-      gdouble        min_y;
-      gdouble        max_y;
-      GeglRectangle  bbox;
-
-      gegl_path_get_bounds (stroke, &min_x, &max_x, &min_y, &max_y);
-      g_object_unref (stroke);
-
-      bbox.x      = min_x - size * 0.5;
-      bbox.y      = min_y - size * 0.5;
-      bbox.width  = max_x - min_x + size;
-      bbox.height = max_y - min_y + size;
-
-      gimp_image_map_apply (wt->image_map, &bbox);
-    }
-}
-
-static void
-gimp_warp_tool_stroke_changed (GeglPath            *path,
-                               const GeglRectangle *roi,
-                               GimpWarpTool        *wt)
+gimp_warp_tool_set_coords_buffer (GimpWarpTool *wt,
+                                  GeglBuffer   *buffer)
 {
-  GimpWarpOptions *options       = GIMP_WARP_TOOL_GET_OPTIONS (wt);
-  GeglRectangle    update_region = *roi;
+  g_object_ref (buffer);
 
-  update_region.x      -= options->effect_size * 0.5;
-  update_region.y      -= options->effect_size * 0.5;
-  update_region.width  += options->effect_size;
-  update_region.height += options->effect_size;
+  if (wt->coords_buffer)
+    g_object_unref (wt->coords_buffer);
 
-#ifdef WARP_DEBUG
-  g_printerr ("update rect: (%d,%d), %dx%d\n",
-              update_region.x, update_region.y,
-              update_region.width, update_region.height);
-#endif
+  wt->coords_buffer = buffer;
 
-  gimp_image_map_apply (wt->image_map, &update_region);
+  gegl_node_set (wt->coords_node,
+                 "buffer", buffer,
+                 NULL);
 }
 
 static void
@@ -729,22 +749,3 @@ gimp_warp_tool_image_map_flush (GimpImageMap *image_map,
 
   gimp_projection_flush (gimp_image_get_projection (image));
 }
-
-static void
-gimp_warp_tool_add_op (GimpWarpTool *wt,
-                       GeglNode     *new_op)
-{
-  GeglNode *last_op;
-
-  g_return_if_fail (GEGL_IS_NODE (wt->render_node));
-
-  gegl_node_add_child (wt->graph, new_op);
-
-  last_op = gegl_node_get_producer (wt->render_node, "aux", NULL);
-
-  gegl_node_disconnect (wt->render_node, "aux");
-  gegl_node_connect_to (last_op,         "output",
-                        new_op,          "input");
-  gegl_node_connect_to (new_op,          "output",
-                        wt->render_node, "aux");
-}
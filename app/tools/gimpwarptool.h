@@ -47,13 +47,16 @@ struct _GimpWarpTool
   GeglBuffer     *coords_buffer; /* Gegl buffer where coordinates are stored */
 
   GeglNode       *graph;         /* Top level GeglNode */
+  GeglNode       *coords_node;   /* Gegl node reading the coords buffer */
   GeglNode       *render_node;   /* Gegl node to render the transformation */
 
-  GeglPath       *current_stroke;
+  gdouble         last_x;        /* Where the stroke was last warped to */
+  gdouble         last_y;
   guint           stroke_timer;
 
   GimpImageMap   *image_map;
 
+  GList          *undo_stack;    /* Coords buffers from before each stroke */
   GList          *redo_stack;
 };
 
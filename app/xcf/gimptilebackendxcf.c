@@ -0,0 +1,666 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimptilebackendxcf.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <gegl.h>
+#include <glib/gstdio.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "core/core-types.h"
+
+#include "xcf-private.h"
+#include "xcf-load.h"
+
+#include "gimptilebackendxcf.h"
+
+#include "gimp-intl.h"
+
+
+/*  an XCF file which is kept open for loading tiles lazily, shared by
+ *  all the backends of the file's layers and channels
+ */
+struct _XcfTileFile
+{
+  gint      ref_count;
+  FILE     *fp;
+  gchar    *filename;
+  guint64   dev;
+  guint64   ino;
+  gint64    size;      /*  size and modification time when it was    */
+  gint64    mtime;     /*  opened, to notice when it gets overwritten  */
+  gboolean  changed;
+  GMutex    mutex;
+};
+
+struct _GimpTileBackendXcfPrivate
+{
+  XcfTileFile         *file;
+  XcfCompressionType   compression;
+  const Babl          *format;
+  gint                 bpp;
+  gint                 width;
+  gint                 height;
+  gint                 n_tile_cols;
+  gint                 n_tile_rows;
+  goffset             *offsets;  /*  '0' for tiles without data in the file  */
+  GeglBuffer          *storage;  /*  tiles which were stored or detached,   */
+  guchar              *stored;   /*  and which of them are in there          */
+  GRecMutex            mutex;
+  GWeakRef             weak_ref; /*  for gimp_tile_backend_xcf_detach_file()  */
+};
+
+
+static void     gimp_tile_backend_xcf_finalize  (GObject            *object);
+static gpointer gimp_tile_backend_xcf_command   (GeglTileSource     *source,
+                                                 GeglTileCommand     command,
+                                                 gint                x,
+                                                 gint                y,
+                                                 gint                z,
+                                                 gpointer            data);
+
+static gboolean gimp_tile_backend_xcf_read_tile (GimpTileBackendXcf *backend,
+                                                 gint                index,
+                                                 guchar             *dest);
+static void     gimp_tile_backend_xcf_tile_rect (GimpTileBackendXcf *backend,
+                                                 gint                index,
+                                                 GeglRectangle      *rect);
+static void     gimp_tile_backend_xcf_store     (GimpTileBackendXcf *backend,
+                                                 gint                index,
+                                                 const guchar       *src);
+static void     gimp_tile_backend_xcf_fetch     (GimpTileBackendXcf *backend,
+                                                 gint                index,
+                                                 guchar             *dest);
+static void     gimp_tile_backend_xcf_detach    (GimpTileBackendXcf *backend);
+
+static gboolean xcf_tile_file_changed_idle      (gchar              *filename);
+static gboolean xcf_tile_file_check             (XcfTileFile        *file);
+static gboolean xcf_tile_file_matches           (XcfTileFile        *file,
+                                                 const gchar        *filename,
+                                                 const GStatBuf     *stat_buf);
+
+
+G_DEFINE_TYPE (GimpTileBackendXcf, gimp_tile_backend_xcf,
+               GEGL_TYPE_TILE_BACKEND)
+
+#define parent_class gimp_tile_backend_xcf_parent_class
+
+
+/*  all backends, so the ones reading from a file can be detached from
+ *  it before the file is overwritten
+ */
+static GList  *backends = NULL;
+static GMutex  backends_mutex;
+
+
+static void
+gimp_tile_backend_xcf_class_init (GimpTileBackendXcfClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gimp_tile_backend_xcf_finalize;
+
+  g_type_class_add_private (klass, sizeof (GimpTileBackendXcfPrivate));
+}
+
+static void
+gimp_tile_backend_xcf_init (GimpTileBackendXcf *backend)
+{
+  GeglTileSource *source = GEGL_TILE_SOURCE (backend);
+
+  backend->priv = G_TYPE_INSTANCE_GET_PRIVATE (backend,
+                                               GIMP_TYPE_TILE_BACKEND_XCF,
+                                               GimpTileBackendXcfPrivate);
+
+  source->command = gimp_tile_backend_xcf_command;
+
+  /*  recursive, because storing a tile in the storage buffer can make
+   *  GEGL's cache write back another tile of this backend
+   */
+  g_rec_mutex_init (&backend->priv->mutex);
+}
+
+static void
+gimp_tile_backend_xcf_finalize (GObject *object)
+{
+  GimpTileBackendXcf        *backend = GIMP_TILE_BACKEND_XCF (object);
+  GimpTileBackendXcfPrivate *priv    = backend->priv;
+
+  g_mutex_lock (&backends_mutex);
+  backends = g_list_remove (backends, backend);
+  g_mutex_unlock (&backends_mutex);
+
+  g_weak_ref_clear (&priv->weak_ref);
+
+  if (priv->file)
+    {
+      xcf_tile_file_unref (priv->file);
+      priv->file = NULL;
+    }
+
+  if (priv->storage)
+    {
+      g_object_unref (priv->storage);
+      priv->storage = NULL;
+    }
+
+  g_free (priv->stored);
+  priv->stored = NULL;
+
+  g_free (priv->offsets);
+  priv->offsets = NULL;
+
+  g_rec_mutex_clear (&priv->mutex);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static gpointer
+gimp_tile_backend_xcf_command (GeglTileSource  *source,
+                               GeglTileCommand  command,
+                               gint             x,
+                               gint             y,
+                               gint             z,
+                               gpointer         data)
+{
+  GimpTileBackendXcf        *backend = GIMP_TILE_BACKEND_XCF (source);
+  GimpTileBackendXcfPrivate *priv    = backend->priv;
+  gint                       tile_size;
+  gint                       index;
+  gpointer                   result  = NULL;
+
+  /*  the xcf tiles are the buffer's tiles, we only have level 0  */
+  if (z != 0                          ||
+      x < 0 || x >= priv->n_tile_cols ||
+      y < 0 || y >= priv->n_tile_rows)
+    return NULL;
+
+  tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (backend));
+  index     = y * priv->n_tile_cols + x;
+
+  g_rec_mutex_lock (&priv->mutex);
+
+  switch (command)
+    {
+    case GEGL_TILE_GET:
+      if (priv->stored[index])
+        {
+          GeglTile *tile = gegl_tile_new (tile_size);
+
+          gimp_tile_backend_xcf_fetch (backend, index,
+                                       gegl_tile_get_data (tile));
+          gegl_tile_mark_as_stored (tile);
+
+          result = tile;
+        }
+      else if (priv->file && priv->offsets[index])
+        {
+          GeglTile *tile = gegl_tile_new (tile_size);
+
+          if (gimp_tile_backend_xcf_read_tile (backend, index,
+                                               gegl_tile_get_data (tile)))
+            {
+              gegl_tile_mark_as_stored (tile);
+
+              result = tile;
+            }
+          else
+            {
+              gegl_tile_unref (tile);
+            }
+        }
+      break;
+
+    case GEGL_TILE_SET:
+      gimp_tile_backend_xcf_store (backend, index, gegl_tile_get_data (data));
+      gegl_tile_mark_as_stored (data);
+      break;
+
+    case GEGL_TILE_VOID:
+      priv->stored[index]  = FALSE;
+      priv->offsets[index] = 0;
+      break;
+
+    case GEGL_TILE_EXIST:
+      result = GINT_TO_POINTER (priv->stored[index] ||
+                                (priv->file && priv->offsets[index]));
+      break;
+
+    default:
+      g_assert (command < GEGL_TILE_LAST_COMMAND && command >= 0);
+    }
+
+  g_rec_mutex_unlock (&priv->mutex);
+
+  return result;
+}
+
+/*  reads and decodes a tile from the file into a tile of the
+ *  backend's layout, called with the backend's mutex held
+ */
+static gboolean
+gimp_tile_backend_xcf_read_tile (GimpTileBackendXcf *backend,
+                                 gint                index,
+                                 guchar             *dest)
+{
+  GimpTileBackendXcfPrivate *priv = backend->priv;
+  XcfTileFile               *file = priv->file;
+  gint                       x    = index % priv->n_tile_cols;
+  gint                       y    = index / priv->n_tile_cols;
+  goffset                    offset;
+  goffset                    offset2;
+  gint                       width;
+  gint                       height;
+  gint                       data_length;
+  gint                       n_read;
+  guchar                    *xcfdata;
+  guchar                    *tile_data;
+  gboolean                   success;
+  gint                       row;
+
+  width  = MIN (XCF_TILE_WIDTH,  priv->width  - x * XCF_TILE_WIDTH);
+  height = MIN (XCF_TILE_HEIGHT, priv->height - y * XCF_TILE_HEIGHT);
+
+  offset  = priv->offsets[index];
+  offset2 = priv->offsets[index + 1];
+
+  /*  see xcf_load_tile_batch()  */
+  if (priv->compression == COMPRESS_NONE)
+    data_length = width * height * priv->bpp;
+  else if (offset2 == 0)
+    data_length = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * priv->bpp * 1.5;
+  else
+    data_length = offset2 - offset;
+
+  if (data_length <= 0)
+    return FALSE;
+
+  xcfdata = g_malloc (data_length);
+
+  g_mutex_lock (&file->mutex);
+
+  /*  never decode data from a file which was overwritten meanwhile  */
+  if (! xcf_tile_file_check (file))
+    n_read = -1;
+  else if (fseeko (file->fp, offset, SEEK_SET) == 0)
+    n_read = fread (xcfdata, sizeof (guchar), data_length, file->fp);
+  else
+    n_read = 0;
+
+  g_mutex_unlock (&file->mutex);
+
+  if (n_read < 0)
+    {
+      g_free (xcfdata);
+
+      return FALSE;
+    }
+
+  tile_data = g_malloc (width * height * priv->bpp);
+
+  success = xcf_load_tile_data (priv->compression, xcfdata, n_read,
+                                tile_data, priv->bpp, width * height);
+
+  if (success)
+    {
+      if (width < XCF_TILE_WIDTH || height < XCF_TILE_HEIGHT)
+        memset (dest, 0, XCF_TILE_WIDTH * XCF_TILE_HEIGHT * priv->bpp);
+
+      for (row = 0; row < height; row++)
+        {
+          memcpy (dest      + row * XCF_TILE_WIDTH * priv->bpp,
+                  tile_data + row * width          * priv->bpp,
+                  width * priv->bpp);
+        }
+    }
+
+  g_free (tile_data);
+  g_free (xcfdata);
+
+  return success;
+}
+
+/*  the tiles which were written to the backend, or read from the file
+ *  before it was overwritten, are kept in an ordinary buffer with the
+ *  same tiles, so they are cached and swapped like any other pixels
+ */
+static void
+gimp_tile_backend_xcf_tile_rect (GimpTileBackendXcf *backend,
+                                 gint                index,
+                                 GeglRectangle      *rect)
+{
+  GimpTileBackendXcfPrivate *priv = backend->priv;
+
+  rect->x      = index % priv->n_tile_cols * XCF_TILE_WIDTH;
+  rect->y      = index / priv->n_tile_cols * XCF_TILE_HEIGHT;
+  rect->width  = XCF_TILE_WIDTH;
+  rect->height = XCF_TILE_HEIGHT;
+}
+
+/*  called with the backend's mutex held  */
+static void
+gimp_tile_backend_xcf_store (GimpTileBackendXcf *backend,
+                             gint                index,
+                             const guchar       *src)
+{
+  GimpTileBackendXcfPrivate *priv = backend->priv;
+  GeglRectangle              rect;
+
+  if (! priv->storage)
+    {
+      /*  whole tiles, so the edge tiles keep their padding  */
+      priv->storage = g_object_new (GEGL_TYPE_BUFFER,
+                                    "format",      priv->format,
+                                    "x",           0,
+                                    "y",           0,
+                                    "width",       (priv->n_tile_cols *
+                                                    XCF_TILE_WIDTH),
+                                    "height",      (priv->n_tile_rows *
+                                                    XCF_TILE_HEIGHT),
+                                    "tile-width",  XCF_TILE_WIDTH,
+                                    "tile-height", XCF_TILE_HEIGHT,
+                                    NULL);
+    }
+
+  gimp_tile_backend_xcf_tile_rect (backend, index, &rect);
+
+  gegl_buffer_set (priv->storage, &rect, 0, priv->format, src,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  priv->stored[index] = TRUE;
+}
+
+/*  called with the backend's mutex held  */
+static void
+gimp_tile_backend_xcf_fetch (GimpTileBackendXcf *backend,
+                             gint                index,
+                             guchar             *dest)
+{
+  GimpTileBackendXcfPrivate *priv = backend->priv;
+  GeglRectangle              rect;
+
+  gimp_tile_backend_xcf_tile_rect (backend, index, &rect);
+
+  gegl_buffer_get (priv->storage, &rect, 1.0, priv->format, dest,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+}
+
+/*  moves all the tiles which were not read from the file yet to the
+ *  storage buffer, and stops using the file
+ */
+static void
+gimp_tile_backend_xcf_detach (GimpTileBackendXcf *backend)
+{
+  GimpTileBackendXcfPrivate *priv = backend->priv;
+  guchar                    *tile_data;
+  gint                       tile_size;
+  gint                       i;
+
+  tile_size = gegl_tile_backend_get_tile_size (GEGL_TILE_BACKEND (backend));
+  tile_data = g_malloc (tile_size);
+
+  g_rec_mutex_lock (&priv->mutex);
+
+  if (priv->file)
+    {
+      for (i = 0; i < priv->n_tile_cols * priv->n_tile_rows; i++)
+        {
+          if (! priv->stored[i] && priv->offsets[i] &&
+              gimp_tile_backend_xcf_read_tile (backend, i, tile_data))
+            {
+              gimp_tile_backend_xcf_store (backend, i, tile_data);
+            }
+
+          priv->offsets[i] = 0;
+        }
+
+      xcf_tile_file_unref (priv->file);
+      priv->file = NULL;
+    }
+
+  g_rec_mutex_unlock (&priv->mutex);
+
+  g_free (tile_data);
+}
+
+static gboolean
+xcf_tile_file_changed_idle (gchar *filename)
+{
+  g_message (_("The file '%s' was changed by another program.  "
+               "Image data which was not loaded from it yet is lost."),
+             gimp_filename_to_utf8 (filename));
+
+  g_free (filename);
+
+  return FALSE;
+}
+
+/*  returns whether the file is still the way it was when it was
+ *  opened, and complains once if it is not.  called with the file's
+ *  mutex held
+ */
+static gboolean
+xcf_tile_file_check (XcfTileFile *file)
+{
+  struct stat stat_buf;
+
+  if (file->changed)
+    return FALSE;
+
+  if (fstat (fileno (file->fp), &stat_buf) != 0 ||
+      stat_buf.st_size  != file->size            ||
+      stat_buf.st_mtime != file->mtime)
+    {
+      file->changed = TRUE;
+
+      /*  we may be on any thread here  */
+      g_idle_add ((GSourceFunc) xcf_tile_file_changed_idle,
+                  g_strdup (file->filename));
+
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+xcf_tile_file_matches (XcfTileFile    *file,
+                       const gchar    *filename,
+                       const GStatBuf *stat_buf)
+{
+  /*  st_ino is not available on all platforms, compare the file
+   *  names too
+   */
+  if (stat_buf                                &&
+      stat_buf->st_ino != 0                   &&
+      (guint64) stat_buf->st_ino == file->ino &&
+      (guint64) stat_buf->st_dev == file->dev)
+    return TRUE;
+
+  return ! strcmp (filename, file->filename);
+}
+
+
+/*  public functions  */
+
+GeglTileBackend *
+gimp_tile_backend_xcf_new (XcfTileFile        *file,
+                           XcfCompressionType  compression,
+                           const Babl         *format,
+                           gint                width,
+                           gint                height,
+                           const goffset      *offsets)
+{
+  GeglTileBackend           *backend;
+  GimpTileBackendXcfPrivate *priv;
+  gint                       n_tiles;
+
+  g_return_val_if_fail (file != NULL, NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+  g_return_val_if_fail (offsets != NULL, NULL);
+
+  backend = g_object_new (GIMP_TYPE_TILE_BACKEND_XCF,
+                          "tile-width",  XCF_TILE_WIDTH,
+                          "tile-height", XCF_TILE_HEIGHT,
+                          "format",      format,
+                          NULL);
+
+  priv = GIMP_TILE_BACKEND_XCF (backend)->priv;
+
+  priv->file        = xcf_tile_file_ref (file);
+  priv->compression = compression;
+  priv->format      = format;
+  priv->bpp         = babl_format_get_bytes_per_pixel (format);
+  priv->width       = width;
+  priv->height      = height;
+  priv->n_tile_cols = (width  + XCF_TILE_WIDTH  - 1) / XCF_TILE_WIDTH;
+  priv->n_tile_rows = (height + XCF_TILE_HEIGHT - 1) / XCF_TILE_HEIGHT;
+
+  n_tiles = priv->n_tile_cols * priv->n_tile_rows;
+
+  priv->offsets = g_memdup (offsets, (n_tiles + 1) * sizeof (goffset));
+  priv->stored  = g_new0 (guchar, n_tiles);
+
+  g_weak_ref_init (&priv->weak_ref, backend);
+
+  gegl_tile_backend_set_extent (backend,
+                                GEGL_RECTANGLE (0, 0, width, height));
+
+  g_mutex_lock (&backends_mutex);
+  backends = g_list_prepend (backends, backend);
+  g_mutex_unlock (&backends_mutex);
+
+  return backend;
+}
+
+/*  makes all backends which read from @filename move their remaining
+ *  tiles to their storage buffers and close the file, must be called
+ *  before @filename is written to
+ */
+void
+gimp_tile_backend_xcf_detach_file (const gchar *filename)
+{
+  GStatBuf  stat_buf;
+  gboolean  have_stat;
+  GList    *detach = NULL;
+  GList    *list;
+
+  g_return_if_fail (filename != NULL);
+
+  have_stat = (g_stat (filename, &stat_buf) == 0);
+
+  /*  collect the backends first, so no backend's mutex is taken
+   *  with backends_mutex held
+   */
+  g_mutex_lock (&backends_mutex);
+
+  for (list = backends; list; list = g_list_next (list))
+    {
+      GimpTileBackendXcf *backend = list->data;
+
+      /*  NULL if the backend is being finalized  */
+      backend = g_weak_ref_get (&backend->priv->weak_ref);
+
+      if (backend)
+        detach = g_list_prepend (detach, backend);
+    }
+
+  g_mutex_unlock (&backends_mutex);
+
+  for (list = detach; list; list = g_list_next (list))
+    {
+      GimpTileBackendXcf *backend = list->data;
+      gboolean            match;
+
+      g_rec_mutex_lock (&backend->priv->mutex);
+      match = (backend->priv->file &&
+               xcf_tile_file_matches (backend->priv->file, filename,
+                                      have_stat ? &stat_buf : NULL));
+      g_rec_mutex_unlock (&backend->priv->mutex);
+
+      if (match)
+        gimp_tile_backend_xcf_detach (backend);
+
+      g_object_unref (backend);
+    }
+
+  g_list_free (detach);
+}
+
+XcfTileFile *
+xcf_tile_file_new (FILE        *fp,
+                   const gchar *filename)
+{
+  XcfTileFile *file;
+  struct stat  stat_buf;
+
+  g_return_val_if_fail (fp != NULL, NULL);
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  file = g_slice_new0 (XcfTileFile);
+
+  file->ref_count = 1;
+  file->fp        = fp;
+  file->filename  = g_strdup (filename);
+
+  if (fstat (fileno (fp), &stat_buf) == 0)
+    {
+      file->dev   = stat_buf.st_dev;
+      file->ino   = stat_buf.st_ino;
+      file->size  = stat_buf.st_size;
+      file->mtime = stat_buf.st_mtime;
+    }
+
+  g_mutex_init (&file->mutex);
+
+  return file;
+}
+
+XcfTileFile *
+xcf_tile_file_ref (XcfTileFile *file)
+{
+  g_return_val_if_fail (file != NULL, NULL);
+
+  g_atomic_int_inc (&file->ref_count);
+
+  return file;
+}
+
+/*  closes the file when the last reference is dropped  */
+void
+xcf_tile_file_unref (XcfTileFile *file)
+{
+  g_return_if_fail (file != NULL);
+
+  if (g_atomic_int_dec_and_test (&file->ref_count))
+    {
+      fclose (file->fp);
+      g_free (file->filename);
+      g_mutex_clear (&file->mutex);
+
+      g_slice_free (XcfTileFile, file);
+    }
+}
+
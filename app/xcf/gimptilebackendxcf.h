@@ -0,0 +1,70 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimptilebackendxcf.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_TILE_BACKEND_XCF_H__
+#define __GIMP_TILE_BACKEND_XCF_H__
+
+
+#include <gegl-buffer-backend.h>
+
+
+#define GIMP_TYPE_TILE_BACKEND_XCF            (gimp_tile_backend_xcf_get_type ())
+#define GIMP_TILE_BACKEND_XCF(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GIMP_TYPE_TILE_BACKEND_XCF, GimpTileBackendXcf))
+#define GIMP_TILE_BACKEND_XCF_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  GIMP_TYPE_TILE_BACKEND_XCF, GimpTileBackendXcfClass))
+#define GIMP_IS_TILE_BACKEND_XCF(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GIMP_TYPE_TILE_BACKEND_XCF))
+#define GIMP_IS_TILE_BACKEND_XCF_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  GIMP_TYPE_TILE_BACKEND_XCF))
+#define GIMP_TILE_BACKEND_XCF_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GIMP_TYPE_TILE_BACKEND_XCF, GimpTileBackendXcfClass))
+
+
+typedef struct _GimpTileBackendXcf        GimpTileBackendXcf;
+typedef struct _GimpTileBackendXcfClass   GimpTileBackendXcfClass;
+typedef struct _GimpTileBackendXcfPrivate GimpTileBackendXcfPrivate;
+
+struct _GimpTileBackendXcf
+{
+  GeglTileBackend            parent_instance;
+
+  GimpTileBackendXcfPrivate *priv;
+};
+
+struct _GimpTileBackendXcfClass
+{
+  GeglTileBackendClass  parent_class;
+};
+
+
+GType             gimp_tile_backend_xcf_get_type    (void) G_GNUC_CONST;
+
+GeglTileBackend * gimp_tile_backend_xcf_new         (XcfTileFile        *file,
+                                                     XcfCompressionType  compression,
+                                                     const Babl         *format,
+                                                     gint                width,
+                                                     gint                height,
+                                                     const goffset      *offsets);
+
+void              gimp_tile_backend_xcf_detach_file (const gchar        *filename);
+
+
+XcfTileFile     * xcf_tile_file_new                 (FILE               *fp,
+                                                     const gchar        *filename);
+XcfTileFile     * xcf_tile_file_ref                 (XcfTileFile        *file);
+void              xcf_tile_file_unref               (XcfTileFile        *file);
+
+
+#endif  /*  __GIMP_TILE_BACKEND_XCF_H__  */
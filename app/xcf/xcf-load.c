@@ -20,6 +20,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <zlib.h>
+
 #include <cairo.h>
 #include <gegl.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -34,6 +36,7 @@
 #include "gegl/gimp-gegl-tile-compat.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 #include "core/gimpcontainer.h"
 #include "core/gimpdrawable-private.h" /* eek */
 #include "core/gimpgrid.h"
@@ -66,15 +69,31 @@
 #include "xcf-load.h"
 #include "xcf-read.h"
 #include "xcf-seek.h"
+#include "gimptilebackendxcf.h"
 
 #include "gimp-intl.h"
 
 
 #define MAX_XCF_PARASITE_DATA_LEN (256L * 1024 * 1024)
 
+/*  the number of tiles that are read at once, and decoded in parallel  */
+#define XCF_LOAD_BATCH_SIZE 64
+
 /* #define GIMP_XCF_PATH_DEBUG */
 
 
+typedef struct
+{
+  GeglBuffer         *buffer;
+  const Babl         *format;
+  XcfCompressionType  compression;
+  gint                first;    /*  the index of the batch's first tile  */
+  guchar             *data[XCF_LOAD_BATCH_SIZE];
+  gint                size[XCF_LOAD_BATCH_SIZE];
+  gboolean            success[XCF_LOAD_BATCH_SIZE];
+} XcfTileBatch;
+
+
 static void            xcf_load_add_masks     (GimpImage     *image);
 static gboolean        xcf_load_image_props   (XcfInfo       *info,
                                                GimpImage     *image);
@@ -101,18 +120,29 @@ static GimpChannel   * xcf_load_channel       (XcfInfo       *info,
 static GimpLayerMask * xcf_load_layer_mask    (XcfInfo       *info,
                                                GimpImage     *image);
 static gboolean        xcf_load_buffer        (XcfInfo       *info,
-                                               GeglBuffer    *buffer);
+                                               GimpDrawable  *drawable);
 static gboolean        xcf_load_level         (XcfInfo       *info,
-                                               GeglBuffer    *buffer);
-static gboolean        xcf_load_tile          (XcfInfo       *info,
-                                               GeglBuffer    *buffer,
-                                               GeglRectangle *tile_rect,
-                                               const Babl    *format);
-static gboolean        xcf_load_tile_rle      (XcfInfo       *info,
-                                               GeglBuffer    *buffer,
-                                               GeglRectangle *tile_rect,
-                                               const Babl    *format,
-                                               gint           data_length);
+                                               GimpDrawable  *drawable);
+static gboolean        xcf_load_tile_batch    (XcfInfo       *info,
+                                               XcfTileBatch  *batch,
+                                               const goffset *offsets,
+                                               gint           n_tiles);
+static void            xcf_load_tile_range    (gsize          offset,
+                                               gsize          size,
+                                               XcfTileBatch  *batch);
+static gboolean        xcf_load_tile          (const guchar  *xcfdata,
+                                               gint           data_length,
+                                               guchar        *tile_data,
+                                               gint           tile_size);
+static gboolean        xcf_load_tile_rle      (const guchar  *xcfdata,
+                                               gint           data_length,
+                                               guchar        *tile_data,
+                                               gint           bpp,
+                                               gint           n_pixels);
+static gboolean        xcf_load_tile_zlib     (const guchar  *xcfdata,
+                                               gint           data_length,
+                                               guchar        *tile_data,
+                                               gint           tile_size);
 static GimpParasite  * xcf_load_parasite      (XcfInfo       *info);
 static gboolean        xcf_load_old_paths     (XcfInfo       *info,
                                                GimpImage     *image);
@@ -141,8 +171,8 @@ xcf_load_image (Gimp     *gimp,
 {
   GimpImage          *image = NULL;
   const GimpParasite *parasite;
-  guint32             saved_pos;
-  guint32             offset;
+  goffset             saved_pos;
+  goffset             offset;
   gint                width;
   gint                height;
   gint                image_type;
@@ -217,7 +247,7 @@ xcf_load_image (Gimp     *gimp,
       GList     *item_path = NULL;
 
       /* read in the offset of the next layer */
-      info->cp += xcf_read_int32 (info->fp, &offset, 1);
+      info->cp += xcf_read_offset (info, &offset, 1);
 
       /* if the offset is 0 then we are at the end
        *  of the layer list.
@@ -301,7 +331,7 @@ xcf_load_image (Gimp     *gimp,
       GimpChannel *channel;
 
       /* read in the offset of the next channel */
-      info->cp += xcf_read_int32 (info->fp, &offset, 1);
+      info->cp += xcf_read_offset (info, &offset, 1);
 
       /* if the offset is 0 then we are at the end
        *  of the channel list.
@@ -611,7 +641,7 @@ xcf_load_image_props (XcfInfo   *info,
 
         case PROP_PARASITES:
           {
-            glong base = info->cp;
+            goffset base = info->cp;
 
             while (info->cp - base < prop_size)
               {
@@ -707,14 +737,14 @@ xcf_load_image_props (XcfInfo   *info,
 
         case PROP_VECTORS:
           {
-            guint32 base = info->cp;
+            goffset base = info->cp;
 
             if (xcf_load_vectors (info, image))
               {
                 if (base + prop_size != info->cp)
                   {
                     g_printerr ("Mismatch in PROP_VECTORS size: "
-                                "skipping %d bytes.\n",
+                                "skipping %" G_GOFFSET_FORMAT " bytes.\n",
                                 base + prop_size - info->cp);
                     xcf_seek_pos (info, base + prop_size, NULL);
                   }
@@ -773,9 +803,7 @@ xcf_load_layer_props (XcfInfo    *info,
 
         case PROP_FLOATING_SELECTION:
           info->floating_sel = *layer;
-          info->cp +=
-            xcf_read_int32 (info->fp,
-                            (guint32 *) &info->floating_sel_offset, 1);
+          info->cp += xcf_read_offset (info, &info->floating_sel_offset, 1);
           break;
 
         case PROP_OPACITY:
@@ -884,7 +912,7 @@ xcf_load_layer_props (XcfInfo    *info,
 
         case PROP_PARASITES:
           {
-            glong base = info->cp;
+            goffset base = info->cp;
 
             while (info->cp - base < prop_size)
               {
@@ -925,7 +953,7 @@ xcf_load_layer_props (XcfInfo    *info,
 
         case PROP_ITEM_PATH:
           {
-            glong  base = info->cp;
+            goffset base = info->cp;
             GList *path = NULL;
 
             while (info->cp - base < prop_size)
@@ -1080,7 +1108,7 @@ xcf_load_channel_props (XcfInfo      *info,
 
         case PROP_PARASITES:
           {
-            glong base = info->cp;
+            goffset base = info->cp;
 
             while ((info->cp - base) < prop_size)
               {
@@ -1139,8 +1167,8 @@ xcf_load_layer (XcfInfo    *info,
 {
   GimpLayer         *layer;
   GimpLayerMask     *layer_mask;
-  guint32            hierarchy_offset;
-  guint32            layer_mask_offset;
+  goffset            hierarchy_offset;
+  goffset            layer_mask_offset;
   gboolean           apply_mask = TRUE;
   gboolean           edit_mask  = FALSE;
   gboolean           show_mask  = FALSE;
@@ -1242,8 +1270,8 @@ xcf_load_layer (XcfInfo    *info,
     }
 
   /* read the hierarchy and layer mask offsets */
-  info->cp += xcf_read_int32 (info->fp, &hierarchy_offset, 1);
-  info->cp += xcf_read_int32 (info->fp, &layer_mask_offset, 1);
+  info->cp += xcf_read_offset (info, &hierarchy_offset, 1);
+  info->cp += xcf_read_offset (info, &layer_mask_offset, 1);
 
   /* read in the hierarchy (ignore it for group layers, both as an
    * optimization and because the hierarchy's extents don't match
@@ -1254,8 +1282,7 @@ xcf_load_layer (XcfInfo    *info,
       if (! xcf_seek_pos (info, hierarchy_offset, NULL))
         goto error;
 
-      if (! xcf_load_buffer (info,
-                             gimp_drawable_get_buffer (GIMP_DRAWABLE (layer))))
+      if (! xcf_load_buffer (info, GIMP_DRAWABLE (layer)))
         goto error;
 
       xcf_progress_update (info);
@@ -1310,7 +1337,7 @@ xcf_load_channel (XcfInfo   *info,
                   GimpImage *image)
 {
   GimpChannel *channel;
-  guint32      hierarchy_offset;
+  goffset      hierarchy_offset;
   gint         width;
   gint         height;
   gboolean     is_fs_drawable;
@@ -1340,14 +1367,13 @@ xcf_load_channel (XcfInfo   *info,
   xcf_progress_update (info);
 
   /* read the hierarchy and layer mask offsets */
-  info->cp += xcf_read_int32 (info->fp, &hierarchy_offset, 1);
+  info->cp += xcf_read_offset (info, &hierarchy_offset, 1);
 
   /* read in the hierarchy */
   if (!xcf_seek_pos (info, hierarchy_offset, NULL))
     goto error;
 
-  if (!xcf_load_buffer (info,
-                        gimp_drawable_get_buffer (GIMP_DRAWABLE (channel))))
+  if (!xcf_load_buffer (info, GIMP_DRAWABLE (channel)))
     goto error;
 
   xcf_progress_update (info);
@@ -1368,7 +1394,7 @@ xcf_load_layer_mask (XcfInfo   *info,
 {
   GimpLayerMask *layer_mask;
   GimpChannel   *channel;
-  guint32        hierarchy_offset;
+  goffset        hierarchy_offset;
   gint           width;
   gint           height;
   gboolean       is_fs_drawable;
@@ -1399,14 +1425,13 @@ xcf_load_layer_mask (XcfInfo   *info,
   xcf_progress_update (info);
 
   /* read the hierarchy and layer mask offsets */
-  info->cp += xcf_read_int32 (info->fp, &hierarchy_offset, 1);
+  info->cp += xcf_read_offset (info, &hierarchy_offset, 1);
 
   /* read in the hierarchy */
   if (! xcf_seek_pos (info, hierarchy_offset, NULL))
     goto error;
 
-  if (!xcf_load_buffer (info,
-                        gimp_drawable_get_buffer (GIMP_DRAWABLE (layer_mask))))
+  if (!xcf_load_buffer (info, GIMP_DRAWABLE (layer_mask)))
     goto error;
 
   xcf_progress_update (info);
@@ -1423,13 +1448,14 @@ xcf_load_layer_mask (XcfInfo   *info,
 }
 
 static gboolean
-xcf_load_buffer (XcfInfo    *info,
-                 GeglBuffer *buffer)
+xcf_load_buffer (XcfInfo      *info,
+                 GimpDrawable *drawable)
 {
+  GeglBuffer *buffer = gimp_drawable_get_buffer (drawable);
   const Babl *format;
-  guint32     saved_pos;
-  guint32     offset;
-  guint32     junk;
+  goffset     saved_pos;
+  goffset     offset;
+  goffset     junk;
   gint        width;
   gint        height;
   gint        bpp;
@@ -1453,13 +1479,13 @@ xcf_load_buffer (XcfInfo    *info,
    *  as the number of levels found in the file.
    */
 
-  info->cp += xcf_read_int32 (info->fp, &offset, 1); /* top level */
+  info->cp += xcf_read_offset (info, &offset, 1); /* top level */
 
   /* discard offsets for layers below first, if any.
    */
   do
     {
-      info->cp += xcf_read_int32 (info->fp, &junk, 1);
+      info->cp += xcf_read_offset (info, &junk, 1);
     }
   while (junk != 0);
 
@@ -1473,7 +1499,7 @@ xcf_load_buffer (XcfInfo    *info,
     return FALSE;
 
   /* read in the level */
-  if (!xcf_load_level (info, buffer))
+  if (!xcf_load_level (info, drawable))
     return FALSE;
 
   /* restore the saved position so we'll be ready to
@@ -1487,23 +1513,18 @@ xcf_load_buffer (XcfInfo    *info,
 
 
 static gboolean
-xcf_load_level (XcfInfo    *info,
-                GeglBuffer *buffer)
+xcf_load_level (XcfInfo      *info,
+                GimpDrawable *drawable)
 {
-  const Babl *format;
-  gint        bpp;
-  guint32     saved_pos;
-  guint32     offset, offset2;
-  gint        n_tile_rows;
-  gint        n_tile_cols;
-  guint       ntiles;
-  gint        width;
-  gint        height;
-  gint        i;
-  gint        fail;
-
-  format = gegl_buffer_get_format (buffer);
-  bpp    = babl_format_get_bytes_per_pixel (format);
+  GeglBuffer   *buffer = gimp_drawable_get_buffer (drawable);
+  XcfTileBatch  batch  = { 0, };
+  goffset      *offsets;
+  gint          n_tile_rows;
+  gint          n_tile_cols;
+  guint         ntiles;
+  gint          width;
+  gint          height;
+  gint          i;
 
   info->cp += xcf_read_int32 (info->fp, (guint32 *) &width, 1);
   info->cp += xcf_read_int32 (info->fp, (guint32 *) &height, 1);
@@ -1512,160 +1533,306 @@ xcf_load_level (XcfInfo    *info,
       height != gegl_buffer_get_height (buffer))
     return FALSE;
 
+  n_tile_rows = gimp_gegl_buffer_get_n_tile_rows (buffer, XCF_TILE_HEIGHT);
+  n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
+
+  ntiles = n_tile_rows * n_tile_cols;
+
   /* read in the first tile offset.
    *  if it is '0', then this tile level is empty
    *  and we can simply return.
    */
-  info->cp += xcf_read_int32 (info->fp, &offset, 1);
-  if (offset == 0)
-    return TRUE;
-
-  n_tile_rows = gimp_gegl_buffer_get_n_tile_rows (buffer, XCF_TILE_HEIGHT);
-  n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
+  offsets = g_new0 (goffset, ntiles + 1);
 
-  ntiles = n_tile_rows * n_tile_cols;
-  for (i = 0; i < ntiles; i++)
+  info->cp += xcf_read_offset (info, offsets, 1);
+  if (offsets[0] == 0)
     {
-      GeglRectangle rect;
+      g_free (offsets);
+      return TRUE;
+    }
 
-      fail = FALSE;
+  /* read in the remaining tile offsets, and the terminating '0'
+   */
+  info->cp += xcf_read_offset (info, offsets + 1, ntiles);
 
-      if (offset == 0)
+  for (i = 0; i < ntiles; i++)
+    {
+      if (offsets[i] == 0)
         {
           gimp_message_literal (info->gimp, G_OBJECT (info->progress),
 				GIMP_MESSAGE_ERROR,
 				"not enough tiles found in level");
+          g_free (offsets);
           return FALSE;
         }
+    }
 
-      /* save the current position as it is where the
-       *  next tile offset is stored.
-       */
-      saved_pos = info->cp;
+  if (offsets[ntiles] != 0)
+    {
+      gimp_message (info->gimp, G_OBJECT (info->progress), GIMP_MESSAGE_ERROR,
+                    "encountered garbage after reading level: %"
+                    G_GOFFSET_FORMAT, offsets[ntiles]);
+      g_free (offsets);
+      return FALSE;
+    }
 
-      /* read in the offset of the next tile so we can calculate the amount
-         of data needed for this tile*/
-      info->cp += xcf_read_int32 (info->fp, &offset2, 1);
+  switch (info->compression)
+    {
+    case COMPRESS_NONE:
+    case COMPRESS_RLE:
+    case COMPRESS_ZLIB:
+      break;
+
+    default:
+      gimp_message (info->gimp, G_OBJECT (info->progress), GIMP_MESSAGE_ERROR,
+                    "unsupported compression type in level: %d",
+                    (gint) info->compression);
+      g_free (offsets);
+      return FALSE;
+    }
+
+  /* when loading lazily, only remember where the tiles are, they are
+   *  read from the file when they are first needed
+   */
+  if (info->tile_file)
+    {
+      GeglTileBackend *backend;
+      GeglBuffer      *lazy_buffer;
+
+      backend = gimp_tile_backend_xcf_new (info->tile_file,
+                                           info->compression,
+                                           gegl_buffer_get_format (buffer),
+                                           width, height, offsets);
+      g_free (offsets);
+
+      lazy_buffer = gegl_buffer_new_for_backend (NULL, backend);
+      g_object_unref (backend);
+
+      gimp_drawable_set_buffer (drawable, FALSE, NULL, lazy_buffer);
+      g_object_unref (lazy_buffer);
+
+      return TRUE;
+    }
+
+  batch.buffer      = buffer;
+  batch.format      = gegl_buffer_get_format (buffer);
+  batch.compression = info->compression;
+
+  /* read the tile data in batches, in file order, and decode each
+   *  batch's tiles in parallel
+   */
+  for (i = 0; i < ntiles; i += XCF_LOAD_BATCH_SIZE)
+    {
+      batch.first = i;
 
-      /* if the offset is 0 then we need to read in the maximum possible
-         allowing for negative compression */
+      if (! xcf_load_tile_batch (info, &batch, offsets,
+                                 MIN (XCF_LOAD_BATCH_SIZE, ntiles - i)))
+        {
+          g_free (offsets);
+          return FALSE;
+        }
+    }
+
+  g_free (offsets);
+
+  return TRUE;
+}
+
+static gboolean
+xcf_load_tile_batch (XcfInfo       *info,
+                     XcfTileBatch  *batch,
+                     const goffset *offsets,
+                     gint           n_tiles)
+{
+  gint     bpp     = babl_format_get_bytes_per_pixel (batch->format);
+  gboolean success = TRUE;
+  gint     i;
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      gint    tile    = batch->first + i;
+      goffset offset  = offsets[tile];
+      goffset offset2 = offsets[tile + 1];
+      gint    data_length;
+
+      /* if the next offset is 0 then we need to read in the maximum
+       *  possible allowing for negative compression
+       */
       if (offset2 == 0)
         offset2 = offset + XCF_TILE_WIDTH * XCF_TILE_WIDTH * bpp * 1.5;
                                         /* 1.5 is probably more
                                            than we need to allow */
 
-      /* seek to the tile offset */
-      if (! xcf_seek_pos (info, offset, NULL))
-        return FALSE;
-
-      /* get the tile from the tile manager */
-      gimp_gegl_buffer_get_tile_rect (buffer,
-                                      XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
-                                      i, &rect);
-
-      /* read in the tile */
-      switch (info->compression)
+      switch (batch->compression)
         {
         case COMPRESS_NONE:
-          if (!xcf_load_tile (info, buffer, &rect, format))
-            fail = TRUE;
+          {
+            GeglRectangle rect;
+
+            gimp_gegl_buffer_get_tile_rect (batch->buffer,
+                                            XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
+                                            tile, &rect);
+
+            data_length = rect.width * rect.height * bpp;
+          }
           break;
         case COMPRESS_RLE:
-          if (!xcf_load_tile_rle (info, buffer, &rect, format,
-                                  offset2 - offset))
-            fail = TRUE;
-          break;
         case COMPRESS_ZLIB:
-          g_error ("xcf: zlib compression unimplemented");
-          fail = TRUE;
-          break;
-        case COMPRESS_FRACTAL:
-          g_error ("xcf: fractal compression unimplemented");
-          fail = TRUE;
+          data_length = offset2 - offset;
           break;
+        default:
+          /* rejected by xcf_load_level()  */
+          g_return_val_if_reached (FALSE);
         }
 
-      if (fail)
-        return FALSE;
+      batch->data[i] = NULL;
+      batch->size[i] = 0;
 
-      /* restore the saved position so we'll be ready to
-       *  read the next offset.
+      /* Workaround for bug #357809: avoid crashing on g_malloc() and
+       * skip this tile as if it did not contain any data.  It is better
+       * than failing, which would skip the whole hierarchy while there
+       * may still be some valid tiles in the file.
        */
-      if (!xcf_seek_pos (info, saved_pos, NULL))
-        return FALSE;
+      if (data_length <= 0)
+        continue;
 
-      /* read in the offset of the next tile */
-      info->cp += xcf_read_int32 (info->fp, &offset, 1);
+      /* seek to the tile offset, this is a no-op for tiles that
+       *  directly follow each other
+       */
+      if (! xcf_seek_pos (info, offset, NULL))
+        {
+          success = FALSE;
+          n_tiles = i;
+          break;
+        }
+
+      /* we have to use fread instead of xcf_read_* because we may be
+       * reading past the end of the file here
+       */
+      batch->data[i] = g_malloc0 (data_length);
+      batch->size[i] = fread ((gchar *) batch->data[i], sizeof (gchar),
+                              data_length, info->fp);
+      info->cp += batch->size[i];
     }
 
-  if (offset != 0)
+  if (success)
     {
-      gimp_message (info->gimp, G_OBJECT (info->progress), GIMP_MESSAGE_ERROR,
-                    "encountered garbage after reading level: %d", offset);
-      return FALSE;
+      gimp_parallel_distribute_range (n_tiles, 1,
+                                      (GimpParallelDistributeRangeFunc)
+                                      xcf_load_tile_range,
+                                      batch);
     }
 
-  return TRUE;
+  for (i = 0; i < n_tiles; i++)
+    {
+      if (! batch->success[i])
+        success = FALSE;
+
+      g_free (batch->data[i]);
+      batch->data[i] = NULL;
+    }
+
+  return success;
 }
 
-static gboolean
-xcf_load_tile (XcfInfo       *info,
-               GeglBuffer    *buffer,
-               GeglRectangle *tile_rect,
-               const Babl    *format)
+/*  runs on the worker threads, decodes the batch's tiles in the range
+ *  [offset, offset + size) and stores them in the buffer
+ */
+static void
+xcf_load_tile_range (gsize         offset,
+                     gsize         size,
+                     XcfTileBatch *batch)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
+  gint    bpp       = babl_format_get_bytes_per_pixel (batch->format);
+  guchar *tile_data = g_malloc (XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp);
+  gsize   i;
+
+  for (i = offset; i < offset + size; i++)
+    {
+      GeglRectangle rect;
+      gint          n_pixels;
+
+      /* a skipped tile, see xcf_load_tile_batch()  */
+      if (! batch->data[i])
+        {
+          batch->success[i] = TRUE;
+          continue;
+        }
 
-  info->cp += xcf_read_int8 (info->fp, tile_data, tile_size);
+      gimp_gegl_buffer_get_tile_rect (batch->buffer,
+                                      XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
+                                      batch->first + i, &rect);
 
-  gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE);
+      n_pixels = rect.width * rect.height;
 
-  return TRUE;
+      batch->success[i] = xcf_load_tile_data (batch->compression,
+                                              batch->data[i], batch->size[i],
+                                              tile_data, bpp, n_pixels);
+
+      if (batch->success[i])
+        gegl_buffer_set (batch->buffer, &rect, 0, batch->format, tile_data,
+                         GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_free (tile_data);
+}
+
+/*  decodes a tile's data as stored in the file, this is also used by
+ *  the lazy loading tile backend and may be called from any thread
+ */
+gboolean
+xcf_load_tile_data (XcfCompressionType  compression,
+                    const guchar       *xcfdata,
+                    gint                data_length,
+                    guchar             *tile_data,
+                    gint                bpp,
+                    gint                n_pixels)
+{
+  switch (compression)
+    {
+    case COMPRESS_NONE:
+      return xcf_load_tile (xcfdata, data_length, tile_data, bpp * n_pixels);
+    case COMPRESS_RLE:
+      return xcf_load_tile_rle (xcfdata, data_length, tile_data,
+                                bpp, n_pixels);
+    case COMPRESS_ZLIB:
+      return xcf_load_tile_zlib (xcfdata, data_length, tile_data,
+                                 bpp * n_pixels);
+    default:
+      return FALSE;
+    }
 }
 
 static gboolean
-xcf_load_tile_rle (XcfInfo       *info,
-                   GeglBuffer    *buffer,
-                   GeglRectangle *tile_rect,
-                   const Babl    *format,
-                   gint           data_length)
+xcf_load_tile (const guchar *xcfdata,
+               gint          data_length,
+               guchar       *tile_data,
+               gint          tile_size)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  gint    i;
-  gint    nmemb_read_successfully;
-  guchar *xcfdata;
-  guchar *xcfodata;
-  guchar *xcfdatalimit;
-
-  /* Workaround for bug #357809: avoid crashing on g_malloc() and skip
-   * this tile (return TRUE without storing data) as if it did not
-   * contain any data.  It is better than returning FALSE, which would
-   * skip the whole hierarchy while there may still be some valid
-   * tiles in the file.
-   */
-  if (data_length <= 0)
-    return TRUE;
+  memcpy (tile_data, xcfdata, MIN (data_length, tile_size));
 
-  xcfdata = xcfodata = g_alloca (data_length);
+  if (data_length < tile_size)
+    memset (tile_data + data_length, 0, tile_size - data_length);
 
-  /* we have to use fread instead of xcf_read_* because we may be
-   * reading past the end of the file here
-   */
-  nmemb_read_successfully = fread ((gchar *) xcfdata, sizeof (gchar),
-                                   data_length, info->fp);
-  info->cp += nmemb_read_successfully;
+  return TRUE;
+}
+
+static gboolean
+xcf_load_tile_rle (const guchar *xcfdata,
+                   gint          data_length,
+                   guchar       *tile_data,
+                   gint          bpp,
+                   gint          n_pixels)
+{
+  const guchar *xcfdatalimit;
+  gint          i;
 
-  xcfdatalimit = &xcfodata[nmemb_read_successfully - 1];
+  xcfdatalimit = &xcfdata[data_length - 1];
 
   for (i = 0; i < bpp; i++)
     {
       guchar *data  = tile_data + i;
-      gint    size  = tile_rect->width * tile_rect->height;
+      gint    size  = n_pixels;
       gint    count = 0;
       guchar  val;
       gint    length;
@@ -1752,15 +1919,42 @@ xcf_load_tile_rle (XcfInfo       *info,
         }
     }
 
-  gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE);
-
   return TRUE;
 
  bogus_rle:
   return FALSE;
 }
 
+static gboolean
+xcf_load_tile_zlib (const guchar *xcfdata,
+                    gint          data_length,
+                    guchar       *tile_data,
+                    gint          tile_size)
+{
+  z_stream strm;
+  gint     status;
+
+  strm.next_in   = (Bytef *) xcfdata;
+  strm.avail_in  = data_length;
+  strm.next_out  = tile_data;
+  strm.avail_out = tile_size;
+  strm.zalloc    = Z_NULL;
+  strm.zfree     = Z_NULL;
+  strm.opaque    = Z_NULL;
+
+  if (inflateInit (&strm) != Z_OK)
+    return FALSE;
+
+  status = inflate (&strm, Z_FINISH);
+
+  inflateEnd (&strm);
+
+  if (status != Z_STREAM_END || strm.avail_out != 0)
+    return FALSE;
+
+  return TRUE;
+}
+
 static GimpParasite *
 xcf_load_parasite (XcfInfo *info)
 {
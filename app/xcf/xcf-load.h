@@ -19,9 +19,16 @@
 #define __XCF_LOAD_H__
 
 
-GimpImage * xcf_load_image (Gimp     *gimp,
-                            XcfInfo  *info,
-                            GError  **error);
+GimpImage * xcf_load_image     (Gimp               *gimp,
+                                XcfInfo            *info,
+                                GError            **error);
+
+gboolean    xcf_load_tile_data (XcfCompressionType  compression,
+                                const guchar       *xcfdata,
+                                gint                data_length,
+                                guchar             *tile_data,
+                                gint                bpp,
+                                gint                n_pixels);
 
 
 #endif  /* __XCF_LOAD_H__ */
@@ -23,6 +23,9 @@
 
 #include "libgimpbase/gimpbase.h"
 
+#include "core/core-types.h"
+
+#include "xcf-private.h"
 #include "xcf-read.h"
 
 #include "gimp-intl.h"
@@ -50,6 +53,58 @@ xcf_read_int32 (FILE    *fp,
   return total;
 }
 
+guint
+xcf_read_int64 (FILE    *fp,
+                guint64 *data,
+                gint     count)
+{
+  guint total = 0;
+
+  if (count > 0)
+    {
+      total += xcf_read_int8 (fp, (guint8 *) data, count * 8);
+
+      while (count--)
+        {
+          *data = GUINT64_FROM_BE (*data);
+          data++;
+        }
+    }
+
+  return total;
+}
+
+/*  reads file offsets, which are 64 bit since XCF version 7  */
+guint
+xcf_read_offset (XcfInfo *info,
+                 goffset *data,
+                 gint     count)
+{
+  guint total = 0;
+
+  while (count-- > 0)
+    {
+      if (info->bytes_per_offset == 8)
+        {
+          guint64 offset = 0;
+
+          total += xcf_read_int64 (info->fp, &offset, 1);
+
+          *data++ = offset;
+        }
+      else
+        {
+          guint32 offset = 0;
+
+          total += xcf_read_int32 (info->fp, &offset, 1);
+
+          *data++ = offset;
+        }
+    }
+
+  return total;
+}
+
 guint
 xcf_read_float (FILE   *fp,
                 gfloat *data,
@@ -22,6 +22,12 @@
 guint   xcf_read_int32  (FILE     *fp,
                          guint32  *data,
                          gint      count);
+guint   xcf_read_int64  (FILE     *fp,
+                         guint64  *data,
+                         gint      count);
+guint   xcf_read_offset (XcfInfo  *info,
+                         goffset  *data,
+                         gint      count);
 guint   xcf_read_float  (FILE     *fp,
                          gfloat   *data,
                          gint      count);
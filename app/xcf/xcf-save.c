@@ -20,6 +20,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <zlib.h>
+
 #include <cairo.h>
 #include <gegl.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -33,6 +35,8 @@
 #include "gegl/gimp-gegl-tile-compat.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
+#include "core/gimp-utils.h"
 #include "core/gimpcontainer.h"
 #include "core/gimpchannel.h"
 #include "core/gimpdrawable.h"
@@ -68,6 +72,21 @@
 #include "gimp-intl.h"
 
 
+/*  the number of tiles that are zlib-compressed at once, in parallel  */
+#define XCF_ZLIB_BATCH_SIZE 64
+
+
+typedef struct
+{
+  GeglBuffer *buffer;
+  const Babl *format;
+  gint        first;    /*  the index of the batch's first tile  */
+  guchar     *data[XCF_ZLIB_BATCH_SIZE];
+  gsize       size[XCF_ZLIB_BATCH_SIZE];
+} XcfZlibBatch;
+
+
+static guint64  xcf_save_estimate_size (GimpImage         *image);
 static gboolean xcf_save_image_props   (XcfInfo           *info,
                                         GimpImage         *image,
                                         GError           **error);
@@ -109,6 +128,17 @@ static gboolean xcf_save_tile_rle      (XcfInfo           *info,
                                         const Babl        *format,
                                         guchar            *rlebuf,
                                         GError           **error);
+static void     xcf_save_zlib_batch    (XcfZlibBatch      *batch,
+                                        gint               first,
+                                        gint               n_tiles);
+static void     xcf_save_zlib_free     (XcfZlibBatch      *batch);
+static void     xcf_save_zlib_range    (gsize              offset,
+                                        gsize              size,
+                                        XcfZlibBatch      *batch);
+static gboolean xcf_save_tile_zlib     (XcfInfo           *info,
+                                        XcfZlibBatch      *batch,
+                                        gint               tile,
+                                        GError           **error);
 static gboolean xcf_save_parasite      (XcfInfo           *info,
                                         GimpParasite      *parasite,
                                         GError           **error);
@@ -160,6 +190,15 @@ static gboolean xcf_save_vectors       (XcfInfo           *info,
     }                                                               \
   } G_STMT_END
 
+#define xcf_write_offset_check_error(info, data, count) G_STMT_START { \
+  info->cp += xcf_write_offset (info, data, count, &tmp_error);     \
+  if (tmp_error)                                                    \
+    {                                                               \
+      g_propagate_error (error, tmp_error);                         \
+      return FALSE;                                                 \
+    }                                                               \
+  } G_STMT_END
+
 #define xcf_write_prop_type_check_error(info, prop_type) G_STMT_START { \
   guint32 _prop_int32 = prop_type;                     \
   xcf_write_int32_check_error (info, &_prop_int32, 1); \
@@ -179,6 +218,42 @@ static gboolean xcf_save_vectors       (XcfInfo           *info,
   } G_STMT_END
 
 
+/*  returns an upper bound for the size of the image's pixel data in
+ *  an XCF file, compressed with RLE in the worst case
+ */
+static guint64
+xcf_save_estimate_size (GimpImage *image)
+{
+  GList   *drawables;
+  GList   *list;
+  guint64  size = 0;
+
+  drawables = g_list_concat (gimp_image_get_layer_list (image),
+                             gimp_image_get_channel_list (image));
+  drawables = g_list_prepend (drawables, gimp_image_get_mask (image));
+
+  for (list = drawables; list; list = g_list_next (list))
+    {
+      GimpDrawable *drawable = list->data;
+
+      size += gimp_gegl_buffer_get_memsize (gimp_drawable_get_buffer (drawable));
+
+      if (GIMP_IS_LAYER (drawable) && gimp_layer_get_mask (GIMP_LAYER (drawable)))
+        {
+          GimpLayerMask *mask = gimp_layer_get_mask (GIMP_LAYER (drawable));
+
+          size += gimp_gegl_buffer_get_memsize (gimp_drawable_get_buffer (GIMP_DRAWABLE (mask)));
+        }
+    }
+
+  g_list_free (drawables);
+
+  /*  RLE data can be up to 1.5 times larger than the pixels, and leave
+   *  some room for the properties, parasites and paths
+   */
+  return size + size / 2 + 64 * 1024 * 1024;
+}
+
 void
 xcf_save_choose_format (XcfInfo   *info,
                         GimpImage *image)
@@ -218,7 +293,20 @@ xcf_save_choose_format (XcfInfo   *info,
   if (gimp_image_get_precision (image) != GIMP_PRECISION_U8_GAMMA)
     save_version = MAX (5, save_version);
 
-  info->file_version = save_version;
+  /* need version 6 for zlib compression, which is only used if the
+   * user asked for it, so files stay readable by older versions
+   */
+  if (info->compression == COMPRESS_ZLIB)
+    save_version = MAX (6, save_version);
+
+  /* need version 7 for 64 bit offsets, if the file can get larger
+   * than 4 GB
+   */
+  if (xcf_save_estimate_size (image) > G_MAXUINT32)
+    save_version = MAX (7, save_version);
+
+  info->file_version     = save_version;
+  info->bytes_per_offset = save_version >= 7 ? 8 : 4;
 }
 
 gint
@@ -229,8 +317,8 @@ xcf_save_image (XcfInfo    *info,
   GList   *all_layers;
   GList   *all_channels;
   GList   *list;
-  guint32  saved_pos;
-  guint32  offset;
+  goffset  saved_pos;
+  goffset  offset;
   guint32  value;
   guint    n_layers;
   guint    n_channels;
@@ -298,7 +386,8 @@ xcf_save_image (XcfInfo    *info,
 
   /* seek to after the offset lists */
   xcf_check_error (xcf_seek_pos (info,
-                                 info->cp + (n_layers + n_channels + 2) * 4,
+                                 info->cp + (n_layers + n_channels + 2) *
+                                 info->bytes_per_offset,
                                  error));
 
   for (list = all_layers; list; list = g_list_next (list))
@@ -319,7 +408,7 @@ xcf_save_image (XcfInfo    *info,
        *  layer offset and write it out.
        */
       xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-      xcf_write_int32_check_error (info, &offset, 1);
+      xcf_write_offset_check_error (info, &offset, 1);
 
       /* increment the location we are to write out the
        *  next offset.
@@ -337,7 +426,7 @@ xcf_save_image (XcfInfo    *info,
    */
   offset = 0;
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
   saved_pos = info->cp;
   xcf_check_error (xcf_seek_end (info, error));
 
@@ -359,7 +448,7 @@ xcf_save_image (XcfInfo    *info,
        *  channel offset and write it out.
        */
       xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-      xcf_write_int32_check_error (info, &offset, 1);
+      xcf_write_offset_check_error (info, &offset, 1);
 
       /* increment the location we are to write out the
        *  next offset.
@@ -380,7 +469,7 @@ xcf_save_image (XcfInfo    *info,
    */
   offset = 0;
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
   saved_pos = info->cp;
 
   return !ferror (info->fp);
@@ -673,15 +762,15 @@ xcf_save_prop (XcfInfo    *info,
 
     case PROP_FLOATING_SELECTION:
       {
-        guint32 dummy;
+        goffset dummy;
 
         dummy = 0;
-        size = 4;
+        size = info->bytes_per_offset;
 
         xcf_write_prop_type_check_error (info, prop_type);
         xcf_write_int32_check_error (info, &size, 1);
         info->floating_sel_offset = info->cp;
-        xcf_write_int32_check_error (info, &dummy, 1);
+        xcf_write_offset_check_error (info, &dummy, 1);
       }
       break;
 
@@ -980,8 +1069,8 @@ xcf_save_prop (XcfInfo    *info,
 
         if (gimp_parasite_list_persistent_length (list) > 0)
           {
-            guint32 base, length;
-            long    pos;
+            goffset base, pos;
+            guint32 length;
 
             xcf_write_prop_type_check_error (info, prop_type);
 
@@ -1025,8 +1114,8 @@ xcf_save_prop (XcfInfo    *info,
 
     case PROP_PATHS:
       {
-        guint32 base, length;
-        glong   pos;
+        goffset base, pos;
+        guint32 length;
 
         xcf_write_prop_type_check_error (info, prop_type);
 
@@ -1091,8 +1180,8 @@ xcf_save_prop (XcfInfo    *info,
 
     case PROP_VECTORS:
       {
-        guint32 base, length;
-        glong   pos;
+        goffset base, pos;
+        guint32 length;
 
         xcf_write_prop_type_check_error (info, prop_type);
 
@@ -1180,8 +1269,8 @@ xcf_save_layer (XcfInfo    *info,
                 GimpLayer  *layer,
                 GError    **error)
 {
-  guint32      saved_pos;
-  guint32      offset;
+  goffset      saved_pos;
+  goffset      offset;
   guint32      value;
   const gchar *string;
   GError      *tmp_error = NULL;
@@ -1193,7 +1282,7 @@ xcf_save_layer (XcfInfo    *info,
     {
       saved_pos = info->cp;
       xcf_check_error (xcf_seek_pos (info, info->floating_sel_offset, error));
-      xcf_write_int32_check_error (info, &saved_pos, 1);
+      xcf_write_offset_check_error (info, &saved_pos, 1);
       xcf_check_error (xcf_seek_pos (info, saved_pos, error));
     }
 
@@ -1220,7 +1309,8 @@ xcf_save_layer (XcfInfo    *info,
   saved_pos = info->cp;
 
   /*  write out the layer tile hierarchy  */
-  xcf_check_error (xcf_seek_pos (info, info->cp + 8, error));
+  xcf_check_error (xcf_seek_pos (info, info->cp + 2 * info->bytes_per_offset,
+                                 error));
   offset = info->cp;
 
   xcf_check_error (xcf_save_buffer (info,
@@ -1228,7 +1318,7 @@ xcf_save_layer (XcfInfo    *info,
                                     error));
 
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
 
   /*  save the current position which is where the layer mask offset
    *  will be stored.
@@ -1250,7 +1340,7 @@ xcf_save_layer (XcfInfo    *info,
     offset = 0;
 
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
 
   return TRUE;
 }
@@ -1261,8 +1351,8 @@ xcf_save_channel (XcfInfo      *info,
                   GimpChannel  *channel,
                   GError      **error)
 {
-  guint32      saved_pos;
-  guint32      offset;
+  goffset      saved_pos;
+  goffset      offset;
   guint32      value;
   const gchar *string;
   GError      *tmp_error = NULL;
@@ -1274,7 +1364,7 @@ xcf_save_channel (XcfInfo      *info,
     {
       saved_pos = info->cp;
       xcf_check_error (xcf_seek_pos (info, info->floating_sel_offset, error));
-      xcf_write_int32_check_error (info, &saved_pos, 1);
+      xcf_write_offset_check_error (info, &saved_pos, 1);
       xcf_check_error (xcf_seek_pos (info, saved_pos, error));
     }
 
@@ -1298,7 +1388,8 @@ xcf_save_channel (XcfInfo      *info,
   saved_pos = info->cp;
 
   /* write out the channel tile hierarchy */
-  xcf_check_error (xcf_seek_pos (info, info->cp + 4, error));
+  xcf_check_error (xcf_seek_pos (info, info->cp + info->bytes_per_offset,
+                                 error));
   offset = info->cp;
 
   xcf_check_error (xcf_save_buffer (info,
@@ -1306,7 +1397,7 @@ xcf_save_channel (XcfInfo      *info,
                                     error));
 
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
   saved_pos = info->cp;
 
   return TRUE;
@@ -1335,8 +1426,9 @@ xcf_save_buffer (XcfInfo     *info,
                  GError     **error)
 {
   const Babl *format;
-  guint32     saved_pos;
-  guint32     offset;
+  goffset     saved_pos;
+  goffset     end_pos;
+  goffset    *offsets;
   guint32     width;
   guint32     height;
   guint32     bpp;
@@ -1361,53 +1453,73 @@ xcf_save_buffer (XcfInfo     *info,
   tmp2 = xcf_calc_levels (height, XCF_TILE_HEIGHT);
   nlevels = MAX (tmp1, tmp2);
 
-  xcf_check_error (xcf_seek_pos (info, info->cp + (1 + nlevels) * 4, error));
+  xcf_check_error (xcf_seek_pos (info,
+                                 info->cp + (1 + nlevels) *
+                                 info->bytes_per_offset,
+                                 error));
+
+  /* the level offsets are collected here, the last one stays '0'
+   * to indicate the end of the level offsets.
+   */
+  offsets = g_new0 (goffset, nlevels + 1);
 
   for (i = 0; i < nlevels; i++)
     {
-      offset = info->cp;
+      offsets[i] = info->cp;
 
       if (i == 0)
         {
           /* write out the level. */
-          xcf_check_error (xcf_save_level (info, buffer, error));
+          if (! xcf_save_level (info, buffer, error))
+            goto error;
         }
       else
         {
+          goffset empty = 0;
+
           /* fake an empty level */
-          tmp1 = 0;
           width  /= 2;
           height /= 2;
-          xcf_write_int32_check_error (info, (guint32 *) &width,  1);
-          xcf_write_int32_check_error (info, (guint32 *) &height, 1);
-          xcf_write_int32_check_error (info, (guint32 *) &tmp1,   1);
+          info->cp += xcf_write_int32 (info->fp, &width,  1, &tmp_error);
+          if (! tmp_error)
+            info->cp += xcf_write_int32 (info->fp, &height, 1, &tmp_error);
+          if (! tmp_error)
+            info->cp += xcf_write_offset (info, &empty, 1, &tmp_error);
+
+          if (tmp_error)
+            {
+              g_propagate_error (error, tmp_error);
+              goto error;
+            }
         }
+    }
 
-      /* seek back to where we are to write out the next
-       *  level offset and write it out.
-       */
-      xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-      xcf_write_int32_check_error (info, &offset, 1);
+  /* seek back once to write out all level offsets, then continue
+   * writing at the end of the file.
+   */
+  end_pos = info->cp;
 
-      /* increment the location we are to write out the
-       *  next offset.
-       */
-      saved_pos = info->cp;
+  if (! xcf_seek_pos (info, saved_pos, error))
+    goto error;
 
-      /* seek to the end of the file which is where
-       *  we will write out the next level.
-       */
-      xcf_check_error (xcf_seek_end (info, error));
+  info->cp += xcf_write_offset (info, offsets, nlevels + 1, &tmp_error);
+
+  if (tmp_error)
+    {
+      g_propagate_error (error, tmp_error);
+      goto error;
     }
 
-  /* write out a '0' offset position to indicate the end
-   *  of the level offsets.
-   */
-  offset = 0;
-  xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  g_free (offsets);
+
+  xcf_check_error (xcf_seek_pos (info, end_pos, error));
 
   return TRUE;
+
+ error:
+  g_free (offsets);
+
+  return FALSE;
 }
 
 static gboolean
@@ -1415,18 +1527,20 @@ xcf_save_level (XcfInfo     *info,
                 GeglBuffer  *buffer,
                 GError     **error)
 {
-  const Babl *format;
-  guint32     saved_pos;
-  guint32     offset;
-  guint32     width;
-  guint32     height;
-  gint        bpp;
-  gint        n_tile_rows;
-  gint        n_tile_cols;
-  guint       ntiles;
-  gint        i;
-  guchar     *rlebuf;
-  GError     *tmp_error = NULL;
+  const Babl   *format;
+  goffset       saved_pos;
+  goffset       end_pos;
+  goffset      *offsets;
+  guint32       width;
+  guint32       height;
+  gint          bpp;
+  gint          n_tile_rows;
+  gint          n_tile_cols;
+  guint         ntiles;
+  gint          i;
+  guchar       *rlebuf;
+  XcfZlibBatch  batch     = { 0, };
+  GError       *tmp_error = NULL;
 
   format = gegl_buffer_get_format (buffer);
 
@@ -1448,7 +1562,19 @@ xcf_save_level (XcfInfo     *info,
   n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
 
   ntiles = n_tile_rows * n_tile_cols;
-  xcf_check_error (xcf_seek_pos (info, info->cp + (ntiles + 1) * 4, error));
+  xcf_check_error (xcf_seek_pos (info,
+                                 info->cp + (ntiles + 1) *
+                                 info->bytes_per_offset,
+                                 error));
+
+  /* the tile offsets are collected here and written out in one go
+   * after all tiles, so the tile data is written sequentially.  The
+   * last offset stays '0' to indicate the end of the tile offsets.
+   */
+  offsets = g_new0 (goffset, ntiles + 1);
+
+  batch.buffer = buffer;
+  batch.format = format;
 
   for (i = 0; i < ntiles; i++)
     {
@@ -1457,7 +1583,7 @@ xcf_save_level (XcfInfo     *info,
       /* save the start offset of where we are writing
        *  out the next tile.
        */
-      offset = info->cp;
+      offsets[i] = info->cp;
 
       gimp_gegl_buffer_get_tile_rect (buffer,
                                       XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
@@ -1467,47 +1593,59 @@ xcf_save_level (XcfInfo     *info,
       switch (info->compression)
         {
         case COMPRESS_NONE:
-          xcf_check_error (xcf_save_tile (info, buffer, &rect, format,
-                                          error));
+          if (! xcf_save_tile (info, buffer, &rect, format, error))
+            goto error;
           break;
         case COMPRESS_RLE:
-          xcf_check_error (xcf_save_tile_rle (info, buffer, &rect, format,
-                                              rlebuf, error));
+          if (! xcf_save_tile_rle (info, buffer, &rect, format,
+                                   rlebuf, error))
+            goto error;
           break;
         case COMPRESS_ZLIB:
-          g_error ("xcf: zlib compression unimplemented");
+          /* compress the next batch of tiles in parallel, and write
+           * them out one by one, in order
+           */
+          if (i % XCF_ZLIB_BATCH_SIZE == 0)
+            xcf_save_zlib_batch (&batch, i,
+                                 MIN (XCF_ZLIB_BATCH_SIZE, ntiles - i));
+
+          if (! xcf_save_tile_zlib (info, &batch, i, error))
+            goto error;
           break;
         case COMPRESS_FRACTAL:
           g_error ("xcf: fractal compression unimplemented");
           break;
         }
+    }
 
-      /* seek back to where we are to write out the next
-       *  tile offset and write it out.
-       */
-      xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-      xcf_write_int32_check_error (info, &offset, 1);
+  /* seek back once to write out the whole offset table, then
+   * continue writing at the end of the file.
+   */
+  end_pos = info->cp;
 
-      /* increment the location we are to write out the
-       *  next offset.
-       */
-      saved_pos = info->cp;
+  if (! xcf_seek_pos (info, saved_pos, error))
+    goto error;
 
-      /* seek to the end of the file which is where
-       *  we will write out the next tile.
-       */
-      xcf_check_error (xcf_seek_end (info, error));
+  info->cp += xcf_write_offset (info, offsets, ntiles + 1, &tmp_error);
+
+  if (tmp_error)
+    {
+      g_propagate_error (error, tmp_error);
+      goto error;
     }
 
-  /* write out a '0' offset position to indicate the end
-   *  of the level offsets.
-   */
-  offset = 0;
-  xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_save_zlib_free (&batch);
+  g_free (offsets);
+
+  xcf_check_error (xcf_seek_pos (info, end_pos, error));
 
   return TRUE;
 
+ error:
+  xcf_save_zlib_free (&batch);
+  g_free (offsets);
+
+  return FALSE;
 }
 
 static gboolean
@@ -1649,6 +1787,104 @@ xcf_save_tile_rle (XcfInfo        *info,
   return TRUE;
 }
 
+static void
+xcf_save_zlib_batch (XcfZlibBatch *batch,
+                     gint          first,
+                     gint          n_tiles)
+{
+  xcf_save_zlib_free (batch);
+
+  batch->first = first;
+
+  gimp_parallel_distribute_range (n_tiles, 1,
+                                  (GimpParallelDistributeRangeFunc)
+                                  xcf_save_zlib_range,
+                                  batch);
+}
+
+static void
+xcf_save_zlib_free (XcfZlibBatch *batch)
+{
+  gint i;
+
+  for (i = 0; i < XCF_ZLIB_BATCH_SIZE; i++)
+    {
+      if (batch->data[i])
+        {
+          g_free (batch->data[i]);
+          batch->data[i] = NULL;
+        }
+
+      batch->size[i] = 0;
+    }
+}
+
+/*  runs on the worker threads, compresses the batch's tiles in the
+ *  range [offset, offset + size)
+ */
+static void
+xcf_save_zlib_range (gsize         offset,
+                     gsize         size,
+                     XcfZlibBatch *batch)
+{
+  gint    bpp       = babl_format_get_bytes_per_pixel (batch->format);
+  guchar *tile_data = g_malloc (XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp);
+  gsize   i;
+
+  for (i = offset; i < offset + size; i++)
+    {
+      GeglRectangle rect;
+      gint          tile_size;
+      uLongf        dest_len;
+
+      gimp_gegl_buffer_get_tile_rect (batch->buffer,
+                                      XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
+                                      batch->first + i, &rect);
+
+      tile_size = bpp * rect.width * rect.height;
+
+      gegl_buffer_get (batch->buffer, &rect, 1.0, batch->format, tile_data,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+      dest_len       = compressBound (tile_size);
+      batch->data[i] = g_malloc (dest_len);
+
+      if (compress2 (batch->data[i], &dest_len, tile_data, tile_size,
+                     Z_DEFAULT_COMPRESSION) == Z_OK)
+        {
+          batch->size[i] = dest_len;
+        }
+      else
+        {
+          g_free (batch->data[i]);
+          batch->data[i] = NULL;
+        }
+    }
+
+  g_free (tile_data);
+}
+
+static gboolean
+xcf_save_tile_zlib (XcfInfo       *info,
+                    XcfZlibBatch  *batch,
+                    gint           tile,
+                    GError       **error)
+{
+  gint    i         = tile - batch->first;
+  GError *tmp_error = NULL;
+
+  if (! batch->data[i])
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   _("Error compressing tile %d"), tile);
+      return FALSE;
+    }
+
+  xcf_write_int8_check_error (info, batch->data[i], batch->size[i]);
+
+  return TRUE;
+}
+
 static gboolean
 xcf_save_parasite (XcfInfo       *info,
                    GimpParasite  *parasite,
@@ -21,8 +21,11 @@
 #include <string.h> /* strlen */
 #include <errno.h>
 
-#include <glib.h>
+#include <glib-object.h>
 
+#include "core/core-types.h"
+
+#include "xcf-private.h"
 #include "xcf-write.h"
 
 
@@ -57,6 +60,78 @@ xcf_write_int32 (FILE           *fp,
   return count * 4;
 }
 
+guint
+xcf_write_int64 (FILE           *fp,
+                 const guint64  *data,
+                 gint            count,
+                 GError        **error)
+{
+  GError  *tmp_error = NULL;
+  gint     i;
+
+  if (count > 0)
+    {
+      for (i = 0; i < count; i++)
+        {
+          guint64  tmp = GUINT64_TO_BE (data[i]);
+
+          xcf_write_int8 (fp, (const guint8 *) &tmp, 8, &tmp_error);
+
+          if (tmp_error)
+            {
+              g_propagate_error (error, tmp_error);
+
+              return i * 8;
+            }
+        }
+    }
+
+  return count * 8;
+}
+
+/*  writes file offsets, which are 64 bit since XCF version 7  */
+guint
+xcf_write_offset (XcfInfo        *info,
+                  const goffset  *data,
+                  gint            count,
+                  GError        **error)
+{
+  GError  *tmp_error = NULL;
+  guint    total     = 0;
+  gint     i;
+
+  for (i = 0; i < count; i++)
+    {
+      if (info->bytes_per_offset == 8)
+        {
+          guint64 offset = data[i];
+
+          total += xcf_write_int64 (info->fp, &offset, 1, &tmp_error);
+        }
+      else if (data[i] > G_MAXUINT32)
+        {
+          g_set_error (&tmp_error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                       _("XCF file is too large for XCF version %d"),
+                       info->file_version);
+        }
+      else
+        {
+          guint32 offset = data[i];
+
+          total += xcf_write_int32 (info->fp, &offset, 1, &tmp_error);
+        }
+
+      if (tmp_error)
+        {
+          g_propagate_error (error, tmp_error);
+
+          return total;
+        }
+    }
+
+  return total;
+}
+
 guint
 xcf_write_float (FILE           *fp,
                  const gfloat   *data,
@@ -23,6 +23,14 @@ guint   xcf_write_int32  (FILE           *fp,
                           const guint32  *data,
                           gint            count,
                           GError        **error);
+guint   xcf_write_int64  (FILE           *fp,
+                          const guint64  *data,
+                          gint            count,
+                          GError        **error);
+guint   xcf_write_offset (XcfInfo        *info,
+                          const goffset  *data,
+                          gint            count,
+                          GError        **error);
 guint   xcf_write_float  (FILE           *fp,
                           const gfloat   *data,
                           gint            count,
@@ -28,6 +28,8 @@
 
 #include "core/core-types.h"
 
+#include "config/gimpcoreconfig.h"
+
 #include "core/gimp.h"
 #include "core/gimpimage.h"
 #include "core/gimpparamspecs.h"
@@ -41,10 +43,14 @@
 #include "xcf-load.h"
 #include "xcf-read.h"
 #include "xcf-save.h"
+#include "gimptilebackendxcf.h"
 
 #include "gimp-intl.h"
 
 
+#define XCF_WRITE_BUFFER_SIZE (1 << 20)
+
+
 typedef GimpImage * GimpXcfLoaderFunc (Gimp     *gimp,
                                        XcfInfo  *info,
                                        GError  **error);
@@ -71,7 +77,9 @@ static GimpXcfLoaderFunc * const xcf_loaders[] =
   xcf_load_image,   /* version 2 */
   xcf_load_image,   /* version 3 */
   xcf_load_image,   /* version 4 */
-  xcf_load_image    /* version 5 */
+  xcf_load_image,   /* version 5 */
+  xcf_load_image,   /* version 6 */
+  xcf_load_image    /* version 7 */
 };
 
 
@@ -230,6 +238,17 @@ xcf_exit (Gimp *gimp)
   g_return_if_fail (GIMP_IS_GIMP (gimp));
 }
 
+/*  makes lazily loaded images stop reading from @filename, must be
+ *  called before @filename is written to
+ */
+void
+xcf_release_file (const gchar *filename)
+{
+  g_return_if_fail (filename != NULL);
+
+  gimp_tile_backend_xcf_detach_file (filename);
+}
+
 static GimpValueArray *
 xcf_load_invoker (GimpProcedure         *procedure,
                   Gimp                  *gimp,
@@ -266,6 +285,13 @@ xcf_load_invoker (GimpProcedure         *procedure,
       info.swap_num              = 0;
       info.ref_count             = NULL;
       info.compression           = COMPRESS_NONE;
+      info.tile_file             = NULL;
+
+      /*  keep the file open, and let the layers and channels read
+       *  their pixels from it on demand
+       */
+      if (gimp->config->xcf_lazy_load)
+        info.tile_file = xcf_tile_file_new (info.fp, filename);
 
       if (progress)
         {
@@ -301,6 +327,9 @@ xcf_load_invoker (GimpProcedure         *procedure,
 
       if (success)
         {
+          /* file offsets are 64 bit since version 7 */
+          info.bytes_per_offset = info.file_version >= 7 ? 8 : 4;
+
           if (info.file_version >= 0 &&
               info.file_version < G_N_ELEMENTS (xcf_loaders))
             {
@@ -318,7 +347,11 @@ xcf_load_invoker (GimpProcedure         *procedure,
             }
         }
 
-      fclose (info.fp);
+      /*  closes the file, unless the image's buffers still need it  */
+      if (info.tile_file)
+        xcf_tile_file_unref (info.tile_file);
+      else
+        fclose (info.fp);
 
       if (progress)
         gimp_progress_end (progress);
@@ -362,10 +395,20 @@ xcf_save_invoker (GimpProcedure         *procedure,
   image    = gimp_value_get_image (gimp_value_array_index (args, 1), gimp);
   filename = g_value_get_string (gimp_value_array_index (args, 3));
 
+  /*  lazily loaded images may still read from the file we are about
+   *  to overwrite
+   */
+  xcf_release_file (filename);
+
   info.fp = g_fopen (filename, "wb");
 
   if (info.fp)
     {
+      /*  tile data is written sequentially, use a large buffer so
+       *  that saving is not bound by the number of write calls
+       */
+      setvbuf (info.fp, NULL, _IOFBF, XCF_WRITE_BUFFER_SIZE);
+
       info.gimp                  = gimp;
       info.progress              = progress;
       info.cp                    = 0;
@@ -378,6 +421,11 @@ xcf_save_invoker (GimpProcedure         *procedure,
       info.swap_num              = 0;
       info.ref_count             = NULL;
       info.compression           = COMPRESS_RLE;
+      info.bytes_per_offset      = 4;
+      info.tile_file             = NULL;
+
+      if (gimp->config->xcf_compression)
+        info.compression = COMPRESS_ZLIB;
 
       if (progress)
         {
@@ -19,8 +19,10 @@
 #define __XCF_H__
 
 
-void   xcf_init (Gimp *gimp);
-void   xcf_exit (Gimp *gimp);
+void   xcf_init         (Gimp        *gimp);
+void   xcf_exit         (Gimp        *gimp);
+
+void   xcf_release_file (const gchar *filename);
 
 
 #endif /* __XCF_H__ */
@@ -54,7 +54,20 @@ enum
 };
 
 
+/*  the number of grid points per channel of the baked LUT  */
+#define LUT_SIZE 33
+
+
+typedef struct
+{
+  guchar *lut;  /*  LUT_SIZE³ RGBx entries, NULL if not baked  */
+} GimpColorDisplayStackPrivate;
+
+#define GIMP_COLOR_DISPLAY_STACK_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GIMP_TYPE_COLOR_DISPLAY_STACK, GimpColorDisplayStackPrivate))
+
+
 static void   gimp_color_display_stack_dispose         (GObject               *object);
+static void   gimp_color_display_stack_finalize        (GObject               *object);
 
 static void   gimp_color_display_stack_display_changed (GimpColorDisplay      *display,
                                                         GimpColorDisplayStack *stack);
@@ -64,6 +77,10 @@ static void   gimp_color_display_stack_display_enabled (GimpColorDisplay      *d
 static void   gimp_color_display_stack_disconnect      (GimpColorDisplayStack *stack,
                                                         GimpColorDisplay      *display);
 
+static guchar * gimp_color_display_stack_bake_lut      (GimpColorDisplayStack *stack);
+static void     gimp_color_display_stack_apply_lut     (const guchar          *lut,
+                                                        cairo_surface_t       *surface);
+
 
 G_DEFINE_TYPE (GimpColorDisplayStack, gimp_color_display_stack, G_TYPE_OBJECT)
 
@@ -118,12 +135,15 @@ gimp_color_display_stack_class_init (GimpColorDisplayStackClass *klass)
                   GIMP_TYPE_COLOR_DISPLAY,
                   G_TYPE_INT);
 
-  object_class->dispose = gimp_color_display_stack_dispose;
+  object_class->dispose  = gimp_color_display_stack_dispose;
+  object_class->finalize = gimp_color_display_stack_finalize;
+
+  klass->changed         = NULL;
+  klass->added           = NULL;
+  klass->removed         = NULL;
+  klass->reordered       = NULL;
 
-  klass->changed        = NULL;
-  klass->added          = NULL;
-  klass->removed        = NULL;
-  klass->reordered      = NULL;
+  g_type_class_add_private (object_class, sizeof (GimpColorDisplayStackPrivate));
 }
 
 static void
@@ -156,6 +176,22 @@ gimp_color_display_stack_dispose (GObject *object)
   G_OBJECT_CLASS (parent_class)->dispose (object);
 }
 
+static void
+gimp_color_display_stack_finalize (GObject *object)
+{
+  GimpColorDisplayStackPrivate *private;
+
+  private = GIMP_COLOR_DISPLAY_STACK_GET_PRIVATE (object);
+
+  if (private->lut)
+    {
+      g_free (private->lut);
+      private->lut = NULL;
+    }
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 GimpColorDisplayStack *
 gimp_color_display_stack_new (void)
 {
@@ -188,8 +224,19 @@ gimp_color_display_stack_clone (GimpColorDisplayStack *stack)
 void
 gimp_color_display_stack_changed (GimpColorDisplayStack *stack)
 {
+  GimpColorDisplayStackPrivate *private;
+
   g_return_if_fail (GIMP_IS_COLOR_DISPLAY_STACK (stack));
 
+  private = GIMP_COLOR_DISPLAY_STACK_GET_PRIVATE (stack);
+
+  /*  the LUT is baked again on the next conversion  */
+  if (private->lut)
+    {
+      g_free (private->lut);
+      private->lut = NULL;
+    }
+
   g_signal_emit (stack, stack_signals[CHANGED], 0);
 }
 
@@ -292,19 +339,51 @@ gimp_color_display_stack_reorder_down (GimpColorDisplayStack *stack,
  *
  * Runs all the stack's filters on all pixels in @surface.
  *
+ * If more than one filter is enabled, their combined effect is baked
+ * into a single 3D lookup table the first time the stack is used
+ * after it changed, and only that table is applied to @surface.
+ * This assumes that the filters map each pixel's color independently
+ * of its neighbours and don't touch its alpha, which is true for all
+ * of GIMP's color display modules.
+ *
  * Since: GIMP 2.8
  **/
 void
 gimp_color_display_stack_convert_surface (GimpColorDisplayStack *stack,
                                           cairo_surface_t       *surface)
 {
-  GList *list;
+  GimpColorDisplayStackPrivate *private;
+  GList                        *list;
+  gint                          n_enabled = 0;
 
   g_return_if_fail (GIMP_IS_COLOR_DISPLAY_STACK (stack));
   g_return_if_fail (surface != NULL);
   g_return_if_fail (cairo_surface_get_type (surface) ==
                     CAIRO_SURFACE_TYPE_IMAGE);
 
+  private = GIMP_COLOR_DISPLAY_STACK_GET_PRIVATE (stack);
+
+  for (list = stack->filters; list; list = g_list_next (list))
+    {
+      GimpColorDisplay *display = list->data;
+
+      if (display->enabled)
+        n_enabled++;
+    }
+
+  if (n_enabled > 1 &&
+      cairo_image_surface_get_format (surface) == CAIRO_FORMAT_ARGB32)
+    {
+      if (! private->lut)
+        private->lut = gimp_color_display_stack_bake_lut (stack);
+
+      cairo_surface_flush (surface);
+      gimp_color_display_stack_apply_lut (private->lut, surface);
+      cairo_surface_mark_dirty (surface);
+
+      return;
+    }
+
   for (list = stack->filters; list; list = g_list_next (list))
     {
       GimpColorDisplay *display = list->data;
@@ -378,3 +457,182 @@ gimp_color_display_stack_disconnect (GimpColorDisplayStack *stack,
                                         gimp_color_display_stack_display_enabled,
                                         stack);
 }
+
+/*  runs the stack's filters on a LUT_SIZE³ grid of opaque colors and
+ *  returns their results, with 4 bytes per entry, blue varying fastest
+ */
+static guchar *
+gimp_color_display_stack_bake_lut (GimpColorDisplayStack *stack)
+{
+  cairo_surface_t *surface;
+  guchar          *data;
+  guchar          *lut;
+  guchar           grid[LUT_SIZE];
+  gint             stride;
+  gint             r, g, b;
+  GList           *list;
+
+  for (r = 0; r < LUT_SIZE; r++)
+    grid[r] = (r * 255 + (LUT_SIZE - 1) / 2) / (LUT_SIZE - 1);
+
+  /*  one row per red grid point, green and blue along the row  */
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                        LUT_SIZE * LUT_SIZE, LUT_SIZE);
+  data    = cairo_image_surface_get_data (surface);
+  stride  = cairo_image_surface_get_stride (surface);
+
+  cairo_surface_flush (surface);
+
+  for (r = 0; r < LUT_SIZE; r++)
+    {
+      guchar *d = data + r * stride;
+
+      for (g = 0; g < LUT_SIZE; g++)
+        for (b = 0; b < LUT_SIZE; b++, d += 4)
+          GIMP_CAIRO_ARGB32_SET_PIXEL (d, grid[r], grid[g], grid[b], 255);
+    }
+
+  cairo_surface_mark_dirty (surface);
+
+  for (list = stack->filters; list; list = g_list_next (list))
+    {
+      GimpColorDisplay *display = list->data;
+
+      gimp_color_display_convert_surface (display, surface);
+    }
+
+  cairo_surface_flush (surface);
+
+  lut = g_new (guchar, LUT_SIZE * LUT_SIZE * LUT_SIZE * 4);
+
+  for (r = 0; r < LUT_SIZE; r++)
+    {
+      const guchar *s = data + r * stride;
+      guchar       *l = lut + r * LUT_SIZE * LUT_SIZE * 4;
+
+      for (g = 0; g < LUT_SIZE * LUT_SIZE; g++, s += 4, l += 4)
+        {
+          guint lr, lg, lb, la;
+
+          GIMP_CAIRO_ARGB32_GET_PIXEL (s, lr, lg, lb, la);
+
+          l[0] = lr;
+          l[1] = lg;
+          l[2] = lb;
+          l[3] = 0;
+        }
+    }
+
+  cairo_surface_destroy (surface);
+
+  return lut;
+}
+
+/*  maps all pixels of the ARGB32 @surface through @lut, using
+ *  tetrahedral interpolation in 8 bit fixed point
+ */
+static void
+gimp_color_display_stack_apply_lut (const guchar    *lut,
+                                    cairo_surface_t *surface)
+{
+  const gint  stride_b = 4;
+  const gint  stride_g = 4 * LUT_SIZE;
+  const gint  stride_r = 4 * LUT_SIZE * LUT_SIZE;
+  gint        width    = cairo_image_surface_get_width (surface);
+  gint        height   = cairo_image_surface_get_height (surface);
+  gint        stride   = cairo_image_surface_get_stride (surface);
+  guchar     *buf      = cairo_image_surface_get_data (surface);
+  gint        index[256];
+  gint        frac[256];
+  gint        v;
+  gint        x, y;
+
+  /*  the grid cell and the position inside it, for each 8 bit value  */
+  for (v = 0; v < 256; v++)
+    {
+      gint pos = v * (LUT_SIZE - 1) * 256 / 255;
+
+      index[v] = MIN (pos >> 8, LUT_SIZE - 2);
+      frac[v]  = pos - (index[v] << 8);
+    }
+
+  for (y = 0; y < height; y++, buf += stride)
+    {
+      guchar *p = buf;
+
+      for (x = 0; x < width; x++, p += 4)
+        {
+          const guchar *c0;
+          const guchar *c1;
+          const guchar *c2;
+          const guchar *c3;
+          guint         r, g, b, a;
+          gint          fr, fg, fb;
+          gint          w0, w1, w2, w3;
+
+          GIMP_CAIRO_ARGB32_GET_PIXEL (p, r, g, b, a);
+
+          if (a == 0)
+            continue;
+
+          fr = frac[r];
+          fg = frac[g];
+          fb = frac[b];
+
+          c0 = lut + (index[r] * stride_r +
+                      index[g] * stride_g +
+                      index[b] * stride_b);
+          c3 = c0 + stride_r + stride_g + stride_b;
+
+          /*  pick the tetrahedron of the cell that contains the color  */
+          if (fr >= fg)
+            {
+              if (fg >= fb)
+                {
+                  c1 = c0 + stride_r;
+                  c2 = c1 + stride_g;
+                  w0 = 256 - fr; w1 = fr - fg; w2 = fg - fb; w3 = fb;
+                }
+              else if (fr >= fb)
+                {
+                  c1 = c0 + stride_r;
+                  c2 = c1 + stride_b;
+                  w0 = 256 - fr; w1 = fr - fb; w2 = fb - fg; w3 = fg;
+                }
+              else
+                {
+                  c1 = c0 + stride_b;
+                  c2 = c1 + stride_r;
+                  w0 = 256 - fb; w1 = fb - fr; w2 = fr - fg; w3 = fg;
+                }
+            }
+          else
+            {
+              if (fb >= fg)
+                {
+                  c1 = c0 + stride_b;
+                  c2 = c1 + stride_g;
+                  w0 = 256 - fb; w1 = fb - fg; w2 = fg - fr; w3 = fr;
+                }
+              else if (fb >= fr)
+                {
+                  c1 = c0 + stride_g;
+                  c2 = c1 + stride_b;
+                  w0 = 256 - fg; w1 = fg - fb; w2 = fb - fr; w3 = fr;
+                }
+              else
+                {
+                  c1 = c0 + stride_g;
+                  c2 = c1 + stride_r;
+                  w0 = 256 - fg; w1 = fg - fr; w2 = fr - fb; w3 = fb;
+                }
+            }
+
+          r = (c0[0] * w0 + c1[0] * w1 + c2[0] * w2 + c3[0] * w3 + 128) >> 8;
+          g = (c0[1] * w0 + c1[1] * w1 + c2[1] * w2 + c3[1] * w3 + 128) >> 8;
+          b = (c0[2] * w0 + c1[2] * w1 + c2[2] * w2 + c3[2] * w3 + 128) >> 8;
+
+          GIMP_CAIRO_ARGB32_SET_PIXEL (p, r, g, b, a);
+        }
+    }
+}